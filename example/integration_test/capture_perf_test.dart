@@ -0,0 +1,301 @@
+// Capture performance harness for the Linux plugin.
+//
+// Run through tool/capture_perf.sh, which starts Xvfb, sizes the window and
+// collects the report. Configuration comes from --dart-define:
+//
+//   RECASTER_PERF_FPS         comma-separated fps values (default 15,30,60)
+//   RECASTER_PERF_DIVISORS    comma-separated divisors (default 1,2)
+//   RECASTER_PERF_SECONDS     seconds recorded per case (default 5)
+//   RECASTER_PERF_SOAK_MIN    soak minutes; 0 skips the soak (default 0). The
+//                             soak records at the highest configured fps and
+//                             divisor, and reports both.
+//   RECASTER_PERF_REPORT      JSON report path (default /tmp/recaster_perf.json)
+
+import 'dart:convert';
+import 'dart:io';
+import 'dart:math' as math;
+
+import 'package:flutter/material.dart';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:integration_test/integration_test.dart';
+
+import 'package:recaster/recaster.dart';
+
+const String _fpsList = String.fromEnvironment(
+  'RECASTER_PERF_FPS',
+  defaultValue: '15,30,60',
+);
+const String _divisorList = String.fromEnvironment(
+  'RECASTER_PERF_DIVISORS',
+  defaultValue: '1,2',
+);
+const int _caseSeconds = int.fromEnvironment(
+  'RECASTER_PERF_SECONDS',
+  defaultValue: 5,
+);
+const int _soakMinutes = int.fromEnvironment(
+  'RECASTER_PERF_SOAK_MIN',
+  defaultValue: 0,
+);
+const String _reportPath = String.fromEnvironment(
+  'RECASTER_PERF_REPORT',
+  defaultValue: '/tmp/recaster_perf.json',
+);
+
+List<int> _parseList(String value) {
+  return value
+      .split(',')
+      .map((item) => int.tryParse(item.trim()))
+      .whereType<int>()
+      .toList();
+}
+
+int _highest(List<int> values, int fallback) {
+  return values.isEmpty ? fallback : values.reduce(math.max);
+}
+
+/// CPU time of this process (all threads) from /proc/self/stat.
+Duration _processCpuTime() {
+  final stat = File('/proc/self/stat').readAsStringSync();
+  // Fields after the parenthesised command name; utime and stime are the
+  // 14th and 15th fields overall.
+  final fields = stat.substring(stat.lastIndexOf(')') + 2).split(' ');
+  final ticks = int.parse(fields[11]) + int.parse(fields[12]);
+  // USER_HZ is 100 on every Linux configuration Flutter supports.
+  return Duration(milliseconds: ticks * 10);
+}
+
+int _statusKb(String field) {
+  for (final line in File('/proc/self/status').readAsLinesSync()) {
+    if (line.startsWith('$field:')) {
+      return int.parse(line.split(RegExp(r'\s+'))[1]);
+    }
+  }
+  return 0;
+}
+
+int _openFds() => Directory('/proc/self/fd').listSync().length;
+
+/// Resets VmHWM so each case reports its own peak RSS.
+void _resetPeakRss() {
+  try {
+    File('/proc/self/clear_refs').writeAsStringSync('5');
+  } on FileSystemException {
+    // Older kernels or restricted sandboxes; the peak then spans all cases.
+  }
+}
+
+/// Full-window scene that repaints most of the window on every frame, so
+/// consecutive recorded frames always differ.
+class _PerfScene extends StatefulWidget {
+  const _PerfScene();
+
+  @override
+  State<_PerfScene> createState() => _PerfSceneState();
+}
+
+class _PerfSceneState extends State<_PerfScene>
+    with SingleTickerProviderStateMixin {
+  late final AnimationController _controller = AnimationController(
+    vsync: this,
+    duration: const Duration(seconds: 2),
+  )..repeat();
+
+  @override
+  void dispose() {
+    _controller.dispose();
+    super.dispose();
+  }
+
+  @override
+  Widget build(BuildContext context) {
+    return AnimatedBuilder(
+      animation: _controller,
+      builder: (context, _) {
+        final t = _controller.value * 2 * math.pi;
+        return Stack(
+          fit: StackFit.expand,
+          children: <Widget>[
+            DecoratedBox(
+              decoration: BoxDecoration(
+                gradient: SweepGradient(
+                  transform: GradientRotation(t),
+                  colors: const <Color>[
+                    Colors.red,
+                    Colors.amber,
+                    Colors.green,
+                    Colors.blue,
+                    Colors.red,
+                  ],
+                ),
+              ),
+            ),
+            for (int i = 0; i < 12; i++)
+              Align(
+                alignment: Alignment(
+                  math.cos(t + i) * 0.8,
+                  math.sin(t * 2 + i) * 0.8,
+                ),
+                child: const FlutterLogo(size: 96),
+              ),
+            Center(
+              child: Text(
+                '${(_controller.value * 1000).round()}',
+                style: const TextStyle(fontSize: 64, color: Colors.white),
+              ),
+            ),
+          ],
+        );
+      },
+    );
+  }
+}
+
+Future<Map<String, Object>> _runCase(
+  Recaster recaster, {
+  required int fps,
+  required int divisor,
+  required Duration duration,
+}) async {
+  final dir = await Directory.systemTemp.createTemp('recaster_perf');
+  final outputPath = '${dir.path}/case.avi';
+  _resetPeakRss();
+  final cpuBefore = _processCpuTime();
+  final wall = Stopwatch()..start();
+
+  await recaster.startRecording(
+    outputPath: outputPath,
+    fps: fps,
+    resolutionDivisor: divisor,
+  );
+  await Future<void>.delayed(duration);
+  final stats = await recaster.getRecordingStats();
+  final recorded = wall.elapsed;
+  final finalizeTimer = Stopwatch()..start();
+  await recaster.stopRecording();
+  final finalize = finalizeTimer.elapsed;
+
+  final cpu = _processCpuTime() - cpuBefore;
+  final frames = stats.framesCaptured;
+  final bytes = File(outputPath).lengthSync();
+  await dir.delete(recursive: true);
+
+  return <String, Object>{
+    'fps': fps,
+    'divisor': divisor,
+    'seconds': recorded.inMicroseconds / 1e6,
+    'framesCaptured': frames,
+    'framesDropped': stats.framesDropped,
+    'achievedFps': frames / (recorded.inMicroseconds / 1e6),
+    'cpuMsPerFrame': frames > 0 ? cpu.inMicroseconds / 1e3 / frames : 0,
+    'mainThreadMsPerFrame':
+        frames > 0 ? stats.captureTime.inMicroseconds / 1e3 / frames : 0,
+    'mainThreadShare':
+        stats.captureTime.inMicroseconds / recorded.inMicroseconds,
+    'readbackMsPerFrame':
+        frames > 0 ? stats.readbackTime.inMicroseconds / 1e3 / frames : 0,
+    'sharedMemoryFrames': stats.framesSharedMemory,
+    'finalizeMs': finalize.inMilliseconds,
+    'peakRssKb': _statusKb('VmHWM'),
+    'outputBytes': bytes,
+  };
+}
+
+void main() {
+  final binding = IntegrationTestWidgetsFlutterBinding.ensureInitialized();
+
+  // Render real frames while recording instead of only on pump().
+  binding.framePolicy = LiveTestWidgetsFlutterBindingFramePolicy.fullyLive;
+
+  testWidgets('capture performance matrix', (WidgetTester tester) async {
+    await tester.pumpWidget(
+      const MaterialApp(home: Scaffold(body: _PerfScene())),
+    );
+    await tester.pump();
+
+    final recaster = Recaster();
+    final view = binding.platformDispatcher.views.first;
+    final cases = <Map<String, Object>>[];
+    for (final fps in _parseList(_fpsList)) {
+      for (final divisor in _parseList(_divisorList)) {
+        cases.add(await _runCase(
+          recaster,
+          fps: fps,
+          divisor: divisor,
+          duration: const Duration(seconds: _caseSeconds),
+        ));
+      }
+    }
+
+    final soak = _soakMinutes > 0
+        ? await _runSoak(
+            recaster,
+            const Duration(minutes: _soakMinutes),
+            fps: _highest(_parseList(_fpsList), 30),
+            divisor: _highest(_parseList(_divisorList), 1),
+          )
+        : null;
+
+    final report = <String, Object>{
+      'window': <String, Object>{
+        'width': view.physicalSize.width.round(),
+        'height': view.physicalSize.height.round(),
+      },
+      'processors': Platform.numberOfProcessors,
+      'cases': cases,
+      if (soak != null) 'soak': soak,
+    };
+    final encoded = jsonEncode(report);
+    File(_reportPath).writeAsStringSync(encoded);
+    // The driver script greps for this line when the report path is not
+    // shared with the host (e.g. inside a container).
+    // ignore: avoid_print
+    print('RECASTER_PERF_REPORT $encoded');
+
+    expect(cases, isNotEmpty);
+    for (final result in cases) {
+      expect(result['framesCaptured'] as int, greaterThan(0));
+    }
+    if (soak != null) {
+      expect(soak['fdGrowth'] as int, lessThanOrEqualTo(0));
+      expect(soak['rssGrowthRatio'] as double, lessThan(0.10));
+    }
+  }, timeout: Timeout.none);
+}
+
+/// Records in one-minute start/stop cycles and samples RSS and open fds after
+/// each cycle. The first cycle is a warm-up and sets the baseline.
+Future<Map<String, Object>> _runSoak(
+  Recaster recaster,
+  Duration duration, {
+  required int fps,
+  required int divisor,
+}) async {
+  final samples = <Map<String, Object>>[];
+  final cycles = math.max(2, duration.inMinutes);
+  for (int i = 0; i < cycles; i++) {
+    await _runCase(
+      recaster,
+      fps: fps,
+      divisor: divisor,
+      duration: const Duration(minutes: 1),
+    );
+    samples.add(<String, Object>{
+      'minute': i + 1,
+      'rssKb': _statusKb('VmRSS'),
+      'fds': _openFds(),
+    });
+  }
+  final baseline = samples.first;
+  final last = samples.last;
+  final baselineRss = baseline['rssKb'] as int;
+  return <String, Object>{
+    'minutes': cycles,
+    'fps': fps,
+    'divisor': divisor,
+    'samples': samples,
+    'rssGrowthRatio':
+        baselineRss > 0 ? ((last['rssKb'] as int) - baselineRss) / baselineRss : 0.0,
+    'fdGrowth': (last['fds'] as int) - (baseline['fds'] as int),
+  };
+}
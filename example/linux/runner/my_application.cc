@@ -1,6 +1,7 @@
 #include "my_application.h"
 
 #include <flutter_linux/flutter_linux.h>
+#include <stdio.h>
 #ifdef GDK_WINDOWING_X11
 #include <gdk/gdkx.h>
 #endif
@@ -47,7 +48,17 @@ static void my_application_activate(GApplication* application) {
     gtk_window_set_title(window, "recaster_example");
   }
 
-  gtk_window_set_default_size(window, 1280, 720);
+  // The capture perf harness (tool/capture_perf.sh) sizes the window through
+  // the environment.
+  int width = 1280;
+  int height = 720;
+  const gchar* window_size = g_getenv("RECASTER_EXAMPLE_WINDOW_SIZE");
+  if (window_size != nullptr &&
+      sscanf(window_size, "%dx%d", &width, &height) != 2) {
+    width = 1280;
+    height = 720;
+  }
+  gtk_window_set_default_size(window, width, height);
   gtk_widget_show(GTK_WIDGET(window));
 
   g_autoptr(FlDartProject) project = fl_dart_project_new();
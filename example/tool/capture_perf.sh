@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+# Runs the capture performance harness (integration_test/capture_perf_test.dart)
+# under Xvfb for each window size and writes one combined JSON report.
+#
+#   tool/capture_perf.sh [--sizes 1280x720,1920x1080] [--fps 15,30,60]
+#                        [--divisors 1,2] [--seconds 5] [--soak MINUTES]
+#                        [--no-shm] [--out report.json]
+#
+# Requires flutter, xvfb-run and a Linux desktop toolchain. A one-hour soak:
+#   tool/capture_perf.sh --sizes 1280x720 --fps 30 --divisors 2 --soak 60
+# --no-shm reads frames through GDK instead of X11 MIT-SHM, for comparison.
+set -euo pipefail
+
+sizes="1280x720,1920x1080"
+fps="15,30,60"
+divisors="1,2"
+seconds=5
+soak=0
+out="capture_perf_report.json"
+no_shm=""
+
+while [[ $# -gt 0 ]]; do
+  case "$1" in
+    --sizes) sizes="$2"; shift 2 ;;
+    --fps) fps="$2"; shift 2 ;;
+    --divisors) divisors="$2"; shift 2 ;;
+    --seconds) seconds="$2"; shift 2 ;;
+    --soak) soak="$2"; shift 2 ;;
+    --no-shm) no_shm=1; shift ;;
+    --out) out="$2"; shift 2 ;;
+    *) echo "unknown option: $1" >&2; exit 2 ;;
+  esac
+done
+
+for tool in flutter xvfb-run; do
+  if ! command -v "$tool" >/dev/null 2>&1; then
+    echo "$tool is required" >&2
+    exit 1
+  fi
+done
+
+cd "$(dirname "$0")/.."
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+reports=()
+IFS=',' read -r -a size_list <<< "$sizes"
+for size in "${size_list[@]}"; do
+  report="$work/$size.json"
+  log="$work/$size.log"
+  echo "== $size" >&2
+  # The screen is larger than the window so window decorations never clip it.
+  width="${size%x*}"
+  height="${size#*x}"
+  screen="$((width + 64))x$((height + 64))x24"
+  RECASTER_EXAMPLE_WINDOW_SIZE="$size" RECASTER_NO_XSHM="$no_shm" \
+    xvfb-run -a -s "-screen 0 $screen" \
+    flutter test integration_test/capture_perf_test.dart -d linux \
+      --dart-define=RECASTER_PERF_FPS="$fps" \
+      --dart-define=RECASTER_PERF_DIVISORS="$divisors" \
+      --dart-define=RECASTER_PERF_SECONDS="$seconds" \
+      --dart-define=RECASTER_PERF_SOAK_MIN="$soak" \
+      --dart-define=RECASTER_PERF_REPORT="$report" \
+      --timeout none 2>&1 | tee "$log" >&2
+  if [[ ! -s "$report" ]]; then
+    # Fall back to the line the test prints on stdout.
+    sed -n 's/.*RECASTER_PERF_REPORT //p' "$log" | tail -n 1 > "$report"
+  fi
+  if [[ ! -s "$report" ]]; then
+    echo "no report for $size" >&2
+    exit 1
+  fi
+  reports+=("$report")
+done
+
+{
+  printf '{"generated":"%s","host":"%s","runs":[' "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -srm)"
+  first=1
+  for report in "${reports[@]}"; do
+    if [[ $first -eq 0 ]]; then printf ','; fi
+    first=0
+    cat "$report"
+  done
+  printf ']}\n'
+} > "$out"
+echo "wrote $out" >&2
@@ -1,26 +1,190 @@
 import 'recaster_platform_interface.dart';
+import 'recaster_types.dart';
+
+export 'recaster_frame_tap.dart';
+export 'recaster_types.dart';
 
 class Recaster {
   Future<String?> getPlatformVersion() {
     return RecasterPlatform.instance.getPlatformVersion();
   }
 
+  /// [fps] is capped at 60 unless [highFrameRate] is set, which allows up
+  /// to 240: a dedicated thread grabs the window on a fixed schedule through
+  /// X11 MIT-SHM and hands frames to the UI thread. It fails with
+  /// `hfr_unavailable` where that is not possible, e.g. under Wayland; check
+  /// [RecordingStats.achievedFps] for the rate actually reached. Linux only.
+  ///
+  /// With [outOfProcess] the plugin only reads the window back; frames go
+  /// through shared memory to a `recaster-helper` process that converts,
+  /// buffers and writes them, so a failing or slow writer cannot take the
+  /// application with it. It cannot be combined with [highFrameRate],
+  /// [thumbnails], [timeLapse], [degradation], [preview] or `.rhash`
+  /// outputs, and [stopRecording] fails with `helper_failed` if the helper
+  /// did. Linux only.
+  ///
+  /// [mainThreadBudget] caps the share of the UI thread capture may use, e.g.
+  /// 0.05 for 5% of each second. Ticks that would go over it repeat the
+  /// previous frame instead of reading the window back, and ticks wait for a
+  /// pending redraw; see [RecordingStats.mainThreadHighWater]. Linux only.
   Future<void> startRecording({
     required String outputPath,
     int fps = 30,
+    bool highFrameRate = false,
+    bool outOfProcess = false,
+    double? mainThreadBudget,
     int resolutionDivisor = 1,
+    int? maxWidth,
+    int? maxHeight,
+    double? scale,
+    ResampleFilter filter = ResampleFilter.bilinear,
+    ResizePolicy resizePolicy = ResizePolicy.letterbox,
+    GifPalette gifPalette = GifPalette.global,
+    BufferCompression bufferCompression = BufferCompression.none,
+    ThumbnailOptions? thumbnails,
+    TimeLapse? timeLapse,
+    DegradationPolicy? degradation,
+    PreviewOptions? preview,
   }) {
     return RecasterPlatform.instance.startRecording(
       outputPath: outputPath,
       fps: fps,
+      highFrameRate: highFrameRate,
+      outOfProcess: outOfProcess,
+      mainThreadBudget: mainThreadBudget,
       resolutionDivisor: resolutionDivisor,
+      maxWidth: maxWidth,
+      maxHeight: maxHeight,
+      scale: scale,
+      filter: filter,
+      resizePolicy: resizePolicy,
+      gifPalette: gifPalette,
+      bufferCompression: bufferCompression,
+      thumbnails: thumbnails,
+      timeLapse: timeLapse,
+      degradation: degradation,
+      preview: preview,
     );
   }
 
+  /// Completes once the output file has been written. On Linux the file is
+  /// written on a worker thread; see [finalizeProgress] and [cancelFinalize].
   Future<String?> stopRecording() {
     return RecasterPlatform.instance.stopRecording();
   }
 
+  /// Bytes written, frames remaining and ETA while a stopped recording is
+  /// being written. Linux only.
+  Stream<FinalizeProgress> get finalizeProgress {
+    return RecasterPlatform.instance.finalizeProgress;
+  }
+
+  /// Aborts the write started by [stopRecording] or [stopSession] and removes
+  /// the partial output; the pending stop call fails with
+  /// `finalize_cancelled`. Returns false when nothing was being written.
+  /// Linux only.
+  Future<bool> cancelFinalize() {
+    return RecasterPlatform.instance.cancelFinalize();
+  }
+
+  /// Records one capture into several outputs at once; [highFrameRate] is
+  /// as for [startRecording]. Linux only.
+  Future<void> startSession({
+    required List<RecordingSink> sinks,
+    int fps = 30,
+    bool highFrameRate = false,
+    double? mainThreadBudget,
+    DegradationPolicy? degradation,
+    PreviewOptions? preview,
+  }) {
+    return RecasterPlatform.instance.startSession(
+      sinks: sinks,
+      fps: fps,
+      highFrameRate: highFrameRate,
+      mainThreadBudget: mainThreadBudget,
+      degradation: degradation,
+      preview: preview,
+    );
+  }
+
+  Future<List<String>> stopSession() {
+    return RecasterPlatform.instance.stopSession();
+  }
+
+  /// Writes a single frame without starting a recording. The readback runs on
+  /// the UI thread; scaling and encoding run on a worker. Linux only.
+  Future<ScreenshotResult> captureScreenshot({
+    required String outputPath,
+    ScreenshotFormat format = ScreenshotFormat.png,
+    int resolutionDivisor = 1,
+  }) {
+    return RecasterPlatform.instance.captureScreenshot(
+      outputPath: outputPath,
+      format: format,
+      resolutionDivisor: resolutionDivisor,
+    );
+  }
+
+  /// Capture counters and the degradation controller's current level and
+  /// history. Still available after stop until the next recording. Linux only.
+  Future<RecordingStats> getRecordingStats() {
+    return RecasterPlatform.instance.getRecordingStats();
+  }
+
+  /// Address of the live preview started with `preview:`, or null when none
+  /// is running. Linux only.
+  Future<String?> getPreviewUrl() {
+    return RecasterPlatform.instance.getPreviewUrl();
+  }
+
+  /// Copies the part of the AVI recording at [inputPath] shown between
+  /// [start] and [end] (or the end of the clip) to [outputPath] without
+  /// re-encoding. Completes with the written path. Linux only.
+  Future<String> trimRecording({
+    required String inputPath,
+    required String outputPath,
+    Duration start = Duration.zero,
+    Duration? end,
+  }) {
+    return RecasterPlatform.instance.trimRecording(
+      inputPath: inputPath,
+      outputPath: outputPath,
+      start: start,
+      end: end,
+    );
+  }
+
+  /// Joins AVI recordings of the same size, pixel format and frame rate into
+  /// [outputPath] without re-encoding, e.g. the files of a `segment`
+  /// recording. Completes with the written path. Linux only.
+  Future<String> concatRecordings({
+    required List<String> inputPaths,
+    required String outputPath,
+  }) {
+    return RecasterPlatform.instance.concatRecordings(
+      inputPaths: inputPaths,
+      outputPath: outputPath,
+    );
+  }
+
+  /// Compares the `.rhash` hashes of a run against a golden run and reports
+  /// the first frame whose whole-frame hash or any tile hash differs in more
+  /// than [frameThreshold] or [tileThreshold] of 64 bits, with the region of
+  /// the differing tiles. Linux only.
+  Future<FrameHashComparison> compareFrameHashes({
+    required String goldenPath,
+    required String runPath,
+    int frameThreshold = 6,
+    int tileThreshold = 6,
+  }) {
+    return RecasterPlatform.instance.compareFrameHashes(
+      goldenPath: goldenPath,
+      runPath: runPath,
+      frameThreshold: frameThreshold,
+      tileThreshold: tileThreshold,
+    );
+  }
+
   Future<bool> isRecording() {
     return RecasterPlatform.instance.isRecording();
   }
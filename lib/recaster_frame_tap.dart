@@ -0,0 +1,161 @@
+import 'dart:async';
+import 'dart:ffi';
+import 'dart:typed_data';
+
+// Mirrors RecasterFrame in linux/include/recaster/recaster_frame_tap.h.
+final class _RecasterFrame extends Struct {
+  external Pointer<Uint8> pixels;
+
+  @Int64()
+  external int timestampUs;
+
+  @Uint64()
+  external int sequence;
+
+  @Int32()
+  external int width;
+
+  @Int32()
+  external int height;
+
+  @Int32()
+  external int stride;
+
+  @Int32()
+  external int format;
+
+  external Pointer<Void> reserved;
+}
+
+class _Bindings {
+  _Bindings(DynamicLibrary library)
+      : open = library.lookupFunction<Int64 Function(Int32), int Function(int)>(
+            'recaster_frame_tap_open'),
+        next = library.lookupFunction<Pointer<_RecasterFrame> Function(Int64),
+            Pointer<_RecasterFrame> Function(int)>('recaster_frame_tap_next'),
+        release = library.lookupFunction<
+            Void Function(Pointer<_RecasterFrame>),
+            void Function(Pointer<_RecasterFrame>)>('recaster_frame_tap_release'),
+        dropped =
+            library.lookupFunction<Uint64 Function(Int64), int Function(int)>(
+                'recaster_frame_tap_dropped'),
+        close = library.lookupFunction<Void Function(Int64), void Function(int)>(
+            'recaster_frame_tap_close'),
+        releaseFinalizer = NativeFinalizer(library
+            .lookup<NativeFinalizerFunction>('recaster_frame_tap_release'));
+
+  // The plugin library is loaded by the runner before any Dart code runs.
+  static final _Bindings instance = _Bindings(DynamicLibrary.process());
+
+  final int Function(int) open;
+  final Pointer<_RecasterFrame> Function(int) next;
+  final void Function(Pointer<_RecasterFrame>) release;
+  final int Function(int) dropped;
+  final void Function(int) close;
+
+  // Gives back the lease of a frame that is dropped without being released.
+  final NativeFinalizer releaseFinalizer;
+}
+
+/// Captured frames read through FFI instead of the method channel, so pixels
+/// are neither copied nor serialised. Frames are lent from the capture's
+/// buffers and must be [TappedFrame.release]d. At most [capacity] frames wait
+/// in the tap and at most [capacity] are lent out; when the consumer falls
+/// behind the oldest waiting frames are dropped, never capture itself.
+/// Frames arrive while a recording or session runs. Linux only.
+class FrameTap {
+  FrameTap._(this._id, this.capacity);
+
+  /// [capacity] is clamped to 1..64.
+  factory FrameTap.open({int capacity = 4}) {
+    final clamped = capacity.clamp(1, 64);
+    return FrameTap._(_Bindings.instance.open(clamped), clamped);
+  }
+
+  final int _id;
+  final int capacity;
+  bool _closed = false;
+
+  /// The oldest waiting frame, or null when none is waiting or [capacity]
+  /// frames are still lent out.
+  TappedFrame? next() {
+    if (_closed) {
+      return null;
+    }
+    final frame = _Bindings.instance.next(_id);
+    return frame == nullptr ? null : TappedFrame._(frame);
+  }
+
+  /// Frames discarded because the consumer fell behind.
+  int get dropped => _closed ? 0 : _Bindings.instance.dropped(_id);
+
+  /// Polls the tap every [interval] and emits each waiting frame. Emitted
+  /// frames must still be released.
+  Stream<TappedFrame> frames({
+    Duration interval = const Duration(milliseconds: 8),
+  }) {
+    Timer? timer;
+    late final StreamController<TappedFrame> controller;
+    controller = StreamController<TappedFrame>(
+      onListen: () {
+        timer = Timer.periodic(interval, (_) {
+          for (var frame = next(); frame != null; frame = next()) {
+            controller.add(frame);
+          }
+        });
+      },
+      onCancel: () => timer?.cancel(),
+    );
+    return controller.stream;
+  }
+
+  /// Stops queueing frames. Frames already lent stay valid until released.
+  void close() {
+    if (!_closed) {
+      _closed = true;
+      _Bindings.instance.close(_id);
+    }
+  }
+}
+
+/// A frame that is never released is given back once it is garbage
+/// collected, so keep the frame itself reachable while [pixels] is in use.
+class TappedFrame implements Finalizable {
+  TappedFrame._(this._frame)
+      : width = _frame.ref.width,
+        height = _frame.ref.height,
+        stride = _frame.ref.stride,
+        sequence = _frame.ref.sequence,
+        timestamp = Duration(microseconds: _frame.ref.timestampUs),
+        pixels =
+            _frame.ref.pixels.asTypedList(_frame.ref.stride * _frame.ref.height) {
+    _Bindings.instance.releaseFinalizer
+        .attach(this, _frame.cast(), detach: this);
+  }
+
+  final Pointer<_RecasterFrame> _frame;
+  bool _released = false;
+
+  final int width;
+  final int height;
+
+  /// Bytes per row of [pixels], which may be padded beyond the pixels.
+  final int stride;
+
+  /// Position among the frames offered to the tap; gaps are drops.
+  final int sequence;
+  final Duration timestamp;
+
+  /// BGRA rows viewing the capture buffer itself. Read only, and invalid
+  /// once the frame is released.
+  final Uint8List pixels;
+
+  /// Gives the buffer back to the capture. Safe to call more than once.
+  void release() {
+    if (!_released) {
+      _released = true;
+      _Bindings.instance.releaseFinalizer.detach(this);
+      _Bindings.instance.release(_frame);
+    }
+  }
+}
@@ -2,11 +2,15 @@ import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
 
 import 'recaster_platform_interface.dart';
+import 'recaster_types.dart';
 
 class MethodChannelRecaster extends RecasterPlatform {
   @visibleForTesting
   final methodChannel = const MethodChannel('recaster');
 
+  @visibleForTesting
+  final progressChannel = const EventChannel('recaster/finalize_progress');
+
   @override
   Future<String?> getPlatformVersion() async {
     final version =
@@ -18,14 +22,44 @@ class MethodChannelRecaster extends RecasterPlatform {
   Future<void> startRecording({
     required String outputPath,
     int fps = 30,
+    bool highFrameRate = false,
+    bool outOfProcess = false,
+    double? mainThreadBudget,
     int resolutionDivisor = 1,
+    int? maxWidth,
+    int? maxHeight,
+    double? scale,
+    ResampleFilter filter = ResampleFilter.bilinear,
+    ResizePolicy resizePolicy = ResizePolicy.letterbox,
+    GifPalette gifPalette = GifPalette.global,
+    BufferCompression bufferCompression = BufferCompression.none,
+    ThumbnailOptions? thumbnails,
+    TimeLapse? timeLapse,
+    DegradationPolicy? degradation,
+    PreviewOptions? preview,
   }) async {
     await methodChannel.invokeMethod<void>(
       'startRecording',
       <String, Object>{
         'outputPath': outputPath,
         'fps': fps,
+        if (highFrameRate) 'highFrameRate': true,
+        if (outOfProcess) 'outOfProcess': true,
+        if (mainThreadBudget != null) 'mainThreadBudget': mainThreadBudget,
         'resolutionDivisor': resolutionDivisor,
+        if (maxWidth != null) 'maxWidth': maxWidth,
+        if (maxHeight != null) 'maxHeight': maxHeight,
+        if (scale != null) 'scale': scale,
+        if (filter != ResampleFilter.bilinear) 'filter': filter.name,
+        if (resizePolicy != ResizePolicy.letterbox)
+          'resizePolicy': resizePolicy.name,
+        if (gifPalette != GifPalette.global) 'gifPalette': gifPalette.name,
+        if (bufferCompression != BufferCompression.none)
+          'bufferCompression': bufferCompression.name,
+        if (thumbnails != null) 'thumbnails': thumbnails.toMap(),
+        if (timeLapse != null) 'timeLapse': timeLapse.toMap(),
+        if (degradation != null) 'degradation': degradation.toMap(),
+        if (preview != null) 'preview': preview.toMap(),
       },
     );
   }
@@ -35,6 +69,128 @@ class MethodChannelRecaster extends RecasterPlatform {
     return methodChannel.invokeMethod<String>('stopRecording');
   }
 
+  @override
+  Stream<FinalizeProgress> get finalizeProgress {
+    return progressChannel.receiveBroadcastStream().map(
+        (event) => FinalizeProgress.fromMap(event as Map<Object?, Object?>));
+  }
+
+  @override
+  Future<bool> cancelFinalize() async {
+    final cancelled = await methodChannel.invokeMethod<bool>('cancelFinalize');
+    return cancelled ?? false;
+  }
+
+  @override
+  Future<void> startSession({
+    required List<RecordingSink> sinks,
+    int fps = 30,
+    bool highFrameRate = false,
+    double? mainThreadBudget,
+    DegradationPolicy? degradation,
+    PreviewOptions? preview,
+  }) async {
+    await methodChannel.invokeMethod<void>(
+      'startSession',
+      <String, Object>{
+        'fps': fps,
+        if (highFrameRate) 'highFrameRate': true,
+        if (mainThreadBudget != null) 'mainThreadBudget': mainThreadBudget,
+        'sinks': sinks.map((sink) => sink.toMap()).toList(),
+        if (degradation != null) 'degradation': degradation.toMap(),
+        if (preview != null) 'preview': preview.toMap(),
+      },
+    );
+  }
+
+  @override
+  Future<List<String>> stopSession() async {
+    final paths = await methodChannel.invokeListMethod<String>('stopSession');
+    return paths ?? <String>[];
+  }
+
+  @override
+  Future<ScreenshotResult> captureScreenshot({
+    required String outputPath,
+    ScreenshotFormat format = ScreenshotFormat.png,
+    int resolutionDivisor = 1,
+  }) async {
+    final result = await methodChannel.invokeMapMethod<Object?, Object?>(
+      'captureScreenshot',
+      <String, Object>{
+        'outputPath': outputPath,
+        'format': format.name,
+        'resolutionDivisor': resolutionDivisor,
+      },
+    );
+    return ScreenshotResult.fromMap(result!);
+  }
+
+  @override
+  Future<RecordingStats> getRecordingStats() async {
+    final result = await methodChannel
+        .invokeMapMethod<Object?, Object?>('getRecordingStats');
+    return RecordingStats.fromMap(result ?? const <Object?, Object?>{});
+  }
+
+  @override
+  Future<String?> getPreviewUrl() async {
+    return methodChannel.invokeMethod<String>('getPreviewUrl');
+  }
+
+  @override
+  Future<String> trimRecording({
+    required String inputPath,
+    required String outputPath,
+    Duration start = Duration.zero,
+    Duration? end,
+  }) async {
+    final path = await methodChannel.invokeMethod<String>(
+      'trimRecording',
+      <String, Object>{
+        'inputPath': inputPath,
+        'outputPath': outputPath,
+        'startMs': start.inMilliseconds,
+        if (end != null) 'endMs': end.inMilliseconds,
+      },
+    );
+    return path!;
+  }
+
+  @override
+  Future<String> concatRecordings({
+    required List<String> inputPaths,
+    required String outputPath,
+  }) async {
+    final path = await methodChannel.invokeMethod<String>(
+      'concatRecordings',
+      <String, Object>{
+        'inputPaths': inputPaths,
+        'outputPath': outputPath,
+      },
+    );
+    return path!;
+  }
+
+  @override
+  Future<FrameHashComparison> compareFrameHashes({
+    required String goldenPath,
+    required String runPath,
+    int frameThreshold = 6,
+    int tileThreshold = 6,
+  }) async {
+    final result = await methodChannel.invokeMapMethod<Object?, Object?>(
+      'compareFrameHashes',
+      <String, Object>{
+        'goldenPath': goldenPath,
+        'runPath': runPath,
+        'frameThreshold': frameThreshold,
+        'tileThreshold': tileThreshold,
+      },
+    );
+    return FrameHashComparison.fromMap(result!);
+  }
+
   @override
   Future<bool> isRecording() async {
     final value = await methodChannel.invokeMethod<bool>('isRecording');
@@ -1,6 +1,7 @@
 import 'package:plugin_platform_interface/plugin_platform_interface.dart';
 
 import 'recaster_method_channel.dart';
+import 'recaster_types.dart';
 
 abstract class RecasterPlatform extends PlatformInterface {
   RecasterPlatform() : super(token: _token);
@@ -23,7 +24,21 @@ abstract class RecasterPlatform extends PlatformInterface {
   Future<void> startRecording({
     required String outputPath,
     int fps = 30,
+    bool highFrameRate = false,
+    bool outOfProcess = false,
+    double? mainThreadBudget,
     int resolutionDivisor = 1,
+    int? maxWidth,
+    int? maxHeight,
+    double? scale,
+    ResampleFilter filter = ResampleFilter.bilinear,
+    ResizePolicy resizePolicy = ResizePolicy.letterbox,
+    GifPalette gifPalette = GifPalette.global,
+    BufferCompression bufferCompression = BufferCompression.none,
+    ThumbnailOptions? thumbnails,
+    TimeLapse? timeLapse,
+    DegradationPolicy? degradation,
+    PreviewOptions? preview,
   }) {
     throw UnimplementedError('startRecording() has not been implemented.');
   }
@@ -32,6 +47,70 @@ abstract class RecasterPlatform extends PlatformInterface {
     throw UnimplementedError('stopRecording() has not been implemented.');
   }
 
+  Stream<FinalizeProgress> get finalizeProgress {
+    throw UnimplementedError('finalizeProgress has not been implemented.');
+  }
+
+  Future<bool> cancelFinalize() {
+    throw UnimplementedError('cancelFinalize() has not been implemented.');
+  }
+
+  Future<void> startSession({
+    required List<RecordingSink> sinks,
+    int fps = 30,
+    bool highFrameRate = false,
+    double? mainThreadBudget,
+    DegradationPolicy? degradation,
+    PreviewOptions? preview,
+  }) {
+    throw UnimplementedError('startSession() has not been implemented.');
+  }
+
+  Future<List<String>> stopSession() {
+    throw UnimplementedError('stopSession() has not been implemented.');
+  }
+
+  Future<ScreenshotResult> captureScreenshot({
+    required String outputPath,
+    ScreenshotFormat format = ScreenshotFormat.png,
+    int resolutionDivisor = 1,
+  }) {
+    throw UnimplementedError('captureScreenshot() has not been implemented.');
+  }
+
+  Future<RecordingStats> getRecordingStats() {
+    throw UnimplementedError('getRecordingStats() has not been implemented.');
+  }
+
+  Future<String?> getPreviewUrl() {
+    throw UnimplementedError('getPreviewUrl() has not been implemented.');
+  }
+
+  Future<String> trimRecording({
+    required String inputPath,
+    required String outputPath,
+    Duration start = Duration.zero,
+    Duration? end,
+  }) {
+    throw UnimplementedError('trimRecording() has not been implemented.');
+  }
+
+  Future<String> concatRecordings({
+    required List<String> inputPaths,
+    required String outputPath,
+  }) {
+    throw UnimplementedError('concatRecordings() has not been implemented.');
+  }
+
+  Future<FrameHashComparison> compareFrameHashes({
+    required String goldenPath,
+    required String runPath,
+    int frameThreshold = 6,
+    int tileThreshold = 6,
+  }) {
+    throw UnimplementedError('compareFrameHashes() has not been implemented.');
+  }
+
   Future<bool> isRecording() {
     throw UnimplementedError('isRecording() has not been implemented.');
   }
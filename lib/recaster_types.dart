@@ -0,0 +1,502 @@
+enum ResampleFilter { bilinear, bicubic, lanczos3 }
+
+enum PixelFormat { bgra32, bgr24 }
+
+enum ThumbnailFormat { jpeg, png }
+
+/// Per-frame compression for `.rcap` outputs. LZ4 and zstd are only
+/// available when the Linux plugin was built against them.
+enum FrameCodec { stored, lz4, zstd }
+
+enum ScreenshotFormat { png, jpeg, raw }
+
+/// What happens to frames captured after the window changes size.
+enum ResizePolicy {
+  /// Fit inside the original canvas with black bars.
+  letterbox,
+
+  /// Stretch to the original canvas.
+  scale,
+
+  /// Fill the original canvas, cropping the overflow.
+  crop,
+
+  /// Start a new file at the new size: `<name>-2.avi`, `<name>-3.avi`, ...
+  segment,
+}
+
+/// Colour palette for `.gif` outputs.
+enum GifPalette {
+  /// One palette for the whole clip; smallest files.
+  global,
+
+  /// A palette per frame; better colour when the content changes a lot.
+  perFrame,
+}
+
+/// How recorded frames are held in memory until the file is written. Linux
+/// only.
+enum BufferCompression {
+  /// Raw frames (default).
+  none,
+
+  /// Each frame compressed on a worker thread as it arrives.
+  frame,
+
+  /// Each frame compressed as its difference from the previous one; static
+  /// content costs almost nothing.
+  delta,
+}
+
+/// A written screenshot. `raw` files hold tightly packed BGRA rows of
+/// [width] x [height] pixels.
+class ScreenshotResult {
+  const ScreenshotResult({
+    required this.path,
+    required this.width,
+    required this.height,
+  });
+
+  factory ScreenshotResult.fromMap(Map<Object?, Object?> map) {
+    return ScreenshotResult(
+      path: map['path']! as String,
+      width: map['width']! as int,
+      height: map['height']! as int,
+    );
+  }
+
+  final String path;
+  final int width;
+  final int height;
+}
+
+/// Scrubbing sprite-sheet written next to the output as
+/// `<name>.thumbs.jpg` plus a `<name>.thumbs.json` timestamp map. Linux only.
+class ThumbnailOptions {
+  const ThumbnailOptions({
+    this.every = 30,
+    this.tileWidth = 160,
+    this.columns = 10,
+    this.format = ThumbnailFormat.jpeg,
+  });
+
+  /// Keep one thumbnail per [every] output frames.
+  final int every;
+  final int tileWidth;
+  final int columns;
+  final ThumbnailFormat format;
+
+  Map<String, Object> toMap() {
+    return <String, Object>{
+      'every': every,
+      'tileWidth': tileWidth,
+      'columns': columns,
+      'format': format.name,
+    };
+  }
+}
+
+/// Time-lapse output: the captures of each [interval] are averaged into one
+/// frame, so brief events still show, and the file plays back at
+/// [playbackFps]. An interval may span at most 256 captures at the output's
+/// frame rate. Linux only.
+class TimeLapse {
+  const TimeLapse({
+    required this.interval,
+    this.playbackFps = 30,
+  });
+
+  final Duration interval;
+  final int playbackFps;
+
+  Map<String, Object> toMap() {
+    return <String, Object>{
+      'intervalMs': interval.inMilliseconds,
+      'playbackFps': playbackFps,
+    };
+  }
+}
+
+/// One output of a capture session. Every sink receives the same window
+/// readback and applies its own size, frame rate and pixel format.
+class RecordingSink {
+  const RecordingSink({
+    required this.outputPath,
+    this.fps,
+    this.resolutionDivisor = 1,
+    this.maxWidth,
+    this.maxHeight,
+    this.scale,
+    this.filter = ResampleFilter.bilinear,
+    this.pixelFormat = PixelFormat.bgra32,
+    this.thumbnails,
+    this.codec,
+    this.compressionLevel,
+    this.resizePolicy = ResizePolicy.letterbox,
+    this.gifPalette = GifPalette.global,
+    this.bufferCompression = BufferCompression.none,
+    this.hashTiles = 8,
+    this.timeLapse,
+  });
+
+  /// Output file. A `.rcap` extension selects the compressed frame container
+  /// instead of AVI; `.mp4` encodes H.264 when GStreamer is available and
+  /// otherwise falls back to `.avi`; `.gif` writes a looping animated GIF.
+  /// `.rhash` keeps no pixels, only perceptual hashes of every frame for
+  /// [Recaster.compareFrameHashes]; `.png` and `.qoi` write numbered image
+  /// files plus a `.json` manifest, whose path stop returns (Linux only).
+  final String outputPath;
+
+  /// Output frame rate; frames are decimated from the session rate.
+  final int? fps;
+  final int resolutionDivisor;
+  final int? maxWidth;
+  final int? maxHeight;
+  final double? scale;
+  final ResampleFilter filter;
+  final PixelFormat pixelFormat;
+  final ThumbnailOptions? thumbnails;
+
+  /// Codec for `.rcap` outputs; defaults to the fastest one available.
+  /// Asking for a codec the plugin was built without fails with
+  /// `codec_unavailable`.
+  final FrameCodec? codec;
+
+  /// `.rcap` compression level from 1 (fastest, the default) to 19
+  /// (smallest); higher always compresses harder whatever the [codec]. LZ4
+  /// switches to its HC mode above 2 and stops getting smaller past 12.
+  /// Values outside 1..19 are rejected.
+  final int? compressionLevel;
+  final ResizePolicy resizePolicy;
+  final GifPalette gifPalette;
+  final BufferCompression bufferCompression;
+
+  /// Tiles per side hashed for `.rhash` outputs, up to 32; finer grids
+  /// locate changes more precisely and cost 8 bytes per tile per frame.
+  final int hashTiles;
+  final TimeLapse? timeLapse;
+
+  Map<String, Object> toMap() {
+    return <String, Object>{
+      'outputPath': outputPath,
+      if (fps != null) 'fps': fps!,
+      'resolutionDivisor': resolutionDivisor,
+      if (maxWidth != null) 'maxWidth': maxWidth!,
+      if (maxHeight != null) 'maxHeight': maxHeight!,
+      if (scale != null) 'scale': scale!,
+      if (filter != ResampleFilter.bilinear) 'filter': filter.name,
+      if (pixelFormat != PixelFormat.bgra32) 'pixelFormat': pixelFormat.name,
+      if (thumbnails != null) 'thumbnails': thumbnails!.toMap(),
+      if (codec != null) 'codec': codec!.name,
+      if (compressionLevel != null) 'compressionLevel': compressionLevel!,
+      if (resizePolicy != ResizePolicy.letterbox)
+        'resizePolicy': resizePolicy.name,
+      if (gifPalette != GifPalette.global) 'gifPalette': gifPalette.name,
+      if (bufferCompression != BufferCompression.none)
+        'bufferCompression': bufferCompression.name,
+      if (hashTiles != 8) 'hashTiles': hashTiles,
+      if (timeLapse != null) 'timeLapse': timeLapse!.toMap(),
+    };
+  }
+}
+
+/// Result of comparing two `.rhash` recordings frame by frame.
+class FrameHashComparison {
+  const FrameHashComparison({
+    required this.framesCompared,
+    this.divergentFrame,
+    this.timestamp,
+    this.frameDistance = 0,
+    this.maxTileDistance = 0,
+    this.x = 0,
+    this.y = 0,
+    this.width = 0,
+    this.height = 0,
+  });
+
+  factory FrameHashComparison.fromMap(Map<Object?, Object?> map) {
+    final timestampUs = map['timestampUs'] as int?;
+    return FrameHashComparison(
+      framesCompared: map['framesCompared'] as int? ?? 0,
+      divergentFrame: map['divergentFrame'] as int?,
+      timestamp:
+          timestampUs == null ? null : Duration(microseconds: timestampUs),
+      frameDistance: map['frameDistance'] as int? ?? 0,
+      maxTileDistance: map['maxTileDistance'] as int? ?? 0,
+      x: map['x'] as int? ?? 0,
+      y: map['y'] as int? ?? 0,
+      width: map['width'] as int? ?? 0,
+      height: map['height'] as int? ?? 0,
+    );
+  }
+
+  final int framesCompared;
+
+  /// Index of the first frame that differs, or null when the runs match. A
+  /// run that ends early diverges at the first frame only the other one has.
+  final int? divergentFrame;
+
+  /// Capture time of [divergentFrame] in the golden run.
+  final Duration? timestamp;
+
+  /// Differing bits (of 64) in the whole-frame and worst tile hashes.
+  final int frameDistance;
+  final int maxTileDistance;
+
+  /// Region of the divergent tiles in golden-run pixels.
+  final int x;
+  final int y;
+  final int width;
+  final int height;
+
+  bool get matches => divergentFrame == null;
+}
+
+/// Progress of writing a stopped recording to disk.
+class FinalizeProgress {
+  const FinalizeProgress({
+    required this.bytesWritten,
+    required this.framesWritten,
+    required this.framesRemaining,
+    required this.eta,
+    required this.done,
+  });
+
+  factory FinalizeProgress.fromMap(Map<Object?, Object?> map) {
+    final etaMs = map['etaMs'] as int? ?? -1;
+    return FinalizeProgress(
+      bytesWritten: map['bytesWritten'] as int? ?? 0,
+      framesWritten: map['framesWritten'] as int? ?? 0,
+      framesRemaining: map['framesRemaining'] as int? ?? 0,
+      eta: etaMs < 0 ? null : Duration(milliseconds: etaMs),
+      done: map['done'] as bool? ?? false,
+    );
+  }
+
+  final int bytesWritten;
+  final int framesWritten;
+  final int framesRemaining;
+
+  /// Estimated time left; null until the first frame has been written.
+  final Duration? eta;
+  final bool done;
+}
+
+/// Live MJPEG preview served on `http://127.0.0.1:<port>/` while recording,
+/// for watching from a browser on the same machine. Frames are decimated to
+/// [fps] and scaled to at most [maxWidth]; slow viewers skip frames and never
+/// hold back the recording. Linux only.
+class PreviewOptions {
+  const PreviewOptions({
+    this.port = 0,
+    this.fps = 5,
+    this.maxWidth = 640,
+    this.quality = 70,
+  });
+
+  /// Port to listen on; 0 picks a free one. See [Recaster.getPreviewUrl].
+  final int port;
+  final int fps;
+  final int maxWidth;
+
+  /// JPEG quality, 1-100.
+  final int quality;
+
+  Map<String, Object> toMap() {
+    return <String, Object>{
+      'port': port,
+      'fps': fps,
+      'maxWidth': maxWidth,
+      'quality': quality,
+    };
+  }
+}
+
+/// One way the Linux recorder may shed work when it falls behind.
+enum DegradationStep {
+  /// Halve the capture rate, repeating the last frame in between.
+  reduceFps,
+
+  /// Halve the stored resolution until the file is written.
+  increaseDivisor,
+
+  /// Compress frames buffered from now on harder, for sinks with
+  /// [BufferCompression.frame] or [BufferCompression.delta]. Trades CPU for
+  /// memory, so it only takes effect while [DegradationPolicy.maxBufferedBytes]
+  /// is set and load is within [DegradationPolicy.targetLoad].
+  raiseCompression,
+
+  /// Skip ticks while over the target load.
+  dropFrames,
+}
+
+/// Applied step by step while capture exceeds [targetLoad] of the tick
+/// interval (or buffers more than [maxBufferedBytes]), and undone in reverse
+/// once load has stayed low for [recoverAfterMs].
+class DegradationPolicy {
+  const DegradationPolicy({
+    this.steps = const <DegradationStep>[
+      DegradationStep.reduceFps,
+      DegradationStep.increaseDivisor,
+      DegradationStep.dropFrames,
+    ],
+    this.targetLoad = 0.6,
+    this.maxBufferedBytes,
+    this.recoverAfterMs = 3000,
+  });
+
+  final List<DegradationStep> steps;
+  final double targetLoad;
+  final int? maxBufferedBytes;
+  final int recoverAfterMs;
+
+  Map<String, Object> toMap() {
+    return <String, Object>{
+      'steps': steps.map((step) => step.name).toList(),
+      'targetLoad': targetLoad,
+      if (maxBufferedBytes != null) 'maxBufferedBytes': maxBufferedBytes!,
+      'recoverAfterMs': recoverAfterMs,
+    };
+  }
+}
+
+/// A degradation step being applied or reverted.
+class DegradationEvent {
+  const DegradationEvent({
+    required this.time,
+    required this.level,
+    required this.step,
+    required this.escalated,
+    required this.load,
+  });
+
+  factory DegradationEvent.fromMap(Map<Object?, Object?> map) {
+    return DegradationEvent(
+      time: Duration(milliseconds: map['timeMs'] as int? ?? 0),
+      level: map['level'] as int? ?? 0,
+      step: DegradationStep.values.byName(map['step'] as String),
+      escalated: map['escalated'] as bool? ?? false,
+      load: (map['load'] as num?)?.toDouble() ?? 0,
+    );
+  }
+
+  final Duration time;
+  final int level;
+  final DegradationStep step;
+  final bool escalated;
+  final double load;
+}
+
+class RecordingStats {
+  const RecordingStats({
+    required this.recording,
+    required this.framesCaptured,
+    required this.framesRepeated,
+    required this.framesDropped,
+    required this.resizes,
+    required this.bufferedBytes,
+    required this.captureTime,
+    this.framesSharedMemory = 0,
+    this.readbackTime = Duration.zero,
+    this.highFrameRate = false,
+    this.requestedFps = 0,
+    this.achievedFps = 0,
+    this.framesMissed = 0,
+    this.mainThreadBudget = 0,
+    this.mainThreadLoad = 0,
+    this.mainThreadHighWater = 0,
+    this.maxTickTime = Duration.zero,
+    this.framesShed = 0,
+    required this.load,
+    required this.level,
+    required this.events,
+  });
+
+  factory RecordingStats.fromMap(Map<Object?, Object?> map) {
+    final events = map['events'] as List<Object?>? ?? const <Object?>[];
+    return RecordingStats(
+      recording: map['recording'] as bool? ?? false,
+      framesCaptured: map['framesCaptured'] as int? ?? 0,
+      framesRepeated: map['framesRepeated'] as int? ?? 0,
+      framesDropped: map['framesDropped'] as int? ?? 0,
+      resizes: map['resizes'] as int? ?? 0,
+      bufferedBytes: map['bufferedBytes'] as int? ?? 0,
+      captureTime: Duration(microseconds: map['totalStageUs'] as int? ?? 0),
+      framesSharedMemory: map['framesSharedMemory'] as int? ?? 0,
+      readbackTime: Duration(microseconds: map['totalReadbackUs'] as int? ?? 0),
+      highFrameRate: map['highFrameRate'] as bool? ?? false,
+      requestedFps: map['requestedFps'] as int? ?? 0,
+      achievedFps: (map['achievedFps'] as num?)?.toDouble() ?? 0,
+      framesMissed: map['framesMissed'] as int? ?? 0,
+      mainThreadBudget: (map['mainThreadBudget'] as num?)?.toDouble() ?? 0,
+      mainThreadLoad: (map['mainThreadLoad'] as num?)?.toDouble() ?? 0,
+      mainThreadHighWater:
+          (map['mainThreadHighWater'] as num?)?.toDouble() ?? 0,
+      maxTickTime: Duration(microseconds: map['maxTickUs'] as int? ?? 0),
+      framesShed: map['framesShed'] as int? ?? 0,
+      load: (map['load'] as num?)?.toDouble() ?? 0,
+      level: map['level'] as int? ?? 0,
+      events: events
+          .map((event) =>
+              DegradationEvent.fromMap(event! as Map<Object?, Object?>))
+          .toList(),
+    );
+  }
+
+  final bool recording;
+  final int framesCaptured;
+
+  /// Frames written as copies of the previous one under `reduceFps`.
+  final int framesRepeated;
+  final int framesDropped;
+
+  /// Times the captured window changed size; see [ResizePolicy].
+  final int resizes;
+  final int bufferedBytes;
+
+  /// Main-thread time spent in capture ticks since recording started.
+  final Duration captureTime;
+
+  /// Frames read through X11 MIT-SHM rather than GDK (Linux only).
+  final int framesSharedMemory;
+
+  /// Part of [captureTime] spent reading the window back.
+  final Duration readbackTime;
+
+  /// Whether the recording was started with `highFrameRate`.
+  final bool highFrameRate;
+  final int requestedFps;
+
+  /// Fresh frames captured per second of recording. Lower than
+  /// [requestedFps] when the capture could not keep up; the gaps are filled
+  /// with repeated frames so the output keeps real time.
+  final double achievedFps;
+
+  /// High-frame-rate slots that got no frame and repeat the previous one.
+  final int framesMissed;
+
+  /// The `mainThreadBudget` the capture runs under; 0 when unlimited.
+  final double mainThreadBudget;
+
+  /// Share of the last second of the UI thread spent in capture ticks.
+  final double mainThreadLoad;
+
+  /// Highest [mainThreadLoad] since recording started, measured with or
+  /// without a budget.
+  final double mainThreadHighWater;
+
+  /// Longest single capture tick.
+  final Duration maxTickTime;
+
+  /// Ticks that repeated the previous frame to stay within the budget. Also
+  /// counted in [framesRepeated], or in [framesDropped] for out-of-process
+  /// recordings.
+  final int framesShed;
+
+  /// Smoothed capture cost as a fraction of the tick interval.
+  final double load;
+
+  /// Number of policy steps currently applied.
+  final int level;
+  final List<DegradationEvent> events;
+}
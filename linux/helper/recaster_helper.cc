@@ -0,0 +1,254 @@
+// Recorder process the plugin starts for outOfProcess recordings. The plugin
+// writes captured frames into a shared-memory ring; conversion, buffering and
+// file writing happen here, so their cost and their failures stay out of the
+// application.
+//
+//   recaster-helper --ring-fd N --event-fd N --output <path> --fps N
+//                   [--divisor N] [--scale F] [--max-width N] [--max-height N]
+//                   [--filter NAME] [--pixel-format NAME] [--resize-policy NAME]
+//                   [--buffer-compression NAME] [--codec NAME] [--level N]
+//                   [--gif-palette NAME]
+//
+// Once the plugin closes the ring, or its process is gone, the recording is
+// written and each file's path printed on its own line. Errors go to stderr
+// with exit status 1.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "avi_writer.h"
+#include "frame_codec.h"
+#include "frame_data.h"
+#include "frame_resampler.h"
+#include "frame_sink.h"
+#include "frame_store.h"
+#include "gif_writer.h"
+#include "image_sequence_writer.h"
+#include "rcap_format.h"
+#include "shm_frame_ring.h"
+#include "worker_pool.h"
+
+#ifdef RECASTER_HAVE_GSTREAMER
+#include "mp4_writer.h"
+#endif
+
+namespace {
+
+// How often an idle helper checks that the plugin's process still exists.
+constexpr int kParentCheckMs = 200;
+
+struct HelperOptions {
+  int ring_fd = -1;
+  int event_fd = -1;
+  std::string output_path;
+  int fps = 30;
+  recaster::ScaleOptions scale_options;
+  recaster::PixelFormat pixel_format = recaster::PixelFormat::kBgra32;
+  recaster::ResizePolicy resize_policy = recaster::ResizePolicy::kLetterbox;
+  recaster::BufferCompression compression = recaster::BufferCompression::kNone;
+  recaster::RcapOptions rcap_options;
+  recaster::GifOptions gif_options;
+};
+
+int usage() {
+  fprintf(stderr,
+          "usage: recaster-helper --ring-fd N --event-fd N --output <path> --fps N "
+          "[options]\n");
+  return 2;
+}
+
+bool has_suffix(const std::string& value, const char* suffix) {
+  const size_t length = strlen(suffix);
+  return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+}
+
+bool parse_options(int argc, char** argv, HelperOptions* options) {
+  options->rcap_options.codec = recaster::default_frame_codec();
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char* name = argv[i];
+    const char* value = argv[i + 1];
+    bool valid = true;
+    if (strcmp(name, "--ring-fd") == 0) {
+      options->ring_fd = atoi(value);
+    } else if (strcmp(name, "--event-fd") == 0) {
+      options->event_fd = atoi(value);
+    } else if (strcmp(name, "--output") == 0) {
+      options->output_path = value;
+    } else if (strcmp(name, "--fps") == 0) {
+      options->fps = atoi(value);
+    } else if (strcmp(name, "--divisor") == 0) {
+      options->scale_options.resolution_divisor = atoi(value);
+    } else if (strcmp(name, "--scale") == 0) {
+      options->scale_options.scale = atof(value);
+    } else if (strcmp(name, "--max-width") == 0) {
+      options->scale_options.max_width = atoi(value);
+    } else if (strcmp(name, "--max-height") == 0) {
+      options->scale_options.max_height = atoi(value);
+    } else if (strcmp(name, "--filter") == 0) {
+      valid = recaster::parse_resample_filter(value, &options->scale_options.filter);
+    } else if (strcmp(name, "--pixel-format") == 0) {
+      valid = recaster::parse_pixel_format(value, &options->pixel_format);
+    } else if (strcmp(name, "--resize-policy") == 0) {
+      valid = recaster::parse_resize_policy(value, &options->resize_policy);
+    } else if (strcmp(name, "--buffer-compression") == 0) {
+      valid = recaster::parse_buffer_compression(value, &options->compression);
+    } else if (strcmp(name, "--codec") == 0) {
+      valid = recaster::parse_frame_codec(value, &options->rcap_options.codec) &&
+              recaster::frame_codec_available(options->rcap_options.codec);
+    } else if (strcmp(name, "--level") == 0) {
+      options->rcap_options.level = atoi(value);
+    } else if (strcmp(name, "--gif-palette") == 0) {
+      valid = recaster::parse_gif_palette(value, &options->gif_options.palette);
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      fprintf(stderr, "recaster-helper: invalid %s %s\n", name, value);
+      return false;
+    }
+  }
+  return options->ring_fd >= 0 && options->event_fd >= 0 && !options->output_path.empty() &&
+         options->fps > 0;
+}
+
+// Copies frames out of the ring until the plugin closes it or goes away.
+// Slots the plugin dropped because the ring was full are repeated, so the
+// recording keeps its timing.
+void receive_frames(recaster::ShmFrameRing* ring,
+                    recaster::FrameSink* sink,
+                    recaster::WorkerPool* workers) {
+  const pid_t parent = getppid();
+  uint64_t next_sequence = 0;
+  while (true) {
+    recaster::ShmFrameInfo info;
+    const uint8_t* pixels = ring->begin_read(&info);
+    if (pixels == nullptr && ring->closed()) {
+      // Frames committed just before the close are visible now.
+      pixels = ring->begin_read(&info);
+      if (pixels == nullptr) {
+        for (; next_sequence < ring->sequence_end(); ++next_sequence) {
+          sink->repeat_last();
+        }
+        return;
+      }
+    }
+    if (pixels == nullptr) {
+      if (!ring->wait(kParentCheckMs) && getppid() != parent) {
+        fprintf(stderr, "recaster-helper: the plugin exited; writing what was received\n");
+        return;
+      }
+      continue;
+    }
+
+    auto frame = std::make_shared<recaster::FrameData>();
+    frame->width = info.width;
+    frame->height = info.height;
+    frame->format = info.format;
+    frame->timestamp_us = info.timestamp_us;
+    frame->pixels.assign(pixels, pixels + info.size);
+    ring->end_read();
+
+    for (; next_sequence < info.sequence; ++next_sequence) {
+      sink->repeat_last();
+    }
+    next_sequence = info.sequence + 1;
+    if (frame->width > 0 && frame->height > 0 &&
+        frame->pixels.size() >=
+            recaster::frame_byte_size(frame->width, frame->height, frame->format)) {
+      sink->append(frame, workers);
+    }
+  }
+}
+
+// Writes every segment, one file per canvas size as the plugin does.
+bool write_recording(const HelperOptions& options,
+                     recaster::FrameSink* sink,
+                     recaster::WorkerPool* workers) {
+  const bool rcap = has_suffix(options.output_path, ".rcap");
+  const bool gif = has_suffix(options.output_path, ".gif");
+  const bool mp4 = has_suffix(options.output_path, ".mp4");
+  recaster::ImageSequenceOptions image_options;
+  const bool image_sequence =
+      recaster::image_format_for_path(options.output_path, &image_options.format);
+  const bool avi = !rcap && !gif && !mp4 && !image_sequence;
+  bool ok = true;
+  for (size_t i = 0; i < sink->segments().size(); ++i) {
+    const size_t frame_count = sink->segments()[i].frame_count();
+    if (i > 0 && frame_count == 0) {
+      continue;
+    }
+    const std::string path = recaster::segment_output_path(options.output_path, i);
+    const std::vector<recaster::FramePtr>& frames = sink->segments()[i].frames;
+    std::string error_message;
+    bool written = false;
+    std::string written_path = path;
+    if (avi && sink->segments()[i].store == nullptr) {
+      written = recaster::write_avi_file(path.c_str(), frames, options.fps, workers,
+                                         &error_message);
+    } else if (avi) {
+      written = recaster::write_avi_file(
+          path.c_str(), frame_count,
+          [sink, i, workers](size_t index) { return sink->frame_at(i, index, workers); },
+          options.fps, &error_message);
+    } else if (image_sequence) {
+      written = recaster::write_image_sequence(
+          path.c_str(), frame_count,
+          [sink, i, workers](size_t index) { return sink->frame_at(i, index, workers); },
+          options.fps, image_options, workers, &error_message);
+      written_path = recaster::image_sequence_manifest_path(path);
+    } else if (!sink->expand_segment(i, workers)) {
+      error_message = "Failed to decode buffered frames.";
+    } else if (rcap) {
+      written = recaster::write_rcap_file(path.c_str(), frames, options.fps,
+                                          options.rcap_options, workers, &error_message);
+    } else if (gif) {
+      written = recaster::write_gif_file(path.c_str(), frames, options.fps,
+                                         options.gif_options, workers, &error_message);
+    } else {
+#ifdef RECASTER_HAVE_GSTREAMER
+      written = recaster::write_mp4_file(path.c_str(), frames, options.fps,
+                                         recaster::Mp4Options(), &error_message);
+#else
+      error_message = "This helper was built without H.264 support.";
+#endif
+    }
+    sink->release_segment(i);
+    if (!written) {
+      fprintf(stderr, "recaster-helper: %s: %s\n", path.c_str(), error_message.c_str());
+      ok = false;
+      continue;
+    }
+    printf("%s\n", written_path.c_str());
+  }
+  fflush(stdout);
+  return ok;
+}
+
+}
+
+int main(int argc, char** argv) {
+  HelperOptions options;
+  if (argc % 2 != 1 || !parse_options(argc, argv, &options)) {
+    return usage();
+  }
+
+  recaster::ShmFrameRing ring;
+  std::string error_message;
+  if (!ring.attach(options.ring_fd, options.event_fd, &error_message)) {
+    fprintf(stderr, "recaster-helper: %s\n", error_message.c_str());
+    return 1;
+  }
+
+  recaster::WorkerPool workers(recaster::WorkerPool::default_thread_count());
+  recaster::FrameSink sink;
+  sink.configure(options.scale_options, options.pixel_format, options.resize_policy,
+                 options.compression);
+  receive_frames(&ring, &sink, &workers);
+  sink.restore_reduced(&workers);
+  return write_recording(options, &sink, &workers) ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef FLUTTER_PLUGIN_RECASTER_FRAME_TAP_H_
+#define FLUTTER_PLUGIN_RECASTER_FRAME_TAP_H_
+
+#include <stdint.h>
+
+#include "recaster_plugin.h"
+
+G_BEGIN_DECLS
+
+// C entry points for reading captured frames through Dart FFI without the
+// method channel's copies. A tap queues up to `capacity` of the frames
+// captured while a recording runs; a consumer that falls behind loses the
+// oldest ones instead of holding capture up. Frames are lent, not copied, and
+// must be given back with recaster_frame_tap_release. All functions are
+// thread safe.
+
+// Read only; valid until the frame is released.
+typedef struct {
+  const uint8_t* pixels;
+  int64_t timestamp_us;
+  // Position among the frames offered to the tap; gaps are drops.
+  uint64_t sequence;
+  int32_t width;
+  int32_t height;
+  // Bytes per row, which may be padded beyond the pixels.
+  int32_t stride;
+  // 0 = BGRA, 1 = BGR, 8 bits per channel. Captures are BGRA.
+  int32_t format;
+  void* reserved;
+} RecasterFrame;
+
+// Returns a tap id; capacity is clamped to 1..64.
+FLUTTER_PLUGIN_EXPORT int64_t recaster_frame_tap_open(int32_t capacity);
+
+// The oldest queued frame, or NULL when none is queued, `capacity` frames are
+// already lent out or the tap is closed.
+FLUTTER_PLUGIN_EXPORT const RecasterFrame* recaster_frame_tap_next(int64_t tap);
+
+FLUTTER_PLUGIN_EXPORT void recaster_frame_tap_release(const RecasterFrame* frame);
+
+FLUTTER_PLUGIN_EXPORT uint64_t recaster_frame_tap_dropped(int64_t tap);
+
+// Lent frames stay valid until they are released.
+FLUTTER_PLUGIN_EXPORT void recaster_frame_tap_close(int64_t tap);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,251 @@
+#include "mp4_writer.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef RECASTER_HAVE_GSTREAMER
+#include <gst/app/gstappsrc.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#endif
+
+namespace recaster {
+
+#ifdef RECASTER_HAVE_GSTREAMER
+
+namespace {
+
+void release_frame(gpointer data) {
+  delete static_cast<FramePtr*>(data);
+}
+
+// The buffer keeps the frame alive until the encoder is done with it. The
+// video meta describes the frame's own stride, so a `width` x `height` crop of
+// it is read in place.
+GstBuffer* wrap_frame(const FramePtr& frame, GstVideoFormat format, int width, int height) {
+  const gsize size = frame->pixels.size();
+  GstBuffer* buffer = gst_buffer_new_wrapped_full(
+      GST_MEMORY_FLAG_READONLY, const_cast<uint8_t*>(frame->pixels.data()), size, 0, size,
+      new FramePtr(frame), release_frame);
+  gsize offset[GST_VIDEO_MAX_PLANES] = {0};
+  gint stride[GST_VIDEO_MAX_PLANES] = {
+      static_cast<gint>(frame_row_bytes(frame->width, frame->format))};
+  gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE, format,
+                                 static_cast<guint>(width), static_cast<guint>(height), 1,
+                                 offset, stride);
+  return buffer;
+}
+
+std::string take_bus_error(GstElement* pipeline) {
+  GstBus* bus = gst_element_get_bus(pipeline);
+  GstMessage* message =
+      gst_bus_pop_filtered(bus, static_cast<GstMessageType>(GST_MESSAGE_ERROR));
+  gst_object_unref(bus);
+  if (message == nullptr) {
+    return "Encoder pipeline failed.";
+  }
+  GError* error = nullptr;
+  gst_message_parse_error(message, &error, nullptr);
+  std::string text = error != nullptr ? error->message : "Encoder pipeline failed.";
+  g_clear_error(&error);
+  gst_message_unref(message);
+  return text;
+}
+
+uint64_t file_size(const char* path) {
+  GStatBuf st;
+  return g_stat(path, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+}
+
+bool mp4_encoder_available() {
+  static gsize checked = 0;
+  static bool available = false;
+  if (g_once_init_enter(&checked)) {
+    GError* error = nullptr;
+    if (gst_init_check(nullptr, nullptr, &error)) {
+      available = true;
+      for (const char* name : {"appsrc", "videoconvert", "x264enc", "mp4mux", "filesink"}) {
+        GstElementFactory* factory = gst_element_factory_find(name);
+        if (factory == nullptr) {
+          g_warning("recaster: GStreamer element %s is not installed", name);
+          available = false;
+          break;
+        }
+        gst_object_unref(factory);
+      }
+    } else {
+      g_warning("recaster: GStreamer failed to initialise: %s",
+                error != nullptr ? error->message : "unknown error");
+      g_clear_error(&error);
+    }
+    g_once_init_leave(&checked, 1);
+  }
+  return available;
+}
+
+bool write_mp4_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    const Mp4Options& options,
+                    std::string* error_message,
+                    const WriteProgress& progress) {
+  if (frames.empty()) {
+    if (error_message != nullptr) {
+      *error_message = "No frames were captured.";
+    }
+    return false;
+  }
+  if (!mp4_encoder_available()) {
+    if (error_message != nullptr) {
+      *error_message = "The GStreamer H.264 encoder is not available.";
+    }
+    return false;
+  }
+
+  const FrameData& first = *frames.front();
+  // x264enc encodes 4:2:0, which needs even dimensions; odd frames lose their
+  // last column or row.
+  const int width = first.width & ~1;
+  const int height = first.height & ~1;
+  if (width == 0 || height == 0) {
+    if (error_message != nullptr) {
+      *error_message = "MP4 frames must be at least 2x2 pixels.";
+    }
+    return false;
+  }
+  const GstVideoFormat format =
+      first.format == PixelFormat::kBgr24 ? GST_VIDEO_FORMAT_BGR : GST_VIDEO_FORMAT_BGRx;
+  GstElement* pipeline = gst_pipeline_new("recaster-mp4");
+  GstElement* source = gst_element_factory_make("appsrc", nullptr);
+  GstElement* convert = gst_element_factory_make("videoconvert", nullptr);
+  GstElement* encoder = gst_element_factory_make("x264enc", nullptr);
+  GstElement* muxer = gst_element_factory_make("mp4mux", nullptr);
+  GstElement* file = gst_element_factory_make("filesink", nullptr);
+  if (pipeline == nullptr || source == nullptr || convert == nullptr || encoder == nullptr ||
+      muxer == nullptr || file == nullptr) {
+    for (GstElement* element : {pipeline, source, convert, encoder, muxer, file}) {
+      if (element != nullptr) {
+        gst_object_unref(element);
+      }
+    }
+    if (error_message != nullptr) {
+      *error_message = "Failed to create the encoder pipeline.";
+    }
+    return false;
+  }
+  gst_bin_add_many(GST_BIN(pipeline), source, convert, encoder, muxer, file, nullptr);
+  if (!gst_element_link_many(source, convert, encoder, muxer, file, nullptr)) {
+    gst_object_unref(pipeline);
+    if (error_message != nullptr) {
+      *error_message = "Failed to link the encoder pipeline.";
+    }
+    return false;
+  }
+
+  GstCaps* caps = gst_caps_new_simple(
+      "video/x-raw", "format", G_TYPE_STRING, gst_video_format_to_string(format), "width",
+      G_TYPE_INT, width, "height", G_TYPE_INT, height, "framerate", GST_TYPE_FRACTION, fps,
+      1, nullptr);
+  // Blocking on a few frames of queue keeps the encoder from pulling the
+  // whole recording into its own buffers.
+  g_object_set(source, "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE, "max-bytes",
+               static_cast<guint64>(first.pixels.size()) * 4U, nullptr);
+  gst_caps_unref(caps);
+  const int threads = options.threads > 0 ? options.threads
+                                          : static_cast<int>(g_get_num_processors());
+  g_object_set(encoder, "threads", static_cast<guint>(threads), "key-int-max",
+               static_cast<guint>(std::max(1, fps) * 2), nullptr);
+  gst_util_set_object_arg(G_OBJECT(encoder), "speed-preset", "veryfast");
+  g_object_set(file, "location", output_path, nullptr);
+
+  if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    const std::string text = take_bus_error(pipeline);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    if (error_message != nullptr) {
+      *error_message = text;
+    }
+    return false;
+  }
+
+  bool ok = true;
+  std::string failure;
+  const GstClockTime duration = gst_util_uint64_scale(1, GST_SECOND, static_cast<guint64>(fps));
+  guint64 index = 0;
+  for (const FramePtr& frame : frames) {
+    if (frame->width != first.width || frame->height != first.height ||
+        frame->format != first.format) {
+      continue;
+    }
+    GstBuffer* buffer = wrap_frame(frame, format, width, height);
+    GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(index, GST_SECOND, static_cast<guint64>(fps));
+    GST_BUFFER_DURATION(buffer) = duration;
+    ++index;
+    if (gst_app_src_push_buffer(GST_APP_SRC(source), buffer) != GST_FLOW_OK) {
+      ok = false;
+      failure = take_bus_error(pipeline);
+      break;
+    }
+    if (progress && !progress(static_cast<size_t>(index), file_size(output_path))) {
+      ok = false;
+      failure = "Write was cancelled.";
+      break;
+    }
+  }
+
+  if (ok) {
+    gst_app_src_end_of_stream(GST_APP_SRC(source));
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* message = gst_bus_timed_pop_filtered(
+        bus, GST_CLOCK_TIME_NONE,
+        static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    gst_object_unref(bus);
+    if (message != nullptr && GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+      GError* error = nullptr;
+      gst_message_parse_error(message, &error, nullptr);
+      ok = false;
+      failure = error != nullptr ? error->message : "Encoder pipeline failed.";
+      g_clear_error(&error);
+    }
+    if (message != nullptr) {
+      gst_message_unref(message);
+    }
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+  if (!ok && error_message != nullptr) {
+    *error_message = failure;
+  }
+  if (ok && progress) {
+    progress(static_cast<size_t>(index), file_size(output_path));
+  }
+  return ok;
+}
+
+#else
+
+bool mp4_encoder_available() {
+  return false;
+}
+
+bool write_mp4_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    const Mp4Options& options,
+                    std::string* error_message,
+                    const WriteProgress& progress) {
+  if (error_message != nullptr) {
+    *error_message = "This build does not include GStreamer.";
+  }
+  return false;
+}
+
+#endif
+
+}
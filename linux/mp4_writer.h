@@ -0,0 +1,35 @@
+#ifndef RECASTER_MP4_WRITER_H_
+#define RECASTER_MP4_WRITER_H_
+
+#include <string>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+struct Mp4Options {
+  // x264 encoder threads; 0 uses every core, which are idle once capture
+  // has stopped.
+  int threads = 0;
+};
+
+// True when the plugin was built with GStreamer and the appsrc, videoconvert,
+// x264enc and mp4mux elements are installed. Initialises GStreamer on first
+// use.
+bool mp4_encoder_available();
+
+// Encodes H.264 into an .mp4 through appsrc ! videoconvert ! x264enc ! mp4mux.
+// Frame buffers are handed to GStreamer without copying. Odd widths and heights
+// are cropped by one pixel to the even size H.264 needs. Frames whose size or
+// format differ from the first frame are skipped.
+bool write_mp4_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    const Mp4Options& options,
+                    std::string* error_message,
+                    const WriteProgress& progress = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include "preview_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <gtk/gtk.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace recaster {
+
+namespace {
+
+constexpr size_t kMaxClients = 8;
+constexpr size_t kMaxRequestBytes = 8192;
+
+const char kStreamHeader[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=recasterframe\r\n"
+    "Cache-Control: no-cache, no-store\r\n"
+    "Pragma: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+const char kForbidden[] =
+    "HTTP/1.0 403 Forbidden\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+const char kMethodNotAllowed[] =
+    "HTTP/1.0 405 Method Not Allowed\r\n"
+    "Allow: GET\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// Listening on loopback alone does not stop DNS rebinding: a remote page can
+// point its own name at 127.0.0.1. Browsers still send that name, so only a
+// loopback Host with our port is served.
+bool loopback_host(const std::string& request, int port) {
+  std::string lower = request;
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  const size_t header = lower.find("\r\nhost:");
+  if (header == std::string::npos) {
+    return false;
+  }
+  size_t begin = header + 7;
+  const size_t end = lower.find("\r\n", begin);
+  while (begin < end && (lower[begin] == ' ' || lower[begin] == '\t')) {
+    ++begin;
+  }
+  size_t last = end;
+  while (last > begin && (lower[last - 1] == ' ' || lower[last - 1] == '\t')) {
+    --last;
+  }
+  const std::string host = lower.substr(begin, last - begin);
+  const std::string suffix = ":" + std::to_string(port);
+  return host == "127.0.0.1" + suffix || host == "localhost" + suffix;
+}
+
+}
+
+PreviewServer::PreviewServer(const PreviewOptions& options) : options_(options) {
+  options_.fps = std::max(1, std::min(30, options_.fps));
+  options_.max_width = std::max(16, options_.max_width);
+  options_.quality = std::max(1, std::min(100, options_.quality));
+}
+
+PreviewServer::~PreviewServer() {
+  stopping_.store(true);
+  wake();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (Client& client : clients_) {
+    close(client.fd);
+  }
+  for (int fd : {listen_fd_, wake_fds_[0], wake_fds_[1]}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool PreviewServer::start(std::string* error_message) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    if (error_message != nullptr) {
+      *error_message = std::string("Failed to create preview socket: ") + strerror(errno);
+    }
+    return false;
+  }
+  const int reuse = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // Loopback only: the preview is for the local machine.
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(options_.port));
+  socklen_t length = sizeof(address);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(listen_fd_, static_cast<int>(kMaxClients)) != 0 ||
+      getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    if (error_message != nullptr) {
+      *error_message = std::string("Failed to listen for preview clients: ") + strerror(errno);
+    }
+    return false;
+  }
+  port_ = ntohs(address.sin_port);
+
+  if (pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+    if (error_message != nullptr) {
+      *error_message = std::string("Failed to create preview pipe: ") + strerror(errno);
+    }
+    return false;
+  }
+  thread_ = std::thread([this]() { run(); });
+  return true;
+}
+
+void PreviewServer::offer(const FramePtr& frame) {
+  if (frame == nullptr || frame->format != PixelFormat::kBgra32) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frame->timestamp_us < next_offer_us_) {
+      return;
+    }
+    const int64_t interval_us = 1000000 / options_.fps;
+    // Keep the preview on a fixed cadence unless capture fell behind it.
+    next_offer_us_ = frame->timestamp_us - next_offer_us_ < interval_us
+                         ? next_offer_us_ + interval_us
+                         : frame->timestamp_us + interval_us;
+    pending_ = frame;
+  }
+  wake();
+}
+
+void PreviewServer::wake() {
+  if (wake_fds_[1] >= 0) {
+    const char byte = 0;
+    // A full pipe already guarantees a wake-up.
+    ssize_t ignored = write(wake_fds_[1], &byte, 1);
+    (void)ignored;
+  }
+}
+
+void PreviewServer::run() {
+  // Lower than capture, higher than the thumbnail thread.
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+  std::vector<pollfd> fds;
+  while (!stopping_.load()) {
+    fds.clear();
+    fds.push_back({listen_fd_, POLLIN, 0});
+    fds.push_back({wake_fds_[0], POLLIN, 0});
+    for (const Client& client : clients_) {
+      const bool has_data = client.sending != nullptr || client.latest != nullptr;
+      fds.push_back({client.fd, static_cast<short>(POLLIN | (has_data ? POLLOUT : 0)), 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    for (size_t i = 0; i < clients_.size(); ++i) {
+      Client& client = clients_[i];
+      const short events = fds[i + 2].revents;
+      bool keep = (events & (POLLERR | POLLNVAL)) == 0;
+      if (keep && (events & (POLLIN | POLLHUP)) != 0) {
+        keep = read_request(&client);
+      }
+      if (keep && (events & POLLOUT) != 0) {
+        keep = write_client(&client);
+      }
+      client.closed = !keep;
+    }
+    clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                                  [](const Client& client) {
+                                    if (client.closed) {
+                                      close(client.fd);
+                                    }
+                                    return client.closed;
+                                  }),
+                   clients_.end());
+
+    if ((fds[0].revents & POLLIN) != 0) {
+      accept_clients();
+    }
+    if ((fds[1].revents & POLLIN) != 0) {
+      char drain[64];
+      while (read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+      }
+      FramePtr frame;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame = std::move(pending_);
+        pending_ = nullptr;
+      }
+      const bool watched = std::any_of(clients_.begin(), clients_.end(),
+                                       [](const Client& client) { return client.streaming; });
+      // Nobody is watching: skip the encode entirely.
+      if (frame != nullptr && watched) {
+        std::shared_ptr<const std::string> part = encode(*frame);
+        if (part != nullptr) {
+          last_part_ = part;
+          for (Client& client : clients_) {
+            if (!client.streaming) {
+              continue;
+            }
+            if (client.latest != nullptr) {
+              frames_skipped_.fetch_add(1);
+            }
+            client.latest = part;
+          }
+        }
+      }
+    }
+  }
+}
+
+void PreviewServer::accept_clients() {
+  for (;;) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    if (clients_.size() >= kMaxClients) {
+      close(fd);
+      continue;
+    }
+    Client client;
+    client.fd = fd;
+    clients_.push_back(std::move(client));
+  }
+}
+
+bool PreviewServer::read_request(Client* client) {
+  char buffer[1024];
+  for (;;) {
+    const ssize_t count = recv(client->fd, buffer, sizeof(buffer), 0);
+    if (count == 0) {
+      return false;
+    }
+    if (count < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    // Once streaming, anything the browser sends is ignored.
+    if (client->streaming || client->sending != nullptr) {
+      continue;
+    }
+    client->request.append(buffer, static_cast<size_t>(count));
+    if (client->request.find("\r\n\r\n") != std::string::npos) {
+      const bool get = client->request.compare(0, 4, "GET ") == 0;
+      const bool allowed = get && loopback_host(client->request, port_);
+      client->sending = std::make_shared<const std::string>(
+          allowed ? kStreamHeader : (get ? kForbidden : kMethodNotAllowed));
+      client->sent = 0;
+      client->streaming = allowed;
+      // A new viewer sees the last frame straight away.
+      client->latest = allowed ? last_part_ : nullptr;
+      client->request.clear();
+    } else if (client->request.size() > kMaxRequestBytes) {
+      return false;
+    }
+  }
+}
+
+bool PreviewServer::write_client(Client* client) {
+  for (;;) {
+    if (client->sending == nullptr) {
+      if (client->latest == nullptr) {
+        return true;
+      }
+      client->sending = std::move(client->latest);
+      client->latest = nullptr;
+      client->sent = 0;
+      frames_sent_.fetch_add(1);
+    }
+    const std::string& data = *client->sending;
+    const ssize_t count = send(client->fd, data.data() + client->sent, data.size() - client->sent,
+                               MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    client->sent += static_cast<size_t>(count);
+    if (client->sent < data.size()) {
+      continue;
+    }
+    client->sending = nullptr;
+    if (!client->streaming) {
+      // The 403 or 405 reply has gone out.
+      return false;
+    }
+  }
+}
+
+std::shared_ptr<const std::string> PreviewServer::encode(const FrameData& frame) {
+  if (frame.width <= 0 || frame.height <= 0) {
+    return nullptr;
+  }
+  const int width = std::min(options_.max_width, frame.width);
+  const int height = std::max(
+      1, static_cast<int>(static_cast<int64_t>(frame.height) * width / frame.width));
+  const uint8_t* bgra = frame.pixels.data();
+  if (width != frame.width || height != frame.height) {
+    scaled_.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * 4U);
+    resampler_.resample(frame.pixels.data(), frame.width, frame.height,
+                        frame_row_bytes(frame.width, frame.format), scaled_.data(), width,
+                        height, ResampleFilter::kBilinear, nullptr);
+    bgra = scaled_.data();
+  }
+  rgb_.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * 3U);
+  uint8_t* rgb = rgb_.data();
+  const size_t pixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+  for (size_t i = 0; i < pixels; ++i) {
+    rgb[0] = bgra[2];
+    rgb[1] = bgra[1];
+    rgb[2] = bgra[0];
+    bgra += 4;
+    rgb += 3;
+  }
+
+  GdkPixbuf* pixbuf = gdk_pixbuf_new_from_data(rgb_.data(), GDK_COLORSPACE_RGB, FALSE, 8, width,
+                                               height, width * 3, nullptr, nullptr);
+  if (pixbuf == nullptr) {
+    return nullptr;
+  }
+  const std::string quality = std::to_string(options_.quality);
+  gchar* jpeg = nullptr;
+  gsize jpeg_size = 0;
+  GError* error = nullptr;
+  const gboolean saved = gdk_pixbuf_save_to_buffer(pixbuf, &jpeg, &jpeg_size, "jpeg", &error,
+                                                   "quality", quality.c_str(), nullptr);
+  g_object_unref(pixbuf);
+  if (!saved) {
+    g_warning("recaster: preview frame was not encoded: %s",
+              error != nullptr ? error->message : "unknown error");
+    g_clear_error(&error);
+    return nullptr;
+  }
+
+  auto part = std::make_shared<std::string>();
+  part->reserve(jpeg_size + 96);
+  part->append("--recasterframe\r\nContent-Type: image/jpeg\r\nContent-Length: ");
+  part->append(std::to_string(jpeg_size));
+  part->append("\r\n\r\n");
+  part->append(jpeg, jpeg_size);
+  part->append("\r\n");
+  g_free(jpeg);
+  return part;
+}
+
+}
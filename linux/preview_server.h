@@ -0,0 +1,86 @@
+#ifndef RECASTER_PREVIEW_SERVER_H_
+#define RECASTER_PREVIEW_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_data.h"
+#include "frame_resampler.h"
+
+namespace recaster {
+
+struct PreviewOptions {
+  // 0 picks a free port; see PreviewServer::port().
+  int port = 0;
+  int fps = 5;
+  int max_width = 640;
+  int quality = 70;
+};
+
+// Serves the live capture to browsers on 127.0.0.1 as
+// multipart/x-mixed-replace JPEG. offer() only hands over a shared frame;
+// decimation, scaling, encoding and socket writes happen on the server
+// thread. Each client holds just the latest encoded frame, so a slow reader
+// skips frames instead of holding back the recording.
+class PreviewServer {
+ public:
+  explicit PreviewServer(const PreviewOptions& options);
+  ~PreviewServer();
+
+  PreviewServer(const PreviewServer&) = delete;
+  PreviewServer& operator=(const PreviewServer&) = delete;
+
+  bool start(std::string* error_message);
+  void offer(const FramePtr& frame);
+
+  int port() const { return port_; }
+  uint64_t frames_sent() const { return frames_sent_.load(); }
+  uint64_t frames_skipped() const { return frames_skipped_.load(); }
+
+ private:
+  struct Client {
+    int fd = -1;
+    std::string request;
+    bool streaming = false;
+    bool closed = false;
+    std::shared_ptr<const std::string> sending;
+    size_t sent = 0;
+    std::shared_ptr<const std::string> latest;
+  };
+
+  void run();
+  void accept_clients();
+  bool read_request(Client* client);
+  bool write_client(Client* client);
+  std::shared_ptr<const std::string> encode(const FrameData& frame);
+  void wake();
+
+  PreviewOptions options_;
+  int port_ = 0;
+  int listen_fd_ = -1;
+  int wake_fds_[2] = {-1, -1};
+  std::thread thread_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<uint64_t> frames_sent_{0};
+  std::atomic<uint64_t> frames_skipped_{0};
+
+  std::mutex mutex_;
+  FramePtr pending_;
+  int64_t next_offer_us_ = 0;
+
+  // Server thread only.
+  std::vector<Client> clients_;
+  std::shared_ptr<const std::string> last_part_;
+  FrameResampler resampler_;
+  std::vector<uint8_t> scaled_;
+  std::vector<uint8_t> rgb_;
+};
+
+}
+
+#endif
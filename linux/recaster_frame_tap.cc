@@ -0,0 +1,71 @@
+#include "include/recaster/recaster_frame_tap.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "frame_tap.h"
+#include "recaster_plugin_private.h"
+
+namespace {
+
+// Keeps the lent frame and its tap alive behind the public struct.
+struct FrameLease {
+  RecasterFrame frame = {};
+  recaster::FramePtr source;
+  std::shared_ptr<recaster::FrameTap> tap;
+};
+
+}
+
+recaster::FrameTapRegistry* frame_tap_registry() {
+  static recaster::FrameTapRegistry* registry = new recaster::FrameTapRegistry();
+  return registry;
+}
+
+int64_t recaster_frame_tap_open(int32_t capacity) {
+  return frame_tap_registry()->open(static_cast<size_t>(std::min(64, std::max(1, capacity))));
+}
+
+const RecasterFrame* recaster_frame_tap_next(int64_t tap) {
+  std::shared_ptr<recaster::FrameTap> frame_tap = frame_tap_registry()->find(tap);
+  if (frame_tap == nullptr) {
+    return nullptr;
+  }
+  recaster::FramePtr source;
+  uint64_t sequence = 0;
+  if (!frame_tap->take(&source, &sequence)) {
+    return nullptr;
+  }
+  FrameLease* lease = new FrameLease();
+  lease->frame.pixels = source->pixels.data();
+  lease->frame.timestamp_us = source->timestamp_us;
+  lease->frame.sequence = sequence;
+  lease->frame.width = source->width;
+  lease->frame.height = source->height;
+  const bool bgr = source->format == recaster::PixelFormat::kBgr24;
+  lease->frame.stride =
+      static_cast<int32_t>(recaster::frame_row_bytes(source->width, source->format));
+  lease->frame.format = bgr ? 1 : 0;
+  lease->frame.reserved = lease;
+  lease->source = std::move(source);
+  lease->tap = std::move(frame_tap);
+  return &lease->frame;
+}
+
+void recaster_frame_tap_release(const RecasterFrame* frame) {
+  if (frame == nullptr) {
+    return;
+  }
+  FrameLease* lease = static_cast<FrameLease*>(frame->reserved);
+  lease->tap->release();
+  delete lease;
+}
+
+uint64_t recaster_frame_tap_dropped(int64_t tap) {
+  std::shared_ptr<recaster::FrameTap> frame_tap = frame_tap_registry()->find(tap);
+  return frame_tap != nullptr ? frame_tap->dropped() : 0;
+}
+
+void recaster_frame_tap_close(int64_t tap) {
+  frame_tap_registry()->close(tap);
+}
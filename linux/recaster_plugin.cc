@@ -1,29 +1,121 @@
 #include "include/recaster/recaster_plugin.h"
 
+#include <dlfcn.h>
+#include <fcntl.h>
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
 #include <sys/utsname.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <glib/gstdio.h>
+#include <memory>
 #include <string>
 #include <unistd.h>
 #include <utility>
 #include <vector>
 
+#include "avi_edit.h"
+#include "avi_writer.h"
+#include "degradation_controller.h"
+#include "frame_blender.h"
+#include "frame_codec.h"
+#include "frame_data.h"
+#include "frame_hash.h"
+#include "frame_pool.h"
+#include "frame_resampler.h"
+#include "frame_sink.h"
+#include "gif_writer.h"
+#include "image_sequence_writer.h"
+#include "main_thread_budget.h"
+#include "mp4_writer.h"
+#include "preview_server.h"
+#include "rcap_format.h"
 #include "recaster_plugin_private.h"
+#include "shm_frame_ring.h"
+#include "thumbnail_sheet.h"
+#include "worker_pool.h"
+#include "x11_capture.h"
 
 #define RECASTER_PLUGIN(obj)                                                   \
   (G_TYPE_CHECK_INSTANCE_CAST((obj), recaster_plugin_get_type(),               \
                               RecasterPlugin))
 
-struct FrameData {
-  int32_t width = 0;
-  int32_t height = 0;
-  std::vector<uint8_t> pixels;
+constexpr int kMaxSinks = 8;
+constexpr int kMaxFps = 60;
+// Only reachable with highFrameRate, where a capture thread does the grabs.
+constexpr int kMaxHighFrameRateFps = 240;
+// The main thread collects paced frames at about 120 Hz; the ring holds
+// 50 ms at 240 fps so a slow callback does not cost frames.
+constexpr guint kPacedDrainIntervalMs = 8;
+constexpr size_t kPacedRingFrames = 12;
+// Slots shared with recaster-helper; each fits at least a 4K BGRA frame.
+constexpr size_t kHelperRingSlots = 8;
+constexpr size_t kHelperMinSlotBytes = 3840 * 2160 * 4;
+// Where recaster-helper finds the ring's memfd and eventfd.
+constexpr int kHelperRingFd = 3;
+constexpr int kHelperEventFd = 4;
+
+struct RecordingSink {
+  std::string output_path;
+  int fps = 30;
+  int tick_accumulator = 0;
+  bool due = false;
+  bool rcap = false;
+  bool mp4 = false;
+  bool gif = false;
+  // .png and .qoi outputs write one numbered file per frame.
+  bool image_sequence = false;
+  recaster::RcapOptions rcap_options;
+  recaster::Mp4Options mp4_options;
+  recaster::GifOptions gif_options;
+  recaster::ImageSequenceOptions image_options;
+  recaster::FrameSink pipeline;
+  std::unique_ptr<recaster::ThumbnailSheet> thumbnails;
+  // Set for .rhash outputs, which keep per-frame hashes instead of pixels.
+  std::unique_ptr<recaster::HashRecorder> hashes;
+  // Set for time-lapse outputs: captures are blended in groups and the file
+  // plays at `playback_fps` instead of `fps`.
+  std::unique_ptr<recaster::FrameBlender> blender;
+  int playback_fps = 0;
+};
+
+struct CaptureStats {
+  gint64 tick_interval_us;
+  gint64 last_tick_us;
+  guint64 ticks;
+  guint64 frames_captured;
+  guint64 frames_repeated;
+  guint64 frames_dropped;
+  guint64 resizes;
+  gint source_width;
+  gint source_height;
+  guint64 buffered_bytes;
+  gint64 last_stage_us;
+  gint64 total_stage_us;
+  guint64 frames_shared_memory;
+  gint64 total_readback_us;
+  bool high_frame_rate;
+  // High-frame-rate slots with no captured frame, filled by repeating.
+  guint64 frames_missed;
+  gint64 elapsed_us;
+};
+
+struct FinalizeJob {
+  std::vector<RecordingSink> sinks;
+  FlMethodCall* method_call = nullptr;
+  bool list_result = false;
+  recaster::WorkerPool* workers = nullptr;
+  std::atomic<bool> cancelled{false};
+  std::atomic<uint64_t> bytes_written{0};
+  std::atomic<uint64_t> frames_written{0};
+  uint64_t frames_total = 0;
+  gint64 start_time_us = 0;
+  std::vector<std::string> written_paths;
+  std::string error_message;
 };
 
 struct _RecasterPlugin {
@@ -31,59 +123,38 @@ struct _RecasterPlugin {
 
   bool is_recording;
   int fps;
-  int resolution_divisor;
+  gint64 start_time_us;
   guint capture_source_id;
-  gchar* current_output_path;
-  std::vector<FrameData>* frames;
+  std::vector<RecordingSink>* sinks;
+  recaster::WorkerPool* workers;
+  recaster::FramePool* frame_pool;
+  recaster::X11ShmCapture* shm_capture;
+  // Set while a highFrameRate capture runs.
+  recaster::X11PacedCapture* paced_capture;
+  // Set while an outOfProcess recording hands frames to recaster-helper; the
+  // process stays set until it has written the recording.
+  recaster::ShmFrameRing* helper_ring;
+  GSubprocess* helper;
+  bool helper_exited;
+  // Set once a frame was too large for the ring's slots.
+  bool helper_oversize_warned;
+  recaster::DegradationController* controller;
+  // Measures every tick; with a mainThreadBudget also sheds ticks over it.
+  recaster::MainThreadBudget* budget;
+  recaster::PreviewServer* preview;
+  CaptureStats stats;
+
+  // Set while sinks are written out on a worker after stop.
+  FinalizeJob* finalize_job;
+  guint progress_source_id;
+  FlEventChannel* progress_channel;
+  bool progress_listening;
 };
 
 G_DEFINE_TYPE(RecasterPlugin, recaster_plugin, g_object_get_type())
 
 namespace {
 
-void write_fourcc(std::ofstream& file, const char* value) {
-  file.write(value, 4);
-}
-
-void write_u32(std::ofstream& file, uint32_t value) {
-  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
-}
-
-void write_u16(std::ofstream& file, uint16_t value) {
-  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
-}
-
-uint32_t streampos_to_u32(std::streampos pos) {
-  return static_cast<uint32_t>(static_cast<std::streamoff>(pos));
-}
-
-std::streampos begin_chunk(std::ofstream& file, const char* fourcc) {
-  write_fourcc(file, fourcc);
-  const std::streampos size_pos = file.tellp();
-  write_u32(file, 0);
-  return size_pos;
-}
-
-void end_chunk(std::ofstream& file, std::streampos size_pos) {
-  const std::streampos end_pos = file.tellp();
-  uint32_t size = streampos_to_u32(end_pos - (size_pos + std::streamoff(4)));
-  file.seekp(size_pos);
-  write_u32(file, size);
-  file.seekp(end_pos);
-  if ((size & 1U) != 0U) {
-    const uint8_t pad = 0;
-    file.write(reinterpret_cast<const char*>(&pad), sizeof(pad));
-  }
-}
-
-std::streampos begin_list(std::ofstream& file, const char* list_type) {
-  write_fourcc(file, "LIST");
-  const std::streampos size_pos = file.tellp();
-  write_u32(file, 0);
-  write_fourcc(file, list_type);
-  return size_pos;
-}
-
 GtkWindow* find_target_window() {
   GList* windows = gtk_window_list_toplevels();
   for (GList* item = windows; item != nullptr; item = item->next) {
@@ -126,228 +197,350 @@ GtkWidget* find_flutter_view_widget(GtkWidget* root) {
   return nullptr;
 }
 
-bool capture_app_window_frame(FrameData* frame, int resolution_divisor) {
-  if (frame == nullptr) {
-    return false;
+void copy_pixbuf_to_rgba32(const guchar* src,
+                           int rowstride,
+                           int channels,
+                           int width,
+                           int height,
+                           bool swap_red_blue,
+                           uint8_t* dst_pixels) {
+  const int red = swap_red_blue ? 2 : 0;
+  const int blue = swap_red_blue ? 0 : 2;
+  for (int y = 0; y < height; ++y) {
+    const guchar* row = src + (static_cast<size_t>(y) * static_cast<size_t>(rowstride));
+    uint8_t* dst = dst_pixels +
+                   (static_cast<size_t>(y) * static_cast<size_t>(width) * 4U);
+    for (int x = 0; x < width; ++x) {
+      const guchar* pixel = row + static_cast<size_t>(x) * static_cast<size_t>(channels);
+      dst[0] = pixel[red];
+      dst[1] = pixel[1];
+      dst[2] = pixel[blue];
+      dst[3] = channels >= 4 ? pixel[3] : 255;
+      dst += 4;
+    }
   }
+}
 
+GdkWindow* find_app_gdk_window() {
   GtkWindow* window = find_target_window();
   if (window == nullptr) {
-    return false;
+    return nullptr;
   }
 
   GtkWidget* root_widget = GTK_WIDGET(window);
   GtkWidget* flutter_view = find_flutter_view_widget(root_widget);
   GtkWidget* target_widget = flutter_view != nullptr ? flutter_view : root_widget;
-  GdkWindow* gdk_window = gtk_widget_get_window(target_widget);
+  return gtk_widget_get_window(target_widget);
+}
+
+GdkPixbuf* read_app_window_pixbuf() {
+  GdkWindow* gdk_window = find_app_gdk_window();
   if (gdk_window == nullptr) {
-    return false;
+    return nullptr;
   }
 
   int width = 0;
   int height = 0;
   gdk_window_get_geometry(gdk_window, nullptr, nullptr, &width, &height);
   if (width <= 0 || height <= 0) {
-    return false;
+    return nullptr;
   }
 
   GdkPixbuf* pixbuf = gdk_pixbuf_get_from_window(gdk_window, 0, 0, width, height);
   if (pixbuf == nullptr) {
-    return false;
+    return nullptr;
   }
-
-  if (resolution_divisor > 1) {
-    const int scaled_width = std::max(1, width / resolution_divisor);
-    const int scaled_height = std::max(1, height / resolution_divisor);
-    GdkPixbuf* scaled = gdk_pixbuf_scale_simple(
-        pixbuf, scaled_width, scaled_height, GDK_INTERP_BILINEAR);
+  if (gdk_pixbuf_read_pixels(pixbuf) == nullptr ||
+      gdk_pixbuf_get_n_channels(pixbuf) < 3) {
     g_object_unref(pixbuf);
-    pixbuf = scaled;
-    if (pixbuf == nullptr) {
-      return false;
-    }
-    width = scaled_width;
-    height = scaled_height;
+    return nullptr;
   }
+  return pixbuf;
+}
 
-  const int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-  const int channels = gdk_pixbuf_get_n_channels(pixbuf);
-  const guchar* src = gdk_pixbuf_read_pixels(pixbuf);
-  if (src == nullptr || channels < 3) {
-    g_object_unref(pixbuf);
-    return false;
+// Reads the window back as BGRA into a pooled buffer, through MIT-SHM when
+// the X server allows it and GDK otherwise. Returns nullptr when the window
+// cannot be read.
+std::shared_ptr<recaster::FrameData> capture_app_window_frame(RecasterPlugin* self) {
+  GdkWindow* gdk_window = find_app_gdk_window();
+  if (gdk_window == nullptr) {
+    return nullptr;
+  }
+  std::shared_ptr<recaster::FrameData> frame =
+      self->shm_capture->capture(gdk_window, self->frame_pool);
+  if (frame != nullptr) {
+    ++self->stats.frames_shared_memory;
+    return frame;
   }
 
-  frame->width = width;
-  frame->height = height;
-  frame->pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * 4U);
-
-  for (int y = 0; y < height; ++y) {
-    const guchar* row = src + (static_cast<size_t>(y) * static_cast<size_t>(rowstride));
-    uint8_t* dst = frame->pixels.data() +
-                   (static_cast<size_t>(y) * static_cast<size_t>(width) * 4U);
-    for (int x = 0; x < width; ++x) {
-      const guchar* pixel = row + static_cast<size_t>(x) * static_cast<size_t>(channels);
-      dst[0] = pixel[2];
-      dst[1] = pixel[1];
-      dst[2] = pixel[0];
-      dst[3] = channels >= 4 ? pixel[3] : 255;
-      dst += 4;
-    }
+  GdkPixbuf* pixbuf = read_app_window_pixbuf();
+  if (pixbuf == nullptr) {
+    return nullptr;
   }
 
+  const int width = gdk_pixbuf_get_width(pixbuf);
+  const int height = gdk_pixbuf_get_height(pixbuf);
+  frame = self->frame_pool->acquire(static_cast<size_t>(width) * static_cast<size_t>(height) * 4U);
+  frame->width = width;
+  frame->height = height;
+  frame->format = recaster::PixelFormat::kBgra32;
+  copy_pixbuf_to_rgba32(gdk_pixbuf_read_pixels(pixbuf), gdk_pixbuf_get_rowstride(pixbuf),
+                        gdk_pixbuf_get_n_channels(pixbuf), width, height, true,
+                        frame->pixels.data());
   g_object_unref(pixbuf);
-  return true;
+  return frame;
 }
 
-bool write_avi_file(const char* output_path,
-                    const std::vector<FrameData>& frames,
-                    int fps,
-                    std::string* error_message) {
-  if (output_path == nullptr || strlen(output_path) == 0) {
-    if (error_message != nullptr) {
-      *error_message = "outputPath is required.";
-    }
+// Reads the window back as BGRA straight into `dst`, for frames handed to
+// recaster-helper. False when the window cannot be read or does not fit; in
+// the latter case `width` and `height` hold its size.
+bool capture_app_window_into(RecasterPlugin* self,
+                             uint8_t* dst,
+                             size_t capacity,
+                             int* width,
+                             int* height) {
+  *width = 0;
+  *height = 0;
+  GdkWindow* gdk_window = find_app_gdk_window();
+  if (gdk_window == nullptr) {
     return false;
   }
-
-  if (frames.empty()) {
-    if (error_message != nullptr) {
-      *error_message = "No frames were captured.";
-    }
+  if (self->shm_capture->capture_to(gdk_window, dst, capacity, width, height)) {
+    ++self->stats.frames_shared_memory;
+    return true;
+  }
+  if (*width > 0) {
+    // Read but too large; GDK would read the same size.
     return false;
   }
 
-  const int width = frames.front().width;
-  const int height = frames.front().height;
-  if (width <= 0 || height <= 0) {
-    if (error_message != nullptr) {
-      *error_message = "Invalid frame size.";
-    }
+  GdkPixbuf* pixbuf = read_app_window_pixbuf();
+  if (pixbuf == nullptr) {
     return false;
   }
+  *width = gdk_pixbuf_get_width(pixbuf);
+  *height = gdk_pixbuf_get_height(pixbuf);
+  const bool fits = static_cast<size_t>(*width) * static_cast<size_t>(*height) * 4U <= capacity;
+  if (fits) {
+    copy_pixbuf_to_rgba32(gdk_pixbuf_read_pixels(pixbuf), gdk_pixbuf_get_rowstride(pixbuf),
+                          gdk_pixbuf_get_n_channels(pixbuf), *width, *height, true, dst);
+  }
+  g_object_unref(pixbuf);
+  return fits;
+}
+
+void offer_thumbnail(RecordingSink* sink, const recaster::FramePtr& frame) {
+  if (sink->thumbnails != nullptr) {
+    sink->thumbnails->offer(static_cast<int64_t>(sink->pipeline.frame_count()) - 1, frame);
+  }
+}
 
-  const uint32_t frame_size = static_cast<uint32_t>(
-      static_cast<uint64_t>(width) * static_cast<uint64_t>(height) * 4ULL);
+size_t store_sink_frame(RecordingSink* sink,
+                        const recaster::FramePtr& source,
+                        recaster::WorkerPool* workers,
+                        int divisor_boost) {
+  if (sink->hashes != nullptr) {
+    sink->hashes->append(source, workers);
+    return 0;
+  }
+  const size_t count = sink->pipeline.frame_count();
+  const size_t bytes = sink->pipeline.append(source, workers, divisor_boost);
+  if (sink->pipeline.frame_count() > count) {
+    // Thumbnails take BGRA; converted frames fall back to the capture.
+    const recaster::FramePtr stored = sink->pipeline.last_frame();
+    offer_thumbnail(sink, stored->format == recaster::PixelFormat::kBgra32 ? stored : source);
+  }
+  return bytes;
+}
 
-  std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
-  if (!file.is_open()) {
-    if (error_message != nullptr) {
-      *error_message = "Failed to open output file.";
-    }
-    return false;
+// Returns the bytes newly buffered for this sink; see FrameSink::append.
+// Time-lapse sinks only store a frame once a group of captures is blended.
+size_t append_sink_frame(RecordingSink* sink,
+                         const recaster::FramePtr& source,
+                         recaster::WorkerPool* workers,
+                         int divisor_boost) {
+  if (sink->blender == nullptr) {
+    return store_sink_frame(sink, source, workers, divisor_boost);
   }
+  const recaster::FramePtr blended = sink->blender->add(source, workers);
+  return blended != nullptr ? store_sink_frame(sink, blended, workers, divisor_boost) : 0;
+}
 
-  struct IndexEntry {
-    uint32_t offset = 0;
-    uint32_t size = 0;
-  };
-  std::vector<IndexEntry> index_entries;
-  index_entries.reserve(frames.size());
-
-  const std::streampos riff_size_pos = begin_chunk(file, "RIFF");
-  write_fourcc(file, "AVI ");
-
-  const std::streampos hdrl_size_pos = begin_list(file, "hdrl");
-
-  const std::streampos avih_size_pos = begin_chunk(file, "avih");
-  write_u32(file, static_cast<uint32_t>(1000000 / std::max(1, fps)));
-  write_u32(file, frame_size * static_cast<uint32_t>(fps));
-  write_u32(file, 0);
-  write_u32(file, 0x10);
-  write_u32(file, static_cast<uint32_t>(frames.size()));
-  write_u32(file, 0);
-  write_u32(file, 1);
-  write_u32(file, frame_size);
-  write_u32(file, static_cast<uint32_t>(width));
-  write_u32(file, static_cast<uint32_t>(height));
-  write_u32(file, 0);
-  write_u32(file, 0);
-  write_u32(file, 0);
-  write_u32(file, 0);
-  end_chunk(file, avih_size_pos);
-
-  const std::streampos strl_size_pos = begin_list(file, "strl");
-
-  const std::streampos strh_size_pos = begin_chunk(file, "strh");
-  write_fourcc(file, "vids");
-  write_fourcc(file, "DIB ");
-  write_u32(file, 0);
-  write_u16(file, 0);
-  write_u16(file, 0);
-  write_u32(file, 0);
-  write_u32(file, 1);
-  write_u32(file, static_cast<uint32_t>(std::max(1, fps)));
-  write_u32(file, 0);
-  write_u32(file, static_cast<uint32_t>(frames.size()));
-  write_u32(file, frame_size);
-  write_u32(file, 0xFFFFFFFF);
-  write_u32(file, 0);
-  write_u16(file, 0);
-  write_u16(file, 0);
-  write_u16(file, static_cast<uint16_t>(width));
-  write_u16(file, static_cast<uint16_t>(height));
-  end_chunk(file, strh_size_pos);
-
-  const std::streampos strf_size_pos = begin_chunk(file, "strf");
-  write_u32(file, 40);
-  write_u32(file, static_cast<uint32_t>(width));
-  write_u32(file, static_cast<uint32_t>(static_cast<int32_t>(-height)));
-  write_u16(file, 1);
-  write_u16(file, 32);
-  write_u32(file, 0);
-  write_u32(file, frame_size);
-  write_u32(file, 0);
-  write_u32(file, 0);
-  write_u32(file, 0);
-  write_u32(file, 0);
-  end_chunk(file, strf_size_pos);
-
-  end_chunk(file, strl_size_pos);
-  end_chunk(file, hdrl_size_pos);
-
-  const std::streampos movi_size_pos = begin_list(file, "movi");
-  const std::streampos movi_data_start = file.tellp();
-
-  for (const FrameData& frame : frames) {
-    if (frame.width != width || frame.height != height ||
-        frame.pixels.size() != frame_size) {
-      continue;
+// One output slot. In high-frame-rate mode `paced` is the frame the capture
+// thread grabbed for the slot, or null when it has none; otherwise the window
+// is read back here.
+void run_capture_tick(RecasterPlugin* self, const recaster::FramePtr& paced) {
+  CaptureStats& stats = self->stats;
+  const bool high_frame_rate = self->paced_capture != nullptr;
+  const gint64 tick_start_us = g_get_monotonic_time();
+  // Paced frames are collected in bursts, so their slots keep the nominal
+  // interval.
+  const gint64 interval_us = stats.last_tick_us > 0 && !high_frame_rate
+                                 ? tick_start_us - stats.last_tick_us
+                                 : stats.tick_interval_us;
+  stats.last_tick_us = tick_start_us;
+  ++stats.ticks;
+
+  bool any_due = false;
+  for (RecordingSink& sink : *self->sinks) {
+    sink.tick_accumulator += sink.fps;
+    sink.due = sink.tick_accumulator >= self->fps;
+    if (sink.due) {
+      sink.tick_accumulator -= self->fps;
+      any_due = true;
     }
+  }
 
-    const std::streampos chunk_start = file.tellp();
-    const std::streampos frame_size_pos = begin_chunk(file, "00db");
-    file.write(reinterpret_cast<const char*>(frame.pixels.data()),
-               static_cast<std::streamsize>(frame.pixels.size()));
-    end_chunk(file, frame_size_pos);
-
-    IndexEntry entry;
-    entry.offset = streampos_to_u32(chunk_start - movi_data_start);
-    entry.size = static_cast<uint32_t>(frame.pixels.size());
-    index_entries.push_back(entry);
+  recaster::DegradationController* controller = self->controller;
+  const recaster::DegradationState& state = controller->state();
+  const int compression_level = controller->buffer_compression_level();
+  for (RecordingSink& sink : *self->sinks) {
+    sink.pipeline.set_compression_level(compression_level);
+  }
+  const bool drop = any_due && controller->should_drop(stats.buffered_bytes);
+  const bool skip = any_due && !drop &&
+                    (stats.ticks % static_cast<guint64>(state.fps_step) != 0 ||
+                     (high_frame_rate && paced == nullptr));
+  // Only a tick that would capture is weighed against the budget.
+  const bool shed = any_due && !drop && !skip && !self->budget->admit(tick_start_us);
+  bool captured = false;
+  if (drop) {
+    ++stats.frames_dropped;
+  } else if (skip || shed) {
+    // Repeating the previous frame keeps the output's timing intact while the
+    // readback is skipped.
+    for (RecordingSink& sink : *self->sinks) {
+      if (!sink.due) {
+        continue;
+      }
+      if (sink.blender != nullptr) {
+        // The skipped capture still counts towards its group.
+        const recaster::FramePtr last = sink.blender->last();
+        if (last != nullptr) {
+          stats.buffered_bytes +=
+              append_sink_frame(&sink, last, self->workers, state.divisor_boost);
+          ++stats.frames_repeated;
+        }
+        continue;
+      }
+      const bool repeated = sink.hashes != nullptr ? sink.hashes->repeat_last()
+                                                   : sink.pipeline.repeat_last();
+      if (repeated) {
+        ++stats.frames_repeated;
+      }
+    }
+  } else if (any_due) {
+    recaster::FramePtr source = paced;
+    if (!high_frame_rate) {
+      const gint64 readback_start_us = g_get_monotonic_time();
+      std::shared_ptr<recaster::FrameData> frame = capture_app_window_frame(self);
+      stats.total_readback_us += g_get_monotonic_time() - readback_start_us;
+      if (frame != nullptr) {
+        frame->timestamp_us = g_get_monotonic_time() - self->start_time_us;
+        source = std::move(frame);
+      }
+    }
+    if (source != nullptr) {
+      if (stats.source_width != 0 &&
+          (source->width != stats.source_width || source->height != stats.source_height)) {
+        ++stats.resizes;
+      }
+      stats.source_width = source->width;
+      stats.source_height = source->height;
+      if (self->preview != nullptr) {
+        self->preview->offer(source);
+      }
+      frame_tap_registry()->offer(source);
+      bool source_kept = false;
+      for (RecordingSink& sink : *self->sinks) {
+        if (sink.due) {
+          stats.buffered_bytes +=
+              append_sink_frame(&sink, source, self->workers, state.divisor_boost);
+          // A compressed buffer only holds the capture until it is packed.
+          source_kept = source_kept ||
+                        (sink.pipeline.compression() == recaster::BufferCompression::kNone &&
+                         sink.pipeline.last_frame() == source);
+        }
+      }
+      if (source_kept) {
+        stats.buffered_bytes += source->pixels.size();
+      }
+      ++stats.frames_captured;
+      captured = true;
+    }
   }
 
-  end_chunk(file, movi_size_pos);
+  const gint64 now_us = g_get_monotonic_time();
+  stats.elapsed_us = now_us - self->start_time_us;
+  stats.last_stage_us = now_us - tick_start_us;
+  stats.total_stage_us += stats.last_stage_us;
+  self->budget->record(tick_start_us, stats.last_stage_us, !captured);
+  controller->observe(now_us, stats.last_stage_us, interval_us, stats.tick_interval_us,
+                      stats.buffered_bytes);
+}
 
-  const std::streampos idx1_size_pos = begin_chunk(file, "idx1");
-  for (const IndexEntry& entry : index_entries) {
-    write_fourcc(file, "00db");
-    write_u32(file, 0x10);
-    write_u32(file, entry.offset);
-    write_u32(file, entry.size);
+// One output slot of an outOfProcess recording. The window is read back
+// into the ring's next free slot and recaster-helper does the rest; when the
+// ring is full the frame is dropped and the helper repeats the previous one
+// in its place.
+void run_helper_tick(RecasterPlugin* self) {
+  CaptureStats& stats = self->stats;
+  const gint64 tick_start_us = g_get_monotonic_time();
+  stats.last_tick_us = tick_start_us;
+  const guint64 sequence = stats.ticks++;
+  if (!self->helper_exited && g_subprocess_get_identifier(self->helper) == nullptr) {
+    // Stop reports the helper's error; the application carries on.
+    self->helper_exited = true;
+    g_warning("recaster: recaster-helper exited during the recording");
   }
-  end_chunk(file, idx1_size_pos);
-
-  end_chunk(file, riff_size_pos);
-  file.flush();
 
-  if (!file.good()) {
-    if (error_message != nullptr) {
-      *error_message = "Failed to finalize AVI output.";
+  // A shed tick is dropped like one that finds the ring full.
+  const bool shed = !self->helper_exited && !self->budget->admit(tick_start_us);
+  uint8_t* slot =
+      self->helper_exited || shed ? nullptr : self->helper_ring->begin_write();
+  bool captured = false;
+  if (slot == nullptr) {
+    ++stats.frames_dropped;
+  } else {
+    int width = 0;
+    int height = 0;
+    const gint64 readback_start_us = g_get_monotonic_time();
+    const bool read = capture_app_window_into(self, slot, self->helper_ring->slot_capacity(),
+                                              &width, &height);
+    stats.total_readback_us += g_get_monotonic_time() - readback_start_us;
+    if (read) {
+      recaster::ShmFrameInfo info;
+      info.sequence = sequence;
+      info.timestamp_us = g_get_monotonic_time() - self->start_time_us;
+      info.width = width;
+      info.height = height;
+      info.size = static_cast<uint64_t>(width) * static_cast<uint64_t>(height) * 4U;
+      self->helper_ring->commit_write(info);
+      if (stats.source_width != 0 &&
+          (width != stats.source_width || height != stats.source_height)) {
+        ++stats.resizes;
+      }
+      stats.source_width = width;
+      stats.source_height = height;
+      ++stats.frames_captured;
+      captured = true;
+    } else {
+      // The slot stays unpublished and the helper repeats the previous frame.
+      ++stats.frames_dropped;
+      if (width > 0 && !self->helper_oversize_warned) {
+        self->helper_oversize_warned = true;
+        g_warning("recaster: the window grew to %dx%d, too large for the outOfProcess "
+                  "frame slots; its frames are dropped until it shrinks",
+                  width, height);
+      }
     }
-    return false;
   }
-  return true;
+
+  const gint64 now_us = g_get_monotonic_time();
+  stats.elapsed_us = now_us - self->start_time_us;
+  stats.last_stage_us = now_us - tick_start_us;
+  stats.total_stage_us += stats.last_stage_us;
+  self->budget->record(tick_start_us, stats.last_stage_us, !captured);
 }
 
 gboolean on_capture_tick(gpointer user_data) {
@@ -355,38 +548,68 @@ gboolean on_capture_tick(gpointer user_data) {
   if (!self->is_recording) {
     return G_SOURCE_REMOVE;
   }
-
-  FrameData frame;
-  if (capture_app_window_frame(&frame, self->resolution_divisor)) {
-    if (self->frames->empty() ||
-        (frame.width == self->frames->front().width &&
-         frame.height == self->frames->front().height)) {
-      self->frames->push_back(std::move(frame));
-    }
+  if (self->helper_ring != nullptr) {
+    run_helper_tick(self);
+  } else {
+    run_capture_tick(self, nullptr);
   }
   return G_SOURCE_CONTINUE;
 }
 
-FlMethodResponse* start_recording(RecasterPlugin* self, FlMethodCall* method_call) {
-  if (self->is_recording) {
-    return FL_METHOD_RESPONSE(fl_method_error_response_new(
-        "already_recording", "Screen recording is already running.", nullptr));
+// The view's area in root window device pixels, or false when it is not
+// mapped.
+bool find_app_capture_rect(recaster::CaptureRect* rect) {
+  GdkWindow* gdk_window = find_app_gdk_window();
+  if (gdk_window == nullptr) {
+    return false;
+  }
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+  gdk_window_get_origin(gdk_window, &x, &y);
+  gdk_window_get_geometry(gdk_window, nullptr, nullptr, &width, &height);
+  if (width <= 0 || height <= 0) {
+    return false;
   }
+  const int scale = gdk_window_get_scale_factor(gdk_window);
+  rect->x = x * scale;
+  rect->y = y * scale;
+  rect->width = width * scale;
+  rect->height = height * scale;
+  return true;
+}
 
-  FlValue* args = fl_method_call_get_args(method_call);
-  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
-    return FL_METHOD_RESPONSE(fl_method_error_response_new(
-        "invalid_args", "Arguments are required.", nullptr));
+// Runs one tick per paced frame. Slots the capture thread missed, by falling
+// behind or by overflowing the ring, repeat the previous frame so the output
+// keeps real time.
+void drain_paced_frames(RecasterPlugin* self) {
+  recaster::FramePtr frame;
+  while (self->paced_capture->pop(&frame)) {
+    const guint64 slot = static_cast<guint64>(
+        std::max<int64_t>(0, frame->timestamp_us) * self->fps / 1000000);
+    while (self->stats.ticks < slot) {
+      ++self->stats.frames_missed;
+      run_capture_tick(self, nullptr);
+    }
+    run_capture_tick(self, frame);
   }
+}
 
-  FlValue* output_path_value = fl_value_lookup_string(args, "outputPath");
-  if (output_path_value == nullptr ||
-      fl_value_get_type(output_path_value) != FL_VALUE_TYPE_STRING) {
-    return FL_METHOD_RESPONSE(fl_method_error_response_new(
-        "invalid_args", "outputPath is required.", nullptr));
+gboolean on_paced_capture_drain(gpointer user_data) {
+  RecasterPlugin* self = RECASTER_PLUGIN(user_data);
+  if (!self->is_recording) {
+    return G_SOURCE_REMOVE;
+  }
+  recaster::CaptureRect rect;
+  if (find_app_capture_rect(&rect)) {
+    self->paced_capture->set_rect(rect);
   }
+  drain_paced_frames(self);
+  return G_SOURCE_CONTINUE;
+}
 
-  const gchar* output_path = fl_value_get_string(output_path_value);
+FlMethodResponse* prepare_output_path(const gchar* output_path) {
   if (output_path == nullptr || strlen(output_path) == 0) {
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
         "invalid_args", "outputPath is required.", nullptr));
@@ -409,98 +632,1555 @@ FlMethodResponse* start_recording(RecasterPlugin* self, FlMethodCall* method_cal
   }
   close(probe_fd);
   g_remove(probe_template);
+  return nullptr;
+}
 
-  int fps = 30;
-  int resolution_divisor = 1;
+int parse_fps(FlValue* args, int fallback, int max_fps) {
   FlValue* fps_value = fl_value_lookup_string(args, "fps");
   if (fps_value != nullptr && fl_value_get_type(fps_value) == FL_VALUE_TYPE_INT) {
     const gint64 value = fl_value_get_int(fps_value);
-    if (value > 0 && value <= 60) {
-      fps = static_cast<int>(value);
+    if (value > 0 && value <= max_fps) {
+      return static_cast<int>(value);
     }
   }
+  return fallback;
+}
+
+FlMethodResponse* parse_scale_options(FlValue* args,
+                                      recaster::ScaleOptions* scale_options) {
   FlValue* divisor_value = fl_value_lookup_string(args, "resolutionDivisor");
   if (divisor_value != nullptr &&
       fl_value_get_type(divisor_value) == FL_VALUE_TYPE_INT) {
     const gint64 value = fl_value_get_int(divisor_value);
     if (value > 0 && value <= 8) {
-      resolution_divisor = static_cast<int>(value);
+      scale_options->resolution_divisor = static_cast<int>(value);
     }
   }
+  FlValue* scale_value = fl_value_lookup_string(args, "scale");
+  if (scale_value != nullptr &&
+      fl_value_get_type(scale_value) == FL_VALUE_TYPE_FLOAT) {
+    const double value = fl_value_get_float(scale_value);
+    if (value > 0.0 && value <= 1.0) {
+      scale_options->scale = value;
+    }
+  }
+  FlValue* max_width_value = fl_value_lookup_string(args, "maxWidth");
+  if (max_width_value != nullptr &&
+      fl_value_get_type(max_width_value) == FL_VALUE_TYPE_INT) {
+    const gint64 value = fl_value_get_int(max_width_value);
+    if (value > 0 && value <= 16384) {
+      scale_options->max_width = static_cast<int>(value);
+    }
+  }
+  FlValue* max_height_value = fl_value_lookup_string(args, "maxHeight");
+  if (max_height_value != nullptr &&
+      fl_value_get_type(max_height_value) == FL_VALUE_TYPE_INT) {
+    const gint64 value = fl_value_get_int(max_height_value);
+    if (value > 0 && value <= 16384) {
+      scale_options->max_height = static_cast<int>(value);
+    }
+  }
+  FlValue* filter_value = fl_value_lookup_string(args, "filter");
+  if (filter_value != nullptr &&
+      fl_value_get_type(filter_value) == FL_VALUE_TYPE_STRING) {
+    if (!recaster::parse_resample_filter(fl_value_get_string(filter_value),
+                                         &scale_options->filter)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "filter must be bilinear, bicubic or lanczos3.", nullptr));
+    }
+  }
+  return nullptr;
+}
 
-  self->frames->clear();
-  g_clear_pointer(&self->current_output_path, g_free);
-  self->current_output_path = g_strdup(output_path);
-  self->fps = fps;
-  self->resolution_divisor = resolution_divisor;
-  self->is_recording = true;
-
-  const guint interval = static_cast<guint>(std::max(1, 1000 / std::max(1, fps)));
-  self->capture_source_id = g_timeout_add(interval, on_capture_tick, self);
+FlMethodResponse* parse_sink(FlValue* args, int session_fps, RecordingSink* sink) {
+  FlValue* output_path_value = fl_value_lookup_string(args, "outputPath");
+  if (output_path_value == nullptr ||
+      fl_value_get_type(output_path_value) != FL_VALUE_TYPE_STRING) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "outputPath is required.", nullptr));
+  }
+  const gchar* output_path = fl_value_get_string(output_path_value);
+  FlMethodResponse* path_error = prepare_output_path(output_path);
+  if (path_error != nullptr) {
+    return path_error;
+  }
+  sink->output_path = output_path;
+  if (g_str_has_suffix(output_path, ".mp4")) {
+    sink->mp4 = recaster::mp4_encoder_available();
+    if (!sink->mp4) {
+      // Keep the recording rather than failing: write AVI next to the
+      // requested path and report that path from stop.
+      sink->output_path.replace(sink->output_path.size() - 4, 4, ".avi");
+      g_warning("recaster: H.264 encoding is unavailable; writing %s instead",
+                sink->output_path.c_str());
+    }
+  }
+  sink->fps = std::min(session_fps, parse_fps(args, session_fps, kMaxHighFrameRateFps));
+  sink->tick_accumulator = session_fps - sink->fps;
+  if (g_str_has_suffix(output_path, ".rhash")) {
+    recaster::HashOptions hash_options;
+    FlValue* tiles_value = fl_value_lookup_string(args, "hashTiles");
+    if (tiles_value != nullptr && fl_value_get_type(tiles_value) == FL_VALUE_TYPE_INT) {
+      hash_options.tile_columns = static_cast<int>(
+          std::min<gint64>(32, std::max<gint64>(1, fl_value_get_int(tiles_value))));
+      hash_options.tile_rows = hash_options.tile_columns;
+    }
+    sink->hashes = std::make_unique<recaster::HashRecorder>(hash_options);
+  }
 
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  recaster::ScaleOptions scale_options;
+  FlMethodResponse* scale_error = parse_scale_options(args, &scale_options);
+  if (scale_error != nullptr) {
+    return scale_error;
+  }
+  recaster::PixelFormat pixel_format = recaster::PixelFormat::kBgra32;
+  FlValue* format_value = fl_value_lookup_string(args, "pixelFormat");
+  if (format_value != nullptr &&
+      fl_value_get_type(format_value) == FL_VALUE_TYPE_STRING) {
+    if (!recaster::parse_pixel_format(fl_value_get_string(format_value),
+                                      &pixel_format)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "pixelFormat must be bgra32 or bgr24.", nullptr));
+    }
+  }
+  recaster::ResizePolicy resize_policy = recaster::ResizePolicy::kLetterbox;
+  FlValue* resize_value = fl_value_lookup_string(args, "resizePolicy");
+  if (resize_value != nullptr &&
+      fl_value_get_type(resize_value) == FL_VALUE_TYPE_STRING) {
+    if (!recaster::parse_resize_policy(fl_value_get_string(resize_value),
+                                       &resize_policy)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "resizePolicy must be letterbox, scale, crop or segment.",
+          nullptr));
+    }
+  }
+  recaster::BufferCompression compression = recaster::BufferCompression::kNone;
+  FlValue* compression_value = fl_value_lookup_string(args, "bufferCompression");
+  if (compression_value != nullptr &&
+      fl_value_get_type(compression_value) == FL_VALUE_TYPE_STRING) {
+    if (!recaster::parse_buffer_compression(fl_value_get_string(compression_value),
+                                            &compression)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "bufferCompression must be none, frame or delta.", nullptr));
+    }
+  }
+  sink->pipeline.configure(scale_options, pixel_format, resize_policy, compression);
+  sink->rcap = g_str_has_suffix(output_path, ".rcap");
+  sink->rcap_options.codec = recaster::default_frame_codec();
+  FlValue* codec_value = fl_value_lookup_string(args, "codec");
+  if (codec_value != nullptr &&
+      fl_value_get_type(codec_value) == FL_VALUE_TYPE_STRING) {
+    if (!recaster::parse_frame_codec(fl_value_get_string(codec_value),
+                                     &sink->rcap_options.codec)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "codec must be stored, lz4 or zstd.", nullptr));
+    }
+    if (!recaster::frame_codec_available(sink->rcap_options.codec)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "codec_unavailable", "This build does not include the requested codec.",
+          nullptr));
+    }
+  }
+  sink->gif = g_str_has_suffix(output_path, ".gif");
+  sink->image_sequence =
+      recaster::image_format_for_path(output_path, &sink->image_options.format);
+  FlValue* palette_value = fl_value_lookup_string(args, "gifPalette");
+  if (palette_value != nullptr &&
+      fl_value_get_type(palette_value) == FL_VALUE_TYPE_STRING) {
+    if (!recaster::parse_gif_palette(fl_value_get_string(palette_value),
+                                     &sink->gif_options.palette)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "gifPalette must be global or perFrame.", nullptr));
+    }
+  }
+  FlValue* level_value = fl_value_lookup_string(args, "compressionLevel");
+  if (level_value != nullptr) {
+    if (fl_value_get_type(level_value) != FL_VALUE_TYPE_INT ||
+        fl_value_get_int(level_value) < 1 || fl_value_get_int(level_value) > 19) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "compressionLevel must be between 1 and 19.", nullptr));
+    }
+    sink->rcap_options.level = static_cast<int>(fl_value_get_int(level_value));
+  }
+  FlValue* time_lapse_value = fl_value_lookup_string(args, "timeLapse");
+  if (time_lapse_value != nullptr &&
+      fl_value_get_type(time_lapse_value) == FL_VALUE_TYPE_MAP) {
+    FlValue* interval_value = fl_value_lookup_string(time_lapse_value, "intervalMs");
+    if (interval_value == nullptr || fl_value_get_type(interval_value) != FL_VALUE_TYPE_INT ||
+        fl_value_get_int(interval_value) <= 0) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "timeLapse.intervalMs must be positive.", nullptr));
+    }
+    // Every capture of the interval is blended, so it must fit the
+    // blender's 16-bit sums.
+    const gint64 count =
+        std::max<gint64>(1, (fl_value_get_int(interval_value) * sink->fps + 500) / 1000);
+    if (count > 256) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args",
+          "timeLapse.intervalMs spans more than 256 captures; lower fps or the interval.",
+          nullptr));
+    }
+    sink->blender = std::make_unique<recaster::FrameBlender>(static_cast<int>(count));
+    sink->playback_fps = 30;
+    FlValue* playback_value = fl_value_lookup_string(time_lapse_value, "playbackFps");
+    if (playback_value != nullptr && fl_value_get_type(playback_value) == FL_VALUE_TYPE_INT) {
+      sink->playback_fps = static_cast<int>(
+          std::min<gint64>(kMaxFps, std::max<gint64>(1, fl_value_get_int(playback_value))));
+    }
+  }
+  FlValue* thumbnails_value = fl_value_lookup_string(args, "thumbnails");
+  if (thumbnails_value != nullptr &&
+      fl_value_get_type(thumbnails_value) == FL_VALUE_TYPE_MAP) {
+    recaster::ThumbnailOptions options;
+    FlValue* every_value = fl_value_lookup_string(thumbnails_value, "every");
+    if (every_value != nullptr && fl_value_get_type(every_value) == FL_VALUE_TYPE_INT) {
+      options.every = static_cast<int>(std::max<gint64>(1, fl_value_get_int(every_value)));
+    }
+    FlValue* width_value = fl_value_lookup_string(thumbnails_value, "tileWidth");
+    if (width_value != nullptr && fl_value_get_type(width_value) == FL_VALUE_TYPE_INT) {
+      options.tile_width = static_cast<int>(
+          std::min<gint64>(1024, std::max<gint64>(16, fl_value_get_int(width_value))));
+    }
+    FlValue* columns_value = fl_value_lookup_string(thumbnails_value, "columns");
+    if (columns_value != nullptr &&
+        fl_value_get_type(columns_value) == FL_VALUE_TYPE_INT) {
+      options.columns = static_cast<int>(
+          std::min<gint64>(64, std::max<gint64>(1, fl_value_get_int(columns_value))));
+    }
+    FlValue* format_value = fl_value_lookup_string(thumbnails_value, "format");
+    if (format_value != nullptr &&
+        fl_value_get_type(format_value) == FL_VALUE_TYPE_STRING) {
+      options.jpeg = strcmp(fl_value_get_string(format_value), "png") != 0;
+    }
+    sink->thumbnails =
+        std::make_unique<recaster::ThumbnailSheet>(options, sink->output_path);
+  }
+  return nullptr;
 }
 
-FlMethodResponse* stop_recording(RecasterPlugin* self) {
-  if (!self->is_recording) {
-    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+FlMethodResponse* parse_degradation_policy(FlValue* args,
+                                           recaster::DegradationPolicy* policy) {
+  FlValue* policy_value = fl_value_lookup_string(args, "degradation");
+  if (policy_value == nullptr || fl_value_get_type(policy_value) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  FlValue* steps_value = fl_value_lookup_string(policy_value, "steps");
+  if (steps_value != nullptr && fl_value_get_type(steps_value) == FL_VALUE_TYPE_LIST) {
+    for (size_t i = 0; i < fl_value_get_length(steps_value); ++i) {
+      FlValue* step_value = fl_value_get_list_value(steps_value, i);
+      recaster::DegradationStep step;
+      if (fl_value_get_type(step_value) != FL_VALUE_TYPE_STRING ||
+          !recaster::parse_degradation_step(fl_value_get_string(step_value), &step)) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "invalid_args",
+            "degradation steps must be reduceFps, increaseDivisor, raiseCompression or "
+            "dropFrames.",
+            nullptr));
+      }
+      policy->steps.push_back(step);
+    }
   }
+  FlValue* load_value = fl_value_lookup_string(policy_value, "targetLoad");
+  if (load_value != nullptr && fl_value_get_type(load_value) == FL_VALUE_TYPE_FLOAT) {
+    const double value = fl_value_get_float(load_value);
+    if (value > 0.0 && value <= 1.0) {
+      policy->target_load = value;
+    }
+  }
+  FlValue* bytes_value = fl_value_lookup_string(policy_value, "maxBufferedBytes");
+  if (bytes_value != nullptr && fl_value_get_type(bytes_value) == FL_VALUE_TYPE_INT) {
+    const gint64 value = fl_value_get_int(bytes_value);
+    if (value > 0) {
+      policy->max_buffered_bytes = static_cast<uint64_t>(value);
+    }
+  }
+  FlValue* recover_value = fl_value_lookup_string(policy_value, "recoverAfterMs");
+  if (recover_value != nullptr && fl_value_get_type(recover_value) == FL_VALUE_TYPE_INT) {
+    const gint64 value = fl_value_get_int(recover_value);
+    if (value >= 100 && value <= 60000) {
+      policy->recover_after_us = value * 1000;
+    }
+  }
+  return nullptr;
+}
 
-  self->is_recording = false;
-  if (self->capture_source_id != 0) {
-    g_source_remove(self->capture_source_id);
-    self->capture_source_id = 0;
+// Starts the optional localhost MJPEG preview for the capture about to begin.
+FlMethodResponse* start_preview(RecasterPlugin* self, FlValue* args) {
+  FlValue* preview_value = fl_value_lookup_string(args, "preview");
+  if (preview_value == nullptr || fl_value_get_type(preview_value) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  recaster::PreviewOptions options;
+  FlValue* port_value = fl_value_lookup_string(preview_value, "port");
+  if (port_value != nullptr && fl_value_get_type(port_value) == FL_VALUE_TYPE_INT) {
+    const gint64 value = fl_value_get_int(port_value);
+    if (value >= 0 && value <= 65535) {
+      options.port = static_cast<int>(value);
+    }
+  }
+  FlValue* fps_value = fl_value_lookup_string(preview_value, "fps");
+  if (fps_value != nullptr && fl_value_get_type(fps_value) == FL_VALUE_TYPE_INT) {
+    options.fps = static_cast<int>(
+        std::min<gint64>(30, std::max<gint64>(1, fl_value_get_int(fps_value))));
+  }
+  FlValue* width_value = fl_value_lookup_string(preview_value, "maxWidth");
+  if (width_value != nullptr && fl_value_get_type(width_value) == FL_VALUE_TYPE_INT) {
+    options.max_width = static_cast<int>(
+        std::min<gint64>(4096, std::max<gint64>(16, fl_value_get_int(width_value))));
+  }
+  FlValue* quality_value = fl_value_lookup_string(preview_value, "quality");
+  if (quality_value != nullptr && fl_value_get_type(quality_value) == FL_VALUE_TYPE_INT) {
+    options.quality = static_cast<int>(
+        std::min<gint64>(100, std::max<gint64>(1, fl_value_get_int(quality_value))));
   }
 
+  recaster::PreviewServer* preview = new recaster::PreviewServer(options);
   std::string error_message;
-  const bool written = write_avi_file(self->current_output_path, *self->frames,
-                                      self->fps, &error_message);
-  if (!written) {
-    g_autoptr(FlValue) details = fl_value_new_string(error_message.c_str());
-    self->frames->clear();
-    g_clear_pointer(&self->current_output_path, g_free);
+  if (!preview->start(&error_message)) {
+    delete preview;
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
-        "stop_failed", "Failed to finalize recording.", details));
+        "preview_failed", error_message.c_str(), nullptr));
   }
+  self->preview = preview;
+  return nullptr;
+}
 
-  g_autoptr(FlValue) result = fl_value_new_string(self->current_output_path);
-  self->frames->clear();
-  g_clear_pointer(&self->current_output_path, g_free);
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+void stop_preview(RecasterPlugin* self) {
+  if (self->preview != nullptr) {
+    delete self->preview;
+    self->preview = nullptr;
+  }
 }
 
-FlMethodResponse* is_recording(RecasterPlugin* self) {
-  g_autoptr(FlValue) result = fl_value_new_bool(self->is_recording);
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+// Fresh captures per second: paced slots that got a frame, or readbacks.
+double achieved_fps(const CaptureStats& stats) {
+  if (stats.elapsed_us <= 0) {
+    return 0.0;
+  }
+  const guint64 frames =
+      stats.high_frame_rate ? stats.ticks - stats.frames_missed : stats.frames_captured;
+  return frames * 1000000.0 / stats.elapsed_us;
 }
 
+bool parse_high_frame_rate(FlValue* args) {
+  FlValue* value = fl_value_lookup_string(args, "highFrameRate");
+  return value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_BOOL &&
+         fl_value_get_bool(value);
 }
 
-static void recaster_plugin_handle_method_call(RecasterPlugin* self,
-                                               FlMethodCall* method_call) {
-  g_autoptr(FlMethodResponse) response = nullptr;
+// Starts the capture thread for a highFrameRate capture beginning at
+// `start_time_us`.
+FlMethodResponse* start_paced_capture(RecasterPlugin* self, int fps, gint64 start_time_us) {
+  recaster::CaptureRect rect;
+  if (!find_app_capture_rect(&rect)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "hfr_unavailable", "The application window is not visible.", nullptr));
+  }
+  recaster::X11PacedCapture* capture = new recaster::X11PacedCapture(fps, kPacedRingFrames);
+  std::string error_message;
+  GdkDisplay* display = gdk_window_get_display(find_app_gdk_window());
+  if (!capture->start(display, rect, start_time_us, &error_message)) {
+    delete capture;
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "hfr_unavailable", error_message.c_str(), nullptr));
+  }
+  self->paced_capture = capture;
+  return nullptr;
+}
 
-  const gchar* method = fl_method_call_get_name(method_call);
+// Joins the capture thread and records the frames it left in the ring.
+void stop_paced_capture(RecasterPlugin* self) {
+  recaster::X11PacedCapture* capture = self->paced_capture;
+  if (capture == nullptr) {
+    return;
+  }
+  capture->stop();
+  drain_paced_frames(self);
+  const CaptureStats& stats = self->stats;
+  const double achieved = achieved_fps(stats);
+  if (achieved < self->fps * 0.9) {
+    g_warning("recaster: captured %.1f of %d fps requested (%" G_GUINT64_FORMAT
+              " slots repeated, %" G_GUINT64_FORMAT " late, %" G_GUINT64_FORMAT
+              " ring overflows)",
+              achieved, self->fps, stats.frames_missed, capture->slots_missed(),
+              capture->ring_overflows());
+  }
+  delete capture;
+  self->paced_capture = nullptr;
+}
 
-  if (strcmp(method, "getPlatformVersion") == 0) {
-    response = get_platform_version();
-  } else if (strcmp(method, "startRecording") == 0) {
-    response = start_recording(self, method_call);
-  } else if (strcmp(method, "stopRecording") == 0) {
-    response = stop_recording(self);
-  } else if (strcmp(method, "isRecording") == 0) {
-    response = is_recording(self);
-  } else {
-    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+// Fraction of the main thread capture ticks may use, or 0 for no limit.
+double parse_main_thread_budget(FlValue* args) {
+  FlValue* value = fl_value_lookup_string(args, "mainThreadBudget");
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_FLOAT) {
+    return 0.0;
   }
+  return std::min(1.0, std::max(0.0, fl_value_get_float(value)));
+}
 
-  fl_method_call_respond(method_call, response, nullptr);
+bool parse_out_of_process(FlValue* args) {
+  FlValue* value = fl_value_lookup_string(args, "outOfProcess");
+  return value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_BOOL &&
+         fl_value_get_bool(value);
 }
 
-FlMethodResponse* get_platform_version() {
-  struct utsname uname_data = {};
-  uname(&uname_data);
-  g_autofree gchar* version = g_strdup_printf("Linux %s", uname_data.version);
+// recaster-helper is installed next to the plugin library. A non-empty
+// RECASTER_HELPER environment variable names another executable.
+std::string find_helper_path() {
+  const gchar* override_path = g_getenv("RECASTER_HELPER");
+  if (override_path != nullptr && override_path[0] != '\0') {
+    return override_path;
+  }
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(&recaster_plugin_register_with_registrar), &info) == 0 ||
+      info.dli_fname == nullptr) {
+    return std::string();
+  }
+  g_autofree gchar* directory = g_path_get_dirname(info.dli_fname);
+  g_autofree gchar* path = g_build_filename(directory, "recaster-helper", nullptr);
+  return g_file_test(path, G_FILE_TEST_IS_EXECUTABLE) ? std::string(path) : std::string();
+}
+
+void add_helper_argument(GPtrArray* argv, const char* flag, gchar* value) {
+  g_ptr_array_add(argv, g_strdup(flag));
+  g_ptr_array_add(argv, value);
+}
+
+// recaster-helper's flags for `sink`. Numbers come from the parsed sink,
+// names as given; parse_sink has validated both.
+void add_helper_sink_arguments(GPtrArray* argv,
+                               FlValue* args,
+                               const RecordingSink& sink,
+                               int fps) {
+  const recaster::ScaleOptions& scale_options = sink.pipeline.scale_options();
+  gchar scale[G_ASCII_DTOSTR_BUF_SIZE];
+  add_helper_argument(argv, "--output", g_strdup(sink.output_path.c_str()));
+  add_helper_argument(argv, "--fps", g_strdup_printf("%d", fps));
+  add_helper_argument(argv, "--divisor",
+                      g_strdup_printf("%d", scale_options.resolution_divisor));
+  add_helper_argument(argv, "--scale",
+                      g_strdup(g_ascii_dtostr(scale, sizeof(scale), scale_options.scale)));
+  add_helper_argument(argv, "--max-width", g_strdup_printf("%d", scale_options.max_width));
+  add_helper_argument(argv, "--max-height", g_strdup_printf("%d", scale_options.max_height));
+  add_helper_argument(argv, "--level", g_strdup_printf("%d", sink.rcap_options.level));
+  static const char* const kNamedOptions[][2] = {
+      {"filter", "--filter"},
+      {"pixelFormat", "--pixel-format"},
+      {"resizePolicy", "--resize-policy"},
+      {"bufferCompression", "--buffer-compression"},
+      {"codec", "--codec"},
+      {"gifPalette", "--gif-palette"},
+  };
+  for (const auto& option : kNamedOptions) {
+    FlValue* value = fl_value_lookup_string(args, option[0]);
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+      add_helper_argument(argv, option[1], g_strdup(fl_value_get_string(value)));
+    }
+  }
+}
+
+// Starts recaster-helper for an outOfProcess recording of `sink`, with the
+// ring it reads frames from.
+FlMethodResponse* start_helper(RecasterPlugin* self,
+                               FlValue* args,
+                               const RecordingSink& sink,
+                               int fps) {
+  const std::string helper_path = find_helper_path();
+  if (helper_path.empty()) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "helper_unavailable", "recaster-helper was not found next to the plugin.", nullptr));
+  }
+  // Slots are only backed once written, so they are sized for the largest
+  // window likely to be recorded rather than the current one.
+  size_t slot_bytes = kHelperMinSlotBytes;
+  recaster::CaptureRect rect;
+  if (find_app_capture_rect(&rect)) {
+    slot_bytes = std::max(slot_bytes, static_cast<size_t>(rect.width) *
+                                          static_cast<size_t>(rect.height) * 4U);
+  }
+  recaster::ShmFrameRing* ring = new recaster::ShmFrameRing();
+  std::string error_message;
+  if (!ring->create(kHelperRingSlots, slot_bytes, &error_message)) {
+    delete ring;
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "helper_failed", error_message.c_str(), nullptr));
+  }
+
+  g_autoptr(GPtrArray) argv = g_ptr_array_new_with_free_func(g_free);
+  g_ptr_array_add(argv, g_strdup(helper_path.c_str()));
+  add_helper_argument(argv, "--ring-fd", g_strdup_printf("%d", kHelperRingFd));
+  add_helper_argument(argv, "--event-fd", g_strdup_printf("%d", kHelperEventFd));
+  add_helper_sink_arguments(argv, args, sink, fps);
+  g_ptr_array_add(argv, nullptr);
+
+  g_autoptr(GSubprocessLauncher) launcher = g_subprocess_launcher_new(
+      static_cast<GSubprocessFlags>(G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                    G_SUBPROCESS_FLAGS_STDERR_PIPE));
+  // The launcher owns these duplicates; the ring keeps its own descriptors.
+  g_subprocess_launcher_take_fd(launcher, fcntl(ring->memory_fd(), F_DUPFD_CLOEXEC, 0),
+                                kHelperRingFd);
+  g_subprocess_launcher_take_fd(launcher, fcntl(ring->event_fd(), F_DUPFD_CLOEXEC, 0),
+                                kHelperEventFd);
+  g_autoptr(GError) error = nullptr;
+  GSubprocess* helper = g_subprocess_launcher_spawnv(
+      launcher, reinterpret_cast<const gchar* const*>(argv->pdata), &error);
+  if (helper == nullptr) {
+    delete ring;
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "helper_failed", error->message, nullptr));
+  }
+  self->helper_ring = ring;
+  self->helper = helper;
+  self->helper_exited = false;
+  self->helper_oversize_warned = false;
+  return nullptr;
+}
+
+// True while the previous recording is still being written, here or by
+// recaster-helper.
+bool finalize_pending(const RecasterPlugin* self) {
+  return self->finalize_job != nullptr || (self->helper != nullptr && !self->is_recording);
+}
+
+// With a main-thread budget the capture source runs below GTK's redraw
+// priority, so a tick that falls due while a frame is pending waits for the
+// frame instead of delaying it.
+guint add_capture_source(RecasterPlugin* self, guint interval_ms, GSourceFunc callback) {
+  GSource* source = g_timeout_source_new(interval_ms);
+  g_source_set_priority(source,
+                        self->budget->enabled() ? GDK_PRIORITY_REDRAW + 1 : G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, callback, self, nullptr);
+  const guint id = g_source_attach(source, nullptr);
+  g_source_unref(source);
+  return id;
+}
+
+void begin_capture(RecasterPlugin* self,
+                   int fps,
+                   gint64 start_time_us,
+                   std::vector<RecordingSink>* sinks,
+                   const recaster::DegradationPolicy& policy,
+                   double main_thread_budget) {
+  self->sinks->swap(*sinks);
+  self->fps = fps;
+  self->start_time_us = start_time_us;
+  delete self->controller;
+  self->controller = new recaster::DegradationController(policy);
+  delete self->budget;
+  self->budget = new recaster::MainThreadBudget(main_thread_budget);
+  if (self->workers == nullptr) {
+    self->workers =
+        new recaster::WorkerPool(recaster::WorkerPool::default_thread_count());
+  }
+  self->is_recording = true;
+
+  self->stats = CaptureStats();
+  self->stats.high_frame_rate = self->paced_capture != nullptr;
+  if (self->stats.high_frame_rate) {
+    self->stats.tick_interval_us = 1000000 / fps;
+    self->capture_source_id =
+        add_capture_source(self, kPacedDrainIntervalMs, on_paced_capture_drain);
+    return;
+  }
+  const guint interval = static_cast<guint>(std::max(1, 1000 / std::max(1, fps)));
+  self->stats.tick_interval_us = static_cast<gint64>(interval) * 1000;
+  self->capture_source_id = add_capture_source(self, interval, on_capture_tick);
+}
+
+FlMethodResponse* start_recording(RecasterPlugin* self, FlMethodCall* method_call) {
+  if (self->is_recording) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "already_recording", "Screen recording is already running.", nullptr));
+  }
+  if (finalize_pending(self)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "finalize_pending", "The previous recording is still being written.", nullptr));
+  }
+
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "Arguments are required.", nullptr));
+  }
+
+  const bool high_frame_rate = parse_high_frame_rate(args);
+  const bool out_of_process = parse_out_of_process(args);
+  const int fps = parse_fps(args, 30, high_frame_rate ? kMaxHighFrameRateFps : kMaxFps);
+  std::vector<RecordingSink> sinks(1);
+  FlMethodResponse* error = parse_sink(args, fps, &sinks.front());
+  if (error != nullptr) {
+    return error;
+  }
+  // The helper only receives the window's pixels.
+  if (out_of_process &&
+      (high_frame_rate || sinks.front().thumbnails != nullptr ||
+       sinks.front().hashes != nullptr || sinks.front().blender != nullptr ||
+       fl_value_lookup_string(args, "preview") != nullptr ||
+       fl_value_lookup_string(args, "degradation") != nullptr)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args",
+        "outOfProcess cannot be combined with highFrameRate, preview, degradation, "
+        "thumbnails, timeLapse or .rhash outputs.",
+        nullptr));
+  }
+  recaster::DegradationPolicy policy;
+  error = parse_degradation_policy(args, &policy);
+  if (error != nullptr) {
+    return error;
+  }
+  error = start_preview(self, args);
+  if (error != nullptr) {
+    return error;
+  }
+  if (out_of_process) {
+    error = start_helper(self, args, sinks.front(), fps);
+    if (error != nullptr) {
+      return error;
+    }
+  }
+  const gint64 start_time_us = g_get_monotonic_time();
+  if (high_frame_rate) {
+    error = start_paced_capture(self, fps, start_time_us);
+    if (error != nullptr) {
+      stop_preview(self);
+      return error;
+    }
+  }
+
+  begin_capture(self, fps, start_time_us, &sinks, policy, parse_main_thread_budget(args));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse* start_session(RecasterPlugin* self, FlMethodCall* method_call) {
+  if (self->is_recording) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "already_recording", "Screen recording is already running.", nullptr));
+  }
+  if (finalize_pending(self)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "finalize_pending", "The previous recording is still being written.", nullptr));
+  }
+
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "Arguments are required.", nullptr));
+  }
+
+  FlValue* sinks_value = fl_value_lookup_string(args, "sinks");
+  if (sinks_value == nullptr || fl_value_get_type(sinks_value) != FL_VALUE_TYPE_LIST ||
+      fl_value_get_length(sinks_value) == 0 ||
+      fl_value_get_length(sinks_value) > kMaxSinks) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "sinks must list between 1 and 8 outputs.", nullptr));
+  }
+
+  const bool high_frame_rate = parse_high_frame_rate(args);
+  const int fps = parse_fps(args, 30, high_frame_rate ? kMaxHighFrameRateFps : kMaxFps);
+  std::vector<RecordingSink> sinks(fl_value_get_length(sinks_value));
+  for (size_t i = 0; i < sinks.size(); ++i) {
+    FlValue* sink_args = fl_value_get_list_value(sinks_value, i);
+    if (fl_value_get_type(sink_args) != FL_VALUE_TYPE_MAP) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "Each sink must be a map.", nullptr));
+    }
+    FlMethodResponse* error = parse_sink(sink_args, fps, &sinks[i]);
+    if (error != nullptr) {
+      return error;
+    }
+    for (size_t j = 0; j < i; ++j) {
+      if (sinks[j].output_path == sinks[i].output_path) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "invalid_args", "Sinks must use distinct output paths.", nullptr));
+      }
+    }
+  }
+  recaster::DegradationPolicy policy;
+  FlMethodResponse* policy_error = parse_degradation_policy(args, &policy);
+  if (policy_error != nullptr) {
+    return policy_error;
+  }
+  FlMethodResponse* preview_error = start_preview(self, args);
+  if (preview_error != nullptr) {
+    return preview_error;
+  }
+  const gint64 start_time_us = g_get_monotonic_time();
+  if (high_frame_rate) {
+    FlMethodResponse* capture_error = start_paced_capture(self, fps, start_time_us);
+    if (capture_error != nullptr) {
+      stop_preview(self);
+      return capture_error;
+    }
+  }
+
+  begin_capture(self, fps, start_time_us, &sinks, policy, parse_main_thread_budget(args));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+void finalize_job_free(gpointer data) {
+  FinalizeJob* job = static_cast<FinalizeJob*>(data);
+  g_clear_object(&job->method_call);
+  delete job;
+}
+
+void send_finalize_progress(RecasterPlugin* self, const FinalizeJob* job, bool done) {
+  if (!self->progress_listening || self->progress_channel == nullptr) {
+    return;
+  }
+  const uint64_t written = job->frames_written.load();
+  const uint64_t remaining = job->frames_total > written ? job->frames_total - written : 0;
+  gint64 eta_ms = -1;
+  if (done) {
+    eta_ms = 0;
+  } else if (written > 0) {
+    const gint64 elapsed_us = g_get_monotonic_time() - job->start_time_us;
+    eta_ms = static_cast<gint64>(static_cast<double>(elapsed_us) * remaining / written / 1000.0);
+  }
+  g_autoptr(FlValue) event = fl_value_new_map();
+  fl_value_set_string_take(event, "bytesWritten",
+                           fl_value_new_int(static_cast<int64_t>(job->bytes_written.load())));
+  fl_value_set_string_take(event, "framesWritten",
+                           fl_value_new_int(static_cast<int64_t>(written)));
+  fl_value_set_string_take(event, "framesRemaining",
+                           fl_value_new_int(static_cast<int64_t>(remaining)));
+  fl_value_set_string_take(event, "etaMs", fl_value_new_int(eta_ms));
+  fl_value_set_string_take(event, "done", fl_value_new_bool(done));
+  fl_event_channel_send(self->progress_channel, event, nullptr, nullptr);
+}
+
+gboolean on_finalize_progress(gpointer user_data) {
+  RecasterPlugin* self = RECASTER_PLUGIN(user_data);
+  if (self->finalize_job == nullptr) {
+    self->progress_source_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+  send_finalize_progress(self, self->finalize_job, false);
+  return G_SOURCE_CONTINUE;
+}
+
+void remove_partial_outputs(const FinalizeJob* job) {
+  for (const RecordingSink& sink : job->sinks) {
+    for (size_t i = 0; i < sink.pipeline.segments().size(); ++i) {
+      const std::string path = recaster::segment_output_path(sink.output_path, i);
+      if (!sink.image_sequence) {
+        g_remove(path.c_str());
+        continue;
+      }
+      // Frames are numbered without gaps.
+      g_remove(recaster::image_sequence_manifest_path(path).c_str());
+      for (size_t frame = 0;; ++frame) {
+        if (g_remove(recaster::image_sequence_frame_path(path, frame).c_str()) != 0) {
+          break;
+        }
+      }
+    }
+  }
+}
+
+// Reports a writer's progress on top of the sinks and segments already
+// written, and the writer's own byte count through `bytes`.
+recaster::WriteProgress finalize_progress(FinalizeJob* job,
+                                          uint64_t base_frames,
+                                          uint64_t base_bytes,
+                                          uint64_t* bytes) {
+  return [job, base_frames, base_bytes, bytes](size_t frames_written, uint64_t bytes_written) {
+    *bytes = bytes_written;
+    job->frames_written = base_frames + frames_written;
+    job->bytes_written = base_bytes + bytes_written;
+    return !job->cancelled.load();
+  };
+}
+
+// Runs on a GTask thread. Frames are released sink by sink as they are
+// written, so memory drains while the file grows.
+void finalize_thread(GTask* task,
+                     gpointer source_object,
+                     gpointer task_data,
+                     GCancellable* cancellable) {
+  FinalizeJob* job = static_cast<FinalizeJob*>(task_data);
+  uint64_t base_frames = 0;
+  uint64_t base_bytes = 0;
+  for (RecordingSink& sink : job->sinks) {
+    if (job->cancelled) {
+      break;
+    }
+    // Time-lapse outputs play back faster than they were captured.
+    const int output_fps = sink.playback_fps > 0 ? sink.playback_fps : sink.fps;
+    if (sink.hashes != nullptr) {
+      uint64_t hash_bytes = 0;
+      std::string error_message;
+      if (sink.hashes->write(sink.output_path.c_str(), output_fps, &error_message,
+                             finalize_progress(job, base_frames, base_bytes, &hash_bytes))) {
+        job->written_paths.push_back(sink.output_path);
+      } else if (job->error_message.empty() && !job->cancelled) {
+        job->error_message = error_message;
+      }
+      base_frames += sink.hashes->size();
+      base_bytes += hash_bytes;
+      job->frames_written = base_frames;
+      continue;
+    }
+    sink.pipeline.restore_reduced(job->workers);
+    // A resize under the segment policy leaves one file per canvas size.
+    for (size_t i = 0; i < sink.pipeline.segments().size() && !job->cancelled; ++i) {
+      const size_t frame_count = sink.pipeline.segments()[i].frame_count();
+      if (i > 0 && frame_count == 0) {
+        continue;
+      }
+      const std::string path = recaster::segment_output_path(sink.output_path, i);
+      uint64_t segment_bytes = 0;
+      const recaster::WriteProgress progress =
+          finalize_progress(job, base_frames, base_bytes, &segment_bytes);
+      std::string error_message;
+      bool written = false;
+      const std::vector<recaster::FramePtr>& frames = sink.pipeline.segments()[i].frames;
+      const bool avi = !sink.rcap && !sink.gif && !sink.mp4 && !sink.image_sequence;
+      std::string written_path = path;
+      if (avi && sink.pipeline.segments()[i].store == nullptr) {
+        // Raw frames have fixed chunk offsets, so the workers write them
+        // concurrently.
+        written = recaster::write_avi_file(path.c_str(), frames, output_fps, job->workers,
+                                           &error_message, progress);
+      } else if (avi) {
+        // AVI is written frame by frame, so a compressed buffer is decoded
+        // one frame at a time.
+        written = recaster::write_avi_file(
+            path.c_str(), frame_count,
+            [&sink, i, job](size_t index) {
+              return sink.pipeline.frame_at(i, index, job->workers);
+            },
+            output_fps, &error_message, progress);
+      } else if (sink.image_sequence) {
+        // Stop reports the manifest, which lists the frame files.
+        written = recaster::write_image_sequence(
+            path.c_str(), frame_count,
+            [&sink, i, job](size_t index) {
+              return sink.pipeline.frame_at(i, index, job->workers);
+            },
+            output_fps, sink.image_options, job->workers, &error_message, progress);
+        written_path = recaster::image_sequence_manifest_path(path);
+      } else if (!sink.pipeline.expand_segment(i, job->workers)) {
+        error_message = "Failed to decode buffered frames.";
+      } else if (sink.rcap) {
+        written = recaster::write_rcap_file(path.c_str(), frames, output_fps,
+                                            sink.rcap_options, job->workers, &error_message,
+                                            progress);
+      } else if (sink.gif) {
+        written = recaster::write_gif_file(path.c_str(), frames, output_fps,
+                                           sink.gif_options, job->workers, &error_message,
+                                           progress);
+      } else if (sink.mp4) {
+        written = recaster::write_mp4_file(path.c_str(), frames, output_fps,
+                                           sink.mp4_options, &error_message, progress);
+      }
+      if (written) {
+        job->written_paths.push_back(written_path);
+      } else if (job->error_message.empty() && !job->cancelled) {
+        job->error_message = error_message;
+      }
+      base_frames += frame_count;
+      base_bytes += segment_bytes;
+      job->frames_written = base_frames;
+      sink.pipeline.release_segment(i);
+    }
+
+    std::string error_message;
+    if (sink.thumbnails != nullptr && !job->cancelled &&
+        !sink.thumbnails->finish(&error_message)) {
+      g_warning("recaster: thumbnails for %s were not written: %s",
+                sink.output_path.c_str(), error_message.c_str());
+    }
+  }
+
+  if (job->cancelled) {
+    for (RecordingSink& sink : job->sinks) {
+      if (sink.thumbnails != nullptr) {
+        g_remove(sink.thumbnails->image_path().c_str());
+        g_remove(sink.thumbnails->index_path().c_str());
+      }
+    }
+    remove_partial_outputs(job);
+  }
+  g_task_return_boolean(task, !job->cancelled && job->error_message.empty());
+}
+
+void finalize_ready(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+  RecasterPlugin* self = RECASTER_PLUGIN(source_object);
+  GTask* task = G_TASK(result);
+  FinalizeJob* job = static_cast<FinalizeJob*>(g_task_get_task_data(task));
+  const gboolean ok = g_task_propagate_boolean(task, nullptr);
+
+  if (self->progress_source_id != 0) {
+    g_source_remove(self->progress_source_id);
+    self->progress_source_id = 0;
+  }
+  send_finalize_progress(self, job, true);
+  self->finalize_job = nullptr;
+
+  if (job->cancelled) {
+    fl_method_call_respond_error(job->method_call, "finalize_cancelled",
+                                 "Finalization was cancelled; partial output removed.",
+                                 nullptr, nullptr);
+    return;
+  }
+  if (!ok) {
+    g_autoptr(FlValue) details = fl_value_new_string(job->error_message.c_str());
+    fl_method_call_respond_error(job->method_call, "stop_failed",
+                                 "Failed to finalize recording.", details, nullptr);
+    return;
+  }
+  if (job->list_result) {
+    g_autoptr(FlValue) paths = fl_value_new_list();
+    for (const std::string& path : job->written_paths) {
+      fl_value_append_take(paths, fl_value_new_string(path.c_str()));
+    }
+    fl_method_call_respond_success(job->method_call, paths, nullptr);
+    return;
+  }
+  g_autoptr(FlValue) path = fl_value_new_string(job->written_paths.front().c_str());
+  fl_method_call_respond_success(job->method_call, path, nullptr);
+}
+
+struct HelperStop {
+  RecasterPlugin* self;
+  FlMethodCall* method_call;
+  bool list_result;
+};
+
+void helper_stopped(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+  HelperStop* stop = static_cast<HelperStop*>(user_data);
+  RecasterPlugin* self = stop->self;
+  GSubprocess* helper = G_SUBPROCESS(source_object);
+  g_autofree gchar* output = nullptr;
+  g_autofree gchar* errors = nullptr;
+  g_autoptr(GError) error = nullptr;
+  const bool communicated =
+      g_subprocess_communicate_utf8_finish(helper, result, &output, &errors, &error);
+  const bool ok = communicated && g_subprocess_get_successful(helper);
+
+  if (!ok) {
+    const gchar* reason = !communicated ? error->message : errors != nullptr ? errors : "";
+    g_autoptr(FlValue) details = fl_value_new_string(reason);
+    fl_method_call_respond_error(stop->method_call, "helper_failed",
+                                 "recaster-helper failed to write the recording.", details,
+                                 nullptr);
+  } else {
+    // The helper prints each written file on its own line.
+    g_auto(GStrv) lines = g_strsplit(output != nullptr ? output : "", "\n", -1);
+    g_autoptr(FlValue) paths = fl_value_new_list();
+    for (gchar** line = lines; *line != nullptr; ++line) {
+      if ((*line)[0] != '\0') {
+        fl_value_append_take(paths, fl_value_new_string(*line));
+      }
+    }
+    if (stop->list_result) {
+      fl_method_call_respond_success(stop->method_call, paths, nullptr);
+    } else {
+      g_autoptr(FlValue) path = fl_value_get_length(paths) > 0
+                                    ? fl_value_ref(fl_value_get_list_value(paths, 0))
+                                    : fl_value_new_null();
+      fl_method_call_respond_success(stop->method_call, path, nullptr);
+    }
+  }
+  g_clear_object(&self->helper);
+  g_object_unref(stop->method_call);
+  g_object_unref(self);
+  delete stop;
+}
+
+// Closes the ring so recaster-helper writes the recording, and responds once
+// the helper has exited.
+FlMethodResponse* stop_helper(RecasterPlugin* self,
+                              FlMethodCall* method_call,
+                              bool list_result) {
+  self->helper_ring->close(self->stats.ticks);
+  delete self->helper_ring;
+  self->helper_ring = nullptr;
+  self->sinks->clear();
+  HelperStop* stop = new HelperStop{RECASTER_PLUGIN(g_object_ref(self)),
+                                    FL_METHOD_CALL(g_object_ref(method_call)), list_result};
+  g_subprocess_communicate_utf8_async(self->helper, nullptr, nullptr, helper_stopped, stop);
+  return nullptr;
+}
+
+// Stops capture on the main thread and writes every sink on a worker thread.
+// Returns nullptr when the response is deferred until the files are done.
+FlMethodResponse* finish_capture(RecasterPlugin* self,
+                                 FlMethodCall* method_call,
+                                 bool list_result) {
+  if (finalize_pending(self)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "finalize_pending", "The previous recording is still being written.", nullptr));
+  }
+  if (!self->is_recording) {
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  }
+
+  self->is_recording = false;
+  if (self->capture_source_id != 0) {
+    g_source_remove(self->capture_source_id);
+    self->capture_source_id = 0;
+  }
+  stop_paced_capture(self);
+  stop_preview(self);
+  if (self->helper_ring != nullptr) {
+    return stop_helper(self, method_call, list_result);
+  }
+
+  // A time-lapse output keeps the captures of its last, partial interval.
+  for (RecordingSink& sink : *self->sinks) {
+    const recaster::FramePtr blended =
+        sink.blender != nullptr ? sink.blender->flush() : nullptr;
+    if (blended != nullptr) {
+      store_sink_frame(&sink, blended, self->workers,
+                       self->controller->state().divisor_boost);
+    }
+  }
+
+  FinalizeJob* job = new FinalizeJob();
+  job->sinks.swap(*self->sinks);
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  job->list_result = list_result;
+  job->workers = self->workers;
+  job->start_time_us = g_get_monotonic_time();
+  for (RecordingSink& sink : job->sinks) {
+    job->frames_total +=
+        sink.hashes != nullptr ? sink.hashes->size() : sink.pipeline.frame_count();
+  }
+  self->finalize_job = job;
+  self->progress_source_id = g_timeout_add(100, on_finalize_progress, self);
+
+  GTask* task = g_task_new(self, nullptr, finalize_ready, nullptr);
+  g_task_set_task_data(task, job, finalize_job_free);
+  g_task_run_in_thread(task, finalize_thread);
+  g_object_unref(task);
+  return nullptr;
+}
+
+FlMethodResponse* cancel_finalize(RecasterPlugin* self) {
+  const bool pending = self->finalize_job != nullptr;
+  if (pending) {
+    self->finalize_job->cancelled = true;
+  }
+  g_autoptr(FlValue) result = fl_value_new_bool(pending);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodErrorResponse* progress_listen_cb(FlEventChannel* channel,
+                                          FlValue* args,
+                                          gpointer user_data) {
+  RECASTER_PLUGIN(user_data)->progress_listening = true;
+  return nullptr;
+}
+
+FlMethodErrorResponse* progress_cancel_cb(FlEventChannel* channel,
+                                          FlValue* args,
+                                          gpointer user_data) {
+  RECASTER_PLUGIN(user_data)->progress_listening = false;
+  return nullptr;
+}
+
+enum class ScreenshotFormat {
+  kPng,
+  kJpeg,
+  kRaw,
+};
+
+struct ScreenshotJob {
+  GdkPixbuf* pixbuf = nullptr;
+  FlMethodCall* method_call = nullptr;
+  std::string output_path;
+  ScreenshotFormat format = ScreenshotFormat::kPng;
+  recaster::ScaleOptions scale_options;
+  recaster::WorkerPool* workers = nullptr;
+  int width = 0;
+  int height = 0;
+  std::string error_message;
+};
+
+void screenshot_job_free(gpointer data) {
+  ScreenshotJob* job = static_cast<ScreenshotJob*>(data);
+  g_clear_object(&job->pixbuf);
+  g_clear_object(&job->method_call);
+  delete job;
+}
+
+bool encode_screenshot(ScreenshotJob* job) {
+  const int source_width = gdk_pixbuf_get_width(job->pixbuf);
+  const int source_height = gdk_pixbuf_get_height(job->pixbuf);
+  const bool raw = job->format == ScreenshotFormat::kRaw;
+
+  std::vector<uint8_t> pixels(static_cast<size_t>(source_width) *
+                              static_cast<size_t>(source_height) * 4U);
+  copy_pixbuf_to_rgba32(gdk_pixbuf_read_pixels(job->pixbuf),
+                        gdk_pixbuf_get_rowstride(job->pixbuf),
+                        gdk_pixbuf_get_n_channels(job->pixbuf), source_width,
+                        source_height, raw, pixels.data());
+  g_clear_object(&job->pixbuf);
+
+  int width = source_width;
+  int height = source_height;
+  recaster::compute_scaled_size(source_width, source_height, job->scale_options,
+                                &width, &height);
+  if (width != source_width || height != source_height) {
+    std::vector<uint8_t> scaled(static_cast<size_t>(width) *
+                                static_cast<size_t>(height) * 4U);
+    recaster::FrameResampler resampler;
+    resampler.resample(pixels.data(), source_width, source_height,
+                       static_cast<size_t>(source_width) * 4U, scaled.data(), width,
+                       height, job->scale_options.filter, job->workers);
+    pixels.swap(scaled);
+  }
+  job->width = width;
+  job->height = height;
+
+  if (raw) {
+    std::ofstream file(job->output_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(pixels.data()),
+               static_cast<std::streamsize>(pixels.size()));
+    file.flush();
+    if (!file.good()) {
+      job->error_message = "Failed to write raw screenshot.";
+      return false;
+    }
+    return true;
+  }
+
+  GdkPixbuf* image = gdk_pixbuf_new_from_data(pixels.data(), GDK_COLORSPACE_RGB, TRUE,
+                                              8, width, height, width * 4, nullptr,
+                                              nullptr);
+  GError* error = nullptr;
+  const gboolean saved =
+      job->format == ScreenshotFormat::kJpeg
+          ? gdk_pixbuf_save(image, job->output_path.c_str(), "jpeg", &error,
+                            "quality", "92", nullptr)
+          : gdk_pixbuf_save(image, job->output_path.c_str(), "png", &error,
+                            "compression", "1", nullptr);
+  g_object_unref(image);
+  if (!saved) {
+    job->error_message =
+        error != nullptr ? error->message : "Failed to encode screenshot.";
+    g_clear_error(&error);
+    return false;
+  }
+  return true;
+}
+
+void screenshot_thread(GTask* task,
+                       gpointer source_object,
+                       gpointer task_data,
+                       GCancellable* cancellable) {
+  ScreenshotJob* job = static_cast<ScreenshotJob*>(task_data);
+  g_task_return_boolean(task, encode_screenshot(job));
+}
+
+void screenshot_ready(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+  GTask* task = G_TASK(result);
+  ScreenshotJob* job = static_cast<ScreenshotJob*>(g_task_get_task_data(task));
+  if (!g_task_propagate_boolean(task, nullptr)) {
+    g_autoptr(FlValue) details = fl_value_new_string(job->error_message.c_str());
+    fl_method_call_respond_error(job->method_call, "screenshot_failed",
+                                 "Failed to write screenshot.", details, nullptr);
+    return;
+  }
+  g_autoptr(FlValue) value = fl_value_new_map();
+  fl_value_set_string_take(value, "path", fl_value_new_string(job->output_path.c_str()));
+  fl_value_set_string_take(value, "width", fl_value_new_int(job->width));
+  fl_value_set_string_take(value, "height", fl_value_new_int(job->height));
+  fl_method_call_respond_success(job->method_call, value, nullptr);
+}
+
+// Reads the window back on the main thread and responds once a worker has
+// swizzled, scaled and encoded it. Returns nullptr when the response is
+// deferred.
+FlMethodResponse* capture_screenshot(RecasterPlugin* self, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "Arguments are required.", nullptr));
+  }
+  FlValue* output_path_value = fl_value_lookup_string(args, "outputPath");
+  if (output_path_value == nullptr ||
+      fl_value_get_type(output_path_value) != FL_VALUE_TYPE_STRING) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "outputPath is required.", nullptr));
+  }
+  const gchar* output_path = fl_value_get_string(output_path_value);
+  FlMethodResponse* path_error = prepare_output_path(output_path);
+  if (path_error != nullptr) {
+    return path_error;
+  }
+
+  ScreenshotFormat format = ScreenshotFormat::kPng;
+  FlValue* format_value = fl_value_lookup_string(args, "format");
+  if (format_value != nullptr &&
+      fl_value_get_type(format_value) == FL_VALUE_TYPE_STRING) {
+    const gchar* name = fl_value_get_string(format_value);
+    if (strcmp(name, "jpeg") == 0) {
+      format = ScreenshotFormat::kJpeg;
+    } else if (strcmp(name, "raw") == 0) {
+      format = ScreenshotFormat::kRaw;
+    } else if (strcmp(name, "png") != 0) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "invalid_args", "format must be png, jpeg or raw.", nullptr));
+    }
+  }
+  recaster::ScaleOptions scale_options;
+  FlMethodResponse* scale_error = parse_scale_options(args, &scale_options);
+  if (scale_error != nullptr) {
+    return scale_error;
+  }
+
+  GdkPixbuf* pixbuf = read_app_window_pixbuf();
+  if (pixbuf == nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "capture_failed", "Unable to read the Flutter view.", nullptr));
+  }
+  if (self->workers == nullptr) {
+    self->workers =
+        new recaster::WorkerPool(recaster::WorkerPool::default_thread_count());
+  }
+
+  ScreenshotJob* job = new ScreenshotJob();
+  job->pixbuf = pixbuf;
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  job->output_path = output_path;
+  job->format = format;
+  job->scale_options = scale_options;
+  job->workers = self->workers;
+
+  GTask* task = g_task_new(self, nullptr, screenshot_ready, nullptr);
+  g_task_set_task_data(task, job, screenshot_job_free);
+  g_task_run_in_thread(task, screenshot_thread);
+  g_object_unref(task);
+  return nullptr;
+}
+
+struct EditJob {
+  FlMethodCall* method_call = nullptr;
+  std::vector<std::string> input_paths;
+  std::string output_path;
+  // Trim range; concatenation when `trim` is false.
+  bool trim = false;
+  int64_t start_us = 0;
+  int64_t end_us = -1;
+  std::string error_message;
+};
+
+void edit_job_free(gpointer data) {
+  EditJob* job = static_cast<EditJob*>(data);
+  g_clear_object(&job->method_call);
+  delete job;
+}
+
+void edit_thread(GTask* task,
+                 gpointer source_object,
+                 gpointer task_data,
+                 GCancellable* cancellable) {
+  EditJob* job = static_cast<EditJob*>(task_data);
+  const bool ok =
+      job->trim ? recaster::trim_avi_file(job->input_paths.front().c_str(),
+                                          job->output_path.c_str(), job->start_us, job->end_us,
+                                          &job->error_message)
+                : recaster::concat_avi_files(job->input_paths, job->output_path.c_str(),
+                                             &job->error_message);
+  g_task_return_boolean(task, ok);
+}
+
+void edit_ready(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+  GTask* task = G_TASK(result);
+  EditJob* job = static_cast<EditJob*>(g_task_get_task_data(task));
+  if (!g_task_propagate_boolean(task, nullptr)) {
+    g_autoptr(FlValue) details = fl_value_new_string(job->error_message.c_str());
+    fl_method_call_respond_error(job->method_call, "edit_failed",
+                                 "Failed to write the edited recording.", details, nullptr);
+    return;
+  }
+  g_autoptr(FlValue) value = fl_value_new_string(job->output_path.c_str());
+  fl_method_call_respond_success(job->method_call, value, nullptr);
+}
+
+// Trims or joins existing AVI recordings by copying their frame chunks on a
+// GTask thread. Returns nullptr when the response is deferred.
+FlMethodResponse* edit_recording(RecasterPlugin* self, FlMethodCall* method_call, bool trim) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "Arguments are required.", nullptr));
+  }
+  EditJob* job = new EditJob();
+  job->trim = trim;
+  if (trim) {
+    FlValue* input_value = fl_value_lookup_string(args, "inputPath");
+    if (input_value != nullptr && fl_value_get_type(input_value) == FL_VALUE_TYPE_STRING) {
+      job->input_paths.push_back(fl_value_get_string(input_value));
+    }
+    FlValue* start_value = fl_value_lookup_string(args, "startMs");
+    if (start_value != nullptr && fl_value_get_type(start_value) == FL_VALUE_TYPE_INT) {
+      job->start_us = std::max<gint64>(0, fl_value_get_int(start_value)) * 1000;
+    }
+    FlValue* end_value = fl_value_lookup_string(args, "endMs");
+    if (end_value != nullptr && fl_value_get_type(end_value) == FL_VALUE_TYPE_INT) {
+      job->end_us = std::max<gint64>(0, fl_value_get_int(end_value)) * 1000;
+    }
+  } else {
+    FlValue* inputs_value = fl_value_lookup_string(args, "inputPaths");
+    if (inputs_value != nullptr && fl_value_get_type(inputs_value) == FL_VALUE_TYPE_LIST) {
+      for (size_t i = 0; i < fl_value_get_length(inputs_value); ++i) {
+        FlValue* path_value = fl_value_get_list_value(inputs_value, i);
+        if (fl_value_get_type(path_value) == FL_VALUE_TYPE_STRING) {
+          job->input_paths.push_back(fl_value_get_string(path_value));
+        }
+      }
+    }
+  }
+  if (job->input_paths.empty()) {
+    delete job;
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", trim ? "inputPath is required." : "inputPaths is required.",
+        nullptr));
+  }
+  FlValue* output_path_value = fl_value_lookup_string(args, "outputPath");
+  if (output_path_value == nullptr ||
+      fl_value_get_type(output_path_value) != FL_VALUE_TYPE_STRING) {
+    delete job;
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "outputPath is required.", nullptr));
+  }
+  const gchar* output_path = fl_value_get_string(output_path_value);
+  FlMethodResponse* path_error = prepare_output_path(output_path);
+  if (path_error != nullptr) {
+    delete job;
+    return path_error;
+  }
+  job->output_path = output_path;
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+
+  GTask* task = g_task_new(self, nullptr, edit_ready, nullptr);
+  g_task_set_task_data(task, job, edit_job_free);
+  g_task_run_in_thread(task, edit_thread);
+  g_object_unref(task);
+  return nullptr;
+}
+
+struct HashCompareJob {
+  FlMethodCall* method_call = nullptr;
+  std::string golden_path;
+  std::string run_path;
+  recaster::HashCompareOptions options;
+  recaster::HashComparison comparison;
+  std::string error_message;
+};
+
+void hash_compare_job_free(gpointer data) {
+  HashCompareJob* job = static_cast<HashCompareJob*>(data);
+  g_clear_object(&job->method_call);
+  delete job;
+}
+
+void hash_compare_thread(GTask* task,
+                         gpointer source_object,
+                         gpointer task_data,
+                         GCancellable* cancellable) {
+  HashCompareJob* job = static_cast<HashCompareJob*>(task_data);
+  g_task_return_boolean(
+      task, recaster::compare_hash_files(job->golden_path.c_str(), job->run_path.c_str(),
+                                         job->options, &job->comparison, &job->error_message));
+}
+
+void hash_compare_ready(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+  GTask* task = G_TASK(result);
+  HashCompareJob* job = static_cast<HashCompareJob*>(g_task_get_task_data(task));
+  if (!g_task_propagate_boolean(task, nullptr)) {
+    g_autoptr(FlValue) details = fl_value_new_string(job->error_message.c_str());
+    fl_method_call_respond_error(job->method_call, "compare_failed",
+                                 "Failed to compare the frame hashes.", details, nullptr);
+    return;
+  }
+  const recaster::HashComparison& comparison = job->comparison;
+  g_autoptr(FlValue) value = fl_value_new_map();
+  fl_value_set_string_take(value, "framesCompared",
+                           fl_value_new_int(static_cast<int64_t>(comparison.frames_compared)));
+  if (comparison.first_divergent_frame >= 0) {
+    fl_value_set_string_take(value, "divergentFrame",
+                             fl_value_new_int(comparison.first_divergent_frame));
+    fl_value_set_string_take(value, "timestampUs", fl_value_new_int(comparison.timestamp_us));
+    fl_value_set_string_take(value, "frameDistance", fl_value_new_int(comparison.frame_distance));
+    fl_value_set_string_take(value, "maxTileDistance",
+                             fl_value_new_int(comparison.max_tile_distance));
+    fl_value_set_string_take(value, "x", fl_value_new_int(comparison.x));
+    fl_value_set_string_take(value, "y", fl_value_new_int(comparison.y));
+    fl_value_set_string_take(value, "width", fl_value_new_int(comparison.width));
+    fl_value_set_string_take(value, "height", fl_value_new_int(comparison.height));
+  }
+  fl_method_call_respond_success(job->method_call, value, nullptr);
+}
+
+// Compares two .rhash sidecars on a GTask thread. Returns nullptr when the
+// response is deferred.
+FlMethodResponse* compare_frame_hashes(RecasterPlugin* self, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "Arguments are required.", nullptr));
+  }
+  FlValue* golden_value = fl_value_lookup_string(args, "goldenPath");
+  FlValue* run_value = fl_value_lookup_string(args, "runPath");
+  if (golden_value == nullptr || fl_value_get_type(golden_value) != FL_VALUE_TYPE_STRING ||
+      run_value == nullptr || fl_value_get_type(run_value) != FL_VALUE_TYPE_STRING) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "goldenPath and runPath are required.", nullptr));
+  }
+  HashCompareJob* job = new HashCompareJob();
+  job->golden_path = fl_value_get_string(golden_value);
+  job->run_path = fl_value_get_string(run_value);
+  FlValue* frame_value = fl_value_lookup_string(args, "frameThreshold");
+  if (frame_value != nullptr && fl_value_get_type(frame_value) == FL_VALUE_TYPE_INT) {
+    job->options.frame_threshold =
+        static_cast<int>(std::min<gint64>(64, std::max<gint64>(0, fl_value_get_int(frame_value))));
+  }
+  FlValue* tile_value = fl_value_lookup_string(args, "tileThreshold");
+  if (tile_value != nullptr && fl_value_get_type(tile_value) == FL_VALUE_TYPE_INT) {
+    job->options.tile_threshold =
+        static_cast<int>(std::min<gint64>(64, std::max<gint64>(0, fl_value_get_int(tile_value))));
+  }
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+
+  GTask* task = g_task_new(self, nullptr, hash_compare_ready, nullptr);
+  g_task_set_task_data(task, job, hash_compare_job_free);
+  g_task_run_in_thread(task, hash_compare_thread);
+  g_object_unref(task);
+  return nullptr;
+}
+
+FlMethodResponse* get_recording_stats(RecasterPlugin* self) {
+  const CaptureStats& stats = self->stats;
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "recording", fl_value_new_bool(self->is_recording));
+  fl_value_set_string_take(result, "ticks",
+                           fl_value_new_int(static_cast<int64_t>(stats.ticks)));
+  fl_value_set_string_take(result, "framesCaptured",
+                           fl_value_new_int(static_cast<int64_t>(stats.frames_captured)));
+  fl_value_set_string_take(result, "framesRepeated",
+                           fl_value_new_int(static_cast<int64_t>(stats.frames_repeated)));
+  fl_value_set_string_take(result, "framesDropped",
+                           fl_value_new_int(static_cast<int64_t>(stats.frames_dropped)));
+  fl_value_set_string_take(result, "resizes",
+                           fl_value_new_int(static_cast<int64_t>(stats.resizes)));
+  fl_value_set_string_take(result, "bufferedBytes",
+                           fl_value_new_int(static_cast<int64_t>(stats.buffered_bytes)));
+  fl_value_set_string_take(result, "lastStageUs", fl_value_new_int(stats.last_stage_us));
+  fl_value_set_string_take(result, "totalStageUs", fl_value_new_int(stats.total_stage_us));
+  fl_value_set_string_take(result, "framesSharedMemory",
+                           fl_value_new_int(static_cast<int64_t>(stats.frames_shared_memory)));
+  fl_value_set_string_take(result, "totalReadbackUs", fl_value_new_int(stats.total_readback_us));
+  fl_value_set_string_take(result, "highFrameRate", fl_value_new_bool(stats.high_frame_rate));
+  fl_value_set_string_take(result, "requestedFps", fl_value_new_int(self->fps));
+  fl_value_set_string_take(result, "achievedFps", fl_value_new_float(achieved_fps(stats)));
+  fl_value_set_string_take(result, "framesMissed",
+                           fl_value_new_int(static_cast<int64_t>(stats.frames_missed)));
+  const recaster::MainThreadBudget& budget = *self->budget;
+  fl_value_set_string_take(result, "mainThreadBudget", fl_value_new_float(budget.fraction()));
+  fl_value_set_string_take(result, "mainThreadLoad", fl_value_new_float(budget.spent_fraction()));
+  fl_value_set_string_take(result, "mainThreadHighWater",
+                           fl_value_new_float(budget.high_water()));
+  fl_value_set_string_take(result, "maxTickUs", fl_value_new_int(budget.max_tick_us()));
+  fl_value_set_string_take(result, "framesShed",
+                           fl_value_new_int(static_cast<int64_t>(budget.ticks_shed())));
+
+  g_autoptr(FlValue) events = fl_value_new_list();
+  if (self->controller != nullptr) {
+    const recaster::DegradationController& controller = *self->controller;
+    const recaster::DegradationState& state = controller.state();
+    fl_value_set_string_take(result, "load", fl_value_new_float(controller.load()));
+    fl_value_set_string_take(result, "level", fl_value_new_int(controller.level()));
+    fl_value_set_string_take(result, "fpsStep", fl_value_new_int(state.fps_step));
+    fl_value_set_string_take(result, "divisorBoost", fl_value_new_int(state.divisor_boost));
+    fl_value_set_string_take(result, "compressionBoost",
+                             fl_value_new_int(state.compression_boost));
+    fl_value_set_string_take(result, "dropFrames", fl_value_new_bool(state.drop_frames));
+    for (const recaster::DegradationEvent& event : controller.events()) {
+      FlValue* entry = fl_value_new_map();
+      fl_value_set_string_take(
+          entry, "timeMs", fl_value_new_int((event.time_us - self->start_time_us) / 1000));
+      fl_value_set_string_take(entry, "level", fl_value_new_int(event.level));
+      fl_value_set_string_take(
+          entry, "step", fl_value_new_string(recaster::degradation_step_name(event.step)));
+      fl_value_set_string_take(entry, "escalated", fl_value_new_bool(event.escalated));
+      fl_value_set_string_take(entry, "load", fl_value_new_float(event.load));
+      fl_value_set_string_take(entry, "bufferedBytes",
+                               fl_value_new_int(static_cast<int64_t>(event.buffered_bytes)));
+      fl_value_append_take(events, entry);
+    }
+  }
+  fl_value_set_string(result, "events", events);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* get_preview_url(RecasterPlugin* self) {
+  if (self->preview == nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  }
+  g_autofree gchar* url = g_strdup_printf("http://127.0.0.1:%d/", self->preview->port());
+  g_autoptr(FlValue) result = fl_value_new_string(url);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* is_recording(RecasterPlugin* self) {
+  g_autoptr(FlValue) result = fl_value_new_bool(self->is_recording);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+}
+
+static void recaster_plugin_handle_method_call(RecasterPlugin* self,
+                                               FlMethodCall* method_call) {
+  g_autoptr(FlMethodResponse) response = nullptr;
+
+  const gchar* method = fl_method_call_get_name(method_call);
+
+  if (strcmp(method, "getPlatformVersion") == 0) {
+    response = get_platform_version();
+  } else if (strcmp(method, "startRecording") == 0) {
+    response = start_recording(self, method_call);
+  } else if (strcmp(method, "stopRecording") == 0) {
+    response = finish_capture(self, method_call, false);
+  } else if (strcmp(method, "startSession") == 0) {
+    response = start_session(self, method_call);
+  } else if (strcmp(method, "stopSession") == 0) {
+    response = finish_capture(self, method_call, true);
+  } else if (strcmp(method, "cancelFinalize") == 0) {
+    response = cancel_finalize(self);
+  } else if (strcmp(method, "captureScreenshot") == 0) {
+    response = capture_screenshot(self, method_call);
+  } else if (strcmp(method, "trimRecording") == 0) {
+    response = edit_recording(self, method_call, true);
+  } else if (strcmp(method, "concatRecordings") == 0) {
+    response = edit_recording(self, method_call, false);
+  } else if (strcmp(method, "compareFrameHashes") == 0) {
+    response = compare_frame_hashes(self, method_call);
+  } else if (strcmp(method, "getRecordingStats") == 0) {
+    response = get_recording_stats(self);
+  } else if (strcmp(method, "getPreviewUrl") == 0) {
+    response = get_preview_url(self);
+  } else if (strcmp(method, "isRecording") == 0) {
+    response = is_recording(self);
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+
+  // Deferred handlers respond from their completion callback.
+  if (response == nullptr) {
+    return;
+  }
+  fl_method_call_respond(method_call, response, nullptr);
+}
+
+FlMethodResponse* get_platform_version() {
+  struct utsname uname_data = {};
+  uname(&uname_data);
+  g_autofree gchar* version = g_strdup_printf("Linux %s", uname_data.version);
   g_autoptr(FlValue) result = fl_value_new_string(version);
   return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
@@ -512,10 +2192,46 @@ static void recaster_plugin_dispose(GObject* object) {
     self->capture_source_id = 0;
   }
   self->is_recording = false;
-  g_clear_pointer(&self->current_output_path, g_free);
-  if (self->frames != nullptr) {
-    delete self->frames;
-    self->frames = nullptr;
+  if (self->paced_capture != nullptr) {
+    delete self->paced_capture;
+    self->paced_capture = nullptr;
+  }
+  stop_preview(self);
+  // The helper is left running and writes what it received.
+  if (self->helper_ring != nullptr) {
+    self->helper_ring->close(self->stats.ticks);
+    delete self->helper_ring;
+    self->helper_ring = nullptr;
+  }
+  g_clear_object(&self->helper);
+  if (self->sinks != nullptr) {
+    delete self->sinks;
+    self->sinks = nullptr;
+  }
+  if (self->progress_source_id != 0) {
+    g_source_remove(self->progress_source_id);
+    self->progress_source_id = 0;
+  }
+  g_clear_object(&self->progress_channel);
+  if (self->controller != nullptr) {
+    delete self->controller;
+    self->controller = nullptr;
+  }
+  if (self->budget != nullptr) {
+    delete self->budget;
+    self->budget = nullptr;
+  }
+  if (self->shm_capture != nullptr) {
+    delete self->shm_capture;
+    self->shm_capture = nullptr;
+  }
+  if (self->frame_pool != nullptr) {
+    delete self->frame_pool;
+    self->frame_pool = nullptr;
+  }
+  if (self->workers != nullptr) {
+    delete self->workers;
+    self->workers = nullptr;
   }
   G_OBJECT_CLASS(recaster_plugin_parent_class)->dispose(object);
 }
@@ -527,10 +2243,25 @@ static void recaster_plugin_class_init(RecasterPluginClass* klass) {
 static void recaster_plugin_init(RecasterPlugin* self) {
   self->is_recording = false;
   self->fps = 30;
-  self->resolution_divisor = 1;
+  self->start_time_us = 0;
   self->capture_source_id = 0;
-  self->current_output_path = nullptr;
-  self->frames = new std::vector<FrameData>();
+  self->sinks = new std::vector<RecordingSink>();
+  self->workers = nullptr;
+  self->frame_pool = new recaster::FramePool();
+  self->shm_capture = new recaster::X11ShmCapture();
+  self->paced_capture = nullptr;
+  self->helper_ring = nullptr;
+  self->helper = nullptr;
+  self->helper_exited = false;
+  self->helper_oversize_warned = false;
+  self->controller = new recaster::DegradationController();
+  self->budget = new recaster::MainThreadBudget(0.0);
+  self->preview = nullptr;
+  self->stats = CaptureStats();
+  self->finalize_job = nullptr;
+  self->progress_source_id = 0;
+  self->progress_channel = nullptr;
+  self->progress_listening = false;
 }
 
 static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
@@ -551,5 +2282,11 @@ void recaster_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
                                             g_object_ref(plugin),
                                             g_object_unref);
 
+  plugin->progress_channel =
+      fl_event_channel_new(fl_plugin_registrar_get_messenger(registrar),
+                           "recaster/finalize_progress", FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->progress_channel, progress_listen_cb,
+                                       progress_cancel_cb, plugin, nullptr);
+
   g_object_unref(plugin);
 }
@@ -1,5 +1,9 @@
 #include <flutter_linux/flutter_linux.h>
 
 #include "include/recaster/recaster_plugin.h"
+#include "frame_tap.h"
 
 FlMethodResponse *get_platform_version();
+
+// Taps opened through the C entry points in recaster_frame_tap.h.
+recaster::FrameTapRegistry* frame_tap_registry();
@@ -1,8 +1,21 @@
+#include <arpa/inet.h>
 #include <flutter_linux/flutter_linux.h>
+#include <glib/gstdio.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "include/recaster/recaster_frame_tap.h"
 #include "include/recaster/recaster_plugin.h"
+#include "mp4_writer.h"
+#include "preview_server.h"
 #include "recaster_plugin_private.h"
 
 namespace recaster {
@@ -18,5 +31,152 @@ TEST(RecasterPlugin, GetPlatformVersion) {
   EXPECT_THAT(fl_value_get_string(result), testing::StartsWith("Linux "));
 }
 
+TEST(FrameTap, LendsCapturedFramesWithoutCopying) {
+  auto frame = std::make_shared<FrameData>();
+  frame->width = 2;
+  frame->height = 1;
+  frame->timestamp_us = 42;
+  frame->pixels.assign(8, 0x7f);
+  const int64_t tap = recaster_frame_tap_open(1);
+  frame_tap_registry()->offer(frame);
+  frame_tap_registry()->offer(frame);
+  EXPECT_EQ(recaster_frame_tap_dropped(tap), 1U);
+
+  const RecasterFrame* lent = recaster_frame_tap_next(tap);
+  ASSERT_NE(lent, nullptr);
+  EXPECT_EQ(lent->pixels, frame->pixels.data());
+  EXPECT_EQ(lent->sequence, 1U);
+  EXPECT_EQ(lent->stride, 8);
+  EXPECT_EQ(lent->format, 0);
+  EXPECT_EQ(recaster_frame_tap_next(tap), nullptr);
+  recaster_frame_tap_close(tap);
+  EXPECT_EQ(lent->timestamp_us, 42);
+  recaster_frame_tap_release(lent);
+  EXPECT_EQ(recaster_frame_tap_next(tap), nullptr);
+
+  // BGR rows are padded to 4 bytes.
+  auto bgr = std::make_shared<FrameData>();
+  bgr->width = 3;
+  bgr->height = 2;
+  bgr->format = PixelFormat::kBgr24;
+  bgr->pixels.assign(frame_byte_size(3, 2, PixelFormat::kBgr24), 0);
+  const int64_t bgr_tap = recaster_frame_tap_open(1);
+  frame_tap_registry()->offer(bgr);
+  const RecasterFrame* padded = recaster_frame_tap_next(bgr_tap);
+  ASSERT_NE(padded, nullptr);
+  EXPECT_EQ(padded->stride, 12);
+  EXPECT_EQ(padded->format, 1);
+  recaster_frame_tap_release(padded);
+  recaster_frame_tap_close(bgr_tap);
+}
+
+TEST(Mp4Writer, CropsOddSizedFramesToEvenDimensions) {
+  if (!mp4_encoder_available()) {
+    GTEST_SKIP() << "GStreamer H.264 encoder is not installed.";
+  }
+  // BGR24 rows of 33 pixels are padded to 100 bytes.
+  std::vector<FramePtr> frames;
+  for (int i = 0; i < 3; ++i) {
+    auto frame = std::make_shared<FrameData>();
+    frame->width = 33;
+    frame->height = 17;
+    frame->format = PixelFormat::kBgr24;
+    frame->timestamp_us = i * 33333;
+    frame->pixels.assign(frame_byte_size(33, 17, PixelFormat::kBgr24),
+                         static_cast<uint8_t>(40 * i));
+    frames.push_back(frame);
+  }
+
+  const std::string path = std::string(g_get_tmp_dir()) + "/recaster_odd_test.mp4";
+  std::string error;
+  ASSERT_TRUE(write_mp4_file(path.c_str(), frames, 30, Mp4Options(), &error)) << error;
+  gchar* contents = nullptr;
+  gsize length = 0;
+  ASSERT_TRUE(g_file_get_contents(path.c_str(), &contents, &length, nullptr));
+  ASSERT_GT(length, 8U);
+  EXPECT_EQ(std::string(contents + 4, 4), "ftyp");
+  g_free(contents);
+  g_remove(path.c_str());
+}
+
+TEST(PreviewServer, StreamsJpegPartsOnLoopback) {
+  PreviewOptions options;
+  options.max_width = 32;
+  PreviewServer server(options);
+  std::string error;
+  ASSERT_TRUE(server.start(&error)) << error;
+  ASSERT_GT(server.port(), 0);
+
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  const timeval timeout = {5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(server.port()));
+  ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+  const std::string request =
+      "GET / HTTP/1.1\r\nHost: 127.0.0.1:" + std::to_string(server.port()) + "\r\n\r\n";
+  ASSERT_EQ(send(fd, request.data(), request.size(), 0),
+            static_cast<ssize_t>(request.size()));
+
+  auto frame = std::make_shared<FrameData>();
+  frame->width = 64;
+  frame->height = 48;
+  frame->pixels.assign(frame_byte_size(64, 48, PixelFormat::kBgra32), 200);
+  std::string received;
+  char buffer[4096];
+  // Offer until a whole part has arrived; the request may still be in flight
+  // when the first offers land.
+  for (int i = 0; i < 50 && received.find("\xff\xd9\r\n") == std::string::npos; ++i) {
+    auto offered = std::make_shared<FrameData>(*frame);
+    offered->timestamp_us = static_cast<int64_t>(i) * 1000000;
+    server.offer(offered);
+    usleep(50000);
+    const ssize_t count = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (count > 0) {
+      received.append(buffer, static_cast<size_t>(count));
+    }
+  }
+  close(fd);
+
+  EXPECT_THAT(received, testing::StartsWith("HTTP/1.0 200 OK\r\n"));
+  EXPECT_THAT(received, testing::HasSubstr("multipart/x-mixed-replace; boundary=recasterframe"));
+  EXPECT_THAT(received, testing::HasSubstr("--recasterframe\r\nContent-Type: image/jpeg\r\n"));
+  EXPECT_GE(server.frames_sent(), 1U);
+}
+
+TEST(PreviewServer, RejectsForeignHostHeaders) {
+  PreviewServer server{PreviewOptions()};
+  std::string error;
+  ASSERT_TRUE(server.start(&error)) << error;
+
+  // What a page that rebound its own name to 127.0.0.1 would send.
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  const timeval timeout = {5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(server.port()));
+  ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+  const std::string request = "GET / HTTP/1.1\r\nHost: attacker.example:" +
+                              std::to_string(server.port()) + "\r\n\r\n";
+  ASSERT_EQ(send(fd, request.data(), request.size(), 0),
+            static_cast<ssize_t>(request.size()));
+
+  std::string received;
+  char buffer[256];
+  ssize_t count = 0;
+  while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    received.append(buffer, static_cast<size_t>(count));
+  }
+  close(fd);
+  EXPECT_THAT(received, testing::StartsWith("HTTP/1.0 403 Forbidden\r\n"));
+  EXPECT_EQ(server.frames_sent(), 0U);
+}
+
 }
 }
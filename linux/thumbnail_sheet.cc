@@ -0,0 +1,219 @@
+#include "thumbnail_sheet.h"
+
+#include <gtk/gtk.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include "json_util.h"
+
+namespace recaster {
+
+namespace {
+
+constexpr size_t kMaxPending = 4;
+
+std::string strip_extension(const std::string& path) {
+  const size_t slash = path.find_last_of('/');
+  const size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return path;
+  }
+  return path.substr(0, dot);
+}
+
+}
+
+ThumbnailSheet::ThumbnailSheet(const ThumbnailOptions& options,
+                               const std::string& output_path)
+    : options_(options) {
+  const std::string base = strip_extension(output_path);
+  image_path_ = base + (options_.jpeg ? ".thumbs.jpg" : ".thumbs.png");
+  index_path_ = base + ".thumbs.json";
+  options_.every = std::max(1, options_.every);
+  options_.tile_width = std::max(16, options_.tile_width);
+  options_.columns = std::max(1, options_.columns);
+  options_.max_tiles = std::max(1, options_.max_tiles);
+  thread_ = std::thread([this]() { run(); });
+}
+
+ThumbnailSheet::~ThumbnailSheet() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finishing_ = true;
+    pending_.clear();
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ThumbnailSheet::offer(int64_t frame_index, const FramePtr& frame) {
+  if (frame == nullptr || frame->format != PixelFormat::kBgra32 ||
+      frame_index % options_.every != 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finishing_ || pending_.size() >= kMaxPending) {
+      return;
+    }
+    Pending pending;
+    pending.frame_index = frame_index;
+    pending.frame = frame;
+    pending_.push_back(std::move(pending));
+  }
+  cv_.notify_one();
+}
+
+bool ThumbnailSheet::finish(std::string* error_message) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finishing_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  return write_outputs(error_message);
+}
+
+void ThumbnailSheet::run() {
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+  for (;;) {
+    Pending pending;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return finishing_ || !pending_.empty(); });
+      if (pending_.empty()) {
+        return;
+      }
+      pending = std::move(pending_.front());
+      pending_.pop_front();
+    }
+    add_tile(pending);
+  }
+}
+
+void ThumbnailSheet::add_tile(const Pending& pending) {
+  const FrameData& frame = *pending.frame;
+  if (static_cast<int>(tiles_.size()) >= options_.max_tiles || frame.width <= 0 ||
+      frame.height <= 0) {
+    return;
+  }
+  const int tile_width = options_.tile_width;
+  if (tile_height_ == 0) {
+    tile_height_ = std::max(
+        1, static_cast<int>(static_cast<int64_t>(tile_width) * frame.height / frame.width));
+  }
+
+  tile_pixels_.resize(static_cast<size_t>(tile_width) *
+                      static_cast<size_t>(tile_height_) * 4U);
+  resampler_.resample(frame.pixels.data(), frame.width, frame.height,
+                      static_cast<size_t>(frame.width) * 4U, tile_pixels_.data(),
+                      tile_width, tile_height_, ResampleFilter::kBilinear, nullptr);
+
+  const int index = static_cast<int>(tiles_.size());
+  const int column = index % options_.columns;
+  const int row = index / options_.columns;
+  const size_t sheet_stride =
+      static_cast<size_t>(options_.columns) * static_cast<size_t>(tile_width) * 3U;
+  const size_t needed =
+      static_cast<size_t>(row + 1) * static_cast<size_t>(tile_height_) * sheet_stride;
+  if (sheet_.size() < needed) {
+    sheet_.resize(needed, 0);
+  }
+
+  for (int y = 0; y < tile_height_; ++y) {
+    const uint8_t* src = tile_pixels_.data() +
+                         static_cast<size_t>(y) * static_cast<size_t>(tile_width) * 4U;
+    uint8_t* dst = sheet_.data() +
+                   (static_cast<size_t>(row) * static_cast<size_t>(tile_height_) +
+                    static_cast<size_t>(y)) *
+                       sheet_stride +
+                   static_cast<size_t>(column) * static_cast<size_t>(tile_width) * 3U;
+    for (int x = 0; x < tile_width; ++x) {
+      dst[0] = src[2];
+      dst[1] = src[1];
+      dst[2] = src[0];
+      src += 4;
+      dst += 3;
+    }
+  }
+
+  Tile tile;
+  tile.frame_index = pending.frame_index;
+  tile.timestamp_us = frame.timestamp_us;
+  tiles_.push_back(tile);
+}
+
+bool ThumbnailSheet::write_outputs(std::string* error_message) {
+  if (tiles_.empty()) {
+    return true;
+  }
+
+  const int columns = std::min(options_.columns, static_cast<int>(tiles_.size()));
+  const int rows =
+      (static_cast<int>(tiles_.size()) + options_.columns - 1) / options_.columns;
+  const int sheet_stride = options_.columns * options_.tile_width * 3;
+  GdkPixbuf* pixbuf = gdk_pixbuf_new_from_data(
+      sheet_.data(), GDK_COLORSPACE_RGB, FALSE, 8, columns * options_.tile_width,
+      rows * tile_height_, sheet_stride, nullptr, nullptr);
+  if (pixbuf == nullptr) {
+    if (error_message != nullptr) {
+      *error_message = "Failed to create thumbnail sheet.";
+    }
+    return false;
+  }
+  GError* error = nullptr;
+  const gboolean saved =
+      options_.jpeg
+          ? gdk_pixbuf_save(pixbuf, image_path_.c_str(), "jpeg", &error, "quality",
+                            "80", nullptr)
+          : gdk_pixbuf_save(pixbuf, image_path_.c_str(), "png", &error,
+                            "compression", "3", nullptr);
+  g_object_unref(pixbuf);
+  if (!saved) {
+    if (error_message != nullptr) {
+      *error_message = error != nullptr ? error->message : "Failed to save thumbnails.";
+    }
+    g_clear_error(&error);
+    return false;
+  }
+
+  std::ofstream index(index_path_, std::ios::trunc);
+  const size_t slash = image_path_.find_last_of('/');
+  const std::string image_name =
+      slash == std::string::npos ? image_path_ : image_path_.substr(slash + 1);
+  index << "{\n  \"image\": \"" << json_escape(image_name) << "\",\n"
+        << "  \"tileWidth\": " << options_.tile_width << ",\n"
+        << "  \"tileHeight\": " << tile_height_ << ",\n"
+        << "  \"columns\": " << options_.columns << ",\n"
+        << "  \"every\": " << options_.every << ",\n"
+        << "  \"tiles\": [";
+  for (size_t i = 0; i < tiles_.size(); ++i) {
+    const int column = static_cast<int>(i) % options_.columns;
+    const int row = static_cast<int>(i) / options_.columns;
+    index << (i == 0 ? "\n" : ",\n") << "    {\"frame\": " << tiles_[i].frame_index
+          << ", \"timeMs\": " << tiles_[i].timestamp_us / 1000
+          << ", \"x\": " << column * options_.tile_width
+          << ", \"y\": " << row * tile_height_ << "}";
+  }
+  index << "\n  ]\n}\n";
+  index.flush();
+  if (!index.good()) {
+    if (error_message != nullptr) {
+      *error_message = "Failed to write thumbnail index.";
+    }
+    return false;
+  }
+  return true;
+}
+
+}
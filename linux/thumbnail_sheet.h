@@ -0,0 +1,74 @@
+#ifndef RECASTER_THUMBNAIL_SHEET_H_
+#define RECASTER_THUMBNAIL_SHEET_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_data.h"
+#include "frame_resampler.h"
+
+namespace recaster {
+
+struct ThumbnailOptions {
+  int every = 30;
+  int tile_width = 160;
+  int columns = 10;
+  int max_tiles = 1000;
+  bool jpeg = true;
+};
+
+// Builds a scrubbing sprite-sheet and a JSON timestamp map while recording.
+// Frames are shared with the sink, queued without copying and downsampled on
+// a nice(19) thread; when that thread falls behind, offers are dropped.
+class ThumbnailSheet {
+ public:
+  ThumbnailSheet(const ThumbnailOptions& options, const std::string& output_path);
+  ~ThumbnailSheet();
+
+  ThumbnailSheet(const ThumbnailSheet&) = delete;
+  ThumbnailSheet& operator=(const ThumbnailSheet&) = delete;
+
+  void offer(int64_t frame_index, const FramePtr& frame);
+  bool finish(std::string* error_message);
+
+  const std::string& image_path() const { return image_path_; }
+  const std::string& index_path() const { return index_path_; }
+
+ private:
+  struct Pending {
+    int64_t frame_index = 0;
+    FramePtr frame;
+  };
+  struct Tile {
+    int64_t frame_index = 0;
+    int64_t timestamp_us = 0;
+  };
+
+  void run();
+  void add_tile(const Pending& pending);
+  bool write_outputs(std::string* error_message);
+
+  ThumbnailOptions options_;
+  std::string image_path_;
+  std::string index_path_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Pending> pending_;
+  bool finishing_ = false;
+
+  int tile_height_ = 0;
+  FrameResampler resampler_;
+  std::vector<uint8_t> tile_pixels_;
+  std::vector<uint8_t> sheet_;
+  std::vector<Tile> tiles_;
+};
+
+}
+
+#endif
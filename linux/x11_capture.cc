@@ -0,0 +1,528 @@
+#include "x11_capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "frame_pacer.h"
+
+#if defined(RECASTER_HAVE_XSHM)
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <gdk/gdkx.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+namespace recaster {
+
+#if defined(RECASTER_HAVE_XSHM)
+
+struct X11ShmCapture::State {
+  GdkDisplay* display = nullptr;
+  Visual* visual = nullptr;
+  int depth = 0;
+  XImage* image = nullptr;
+  XShmSegmentInfo segment = {};
+};
+
+namespace {
+
+// Client-side GDK windows draw into their nearest native ancestor; returns
+// that ancestor and `window`'s offset within it.
+GdkWindow* native_ancestor(GdkWindow* window, int* x, int* y) {
+  *x = 0;
+  *y = 0;
+  while (window != nullptr && !gdk_window_has_native(window)) {
+    int child_x = 0;
+    int child_y = 0;
+    gdk_window_get_position(window, &child_x, &child_y);
+    *x += child_x;
+    *y += child_y;
+    window = gdk_window_get_parent(window);
+  }
+  return window;
+}
+
+bool disabled_by_environment() {
+  const char* value = getenv("RECASTER_NO_XSHM");
+  return value != nullptr && value[0] != '\0';
+}
+
+// Little-endian 32-bit pixels with red in the third byte are BGRX in memory.
+bool is_bgrx(const XImage* image) {
+  return image->bits_per_pixel == 32 && image->byte_order == LSBFirst &&
+         image->red_mask == 0xff0000 && image->green_mask == 0xff00 &&
+         image->blue_mask == 0xff;
+}
+
+// A BGRX image over a new shared-memory segment, not yet attached to the
+// server. Returns nullptr for other pixel layouts.
+XImage* create_shm_image(Display* display,
+                         Visual* visual,
+                         int depth,
+                         int width,
+                         int height,
+                         XShmSegmentInfo* segment) {
+  *segment = XShmSegmentInfo();
+  XImage* image =
+      XShmCreateImage(display, visual, depth, ZPixmap, nullptr, segment, width, height);
+  if (image == nullptr) {
+    return nullptr;
+  }
+  if (!is_bgrx(image)) {
+    XDestroyImage(image);
+    return nullptr;
+  }
+  segment->shmid = shmget(IPC_PRIVATE,
+                          static_cast<size_t>(image->bytes_per_line) *
+                              static_cast<size_t>(image->height),
+                          IPC_CREAT | 0600);
+  if (segment->shmid < 0) {
+    XDestroyImage(image);
+    return nullptr;
+  }
+  segment->shmaddr = static_cast<char*>(shmat(segment->shmid, nullptr, 0));
+  if (segment->shmaddr == reinterpret_cast<char*>(-1)) {
+    shmctl(segment->shmid, IPC_RMID, nullptr);
+    XDestroyImage(image);
+    return nullptr;
+  }
+  image->data = segment->shmaddr;
+  segment->readOnly = False;
+  return image;
+}
+
+void destroy_shm_image(XImage* image, XShmSegmentInfo* segment) {
+  // Frees only the XImage; its pixels are the segment.
+  XDestroyImage(image);
+  shmdt(segment->shmaddr);
+  *segment = XShmSegmentInfo();
+}
+
+// Copies a BGRX image into a tightly packed BGRA buffer with opaque alpha.
+void copy_bgrx_image(const XImage* image, uint8_t* dst) {
+  const int width = image->width;
+  for (int row = 0; row < image->height; ++row) {
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(image->data) +
+                         static_cast<size_t>(row) * static_cast<size_t>(image->bytes_per_line);
+    uint8_t* out = dst + static_cast<size_t>(row) * width * 4U;
+    for (int column = 0; column < width; ++column) {
+      uint32_t pixel;
+      memcpy(&pixel, src + column * 4, 4);
+      pixel |= 0xff000000U;
+      memcpy(out + column * 4, &pixel, 4);
+    }
+  }
+}
+
+// Errors on the paced capture's private connection are counted instead of
+// reaching GDK's handler, which runs on the main thread's terms.
+std::atomic<Display*> paced_display{nullptr};
+std::atomic<uint64_t> paced_errors{0};
+XErrorHandler previous_error_handler = nullptr;
+std::once_flag error_handler_once;
+
+int paced_error_handler(Display* display, XErrorEvent* event) {
+  if (display == paced_display.load()) {
+    paced_errors.fetch_add(1);
+    return 0;
+  }
+  return previous_error_handler != nullptr ? previous_error_handler(display, event) : 0;
+}
+
+}
+
+X11ShmCapture::X11ShmCapture()
+    : state_(new State()), disabled_(disabled_by_environment()) {}
+
+X11ShmCapture::~X11ShmCapture() {
+  release();
+}
+
+bool X11ShmCapture::allocate(GdkWindow* native, int width, int height) {
+  release();
+  State* state = state_.get();
+  Display* display = gdk_x11_display_get_xdisplay(state->display);
+  GdkVisual* gdk_visual = gdk_window_get_visual(native);
+  Visual* visual = gdk_x11_visual_get_xvisual(gdk_visual);
+  const int depth = gdk_visual_get_depth(gdk_visual);
+  XShmSegmentInfo segment;
+  XImage* image = create_shm_image(display, visual, depth, width, height, &segment);
+  if (image == nullptr) {
+    return false;
+  }
+
+  // A server on another host fails the attach.
+  gdk_x11_display_error_trap_push(state->display);
+  XShmAttach(display, &segment);
+  XSync(display, False);
+  const bool attached = gdk_x11_display_error_trap_pop(state->display) == 0;
+  // The kernel frees the segment once both sides have detached.
+  shmctl(segment.shmid, IPC_RMID, nullptr);
+  if (!attached) {
+    destroy_shm_image(image, &segment);
+    return false;
+  }
+
+  state->visual = visual;
+  state->depth = depth;
+  state->image = image;
+  state->segment = segment;
+  return true;
+}
+
+void X11ShmCapture::release() {
+  State* state = state_.get();
+  if (state->image == nullptr) {
+    return;
+  }
+  Display* display = gdk_x11_display_get_xdisplay(state->display);
+  gdk_x11_display_error_trap_push(state->display);
+  XShmDetach(display, &state->segment);
+  XSync(display, False);
+  gdk_x11_display_error_trap_pop_ignored(state->display);
+  destroy_shm_image(state->image, &state->segment);
+  state->image = nullptr;
+}
+
+bool X11ShmCapture::read(GdkWindow* window) {
+  if (disabled_) {
+    return false;
+  }
+  State* state = state_.get();
+  GdkDisplay* gdk_display = gdk_window_get_display(window);
+  if (gdk_display != state->display) {
+    release();
+    if (!GDK_IS_X11_DISPLAY(gdk_display) ||
+        !XShmQueryExtension(gdk_x11_display_get_xdisplay(gdk_display))) {
+      disabled_ = true;
+      return false;
+    }
+    state->display = gdk_display;
+  }
+
+  int x = 0;
+  int y = 0;
+  GdkWindow* native = native_ancestor(window, &x, &y);
+  if (native == nullptr) {
+    return false;
+  }
+  int width = 0;
+  int height = 0;
+  gdk_window_get_geometry(window, nullptr, nullptr, &width, &height);
+  // X works in device pixels, GDK in logical ones.
+  const int scale = gdk_window_get_scale_factor(window);
+  x *= scale;
+  y *= scale;
+  width *= scale;
+  height *= scale;
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+
+  GdkVisual* gdk_visual = gdk_window_get_visual(native);
+  if (state->image == nullptr || state->image->width != width ||
+      state->image->height != height ||
+      state->visual != gdk_x11_visual_get_xvisual(gdk_visual) ||
+      state->depth != gdk_visual_get_depth(gdk_visual)) {
+    if (!allocate(native, width, height)) {
+      disabled_ = true;
+      return false;
+    }
+  }
+
+  // Fails while the window is unmapped or partly off screen.
+  Display* display = gdk_x11_display_get_xdisplay(gdk_display);
+  XImage* image = state->image;
+  gdk_x11_display_error_trap_push(gdk_display);
+  const Bool grabbed =
+      XShmGetImage(display, gdk_x11_window_get_xid(native), image, x, y, AllPlanes);
+  return gdk_x11_display_error_trap_pop(gdk_display) == 0 && grabbed;
+}
+
+std::shared_ptr<FrameData> X11ShmCapture::capture(GdkWindow* window, FramePool* pool) {
+  if (!read(window)) {
+    return nullptr;
+  }
+  const XImage* image = state_->image;
+  std::shared_ptr<FrameData> frame = pool->acquire(static_cast<size_t>(image->width) *
+                                                   static_cast<size_t>(image->height) * 4U);
+  frame->width = image->width;
+  frame->height = image->height;
+  frame->format = PixelFormat::kBgra32;
+  copy_bgrx_image(image, frame->pixels.data());
+  return frame;
+}
+
+bool X11ShmCapture::capture_to(GdkWindow* window,
+                               uint8_t* dst,
+                               size_t capacity,
+                               int* width,
+                               int* height) {
+  if (!read(window)) {
+    return false;
+  }
+  const XImage* image = state_->image;
+  *width = image->width;
+  *height = image->height;
+  if (static_cast<size_t>(image->width) * static_cast<size_t>(image->height) * 4U > capacity) {
+    return false;
+  }
+  copy_bgrx_image(image, dst);
+  return true;
+}
+
+struct X11PacedCapture::State {
+  Display* display = nullptr;
+  Window root = 0;
+  Visual* visual = nullptr;
+  int depth = 0;
+  int root_width = 0;
+  int root_height = 0;
+  XImage* image = nullptr;
+  XShmSegmentInfo segment = {};
+};
+
+namespace {
+
+// Keeps the rectangle on screen by moving it, so the frame size only changes
+// with the window's.
+CaptureRect clip_to_root(CaptureRect rect, int root_width, int root_height) {
+  rect.width = std::min(rect.width, root_width);
+  rect.height = std::min(rect.height, root_height);
+  rect.x = std::max(0, std::min(rect.x, root_width - rect.width));
+  rect.y = std::max(0, std::min(rect.y, root_height - rect.height));
+  return rect;
+}
+
+}
+
+X11PacedCapture::X11PacedCapture(int fps, size_t ring_capacity)
+    : fps_(fps), state_(new State()), pool_(ring_capacity + 2), ring_(ring_capacity) {}
+
+X11PacedCapture::~X11PacedCapture() {
+  stop();
+}
+
+bool X11PacedCapture::start(GdkDisplay* display,
+                            const CaptureRect& rect,
+                            int64_t start_time_us,
+                            std::string* error_message) {
+  if (!GDK_IS_X11_DISPLAY(display)) {
+    *error_message = "High frame rate capture needs an X11 session.";
+    return false;
+  }
+  std::call_once(error_handler_once,
+                 []() { previous_error_handler = XSetErrorHandler(paced_error_handler); });
+  // Xlib connections are not shared between threads, so the capture thread
+  // talks to the server over its own.
+  State* state = state_.get();
+  state->display = XOpenDisplay(DisplayString(gdk_x11_display_get_xdisplay(display)));
+  if (state->display == nullptr) {
+    *error_message = "Unable to open a second connection to the X server.";
+    return false;
+  }
+  paced_display = state->display;
+  const int screen = DefaultScreen(state->display);
+  state->root = RootWindow(state->display, screen);
+  state->visual = DefaultVisual(state->display, screen);
+  state->depth = DefaultDepth(state->display, screen);
+  state->root_width = DisplayWidth(state->display, screen);
+  state->root_height = DisplayHeight(state->display, screen);
+
+  const CaptureRect clipped = clip_to_root(rect, state->root_width, state->root_height);
+  if (!XShmQueryExtension(state->display) || clipped.width <= 0 || clipped.height <= 0 ||
+      !attach(clipped.width, clipped.height)) {
+    stop();
+    *error_message = "MIT-SHM capture is not available on this X server.";
+    return false;
+  }
+  set_rect(rect);
+  pool_.reserve(static_cast<size_t>(clipped.width) * static_cast<size_t>(clipped.height) * 4U,
+                ring_.capacity());
+  start_time_us_ = start_time_us;
+  stopping_ = false;
+  thread_ = std::thread(&X11PacedCapture::run, this);
+  return true;
+}
+
+void X11PacedCapture::stop() {
+  stopping_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  State* state = state_.get();
+  if (state->display == nullptr) {
+    return;
+  }
+  detach();
+  XCloseDisplay(state->display);
+  paced_display = nullptr;
+  state->display = nullptr;
+}
+
+void X11PacedCapture::set_rect(const CaptureRect& rect) {
+  std::lock_guard<std::mutex> lock(rect_mutex_);
+  rect_ = rect;
+}
+
+void X11PacedCapture::run() {
+  // Anchors the schedule at the capture's start so slot `i` is grabbed at
+  // i / fps in frame timestamps.
+  const auto since_start = std::chrono::microseconds(g_get_monotonic_time() - start_time_us_);
+  FramePacer pacer(fps_, FramePacer::Clock::now() - since_start);
+  while (!stopping_.load()) {
+    std::this_thread::sleep_until(pacer.next_deadline(FramePacer::Clock::now()));
+    slots_missed_ = pacer.missed();
+    if (stopping_.load()) {
+      break;
+    }
+    FramePtr frame;
+    if (!grab(&frame)) {
+      ++grab_failures_;
+      continue;
+    }
+    ++frames_captured_;
+    if (!ring_.push(std::move(frame))) {
+      ++ring_overflows_;
+    }
+  }
+}
+
+bool X11PacedCapture::grab(FramePtr* frame) {
+  CaptureRect rect;
+  {
+    std::lock_guard<std::mutex> lock(rect_mutex_);
+    rect = rect_;
+  }
+  State* state = state_.get();
+  rect = clip_to_root(rect, state->root_width, state->root_height);
+  if (rect.width <= 0 || rect.height <= 0) {
+    return false;
+  }
+  if (state->image == nullptr || state->image->width != rect.width ||
+      state->image->height != rect.height) {
+    detach();
+    if (!attach(rect.width, rect.height)) {
+      return false;
+    }
+  }
+
+  const int64_t timestamp_us = g_get_monotonic_time() - start_time_us_;
+  const uint64_t errors = paced_errors.load();
+  if (!XShmGetImage(state->display, state->root, state->image, rect.x, rect.y, AllPlanes) ||
+      paced_errors.load() != errors) {
+    return false;
+  }
+  std::shared_ptr<FrameData> data =
+      pool_.acquire(static_cast<size_t>(rect.width) * static_cast<size_t>(rect.height) * 4U);
+  data->width = rect.width;
+  data->height = rect.height;
+  data->format = PixelFormat::kBgra32;
+  data->timestamp_us = timestamp_us;
+  copy_bgrx_image(state->image, data->pixels.data());
+  *frame = std::move(data);
+  return true;
+}
+
+bool X11PacedCapture::attach(int width, int height) {
+  State* state = state_.get();
+  XShmSegmentInfo segment;
+  XImage* image =
+      create_shm_image(state->display, state->visual, state->depth, width, height, &segment);
+  if (image == nullptr) {
+    return false;
+  }
+  const uint64_t errors = paced_errors.load();
+  XShmAttach(state->display, &segment);
+  XSync(state->display, False);
+  shmctl(segment.shmid, IPC_RMID, nullptr);
+  if (paced_errors.load() != errors) {
+    destroy_shm_image(image, &segment);
+    return false;
+  }
+  state->image = image;
+  state->segment = segment;
+  return true;
+}
+
+void X11PacedCapture::detach() {
+  State* state = state_.get();
+  if (state->image == nullptr) {
+    return;
+  }
+  XShmDetach(state->display, &state->segment);
+  XSync(state->display, False);
+  destroy_shm_image(state->image, &state->segment);
+  state->image = nullptr;
+}
+
+#else
+
+struct X11ShmCapture::State {};
+
+X11ShmCapture::X11ShmCapture() : state_(new State()), disabled_(true) {}
+
+X11ShmCapture::~X11ShmCapture() = default;
+
+bool X11ShmCapture::allocate(GdkWindow* native, int width, int height) {
+  return false;
+}
+
+void X11ShmCapture::release() {}
+
+bool X11ShmCapture::read(GdkWindow* window) {
+  return false;
+}
+
+std::shared_ptr<FrameData> X11ShmCapture::capture(GdkWindow* window, FramePool* pool) {
+  return nullptr;
+}
+
+bool X11ShmCapture::capture_to(GdkWindow* window,
+                               uint8_t* dst,
+                               size_t capacity,
+                               int* width,
+                               int* height) {
+  return false;
+}
+
+struct X11PacedCapture::State {};
+
+X11PacedCapture::X11PacedCapture(int fps, size_t ring_capacity)
+    : fps_(fps), state_(new State()), pool_(ring_capacity + 2), ring_(ring_capacity) {}
+
+X11PacedCapture::~X11PacedCapture() = default;
+
+bool X11PacedCapture::start(GdkDisplay* display,
+                            const CaptureRect& rect,
+                            int64_t start_time_us,
+                            std::string* error_message) {
+  *error_message = "This build has no X11 MIT-SHM support.";
+  return false;
+}
+
+void X11PacedCapture::stop() {}
+
+void X11PacedCapture::set_rect(const CaptureRect& rect) {}
+
+void X11PacedCapture::run() {}
+
+bool X11PacedCapture::grab(FramePtr* frame) {
+  return false;
+}
+
+bool X11PacedCapture::attach(int width, int height) {
+  return false;
+}
+
+void X11PacedCapture::detach() {}
+
+#endif
+
+}
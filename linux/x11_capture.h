@@ -0,0 +1,123 @@
+#ifndef RECASTER_X11_CAPTURE_H_
+#define RECASTER_X11_CAPTURE_H_
+
+#include <gtk/gtk.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "frame_data.h"
+#include "frame_pool.h"
+#include "spsc_ring.h"
+
+namespace recaster {
+
+// Reads a window back with MIT-SHM XShmGetImage into a shared-memory segment
+// that is kept across frames, so pixels no longer travel through the X socket
+// as they do with the XGetImage behind gdk_pixbuf_get_from_window. The
+// segment is reallocated only when the window size changes. Main thread only.
+class X11ShmCapture {
+ public:
+  X11ShmCapture();
+  ~X11ShmCapture();
+
+  X11ShmCapture(const X11ShmCapture&) = delete;
+  X11ShmCapture& operator=(const X11ShmCapture&) = delete;
+
+  // Returns `window` as a pooled BGRA frame, or nullptr when it cannot be
+  // read this way; the caller then falls back to GDK. Wayland, a server
+  // without MIT-SHM or on another host, an unsupported visual and a
+  // non-empty RECASTER_NO_XSHM environment variable disable it for good.
+  std::shared_ptr<FrameData> capture(GdkWindow* window, FramePool* pool);
+  // Same, converting straight into `dst` when the window's BGRA pixels fit
+  // in `capacity` bytes. `width` and `height` are set whenever the window was
+  // read, even if it did not fit.
+  bool capture_to(GdkWindow* window, uint8_t* dst, size_t capacity, int* width, int* height);
+
+  bool disabled() const { return disabled_; }
+
+ private:
+  struct State;
+
+  // Leaves the window's pixels in the segment's image.
+  bool read(GdkWindow* window);
+  bool allocate(GdkWindow* native, int width, int height);
+  void release();
+
+  std::unique_ptr<State> state_;
+  bool disabled_ = false;
+};
+
+// Where a paced capture reads from, in root window device pixels.
+struct CaptureRect {
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+};
+
+// High-frame-rate capture: a dedicated thread with its own X connection
+// grabs the screen area under the window with XShmGetImage on a fixed
+// deadline schedule, converts into buffers from a preallocated pool and
+// hands frames to the main thread through a lock-free ring. Reading from the
+// root window keeps a moved or resized window from failing the grab; the
+// main thread only updates the rectangle.
+class X11PacedCapture {
+ public:
+  X11PacedCapture(int fps, size_t ring_capacity);
+  ~X11PacedCapture();
+
+  X11PacedCapture(const X11PacedCapture&) = delete;
+  X11PacedCapture& operator=(const X11PacedCapture&) = delete;
+
+  // Connects to `display`'s server and starts the thread. Frame timestamps
+  // are g_get_monotonic_time() minus `start_time_us`.
+  bool start(GdkDisplay* display,
+             const CaptureRect& rect,
+             int64_t start_time_us,
+             std::string* error_message);
+  // Joins the thread; frames already captured stay in the ring.
+  void stop();
+
+  void set_rect(const CaptureRect& rect);
+  // Main thread: the oldest frame not yet taken.
+  bool pop(FramePtr* frame) { return ring_.pop(frame); }
+
+  int fps() const { return fps_; }
+  uint64_t frames_captured() const { return frames_captured_.load(); }
+  // Deadlines that passed while a grab was still running.
+  uint64_t slots_missed() const { return slots_missed_.load(); }
+  // Frames discarded because the main thread had not taken the ring's.
+  uint64_t ring_overflows() const { return ring_overflows_.load(); }
+  uint64_t grab_failures() const { return grab_failures_.load(); }
+
+ private:
+  struct State;
+
+  void run();
+  bool grab(FramePtr* frame);
+  bool attach(int width, int height);
+  void detach();
+
+  int fps_;
+  std::unique_ptr<State> state_;
+  FramePool pool_;
+  SpscRing<FramePtr> ring_;
+  int64_t start_time_us_ = 0;
+  std::mutex rect_mutex_;
+  CaptureRect rect_;
+  std::thread thread_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<uint64_t> frames_captured_{0};
+  std::atomic<uint64_t> slots_missed_{0};
+  std::atomic<uint64_t> ring_overflows_{0};
+  std::atomic<uint64_t> grab_failures_{0};
+};
+
+}
+
+#endif
@@ -95,8 +95,23 @@ public class RecasterPlugin: NSObject, FlutterPlugin {
       return
     }
 
-    var width = max(1, firstFrame.width / resolutionDivisor)
-    var height = max(1, firstFrame.height / resolutionDivisor)
+    var scaledWidth = Double(max(1, firstFrame.width / resolutionDivisor))
+    var scaledHeight = Double(max(1, firstFrame.height / resolutionDivisor))
+    if let scale = args["scale"] as? Double, scale > 0, scale <= 1 {
+      scaledWidth *= scale
+      scaledHeight *= scale
+    }
+    var fit = 1.0
+    if let maxWidth = args["maxWidth"] as? Int, maxWidth > 0, scaledWidth > Double(maxWidth) {
+      fit = min(fit, Double(maxWidth) / scaledWidth)
+    }
+    if let maxHeight = args["maxHeight"] as? Int, maxHeight > 0,
+      scaledHeight > Double(maxHeight)
+    {
+      fit = min(fit, Double(maxHeight) / scaledHeight)
+    }
+    var width = max(1, Int((scaledWidth * fit).rounded()))
+    var height = max(1, Int((scaledHeight * fit).rounded()))
     if width > 1 && width % 2 != 0 {
       width -= 1
     }
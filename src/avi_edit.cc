@@ -0,0 +1,723 @@
+#include "avi_edit.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+
+#include "avi_writer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RECASTER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace recaster {
+
+namespace {
+
+// RIFF sizes and 'idx1' offsets are 32-bit.
+constexpr uint64_t kMaxAviSize = 0xFFFFFFFFULL;
+// Upper bound on one copy, so progress and cancellation stay responsive.
+constexpr uint64_t kCopyBytes = 64ULL << 20;
+
+template <typename T>
+T get(const uint8_t* data, size_t offset) {
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+template <typename T>
+void put(uint8_t* data, size_t offset, T value) {
+  std::memcpy(data + offset, &value, sizeof(T));
+}
+
+void set_error(std::string* error_message, const char* message) {
+  if (error_message != nullptr) {
+    *error_message = message;
+  }
+}
+
+// Calls `visit(fourcc, body_offset, body_size)` for each chunk in
+// [begin, end). A truncated last chunk is clipped to `end`.
+void for_each_chunk(const uint8_t* data,
+                    size_t begin,
+                    size_t end,
+                    const std::function<void(const uint8_t*, size_t, size_t)>& visit) {
+  size_t pos = begin;
+  while (pos + 8 <= end) {
+    const size_t body = pos + 8;
+    const size_t size = std::min<size_t>(get<uint32_t>(data, pos + 4), end - body);
+    visit(data + pos, body, size);
+    pos = body + size + (size & 1U);
+  }
+}
+
+bool is_fourcc(const uint8_t* data, const char* fourcc) {
+  return std::memcmp(data, fourcc, 4) == 0;
+}
+
+int lowest_bit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// First offset in [begin, end) holding `fourcc`, or `end`. SSE2 matches
+// the first and last byte of 16 candidates at once.
+size_t find_fourcc(const uint8_t* data, size_t begin, size_t end, const char* fourcc) {
+  size_t pos = begin;
+#if defined(RECASTER_HAVE_SSE2)
+  const __m128i first = _mm_set1_epi8(fourcc[0]);
+  const __m128i last = _mm_set1_epi8(fourcc[3]);
+  while (pos + 19 <= end) {
+    const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+    const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 3));
+    const __m128i matches =
+        _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+    while (mask != 0) {
+      const size_t bit = static_cast<size_t>(lowest_bit(mask));
+      if (std::memcmp(data + pos + bit, fourcc, 4) == 0) {
+        return pos + bit;
+      }
+      mask &= mask - 1;
+    }
+    pos += 16;
+  }
+#endif
+  for (; pos + 4 <= end; ++pos) {
+    if (std::memcmp(data + pos, fourcc, 4) == 0) {
+      return pos;
+    }
+  }
+  return end;
+}
+
+// 'idx1' chunk for frames at `offsets`, relative to the 'movi' data.
+std::vector<uint8_t> build_index(const std::vector<uint32_t>& offsets, size_t frame_size) {
+  std::vector<uint8_t> index(8 + 16 * offsets.size());
+  std::memcpy(index.data(), "idx1", 4);
+  put<uint32_t>(index.data(), 4, static_cast<uint32_t>(16 * offsets.size()));
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    uint8_t* entry = index.data() + 8 + i * 16;
+    std::memcpy(entry, "00db", 4);
+    put<uint32_t>(entry, 4, 0x10);
+    put<uint32_t>(entry, 8, offsets[i]);
+    put<uint32_t>(entry, 12, static_cast<uint32_t>(frame_size));
+  }
+  return index;
+}
+
+bool same_file(const char* a, const char* b) {
+  std::error_code error;
+  return std::filesystem::equivalent(std::filesystem::u8path(a), std::filesystem::u8path(b),
+                                     error);
+}
+
+#if defined(_WIN32)
+
+class OutputFile {
+ public:
+  bool open(const char* path) {
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    return file_.is_open();
+  }
+
+  bool write(const uint8_t* data, size_t size) {
+    file_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    return file_.good();
+  }
+
+  bool copy(const AviReader& reader, uint64_t offset, uint64_t size) {
+    return write(reader.data() + offset, static_cast<size_t>(size));
+  }
+
+  bool close() {
+    if (!file_.is_open()) {
+      return true;
+    }
+    file_.flush();
+    const bool ok = file_.good();
+    file_.close();
+    return ok;
+  }
+
+ private:
+  std::ofstream file_;
+};
+
+#else
+
+class OutputFile {
+ public:
+  ~OutputFile() { close(); }
+
+  bool open(const char* path) {
+    fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return fd_ >= 0;
+  }
+
+  bool write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+      const ssize_t count = ::write(fd_, data, size);
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += count;
+      size -= static_cast<size_t>(count);
+    }
+    return true;
+  }
+
+  // Lets the kernel move the bytes, or clone them on filesystems that share
+  // extents; falls back to writing from the mapping.
+  bool copy(const AviReader& reader, uint64_t offset, uint64_t size) {
+#if defined(__linux__)
+    off_t input_offset = static_cast<off_t>(offset);
+    while (size > 0 && use_copy_range_) {
+      const ssize_t count =
+          copy_file_range(reader.fd(), &input_offset, fd_, nullptr, static_cast<size_t>(size), 0);
+      if (count > 0) {
+        size -= static_cast<uint64_t>(count);
+      } else if (count < 0 && errno == EINTR) {
+        continue;
+      } else if (count == 0 || errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                 errno == EOPNOTSUPP) {
+        use_copy_range_ = false;
+      } else {
+        return false;
+      }
+    }
+    offset = static_cast<uint64_t>(input_offset);
+#endif
+    return write(reader.data() + offset, static_cast<size_t>(size));
+  }
+
+  bool close() {
+    if (fd_ < 0) {
+      return true;
+    }
+    const bool ok = ::close(fd_) == 0;
+    fd_ = -1;
+    return ok;
+  }
+
+ private:
+  int fd_ = -1;
+  bool use_copy_range_ = true;
+};
+
+#endif
+
+}
+
+AviReader::~AviReader() {
+  close();
+}
+
+#if defined(_WIN32)
+
+void AviReader::close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  if (file_ != nullptr) {
+    CloseHandle(file_);
+    file_ = nullptr;
+  }
+  size_ = 0;
+  data_end_ = 0;
+  skipped_bytes_ = 0;
+  chunks_.clear();
+}
+
+bool AviReader::map_file(const char* path, std::string* error_message) {
+  const int count = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+  std::wstring wide_path(static_cast<size_t>(std::max(count, 1)), L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide_path[0], count);
+  HANDLE file = CreateFileW(wide_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    set_error(error_message, "Failed to open input file.");
+    return false;
+  }
+  file_ = file;
+  LARGE_INTEGER size = {};
+  if (!GetFileSizeEx(file, &size) || size.QuadPart < 12) {
+    set_error(error_message, "Input is not an AVI file.");
+    return false;
+  }
+  mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    set_error(error_message, "Failed to map input file.");
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    set_error(error_message, "Failed to map input file.");
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+#else
+
+void AviReader::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  size_ = 0;
+  data_end_ = 0;
+  skipped_bytes_ = 0;
+  chunks_.clear();
+}
+
+bool AviReader::map_file(const char* path, std::string* error_message) {
+  fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    set_error(error_message, "Failed to open input file.");
+    return false;
+  }
+  struct stat info = {};
+  if (fstat(fd_, &info) != 0 || info.st_size < 12) {
+    set_error(error_message, "Input is not an AVI file.");
+    return false;
+  }
+  void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED,
+                      fd_, 0);
+  if (mapped == MAP_FAILED) {
+    set_error(error_message, "Failed to map input file.");
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(mapped);
+  size_ = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+#endif
+
+bool AviReader::open(const char* path, std::string* error_message, AviChunkSource source) {
+  close();
+  if (!map_file(path, error_message) || !parse(source, error_message)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool AviReader::parse(AviChunkSource source, std::string* error_message) {
+  if (!is_fourcc(data_, "RIFF") || !is_fourcc(data_ + 8, "AVI ")) {
+    set_error(error_message, "Input is not an AVI file.");
+    return false;
+  }
+
+  int streams = 0;
+  bool video = false;
+  uint32_t scale = 0;
+  uint32_t rate = 0;
+  uint32_t compression = 1;
+  uint16_t bit_count = 0;
+  int32_t height = 0;
+  const uint8_t* data = data_;
+  layout_ = AviHeaderLayout();
+  layout_.riff_size = 4;
+  movi_start_ = 0;
+  has_index_ = false;
+
+  // RIFF and 'movi' sizes are still zero in a file that was never finished,
+  // so chunks are walked up to the end of the file instead.
+  for_each_chunk(data, 12, size_, [&](const uint8_t* id, size_t body, size_t size) {
+    if (is_fourcc(id, "idx1")) {
+      has_index_ = true;
+      index_start_ = body;
+      index_size_ = size;
+      return;
+    }
+    if (!is_fourcc(id, "LIST") || body + 4 > size_) {
+      return;
+    }
+    if (is_fourcc(data + body, "movi") && movi_start_ == 0) {
+      layout_.movi_size = body - 4;
+      movi_start_ = body + 4;
+      movi_end_ = size >= 4 ? body + size : size_;
+      return;
+    }
+    if (!is_fourcc(data + body, "hdrl")) {
+      return;
+    }
+    for_each_chunk(data, body + 4, body + size, [&](const uint8_t* id, size_t body, size_t size) {
+      if (is_fourcc(id, "avih") && size >= 20) {
+        layout_.avih_frames = body + 16;
+      }
+      if (!is_fourcc(id, "LIST") || size < 4 || !is_fourcc(data + body, "strl")) {
+        return;
+      }
+      ++streams;
+      for_each_chunk(data, body + 4, body + size,
+                     [&](const uint8_t* id, size_t body, size_t size) {
+                       if (is_fourcc(id, "strh") && size >= 36) {
+                         video = is_fourcc(data + body, "vids");
+                         scale = get<uint32_t>(data, body + 20);
+                         rate = get<uint32_t>(data, body + 24);
+                         layout_.strh_length = body + 32;
+                       } else if (is_fourcc(id, "strf") && size >= 40) {
+                         width_ = get<int32_t>(data, body + 4);
+                         height = get<int32_t>(data, body + 8);
+                         bit_count = get<uint16_t>(data, body + 14);
+                         compression = get<uint32_t>(data, body + 16);
+                       }
+                     });
+    });
+  });
+
+  if (streams != 1 || !video || compression != 0 || (bit_count != 24 && bit_count != 32) ||
+      width_ <= 0 || height == 0 || scale == 0 || rate == 0 || movi_start_ == 0 ||
+      layout_.avih_frames == 0) {
+    set_error(error_message, "Input is not a supported uncompressed AVI file.");
+    return false;
+  }
+  height_ = height < 0 ? -height : height;
+  format_ = bit_count == 24 ? PixelFormat::kBgr24 : PixelFormat::kBgra32;
+  fps_ = std::max(1, static_cast<int>((rate + scale / 2) / scale));
+  frame_size_ = frame_byte_size(width_, height_, format_);
+  if (source == AviChunkSource::kScan) {
+    scan_chunks();
+    return true;
+  }
+  return read_index(error_message);
+}
+
+bool AviReader::read_index(std::string* error_message) {
+  if (!has_index_) {
+    set_error(error_message, "Input has no index.");
+    return false;
+  }
+
+  // 'idx1' offsets are relative to the 'movi' data (AviWriter), to the
+  // 'movi' fourcc (the AVI spec) or absolute; the first entry tells which.
+  const uint8_t* data = data_;
+  const size_t entries = index_size_ / 16;
+  size_t base = 0;
+  bool based = false;
+  auto chunk_at = [&](size_t offset) {
+    return offset + 8 + frame_size_ <= movi_end_ && is_fourcc(data + offset, "00db") &&
+           get<uint32_t>(data, offset + 4) == frame_size_;
+  };
+  chunks_.reserve(entries);
+  for (size_t i = 0; i < entries; ++i) {
+    const uint8_t* entry = data + index_start_ + i * 16;
+    if (!is_fourcc(entry, "00db")) {
+      continue;
+    }
+    const size_t offset = get<uint32_t>(entry, 8);
+    if (get<uint32_t>(entry, 12) != frame_size_) {
+      set_error(error_message, "Input contains frames of an unexpected size.");
+      return false;
+    }
+    if (!based) {
+      for (const size_t candidate : {movi_start_, movi_start_ - 4, size_t{0}}) {
+        if (chunk_at(candidate + offset)) {
+          base = candidate;
+          based = true;
+          break;
+        }
+      }
+    }
+    if (!based || !chunk_at(base + offset)) {
+      set_error(error_message, "Input index is damaged.");
+      return false;
+    }
+    chunks_.push_back(base + offset);
+  }
+  data_end_ = chunks_.empty() ? movi_start_ : chunks_.back() + chunk_size();
+  return true;
+}
+
+void AviReader::scan_chunks() {
+  const size_t chunk = static_cast<size_t>(chunk_size());
+  auto chunk_at = [this](size_t offset) {
+    return offset + 8 <= size_ && is_fourcc(data_ + offset, "00db") &&
+           get<uint32_t>(data_, offset + 4) == frame_size_;
+  };
+  size_t pos = movi_start_;
+  while (pos + 8 <= size_) {
+    if (chunk_at(pos)) {
+      if (pos + chunk > size_) {
+        // The last frame was cut off.
+        break;
+      }
+      chunks_.push_back(pos);
+      pos += chunk;
+      continue;
+    }
+    if (is_fourcc(data_ + pos, "idx1")) {
+      // A previous index; it is rebuilt.
+      break;
+    }
+    // Resync on the next plausible chunk header.
+    size_t next = find_fourcc(data_, pos + 1, size_, "00db");
+    while (next < size_ && !chunk_at(next)) {
+      next = find_fourcc(data_, next + 1, size_, "00db");
+    }
+    if (next >= size_) {
+      break;
+    }
+    skipped_bytes_ += next - pos;
+    pos = next;
+  }
+  data_end_ = chunks_.empty() ? movi_start_ : chunks_.back() + chunk;
+}
+
+bool write_avi_clips(const char* output_path,
+                     const std::vector<AviClip>& clips,
+                     std::string* error_message,
+                     const WriteProgress& progress) {
+  size_t frame_count = 0;
+  for (const AviClip& clip : clips) {
+    const AviReader* first = clips.front().reader;
+    if (clip.reader == nullptr || clip.first_frame > clip.reader->frame_count() ||
+        clip.frame_count > clip.reader->frame_count() - clip.first_frame) {
+      set_error(error_message, "Clip range is outside the input.");
+      return false;
+    }
+    if (clip.reader->width() != first->width() || clip.reader->height() != first->height() ||
+        clip.reader->format() != first->format() || clip.reader->fps() != first->fps()) {
+      set_error(error_message, "Inputs must share frame size, pixel format and frame rate.");
+      return false;
+    }
+    frame_count += clip.frame_count;
+  }
+  if (frame_count == 0) {
+    set_error(error_message, "No frames to write.");
+    return false;
+  }
+
+  const AviReader& reference = *clips.front().reader;
+  const uint64_t chunk_size = reference.chunk_size();
+  AviHeaderLayout layout;
+  std::vector<uint8_t> header = build_avi_header(reference.width(), reference.height(),
+                                                 reference.format(), reference.fps(), &layout);
+  const uint64_t movi_bytes = chunk_size * frame_count;
+  const uint64_t total = header.size() + movi_bytes + 8 + 16ULL * frame_count;
+  if (total > kMaxAviSize) {
+    set_error(error_message, "Output would exceed the 4 GB AVI size limit.");
+    return false;
+  }
+  put<uint32_t>(header.data(), layout.riff_size, static_cast<uint32_t>(total - 8));
+  put<uint32_t>(header.data(), layout.avih_frames, static_cast<uint32_t>(frame_count));
+  put<uint32_t>(header.data(), layout.strh_length, static_cast<uint32_t>(frame_count));
+  put<uint32_t>(header.data(), layout.movi_size, static_cast<uint32_t>(4 + movi_bytes));
+
+  OutputFile output;
+  if (!output.open(output_path)) {
+    set_error(error_message, "Failed to open output file.");
+    return false;
+  }
+  auto fail = [&](const char* message) {
+    set_error(error_message, message);
+    output.close();
+    std::remove(output_path);
+    return false;
+  };
+  if (!output.write(header.data(), header.size())) {
+    return fail("Failed to write output file.");
+  }
+
+  // Adjacent chunks are copied as one range.
+  const size_t max_run = static_cast<size_t>(std::max<uint64_t>(1, kCopyBytes / chunk_size));
+  size_t frames_written = 0;
+  uint64_t bytes_written = header.size();
+  for (const AviClip& clip : clips) {
+    const AviReader& reader = *clip.reader;
+    const size_t end = clip.first_frame + clip.frame_count;
+    size_t frame = clip.first_frame;
+    while (frame < end) {
+      size_t run_end = frame + 1;
+      while (run_end < end && run_end - frame < max_run &&
+             reader.chunk_offset(run_end) == reader.chunk_offset(run_end - 1) + chunk_size) {
+        ++run_end;
+      }
+      const uint64_t bytes = (run_end - frame) * chunk_size;
+      if (!output.copy(reader, reader.chunk_offset(frame), bytes)) {
+        return fail("Failed to write output file.");
+      }
+      frames_written += run_end - frame;
+      bytes_written += bytes;
+      frame = run_end;
+      if (progress && !progress(frames_written, bytes_written)) {
+        return fail("Write was cancelled.");
+      }
+    }
+  }
+
+  std::vector<uint32_t> offsets(frame_count);
+  for (size_t i = 0; i < frame_count; ++i) {
+    offsets[i] = static_cast<uint32_t>(i * chunk_size);
+  }
+  const std::vector<uint8_t> index = build_index(offsets, reference.frame_size());
+  if (!output.write(index.data(), index.size()) || !output.close()) {
+    return fail("Failed to finalize AVI output.");
+  }
+  return true;
+}
+
+bool trim_avi_file(const char* input_path,
+                   const char* output_path,
+                   int64_t start_us,
+                   int64_t end_us,
+                   std::string* error_message,
+                   const WriteProgress& progress) {
+  if (same_file(input_path, output_path)) {
+    set_error(error_message, "outputPath must differ from the input.");
+    return false;
+  }
+  AviReader reader;
+  if (!reader.open(input_path, error_message)) {
+    return false;
+  }
+  // Frame k is on screen from k / fps until (k + 1) / fps.
+  const int64_t fps = reader.fps();
+  const size_t count = reader.frame_count();
+  const size_t first =
+      static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(0, start_us) * fps / 1000000,
+                                            static_cast<int64_t>(count)));
+  const size_t end = end_us < 0 ? count
+                                : static_cast<size_t>(std::min<int64_t>(
+                                      (end_us * fps + 999999) / 1000000,
+                                      static_cast<int64_t>(count)));
+  if (first >= end) {
+    set_error(error_message, "The trim range contains no frames.");
+    return false;
+  }
+  return write_avi_clips(output_path, {AviClip{&reader, first, end - first}}, error_message,
+                         progress);
+}
+
+bool concat_avi_files(const std::vector<std::string>& input_paths,
+                      const char* output_path,
+                      std::string* error_message,
+                      const WriteProgress& progress) {
+  std::vector<std::unique_ptr<AviReader>> readers;
+  std::vector<AviClip> clips;
+  for (const std::string& path : input_paths) {
+    if (same_file(path.c_str(), output_path)) {
+      set_error(error_message, "outputPath must differ from the inputs.");
+      return false;
+    }
+    auto reader = std::make_unique<AviReader>();
+    std::string error;
+    if (!reader->open(path.c_str(), &error)) {
+      if (error_message != nullptr) {
+        *error_message = path + ": " + error;
+      }
+      return false;
+    }
+    clips.push_back(AviClip{reader.get(), 0, reader->frame_count()});
+    readers.push_back(std::move(reader));
+  }
+  if (clips.empty()) {
+    set_error(error_message, "No inputs were given.");
+    return false;
+  }
+  return write_avi_clips(output_path, clips, error_message, progress);
+}
+
+bool recover_avi_file(const char* path, AviRecovery* recovery, std::string* error_message) {
+  AviReader reader;
+  if (!reader.open(path, error_message, AviChunkSource::kScan)) {
+    return false;
+  }
+  if (reader.frame_count() == 0) {
+    set_error(error_message, "No complete frames were found.");
+    return false;
+  }
+
+  const AviHeaderLayout layout = reader.layout();
+  const uint64_t data_end = reader.data_end();
+  const uint64_t file_size = reader.file_size();
+  std::vector<uint32_t> offsets(reader.frame_count());
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    offsets[i] = static_cast<uint32_t>(reader.chunk_offset(i) - reader.movi_start());
+  }
+  const std::vector<uint8_t> index = build_index(offsets, reader.frame_size());
+  const uint64_t total = data_end + index.size();
+  if (total > kMaxAviSize) {
+    set_error(error_message, "Recovered file would exceed the 4 GB AVI size limit.");
+    return false;
+  }
+  if (recovery != nullptr) {
+    recovery->frames = reader.frame_count();
+    recovery->skipped_bytes = reader.skipped_bytes();
+    recovery->truncated_bytes = file_size - data_end;
+  }
+  // Unmapped first: Windows cannot truncate a mapped file.
+  reader.close();
+
+  std::error_code resize_error;
+  std::filesystem::resize_file(std::filesystem::u8path(path), data_end, resize_error);
+  if (resize_error) {
+    set_error(error_message, "Failed to truncate the damaged tail.");
+    return false;
+  }
+  std::fstream file(std::filesystem::u8path(path),
+                    std::ios::binary | std::ios::in | std::ios::out);
+  auto patch = [&file](uint64_t offset, uint64_t value) {
+    const uint32_t field = static_cast<uint32_t>(value);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(reinterpret_cast<const char*>(&field), sizeof(field));
+  };
+  patch(layout.riff_size, total - 8);
+  patch(layout.movi_size, data_end - layout.movi_size - 4);
+  patch(layout.avih_frames, offsets.size());
+  patch(layout.strh_length, offsets.size());
+  file.seekp(static_cast<std::streamoff>(data_end));
+  file.write(reinterpret_cast<const char*>(index.data()),
+             static_cast<std::streamsize>(index.size()));
+  file.flush();
+  if (!file.good()) {
+    set_error(error_message, "Failed to write the rebuilt index.");
+    return false;
+  }
+  return true;
+}
+
+}
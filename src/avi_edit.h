@@ -0,0 +1,138 @@
+#ifndef RECASTER_AVI_EDIT_H_
+#define RECASTER_AVI_EDIT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "avi_writer.h"
+#include "frame_data.h"
+
+namespace recaster {
+
+// Where AviReader finds the frame chunks.
+enum class AviChunkSource {
+  // The 'idx1' table; a file without one fails to open.
+  kIndex,
+  // A linear scan of 'movi' that skips damaged bytes, for files whose writer
+  // never reached finish().
+  kScan,
+};
+
+// Memory-mapped view of an uncompressed DIB AVI as written by AviWriter:
+// the stream format and the location of every '00db' frame chunk.
+class AviReader {
+ public:
+  AviReader() = default;
+  ~AviReader();
+
+  AviReader(const AviReader&) = delete;
+  AviReader& operator=(const AviReader&) = delete;
+
+  bool open(const char* path,
+            std::string* error_message,
+            AviChunkSource source = AviChunkSource::kIndex);
+  void close();
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  PixelFormat format() const { return format_; }
+  int fps() const { return fps_; }
+  size_t frame_count() const { return chunks_.size(); }
+  size_t frame_size() const { return frame_size_; }
+  // File offset of frame `index`'s chunk header; the chunk, including its
+  // padding, is chunk_size() bytes long.
+  uint64_t chunk_offset(size_t index) const { return chunks_[index]; }
+  uint64_t chunk_size() const { return 8 + frame_size_ + (frame_size_ & 1U); }
+  const uint8_t* pixels(size_t index) const { return data_ + chunks_[index] + 8; }
+  const uint8_t* data() const { return data_; }
+  uint64_t file_size() const { return size_; }
+  // Where the header's size and frame count fields are in this file.
+  const AviHeaderLayout& layout() const { return layout_; }
+  // First byte of 'movi' data; 'idx1' offsets are relative to it.
+  uint64_t movi_start() const { return movi_start_; }
+  // With kScan: the end of the last complete chunk, and the bytes between
+  // chunks that did not parse.
+  uint64_t data_end() const { return data_end_; }
+  uint64_t skipped_bytes() const { return skipped_bytes_; }
+#if !defined(_WIN32)
+  int fd() const { return fd_; }
+#endif
+
+ private:
+  bool map_file(const char* path, std::string* error_message);
+  bool parse(AviChunkSource source, std::string* error_message);
+  bool read_index(std::string* error_message);
+  void scan_chunks();
+
+#if defined(_WIN32)
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  PixelFormat format_ = PixelFormat::kBgra32;
+  int fps_ = 0;
+  size_t frame_size_ = 0;
+  AviHeaderLayout layout_;
+  size_t movi_start_ = 0;
+  size_t movi_end_ = 0;
+  size_t index_start_ = 0;
+  size_t index_size_ = 0;
+  bool has_index_ = false;
+  uint64_t data_end_ = 0;
+  uint64_t skipped_bytes_ = 0;
+  std::vector<uint64_t> chunks_;
+};
+
+// Frames [first_frame, first_frame + frame_count) of an open reader.
+struct AviClip {
+  const AviReader* reader = nullptr;
+  size_t first_frame = 0;
+  size_t frame_count = 0;
+};
+
+// Writes `clips` back to back as a new AVI without decoding: the frame chunks
+// are copied straight from the inputs (copy_file_range where available) and
+// the headers and index are rebuilt. Clips must share size, format and fps.
+bool write_avi_clips(const char* output_path,
+                     const std::vector<AviClip>& clips,
+                     std::string* error_message,
+                     const WriteProgress& progress = nullptr);
+
+// Keeps the frames shown from `start_us` up to `end_us`; a negative `end_us`
+// keeps everything to the end.
+bool trim_avi_file(const char* input_path,
+                   const char* output_path,
+                   int64_t start_us,
+                   int64_t end_us,
+                   std::string* error_message,
+                   const WriteProgress& progress = nullptr);
+
+bool concat_avi_files(const std::vector<std::string>& input_paths,
+                      const char* output_path,
+                      std::string* error_message,
+                      const WriteProgress& progress = nullptr);
+
+struct AviRecovery {
+  size_t frames = 0;
+  // Damaged bytes between frames, left in place but not indexed.
+  uint64_t skipped_bytes = 0;
+  // Partial frame or stale index cut from the end of the file.
+  uint64_t truncated_bytes = 0;
+};
+
+// Repairs an AVI whose writer was killed before finish(): finds the frame
+// chunks by scanning, then truncates the file after the last complete chunk,
+// appends a new 'idx1' and patches the header sizes in place. The frame data
+// is not moved.
+bool recover_avi_file(const char* path, AviRecovery* recovery, std::string* error_message);
+
+}
+
+#endif
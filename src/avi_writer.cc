@@ -0,0 +1,498 @@
+#include "avi_writer.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "worker_pool.h"
+
+namespace recaster {
+
+namespace {
+
+void write_fourcc(std::ofstream& file, const char* value) {
+  file.write(value, 4);
+}
+
+void write_u32(std::ofstream& file, uint32_t value) {
+  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+uint32_t streampos_to_u32(std::streampos pos) {
+  return static_cast<uint32_t>(static_cast<std::streamoff>(pos));
+}
+
+std::streampos begin_chunk(std::ofstream& file, const char* fourcc) {
+  write_fourcc(file, fourcc);
+  const std::streampos size_pos = file.tellp();
+  write_u32(file, 0);
+  return size_pos;
+}
+
+void end_chunk(std::ofstream& file, std::streampos size_pos) {
+  const std::streampos end_pos = file.tellp();
+  uint32_t size = streampos_to_u32(end_pos - (size_pos + std::streamoff(4)));
+  file.seekp(size_pos);
+  write_u32(file, size);
+  file.seekp(end_pos);
+  if ((size & 1U) != 0U) {
+    const uint8_t pad = 0;
+    file.write(reinterpret_cast<const char*>(&pad), sizeof(pad));
+  }
+}
+
+void patch_u32(std::ofstream& file, std::streampos pos, uint32_t value) {
+  const std::streampos end_pos = file.tellp();
+  file.seekp(pos);
+  write_u32(file, value);
+  file.seekp(end_pos);
+}
+
+#if !defined(_WIN32)
+
+void put_u32(uint8_t* data, size_t offset, uint32_t value) {
+  memcpy(data + offset, &value, sizeof(value));
+}
+
+void set_error(std::string* error_message, const char* message) {
+  if (error_message != nullptr) {
+    *error_message = message;
+  }
+}
+
+// Writes all of `parts` at `offset`, resuming after short writes.
+bool pwrite_all(int fd, iovec* parts, int count, uint64_t offset) {
+  while (count > 0) {
+    const ssize_t written = pwritev(fd, parts, count, static_cast<off_t>(offset));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    offset += static_cast<uint64_t>(written);
+    size_t remaining = static_cast<size_t>(written);
+    while (count > 0 && remaining >= parts->iov_len) {
+      remaining -= parts->iov_len;
+      ++parts;
+      --count;
+    }
+    if (count > 0) {
+      parts->iov_base = static_cast<uint8_t*>(parts->iov_base) + remaining;
+      parts->iov_len -= remaining;
+    }
+  }
+  return true;
+}
+
+#endif
+
+}
+
+std::vector<uint8_t> build_avi_header(int width,
+                                      int height,
+                                      PixelFormat format,
+                                      int fps,
+                                      AviHeaderLayout* layout) {
+  const uint32_t frame_size = static_cast<uint32_t>(frame_byte_size(width, height, format));
+  std::vector<uint8_t> header;
+  header.reserve(224);
+  auto put_fourcc = [&header](const char* value) { header.insert(header.end(), value, value + 4); };
+  auto put_u32 = [&header](uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      header.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  };
+  auto put_u16 = [&header](uint16_t value) {
+    header.push_back(static_cast<uint8_t>(value));
+    header.push_back(static_cast<uint8_t>(value >> 8));
+  };
+  auto begin_chunk = [&](const char* fourcc) {
+    put_fourcc(fourcc);
+    put_u32(0);
+    return header.size() - 4;
+  };
+  auto begin_list = [&](const char* list_type) {
+    const size_t size_pos = begin_chunk("LIST");
+    put_fourcc(list_type);
+    return size_pos;
+  };
+  // Every header chunk has an even size, so no padding is needed.
+  auto end_chunk = [&header](size_t size_pos) {
+    const uint32_t size = static_cast<uint32_t>(header.size() - size_pos - 4);
+    memcpy(header.data() + size_pos, &size, sizeof(size));
+  };
+
+  layout->riff_size = begin_chunk("RIFF");
+  put_fourcc("AVI ");
+
+  const size_t hdrl_size_pos = begin_list("hdrl");
+
+  const size_t avih_size_pos = begin_chunk("avih");
+  put_u32(static_cast<uint32_t>(1000000 / std::max(1, fps)));
+  put_u32(frame_size * static_cast<uint32_t>(fps));
+  put_u32(0);
+  put_u32(0x10);
+  layout->avih_frames = header.size();
+  put_u32(0);
+  put_u32(0);
+  put_u32(1);
+  put_u32(frame_size);
+  put_u32(static_cast<uint32_t>(width));
+  put_u32(static_cast<uint32_t>(height));
+  put_u32(0);
+  put_u32(0);
+  put_u32(0);
+  put_u32(0);
+  end_chunk(avih_size_pos);
+
+  const size_t strl_size_pos = begin_list("strl");
+
+  const size_t strh_size_pos = begin_chunk("strh");
+  put_fourcc("vids");
+  put_fourcc("DIB ");
+  put_u32(0);
+  put_u16(0);
+  put_u16(0);
+  put_u32(0);
+  put_u32(1);
+  put_u32(static_cast<uint32_t>(std::max(1, fps)));
+  put_u32(0);
+  layout->strh_length = header.size();
+  put_u32(0);
+  put_u32(frame_size);
+  put_u32(0xFFFFFFFF);
+  put_u32(0);
+  put_u16(0);
+  put_u16(0);
+  put_u16(static_cast<uint16_t>(width));
+  put_u16(static_cast<uint16_t>(height));
+  end_chunk(strh_size_pos);
+
+  const size_t strf_size_pos = begin_chunk("strf");
+  put_u32(40);
+  put_u32(static_cast<uint32_t>(width));
+  put_u32(static_cast<uint32_t>(static_cast<int32_t>(-height)));
+  put_u16(1);
+  put_u16(static_cast<uint16_t>(bits_per_pixel(format)));
+  put_u32(0);
+  put_u32(frame_size);
+  put_u32(0);
+  put_u32(0);
+  put_u32(0);
+  put_u32(0);
+  end_chunk(strf_size_pos);
+
+  end_chunk(strl_size_pos);
+  end_chunk(hdrl_size_pos);
+
+  layout->movi_size = begin_list("movi");
+  return header;
+}
+
+bool AviWriter::open(const char* output_path,
+                     int width,
+                     int height,
+                     PixelFormat format,
+                     int fps,
+                     std::string* error_message) {
+  if (output_path == nullptr || strlen(output_path) == 0) {
+    if (error_message != nullptr) {
+      *error_message = "outputPath is required.";
+    }
+    return false;
+  }
+  if (width <= 0 || height <= 0) {
+    if (error_message != nullptr) {
+      *error_message = "Invalid frame size.";
+    }
+    return false;
+  }
+
+  frame_size_ = frame_byte_size(width, height, format);
+  index_.clear();
+
+  file_.open(output_path, std::ios::binary | std::ios::trunc);
+  if (!file_.is_open()) {
+    if (error_message != nullptr) {
+      *error_message = "Failed to open output file.";
+    }
+    return false;
+  }
+
+  AviHeaderLayout layout;
+  const std::vector<uint8_t> header = build_avi_header(width, height, format, fps, &layout);
+  file_.write(reinterpret_cast<const char*>(header.data()),
+              static_cast<std::streamsize>(header.size()));
+  riff_size_pos_ = static_cast<std::streamoff>(layout.riff_size);
+  avih_frames_pos_ = static_cast<std::streamoff>(layout.avih_frames);
+  strh_length_pos_ = static_cast<std::streamoff>(layout.strh_length);
+  movi_size_pos_ = static_cast<std::streamoff>(layout.movi_size);
+  movi_data_start_ = file_.tellp();
+  return file_.good();
+}
+
+bool AviWriter::append(const uint8_t* pixels, size_t size) {
+  if (!file_.is_open() || pixels == nullptr || size != frame_size_) {
+    return false;
+  }
+
+  const std::streampos chunk_start = file_.tellp();
+  const std::streampos frame_size_pos = begin_chunk(file_, "00db");
+  file_.write(reinterpret_cast<const char*>(pixels), static_cast<std::streamsize>(size));
+  end_chunk(file_, frame_size_pos);
+
+  IndexEntry entry;
+  entry.offset = streampos_to_u32(chunk_start - movi_data_start_);
+  entry.size = static_cast<uint32_t>(size);
+  index_.push_back(entry);
+  return file_.good();
+}
+
+uint64_t AviWriter::bytes_written() {
+  if (!file_.is_open()) {
+    return 0;
+  }
+  return static_cast<uint64_t>(static_cast<std::streamoff>(file_.tellp()));
+}
+
+bool AviWriter::finish(std::string* error_message) {
+  if (!file_.is_open()) {
+    if (error_message != nullptr) {
+      *error_message = "Output file is not open.";
+    }
+    return false;
+  }
+
+  end_chunk(file_, movi_size_pos_);
+
+  const std::streampos idx1_size_pos = begin_chunk(file_, "idx1");
+  for (const IndexEntry& entry : index_) {
+    write_fourcc(file_, "00db");
+    write_u32(file_, 0x10);
+    write_u32(file_, entry.offset);
+    write_u32(file_, entry.size);
+  }
+  end_chunk(file_, idx1_size_pos);
+
+  end_chunk(file_, riff_size_pos_);
+  patch_u32(file_, avih_frames_pos_, frame_count());
+  patch_u32(file_, strh_length_pos_, frame_count());
+  file_.flush();
+
+  const bool ok = file_.good();
+  file_.close();
+  if (!ok) {
+    if (error_message != nullptr) {
+      *error_message = "Failed to finalize AVI output.";
+    }
+    return false;
+  }
+  return true;
+}
+
+bool write_avi_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    std::string* error_message,
+                    const WriteProgress& progress) {
+  return write_avi_file(
+      output_path, frames.size(), [&frames](size_t index) { return frames[index]; }, fps,
+      error_message, progress);
+}
+
+bool write_avi_file(const char* output_path,
+                    size_t frame_count,
+                    const FrameSource& frames,
+                    int fps,
+                    std::string* error_message,
+                    const WriteProgress& progress) {
+  const FramePtr first = frame_count > 0 ? frames(0) : nullptr;
+  if (first == nullptr) {
+    if (error_message != nullptr) {
+      *error_message = frame_count > 0 ? "Failed to read frame." : "No frames were captured.";
+    }
+    return false;
+  }
+
+  AviWriter writer;
+  if (!writer.open(output_path, first->width, first->height, first->format, fps,
+                   error_message)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < frame_count; ++i) {
+    const FramePtr frame_ptr = i == 0 ? first : frames(i);
+    if (frame_ptr == nullptr) {
+      if (error_message != nullptr) {
+        *error_message = "Failed to read frame.";
+      }
+      return false;
+    }
+    const FrameData& frame = *frame_ptr;
+    if (frame.width != first->width || frame.height != first->height ||
+        frame.format != first->format) {
+      continue;
+    }
+    if (!writer.append(frame.pixels.data(), frame.pixels.size())) {
+      if (error_message != nullptr) {
+        *error_message = "Failed to write frame.";
+      }
+      return false;
+    }
+    if (progress && !progress(writer.frame_count(), writer.bytes_written())) {
+      if (error_message != nullptr) {
+        *error_message = "Write was cancelled.";
+      }
+      return false;
+    }
+  }
+
+  return writer.finish(error_message);
+}
+
+bool write_avi_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    WorkerPool* pool,
+                    std::string* error_message,
+                    const WriteProgress& progress) {
+#if defined(_WIN32)
+  return write_avi_file(output_path, frames, fps, error_message, progress);
+#else
+  if (pool == nullptr) {
+    return write_avi_file(output_path, frames, fps, error_message, progress);
+  }
+  if (output_path == nullptr || strlen(output_path) == 0) {
+    set_error(error_message, "outputPath is required.");
+    return false;
+  }
+  if (frames.empty()) {
+    set_error(error_message, "No frames were captured.");
+    return false;
+  }
+  const FrameData& first = *frames.front();
+  if (first.width <= 0 || first.height <= 0) {
+    set_error(error_message, "Invalid frame size.");
+    return false;
+  }
+  const size_t frame_size = frame_byte_size(first.width, first.height, first.format);
+  std::vector<const FrameData*> accepted;
+  accepted.reserve(frames.size());
+  for (const FramePtr& frame : frames) {
+    if (frame->width != first.width || frame->height != first.height ||
+        frame->format != first.format) {
+      continue;
+    }
+    if (frame->pixels.size() != frame_size) {
+      set_error(error_message, "Failed to write frame.");
+      return false;
+    }
+    accepted.push_back(frame.get());
+  }
+
+  // Chunks are padded to even sizes; 'idx1' offsets count from the end of
+  // the header, as AviWriter writes them.
+  AviHeaderLayout layout;
+  std::vector<uint8_t> header =
+      build_avi_header(first.width, first.height, first.format, fps, &layout);
+  const uint64_t chunk_size = 8 + frame_size + (frame_size & 1U);
+  const uint64_t count = accepted.size();
+  const uint64_t idx1_offset = header.size() + count * chunk_size;
+  const uint64_t total_size = idx1_offset + 8 + count * 16;
+  put_u32(header.data(), layout.riff_size, static_cast<uint32_t>(total_size - 8));
+  put_u32(header.data(), layout.avih_frames, static_cast<uint32_t>(count));
+  put_u32(header.data(), layout.strh_length, static_cast<uint32_t>(count));
+  put_u32(header.data(), layout.movi_size, static_cast<uint32_t>(4 + count * chunk_size));
+
+  std::vector<uint8_t> index(8 + count * 16);
+  memcpy(index.data(), "idx1", 4);
+  put_u32(index.data(), 4, static_cast<uint32_t>(count * 16));
+  for (uint64_t i = 0; i < count; ++i) {
+    uint8_t* entry = index.data() + 8 + i * 16;
+    memcpy(entry, "00db", 4);
+    put_u32(entry, 4, 0x10);
+    put_u32(entry, 8, static_cast<uint32_t>(i * chunk_size));
+    put_u32(entry, 12, static_cast<uint32_t>(frame_size));
+  }
+
+  const int fd = ::open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    set_error(error_message, "Failed to open output file.");
+    return false;
+  }
+  // Reserving the whole file up front keeps it contiguous and fails early
+  // when the disk is too small.
+#if defined(__linux__)
+  const int reserved = posix_fallocate(fd, 0, static_cast<off_t>(total_size));
+#else
+  const int reserved = EOPNOTSUPP;
+#endif
+  if (reserved == ENOSPC) {
+    ::close(fd);
+    set_error(error_message, "Not enough disk space for the recording.");
+    return false;
+  }
+  if (reserved != 0 && ftruncate(fd, static_cast<off_t>(total_size)) != 0) {
+    ::close(fd);
+    set_error(error_message, "Failed to write frame.");
+    return false;
+  }
+  iovec header_part = {header.data(), header.size()};
+  bool ok = pwrite_all(fd, &header_part, 1, 0);
+
+  // Batches keep progress and cancellation responsive.
+  const size_t batch_size = static_cast<size_t>(pool->thread_count() + 1) * 4U;
+  std::atomic<bool> failed{false};
+  for (size_t batch = 0; ok && batch < accepted.size(); batch += batch_size) {
+    const size_t batch_count = std::min(batch_size, accepted.size() - batch);
+    pool->parallel_for(static_cast<int>(batch_count), 1, [&](int begin, int end) {
+      uint8_t chunk_header[8];
+      memcpy(chunk_header, "00db", 4);
+      put_u32(chunk_header, 4, static_cast<uint32_t>(frame_size));
+      uint8_t pad = 0;
+      for (int i = begin; i < end && !failed.load(); ++i) {
+        const size_t index_in_file = batch + static_cast<size_t>(i);
+        iovec parts[3] = {
+            {chunk_header, sizeof(chunk_header)},
+            {const_cast<uint8_t*>(accepted[index_in_file]->pixels.data()), frame_size},
+            {&pad, chunk_size - 8 - frame_size},
+        };
+        if (!pwrite_all(fd, parts, parts[2].iov_len > 0 ? 3 : 2,
+                        header.size() + index_in_file * chunk_size)) {
+          failed = true;
+        }
+      }
+    });
+    if (failed.load()) {
+      set_error(error_message, "Failed to write frame.");
+      ok = false;
+    } else if (progress &&
+               !progress(batch + batch_count, header.size() + (batch + batch_count) * chunk_size)) {
+      set_error(error_message, "Write was cancelled.");
+      ok = false;
+    }
+  }
+
+  iovec index_part = {index.data(), index.size()};
+  if (ok && !pwrite_all(fd, &index_part, 1, idx1_offset)) {
+    set_error(error_message, "Failed to finalize AVI output.");
+    ok = false;
+  }
+  if (::close(fd) != 0 && ok) {
+    set_error(error_message, "Failed to finalize AVI output.");
+    ok = false;
+  }
+  return ok;
+#endif
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef RECASTER_AVI_WRITER_H_
+#define RECASTER_AVI_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+// Offsets of the fields build_avi_header() leaves zero for the caller to fill
+// in once the frame count and chunk sizes are known.
+struct AviHeaderLayout {
+  size_t riff_size = 0;
+  size_t avih_frames = 0;
+  size_t strh_length = 0;
+  size_t movi_size = 0;
+};
+
+// RIFF header of a single-stream DIB AVI, up to the first byte of 'movi' data.
+std::vector<uint8_t> build_avi_header(int width,
+                                      int height,
+                                      PixelFormat format,
+                                      int fps,
+                                      AviHeaderLayout* layout);
+
+// Streaming writer for uncompressed DIB AVI files. Frame counts and chunk
+// sizes are patched in finish(), so frames can be appended as they arrive.
+class AviWriter {
+ public:
+  bool open(const char* output_path,
+            int width,
+            int height,
+            PixelFormat format,
+            int fps,
+            std::string* error_message);
+  bool append(const uint8_t* pixels, size_t size);
+  bool finish(std::string* error_message);
+
+  size_t frame_size() const { return frame_size_; }
+  uint32_t frame_count() const { return static_cast<uint32_t>(index_.size()); }
+  uint64_t bytes_written();
+
+ private:
+  struct IndexEntry {
+    uint32_t offset = 0;
+    uint32_t size = 0;
+  };
+
+  std::ofstream file_;
+  size_t frame_size_ = 0;
+  std::vector<IndexEntry> index_;
+  std::streampos riff_size_pos_;
+  std::streampos avih_frames_pos_;
+  std::streampos strh_length_pos_;
+  std::streampos movi_size_pos_;
+  std::streampos movi_data_start_;
+};
+
+// Writes an uncompressed DIB AVI. Frames whose size or format differ from the
+// first frame are skipped.
+bool write_avi_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    std::string* error_message,
+                    const WriteProgress& progress = nullptr);
+bool write_avi_file(const char* output_path,
+                    size_t frame_count,
+                    const FrameSource& frames,
+                    int fps,
+                    std::string* error_message,
+                    const WriteProgress& progress = nullptr);
+
+// Same output as above, written by `pool`'s threads. Frames all have one size,
+// so every chunk offset is known up front: the file is preallocated, batches
+// of frames are written concurrently with pwrite at their computed offsets
+// and 'idx1' is written in one block. Writes serially without a pool and on
+// Windows.
+bool write_avi_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    WorkerPool* pool,
+                    std::string* error_message,
+                    const WriteProgress& progress = nullptr);
+
+}
+
+#endif
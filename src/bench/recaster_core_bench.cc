@@ -0,0 +1,164 @@
+// Headless throughput check for the hot pipeline stages.
+//
+//   recaster_core_bench [width height] [--threads N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "avi_writer.h"
+#include "frame_blender.h"
+#include "frame_codec.h"
+#include "frame_data.h"
+#include "frame_resampler.h"
+#include "image_sequence_writer.h"
+#include "worker_pool.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Fn>
+double run_ms(int iterations, Fn fn) {
+  const Clock::time_point start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    fn();
+  }
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+// Gradient with some noise, closer to UI content than a flat fill.
+std::vector<uint8_t> make_pixels(int width, int height) {
+  std::vector<uint8_t> pixels(static_cast<size_t>(width) * static_cast<size_t>(height) * 4U);
+  uint32_t seed = 1;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint8_t* px = &pixels[(static_cast<size_t>(y) * width + x) * 4U];
+      seed = seed * 1103515245U + 12345U;
+      px[0] = static_cast<uint8_t>(x * 255 / width);
+      px[1] = static_cast<uint8_t>(y * 255 / height);
+      px[2] = static_cast<uint8_t>((seed >> 16) & 0x0f);
+      px[3] = 255;
+    }
+  }
+  return pixels;
+}
+
+}
+
+int main(int argc, char** argv) {
+  int width = 1920;
+  int height = 1080;
+  int threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (i + 1 < argc) {
+      width = atoi(argv[i]);
+      height = atoi(argv[++i]);
+    }
+  }
+  if (width <= 0 || height <= 0) {
+    fprintf(stderr, "usage: recaster_core_bench [width height] [--threads N]\n");
+    return 2;
+  }
+
+  recaster::WorkerPool pool(threads > 0 ? threads : recaster::WorkerPool::default_thread_count());
+  const std::vector<uint8_t> src = make_pixels(width, height);
+  printf("frame %dx%d, %d threads\n", width, height, pool.thread_count());
+
+  recaster::FrameResampler resampler;
+  const int dst_width = width / 2;
+  const int dst_height = height / 2;
+  std::vector<uint8_t> dst(static_cast<size_t>(dst_width) * dst_height * 4U);
+  const struct {
+    const char* name;
+    recaster::ResampleFilter filter;
+  } filters[] = {{"bilinear", recaster::ResampleFilter::kBilinear},
+                 {"bicubic", recaster::ResampleFilter::kBicubic},
+                 {"lanczos3", recaster::ResampleFilter::kLanczos3}};
+  for (const auto& entry : filters) {
+    const double ms = run_ms(20, [&] {
+      resampler.resample(src.data(), width, height, static_cast<size_t>(width) * 4U, dst.data(),
+                         dst_width, dst_height, entry.filter, &pool);
+    });
+    printf("resample %-8s 1/2   %8.2f ms\n", entry.name, ms);
+  }
+
+  std::vector<uint8_t> bgr(recaster::frame_byte_size(width, height, recaster::PixelFormat::kBgr24));
+  const double convert_ms = run_ms(20, [&] {
+    recaster::convert_bgra_frame(src.data(), width, height, recaster::PixelFormat::kBgr24,
+                                 bgr.data());
+  });
+  printf("convert bgra->bgr24    %8.2f ms\n", convert_ms);
+
+  // Per-capture cost of a time-lapse output; one in 60 calls also averages.
+  auto capture = std::make_shared<recaster::FrameData>();
+  capture->width = width;
+  capture->height = height;
+  capture->pixels = src;
+  recaster::FrameBlender blender(60);
+  const double blend_ms = run_ms(60, [&] { blender.add(capture, &pool); });
+  printf("time-lapse blend add   %8.2f ms\n", blend_ms);
+
+  for (recaster::FrameCodec codec :
+       {recaster::FrameCodec::kStored, recaster::FrameCodec::kLz4, recaster::FrameCodec::kZstd}) {
+    if (!recaster::frame_codec_available(codec)) {
+      printf("encode %-8s         unavailable\n", recaster::frame_codec_name(codec));
+      continue;
+    }
+    recaster::FrameEncoder encoder(codec, 1, std::vector<uint8_t>());
+    std::vector<uint8_t> encoded;
+    const double ms = run_ms(10, [&] { encoder.encode(src.data(), src.size(), &encoded); });
+    printf("encode %-8s         %8.2f ms  %.2fx\n", recaster::frame_codec_name(codec), ms,
+           encoded.empty() ? 0.0 : static_cast<double>(src.size()) / encoded.size());
+  }
+
+  // Finalize throughput, bounded by the temp directory's disk and page cache.
+  std::vector<recaster::FramePtr> frames;
+  for (int i = 0; i < 60; ++i) {
+    auto frame = std::make_shared<recaster::FrameData>();
+    frame->width = width;
+    frame->height = height;
+    frame->pixels = src;
+    frames.push_back(std::move(frame));
+  }
+  const std::string avi_path =
+      (std::filesystem::temp_directory_path() / "recaster_core_bench.avi").string();
+  const double serial_ms = run_ms(3, [&] {
+    recaster::write_avi_file(avi_path.c_str(), frames, 60, nullptr);
+  });
+  const double parallel_ms = run_ms(3, [&] {
+    recaster::write_avi_file(avi_path.c_str(), frames, 60, &pool, nullptr);
+  });
+  std::filesystem::remove(avi_path);
+  const double megabytes = static_cast<double>(src.size()) * frames.size() / (1 << 20);
+  printf("avi 60 frames serial   %8.2f ms  %.0f MB/s\n", serial_ms, megabytes * 1000 / serial_ms);
+  printf("avi 60 frames parallel %8.2f ms  %.0f MB/s\n", parallel_ms,
+         megabytes * 1000 / parallel_ms);
+
+  // Image sequences sync every file, so these include the disk's flush cost.
+  const std::string sequence_path =
+      (std::filesystem::temp_directory_path() / "recaster_core_bench.png").string();
+  for (recaster::ImageFormat format : {recaster::ImageFormat::kPng, recaster::ImageFormat::kQoi}) {
+    recaster::ImageSequenceOptions options;
+    options.format = format;
+    const double ms = run_ms(1, [&] {
+      recaster::write_image_sequence(
+          sequence_path.c_str(), frames.size(), [&frames](size_t index) { return frames[index]; },
+          60, options, &pool, nullptr);
+    });
+    for (size_t i = 0; i < frames.size(); ++i) {
+      std::filesystem::remove(recaster::image_sequence_frame_path(sequence_path, i));
+    }
+    std::filesystem::remove(recaster::image_sequence_manifest_path(sequence_path));
+    printf("%s 60 frames parallel %8.2f ms  %.0f fps\n",
+           format == recaster::ImageFormat::kPng ? "png" : "qoi", ms, frames.size() * 1000 / ms);
+  }
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "degradation_controller.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace recaster {
+
+namespace {
+
+constexpr double kLoadSmoothing = 0.2;
+constexpr size_t kMaxEvents = 256;
+
+}
+
+bool parse_degradation_step(const char* name, DegradationStep* step) {
+  if (name == nullptr || step == nullptr) {
+    return false;
+  }
+  if (strcmp(name, "reduceFps") == 0) {
+    *step = DegradationStep::kReduceFps;
+  } else if (strcmp(name, "increaseDivisor") == 0) {
+    *step = DegradationStep::kIncreaseDivisor;
+  } else if (strcmp(name, "raiseCompression") == 0) {
+    *step = DegradationStep::kRaiseCompression;
+  } else if (strcmp(name, "dropFrames") == 0) {
+    *step = DegradationStep::kDropFrames;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* degradation_step_name(DegradationStep step) {
+  switch (step) {
+    case DegradationStep::kIncreaseDivisor:
+      return "increaseDivisor";
+    case DegradationStep::kRaiseCompression:
+      return "raiseCompression";
+    case DegradationStep::kDropFrames:
+      return "dropFrames";
+    case DegradationStep::kReduceFps:
+    default:
+      return "reduceFps";
+  }
+}
+
+DegradationController::DegradationController(const DegradationPolicy& policy)
+    : policy_(policy) {}
+
+bool DegradationController::observe(int64_t now_us,
+                                    int64_t stage_us,
+                                    int64_t interval_us,
+                                    int64_t expected_interval_us,
+                                    uint64_t buffered_bytes) {
+  // Lateness counts as load too: it means the main loop is saturated by
+  // something other than the capture stage.
+  const double expected = static_cast<double>(std::max<int64_t>(1, expected_interval_us));
+  const int64_t late_us = std::max<int64_t>(0, interval_us - expected_interval_us);
+  const double sample = static_cast<double>(std::max<int64_t>(0, stage_us) + late_us) / expected;
+  load_ = primed_ ? load_ + kLoadSmoothing * (sample - load_) : sample;
+  primed_ = true;
+
+  const uint64_t budget = policy_.max_buffered_bytes;
+  const bool over_budget = budget > 0 && buffered_bytes > budget;
+  const bool pressure = load_ > policy_.target_load || over_budget;
+  const bool calm = load_ < policy_.target_load * 0.5 &&
+                    (budget == 0 || buffered_bytes < budget - budget / 5);
+
+  pressure_since_us_ = pressure ? (pressure_since_us_ < 0 ? now_us : pressure_since_us_) : -1;
+  calm_since_us_ = calm ? (calm_since_us_ < 0 ? now_us : calm_since_us_) : -1;
+
+  const int max_level = static_cast<int>(policy_.steps.size());
+  if (pressure && level_ < max_level &&
+      now_us - pressure_since_us_ >= policy_.escalate_after_us) {
+    ++level_;
+    apply_level();
+    record(now_us, policy_.steps[static_cast<size_t>(level_ - 1)], true, buffered_bytes);
+    pressure_since_us_ = now_us;
+    return true;
+  }
+  // Memory already buffered does not shrink while recording, so recovery only
+  // looks at load once the budget is no longer exceeded.
+  if (calm && level_ > 0 && now_us - calm_since_us_ >= policy_.recover_after_us) {
+    --level_;
+    apply_level();
+    record(now_us, policy_.steps[static_cast<size_t>(level_)], false, buffered_bytes);
+    calm_since_us_ = now_us;
+    return true;
+  }
+  return false;
+}
+
+bool DegradationController::should_drop(uint64_t buffered_bytes) const {
+  const uint64_t budget = policy_.max_buffered_bytes;
+  if (budget > 0 && buffered_bytes >= budget) {
+    return true;
+  }
+  return state_.drop_frames && load_ > policy_.target_load;
+}
+
+int DegradationController::buffer_compression_level() const {
+  if (state_.compression_boost == 0 || policy_.max_buffered_bytes == 0 ||
+      load_ > policy_.target_load) {
+    return 1;
+  }
+  return std::min(19, 1 + state_.compression_boost);
+}
+
+void DegradationController::apply_level() {
+  state_ = DegradationState();
+  for (int i = 0; i < level_; ++i) {
+    switch (policy_.steps[static_cast<size_t>(i)]) {
+      case DegradationStep::kReduceFps:
+        state_.fps_step = std::min(8, state_.fps_step * 2);
+        break;
+      case DegradationStep::kIncreaseDivisor:
+        state_.divisor_boost = std::min(8, state_.divisor_boost * 2);
+        break;
+      case DegradationStep::kRaiseCompression:
+        state_.compression_boost += 3;
+        break;
+      case DegradationStep::kDropFrames:
+        state_.drop_frames = true;
+        break;
+    }
+  }
+}
+
+void DegradationController::record(int64_t now_us,
+                                   DegradationStep step,
+                                   bool escalated,
+                                   uint64_t buffered_bytes) {
+  if (events_.size() >= kMaxEvents) {
+    events_.erase(events_.begin());
+  }
+  DegradationEvent event;
+  event.time_us = now_us;
+  event.level = level_;
+  event.step = step;
+  event.escalated = escalated;
+  event.load = load_;
+  event.buffered_bytes = buffered_bytes;
+  events_.push_back(event);
+}
+
+}
@@ -0,0 +1,96 @@
+#ifndef RECASTER_DEGRADATION_CONTROLLER_H_
+#define RECASTER_DEGRADATION_CONTROLLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace recaster {
+
+enum class DegradationStep {
+  kReduceFps,
+  kIncreaseDivisor,
+  kRaiseCompression,
+  kDropFrames,
+};
+
+bool parse_degradation_step(const char* name, DegradationStep* step);
+const char* degradation_step_name(DegradationStep step);
+
+// Steps are applied in order as pressure persists and undone in reverse as it
+// eases. A step may appear more than once (e.g. halve the frame rate twice).
+struct DegradationPolicy {
+  std::vector<DegradationStep> steps;
+  // Fraction of the tick interval the capture stage may use.
+  double target_load = 0.6;
+  // 0 disables the memory budget.
+  uint64_t max_buffered_bytes = 0;
+  int64_t escalate_after_us = 500000;
+  int64_t recover_after_us = 3000000;
+};
+
+struct DegradationState {
+  // Capture every Nth tick; skipped ticks repeat the previous frame.
+  int fps_step = 1;
+  // Multiplies each sink's resolution divisor.
+  int divisor_boost = 1;
+  // Added to the codec level of compressed in-memory buffers; see
+  // DegradationController::buffer_compression_level().
+  int compression_boost = 0;
+  bool drop_frames = false;
+};
+
+struct DegradationEvent {
+  int64_t time_us = 0;
+  int level = 0;
+  DegradationStep step = DegradationStep::kReduceFps;
+  bool escalated = false;
+  double load = 0.0;
+  uint64_t buffered_bytes = 0;
+};
+
+class DegradationController {
+ public:
+  DegradationController() = default;
+  explicit DegradationController(const DegradationPolicy& policy);
+
+  // Feeds one capture tick. `stage_us` is the time spent reading back and
+  // fanning out the frame, `interval_us` the time since the previous tick.
+  // Returns true when the degradation level changed.
+  bool observe(int64_t now_us,
+               int64_t stage_us,
+               int64_t interval_us,
+               int64_t expected_interval_us,
+               uint64_t buffered_bytes);
+
+  // True when the current tick should not be captured at all.
+  bool should_drop(uint64_t buffered_bytes) const;
+
+  // Codec level for compressed in-memory buffers. Harder compression costs
+  // CPU, so kRaiseCompression steps only take effect while a memory budget is
+  // set and load is within target; otherwise this is the fastest level, 1.
+  int buffer_compression_level() const;
+
+  const DegradationPolicy& policy() const { return policy_; }
+  const DegradationState& state() const { return state_; }
+  int level() const { return level_; }
+  double load() const { return load_; }
+  const std::vector<DegradationEvent>& events() const { return events_; }
+
+ private:
+  void apply_level();
+  void record(int64_t now_us, DegradationStep step, bool escalated, uint64_t buffered_bytes);
+
+  DegradationPolicy policy_;
+  DegradationState state_;
+  int level_ = 0;
+  double load_ = 0.0;
+  bool primed_ = false;
+  int64_t pressure_since_us_ = -1;
+  int64_t calm_since_us_ = -1;
+  std::vector<DegradationEvent> events_;
+};
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include "frame_blender.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "worker_pool.h"
+
+// MSVC does not define __SSE2__; SSE2 is baseline on x64.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RECASTER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace recaster {
+
+namespace {
+
+// 256 frames of 255 still fit in 16 bits.
+constexpr int kMaxCount = 256;
+// Bytes per parallel_for item.
+constexpr size_t kChunkBytes = 64 * 1024;
+
+void add_bytes(const uint8_t* src, uint16_t* sums, size_t size) {
+  size_t i = 0;
+#if defined(RECASTER_HAVE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= size; i += 16) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i* low = reinterpret_cast<__m128i*>(sums + i);
+    __m128i* high = reinterpret_cast<__m128i*>(sums + i + 8);
+    _mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low), _mm_unpacklo_epi8(bytes, zero)));
+    _mm_storeu_si128(high,
+                     _mm_add_epi16(_mm_loadu_si128(high), _mm_unpackhi_epi8(bytes, zero)));
+  }
+#endif
+  for (; i < size; ++i) {
+    sums[i] = static_cast<uint16_t>(sums[i] + src[i]);
+  }
+}
+
+// Rounded sums / count. The 32-bit reciprocal is exact for 16-bit sums and
+// counts up to 256, and runs once per output frame rather than per capture.
+void average_bytes(const uint16_t* sums, int count, uint8_t* dst, size_t size) {
+  const uint64_t reciprocal = ((uint64_t{1} << 32) + count - 1) / count;
+  const uint32_t half = static_cast<uint32_t>(count / 2);
+  for (size_t i = 0; i < size; ++i) {
+    dst[i] = static_cast<uint8_t>(((sums[i] + half) * reciprocal) >> 32);
+  }
+}
+
+}
+
+FrameBlender::FrameBlender(int count) : count_(std::min(kMaxCount, std::max(1, count))) {}
+
+FramePtr FrameBlender::add(const FramePtr& frame, WorkerPool* workers) {
+  FramePtr blended;
+  if (pending_ > 0 &&
+      (frame->width != width_ || frame->height != height_ || frame->format != format_)) {
+    blended = flush();
+  }
+  if (pending_ == 0) {
+    width_ = frame->width;
+    height_ = frame->height;
+    format_ = frame->format;
+    timestamp_us_ = frame->timestamp_us;
+    sums_.assign(frame->pixels.size(), 0);
+  }
+  accumulate(*frame, workers);
+  last_ = frame;
+  if (++pending_ == count_) {
+    blended = flush();
+  }
+  return blended;
+}
+
+FramePtr FrameBlender::flush() {
+  if (pending_ == 0) {
+    return nullptr;
+  }
+  auto frame = std::make_shared<FrameData>();
+  frame->width = width_;
+  frame->height = height_;
+  frame->format = format_;
+  frame->timestamp_us = timestamp_us_;
+  frame->pixels.resize(sums_.size());
+  average_bytes(sums_.data(), pending_, frame->pixels.data(), sums_.size());
+  pending_ = 0;
+  return frame;
+}
+
+void FrameBlender::accumulate(const FrameData& frame, WorkerPool* workers) {
+  const size_t size = std::min(sums_.size(), frame.pixels.size());
+  const int chunks = static_cast<int>((size + kChunkBytes - 1) / kChunkBytes);
+  auto body = [&](int begin, int end) {
+    const size_t start = static_cast<size_t>(begin) * kChunkBytes;
+    const size_t stop = std::min(size, static_cast<size_t>(end) * kChunkBytes);
+    add_bytes(frame.pixels.data() + start, sums_.data() + start, stop - start);
+  };
+  if (workers != nullptr && chunks > 1) {
+    workers->parallel_for(chunks, 1, body);
+  } else {
+    body(0, chunks);
+  }
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef RECASTER_FRAME_BLENDER_H_
+#define RECASTER_FRAME_BLENDER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+// Averages each run of `count` captures into one frame for time-lapse
+// outputs, so that an event shorter than the output interval still leaves a
+// trace instead of falling between samples. Sums are kept per byte in 16
+// bits, which holds 256 frames; `count` is clamped to 1..256.
+class FrameBlender {
+ public:
+  explicit FrameBlender(int count);
+
+  // Adds `frame` to the current group. Returns the blended frame when this
+  // completes the group, or the partial group's blend when `frame` has a
+  // different size or format and starts a new group; nullptr otherwise.
+  FramePtr add(const FramePtr& frame, WorkerPool* workers);
+  // Blends what the current group holds, for the end of a recording.
+  // nullptr when it is empty.
+  FramePtr flush();
+
+  int count() const { return count_; }
+  int pending() const { return pending_; }
+  // The frame added last, for repeating it in a skipped slot.
+  const FramePtr& last() const { return last_; }
+
+ private:
+  void accumulate(const FrameData& frame, WorkerPool* workers);
+
+  const int count_;
+  int pending_ = 0;
+  FramePtr last_;
+  // Shape and start of the current group.
+  int width_ = 0;
+  int height_ = 0;
+  PixelFormat format_ = PixelFormat::kBgra32;
+  int64_t timestamp_us_ = 0;
+  std::vector<uint16_t> sums_;
+};
+
+}
+
+#endif
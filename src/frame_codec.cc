@@ -0,0 +1,291 @@
+#include "frame_codec.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(RECASTER_HAVE_LZ4)
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#if defined(RECASTER_HAVE_ZSTD)
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace recaster {
+
+namespace {
+
+#if defined(RECASTER_HAVE_LZ4)
+// LZ4's fast mode has no stronger setting than acceleration 1, so levels above
+// this switch to LZ4 HC, whose own levels top out at 12.
+constexpr int kLz4FastLevelLimit = 2;
+constexpr int kLz4MaxHcLevel = 12;
+#endif
+
+#if defined(RECASTER_HAVE_ZSTD)
+constexpr size_t kDictionarySampleBlock = 16 * 1024;
+constexpr size_t kDictionarySampleLimit = 2 * 1024 * 1024;
+#endif
+
+}
+
+bool parse_frame_codec(const char* name, FrameCodec* codec) {
+  if (name == nullptr || codec == nullptr) {
+    return false;
+  }
+  if (strcmp(name, "stored") == 0) {
+    *codec = FrameCodec::kStored;
+  } else if (strcmp(name, "lz4") == 0) {
+    *codec = FrameCodec::kLz4;
+  } else if (strcmp(name, "zstd") == 0) {
+    *codec = FrameCodec::kZstd;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* frame_codec_name(FrameCodec codec) {
+  switch (codec) {
+    case FrameCodec::kLz4:
+      return "lz4";
+    case FrameCodec::kZstd:
+      return "zstd";
+    case FrameCodec::kStored:
+    default:
+      return "stored";
+  }
+}
+
+bool frame_codec_available(FrameCodec codec) {
+  switch (codec) {
+    case FrameCodec::kStored:
+      return true;
+    case FrameCodec::kLz4:
+#if defined(RECASTER_HAVE_LZ4)
+      return true;
+#else
+      return false;
+#endif
+    case FrameCodec::kZstd:
+#if defined(RECASTER_HAVE_ZSTD)
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+FrameCodec default_frame_codec() {
+  if (frame_codec_available(FrameCodec::kLz4)) {
+    return FrameCodec::kLz4;
+  }
+  if (frame_codec_available(FrameCodec::kZstd)) {
+    return FrameCodec::kZstd;
+  }
+  return FrameCodec::kStored;
+}
+
+std::vector<uint8_t> train_frame_dictionary(FrameCodec codec,
+                                            const std::vector<FramePtr>& frames,
+                                            size_t capacity) {
+  std::vector<uint8_t> dictionary;
+#if defined(RECASTER_HAVE_ZSTD)
+  if (codec != FrameCodec::kZstd || frames.empty() || capacity == 0) {
+    return dictionary;
+  }
+
+  std::vector<uint8_t> samples;
+  std::vector<size_t> sample_sizes;
+  const size_t frame_stride = std::max<size_t>(1, frames.size() / 16);
+  for (size_t f = 0; f < frames.size() && samples.size() < kDictionarySampleLimit;
+       f += frame_stride) {
+    const std::vector<uint8_t>& pixels = frames[f]->pixels;
+    const size_t block_stride = std::max(kDictionarySampleBlock, pixels.size() / 8);
+    for (size_t offset = 0; offset + kDictionarySampleBlock <= pixels.size() &&
+                            samples.size() < kDictionarySampleLimit;
+         offset += block_stride) {
+      samples.insert(samples.end(), pixels.begin() + static_cast<std::ptrdiff_t>(offset),
+                     pixels.begin() + static_cast<std::ptrdiff_t>(
+                                          offset + kDictionarySampleBlock));
+      sample_sizes.push_back(kDictionarySampleBlock);
+    }
+  }
+  if (sample_sizes.size() < 8) {
+    return dictionary;
+  }
+
+  dictionary.resize(capacity);
+  const size_t size =
+      ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                            sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+  if (ZDICT_isError(size)) {
+    dictionary.clear();
+  } else {
+    dictionary.resize(size);
+  }
+#else
+  (void)codec;
+  (void)frames;
+  (void)capacity;
+#endif
+  return dictionary;
+}
+
+FrameEncoder::FrameEncoder(FrameCodec codec,
+                           int level,
+                           const std::vector<uint8_t>& dictionary)
+    : codec_(codec), level_(level) {
+#if defined(RECASTER_HAVE_LZ4)
+  if (codec_ == FrameCodec::kLz4 && level_ > kLz4FastLevelLimit) {
+    context_ = malloc(static_cast<size_t>(LZ4_sizeofStateHC()));
+  }
+#endif
+#if defined(RECASTER_HAVE_ZSTD)
+  if (codec_ == FrameCodec::kZstd) {
+    context_ = ZSTD_createCCtx();
+    if (!dictionary.empty()) {
+      dictionary_ = ZSTD_createCDict(dictionary.data(), dictionary.size(), level_);
+    }
+  }
+#else
+  (void)dictionary;
+#endif
+}
+
+FrameEncoder::~FrameEncoder() {
+#if defined(RECASTER_HAVE_LZ4)
+  if (codec_ == FrameCodec::kLz4) {
+    free(context_);
+  }
+#endif
+#if defined(RECASTER_HAVE_ZSTD)
+  if (codec_ == FrameCodec::kZstd) {
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(dictionary_));
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(context_));
+  }
+#endif
+}
+
+bool FrameEncoder::encode(const uint8_t* src, size_t size, std::vector<uint8_t>* out) {
+  switch (codec_) {
+    case FrameCodec::kStored:
+      out->assign(src, src + size);
+      return true;
+    case FrameCodec::kLz4: {
+#if defined(RECASTER_HAVE_LZ4)
+      out->resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(size))));
+      const char* source = reinterpret_cast<const char*>(src);
+      char* destination = reinterpret_cast<char*>(out->data());
+      const int written =
+          level_ > kLz4FastLevelLimit
+              ? (context_ != nullptr
+                     ? LZ4_compress_HC_extStateHC(context_, source, destination,
+                                                  static_cast<int>(size),
+                                                  static_cast<int>(out->size()),
+                                                  std::min(level_, kLz4MaxHcLevel))
+                     : 0)
+              : LZ4_compress_default(source, destination, static_cast<int>(size),
+                                     static_cast<int>(out->size()));
+      if (written <= 0) {
+        return false;
+      }
+      out->resize(static_cast<size_t>(written));
+      return true;
+#else
+      return false;
+#endif
+    }
+    case FrameCodec::kZstd: {
+#if defined(RECASTER_HAVE_ZSTD)
+      ZSTD_CCtx* context = static_cast<ZSTD_CCtx*>(context_);
+      if (context == nullptr) {
+        return false;
+      }
+      out->resize(ZSTD_compressBound(size));
+      const size_t written =
+          dictionary_ != nullptr
+              ? ZSTD_compress_usingCDict(context, out->data(), out->size(), src, size,
+                                         static_cast<const ZSTD_CDict*>(dictionary_))
+              : ZSTD_compressCCtx(context, out->data(), out->size(), src, size, level_);
+      if (ZSTD_isError(written)) {
+        return false;
+      }
+      out->resize(written);
+      return true;
+#else
+      return false;
+#endif
+    }
+  }
+  return false;
+}
+
+FrameDecoder::FrameDecoder(FrameCodec codec,
+                           const uint8_t* dictionary,
+                           size_t dictionary_size)
+    : codec_(codec) {
+#if defined(RECASTER_HAVE_ZSTD)
+  if (codec_ == FrameCodec::kZstd) {
+    context_ = ZSTD_createDCtx();
+    if (dictionary != nullptr && dictionary_size > 0) {
+      dictionary_ = ZSTD_createDDict(dictionary, dictionary_size);
+    }
+  }
+#else
+  (void)dictionary;
+  (void)dictionary_size;
+#endif
+}
+
+FrameDecoder::~FrameDecoder() {
+#if defined(RECASTER_HAVE_ZSTD)
+  if (codec_ == FrameCodec::kZstd) {
+    ZSTD_freeDDict(static_cast<ZSTD_DDict*>(dictionary_));
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(context_));
+  }
+#endif
+}
+
+bool FrameDecoder::decode(const uint8_t* src, size_t size, uint8_t* dst, size_t raw_size) {
+  switch (codec_) {
+    case FrameCodec::kStored:
+      if (size != raw_size) {
+        return false;
+      }
+      std::memcpy(dst, src, size);
+      return true;
+    case FrameCodec::kLz4: {
+#if defined(RECASTER_HAVE_LZ4)
+      const int read = LZ4_decompress_safe(reinterpret_cast<const char*>(src),
+                                           reinterpret_cast<char*>(dst),
+                                           static_cast<int>(size), static_cast<int>(raw_size));
+      return read >= 0 && static_cast<size_t>(read) == raw_size;
+#else
+      return false;
+#endif
+    }
+    case FrameCodec::kZstd: {
+#if defined(RECASTER_HAVE_ZSTD)
+      ZSTD_DCtx* context = static_cast<ZSTD_DCtx*>(context_);
+      if (context == nullptr) {
+        return false;
+      }
+      const size_t read =
+          dictionary_ != nullptr
+              ? ZSTD_decompress_usingDDict(context, dst, raw_size, src, size,
+                                           static_cast<const ZSTD_DDict*>(dictionary_))
+              : ZSTD_decompressDCtx(context, dst, raw_size, src, size);
+      return !ZSTD_isError(read) && read == raw_size;
+#else
+      return false;
+#endif
+    }
+  }
+  return false;
+}
+
+}
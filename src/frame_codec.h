@@ -0,0 +1,71 @@
+#ifndef RECASTER_FRAME_CODEC_H_
+#define RECASTER_FRAME_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+// Per-frame lossless codecs. LZ4 and zstd are compiled in only when the build
+// finds them (RECASTER_HAVE_LZ4 / RECASTER_HAVE_ZSTD); kStored always works.
+enum class FrameCodec : uint32_t {
+  kStored = 0,
+  kLz4 = 1,
+  kZstd = 2,
+};
+
+bool parse_frame_codec(const char* name, FrameCodec* codec);
+const char* frame_codec_name(FrameCodec codec);
+bool frame_codec_available(FrameCodec codec);
+FrameCodec default_frame_codec();
+
+// Trains a zstd dictionary on blocks sampled across `frames`. Returns an empty
+// dictionary for the other codecs or when training fails.
+std::vector<uint8_t> train_frame_dictionary(FrameCodec codec,
+                                            const std::vector<FramePtr>& frames,
+                                            size_t capacity);
+
+// Encoder and decoder state is per thread; create one per worker. `level` runs
+// from 1 to 19 and higher is always smaller and slower: zstd uses it as is,
+// LZ4 uses its fast mode up to 2 and LZ4 HC above, capped at HC level 12.
+class FrameEncoder {
+ public:
+  FrameEncoder(FrameCodec codec, int level, const std::vector<uint8_t>& dictionary);
+  ~FrameEncoder();
+
+  FrameEncoder(const FrameEncoder&) = delete;
+  FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+  bool encode(const uint8_t* src, size_t size, std::vector<uint8_t>* out);
+
+  int level() const { return level_; }
+
+ private:
+  FrameCodec codec_;
+  int level_;
+  void* context_ = nullptr;
+  void* dictionary_ = nullptr;
+};
+
+class FrameDecoder {
+ public:
+  FrameDecoder(FrameCodec codec, const uint8_t* dictionary, size_t dictionary_size);
+  ~FrameDecoder();
+
+  FrameDecoder(const FrameDecoder&) = delete;
+  FrameDecoder& operator=(const FrameDecoder&) = delete;
+
+  bool decode(const uint8_t* src, size_t size, uint8_t* dst, size_t raw_size);
+
+ private:
+  FrameCodec codec_;
+  void* context_ = nullptr;
+  void* dictionary_ = nullptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "frame_data.h"
+
+#include <cstring>
+
+namespace recaster {
+
+bool parse_pixel_format(const char* name, PixelFormat* format) {
+  if (name == nullptr || format == nullptr) {
+    return false;
+  }
+  if (strcmp(name, "bgra32") == 0) {
+    *format = PixelFormat::kBgra32;
+  } else if (strcmp(name, "bgr24") == 0) {
+    *format = PixelFormat::kBgr24;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int bits_per_pixel(PixelFormat format) {
+  return format == PixelFormat::kBgr24 ? 24 : 32;
+}
+
+size_t frame_row_bytes(int width, PixelFormat format) {
+  const size_t bytes = static_cast<size_t>(width) *
+                       static_cast<size_t>(bits_per_pixel(format) / 8);
+  return (bytes + 3U) & ~static_cast<size_t>(3U);
+}
+
+size_t frame_byte_size(int width, int height, PixelFormat format) {
+  return frame_row_bytes(width, format) * static_cast<size_t>(height);
+}
+
+void convert_bgra_frame(const uint8_t* src,
+                        int width,
+                        int height,
+                        PixelFormat format,
+                        uint8_t* dst) {
+  const size_t src_row = static_cast<size_t>(width) * 4U;
+  const size_t dst_row = frame_row_bytes(width, format);
+  if (format == PixelFormat::kBgra32) {
+    std::memcpy(dst, src, src_row * static_cast<size_t>(height));
+    return;
+  }
+  for (int y = 0; y < height; ++y) {
+    const uint8_t* in = src + static_cast<size_t>(y) * src_row;
+    uint8_t* out = dst + static_cast<size_t>(y) * dst_row;
+    for (int x = 0; x < width; ++x) {
+      out[0] = in[0];
+      out[1] = in[1];
+      out[2] = in[2];
+      in += 4;
+      out += 3;
+    }
+    for (size_t pad = static_cast<size_t>(width) * 3U; pad < dst_row; ++pad) {
+      dst[static_cast<size_t>(y) * dst_row + pad] = 0;
+    }
+  }
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef RECASTER_FRAME_DATA_H_
+#define RECASTER_FRAME_DATA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace recaster {
+
+enum class PixelFormat {
+  kBgra32,
+  kBgr24,
+};
+
+struct FrameData {
+  int32_t width = 0;
+  int32_t height = 0;
+  PixelFormat format = PixelFormat::kBgra32;
+  int64_t timestamp_us = 0;
+  std::vector<uint8_t> pixels;
+};
+
+// Frames are shared read-only between the capture tick and every sink that
+// keeps them, so a full-resolution BGRA sink stores the readback itself.
+using FramePtr = std::shared_ptr<const FrameData>;
+
+// Called by the file writers after each frame; returning false cancels the
+// write.
+using WriteProgress = std::function<bool(size_t frames_written, uint64_t bytes_written)>;
+
+// Produces frame `index` for a writer on demand, so buffered frames can be
+// decoded one at a time. Returns nullptr if the frame is unavailable.
+using FrameSource = std::function<FramePtr(size_t index)>;
+
+bool parse_pixel_format(const char* name, PixelFormat* format);
+
+int bits_per_pixel(PixelFormat format);
+
+// DIB rows are padded to a multiple of four bytes.
+size_t frame_row_bytes(int width, PixelFormat format);
+
+size_t frame_byte_size(int width, int height, PixelFormat format);
+
+void convert_bgra_frame(const uint8_t* src,
+                        int width,
+                        int height,
+                        PixelFormat format,
+                        uint8_t* dst);
+
+}
+
+#endif
@@ -0,0 +1,425 @@
+#include "frame_hash.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "worker_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RECASTER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace recaster {
+
+namespace {
+
+constexpr char kHashMagic[4] = {'R', 'H', 'S', 'H'};
+constexpr int kMaxTiles = 32;
+
+// BT.601 luma weights scaled to 256.
+constexpr int kBlueWeight = 29;
+constexpr int kGreenWeight = 150;
+constexpr int kRedWeight = 77;
+
+template <typename T>
+void put(uint8_t* dst, size_t offset, T value) {
+  std::memcpy(dst + offset, &value, sizeof(value));
+}
+
+template <typename T>
+T get(const uint8_t* src, size_t offset) {
+  T value;
+  std::memcpy(&value, src + offset, sizeof(value));
+  return value;
+}
+
+void set_error(std::string* error_message, const char* message) {
+  if (error_message != nullptr) {
+    *error_message = message;
+  }
+}
+
+int clamp_tiles(int tiles) {
+  return std::min(kMaxTiles, std::max(1, tiles));
+}
+
+size_t record_size(int tile_columns, int tile_rows) {
+  return 16 + static_cast<size_t>(tile_columns) * static_cast<size_t>(tile_rows) * 8U;
+}
+
+// Adds the scaled luma of each pixel of `row` to `sums`.
+void add_luma_row(const uint8_t* row, int width, PixelFormat format, uint32_t* sums) {
+  int x = 0;
+  if (format == PixelFormat::kBgra32) {
+#if defined(RECASTER_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(kBlueWeight, kGreenWeight, kRedWeight, 0,
+                                           kBlueWeight, kGreenWeight, kRedWeight, 0);
+    for (; x + 4 <= width; x += 4) {
+      const __m128i pixels =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + static_cast<size_t>(x) * 4U));
+      const __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+      const __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+      // Each pixel is split over two lanes: blue plus green, red plus alpha.
+      const __m128i low_sum = _mm_add_epi32(low, _mm_srli_epi64(low, 32));
+      const __m128i high_sum = _mm_add_epi32(high, _mm_srli_epi64(high, 32));
+      const __m128i luma = _mm_castps_si128(_mm_shuffle_ps(
+          _mm_castsi128_ps(low_sum), _mm_castsi128_ps(high_sum), _MM_SHUFFLE(2, 0, 2, 0)));
+      __m128i* dst = reinterpret_cast<__m128i*>(sums + x);
+      _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), luma));
+    }
+#endif
+  }
+  const size_t channels = format == PixelFormat::kBgra32 ? 4U : 3U;
+  for (; x < width; ++x) {
+    const uint8_t* pixel = row + static_cast<size_t>(x) * channels;
+    sums[x] += pixel[0] * kBlueWeight + pixel[1] * kGreenWeight + pixel[2] * kRedWeight;
+  }
+}
+
+// Start and end of cell `index` of `cells` spanning `size`; frames smaller
+// than the grid repeat pixels.
+void cell_span(int index, int cells, int size, int* start, int* end) {
+  *start = static_cast<int>(static_cast<int64_t>(index) * size / cells);
+  *end = std::max(*start + 1, static_cast<int>(static_cast<int64_t>(index + 1) * size / cells));
+}
+
+// Box-filters `frame` to a grid_width x grid_height grayscale grid.
+void downsample_luma(const FrameData& frame, int grid_width, int grid_height, uint32_t* grid) {
+  const int width = frame.width;
+  const int height = frame.height;
+  const size_t row_bytes = frame.format == PixelFormat::kBgra32
+                               ? static_cast<size_t>(width) * 4U
+                               : frame_row_bytes(width, frame.format);
+  std::vector<uint32_t> sums(static_cast<size_t>(width));
+  for (int cell_y = 0; cell_y < grid_height; ++cell_y) {
+    int y0 = 0;
+    int y1 = 0;
+    cell_span(cell_y, grid_height, height, &y0, &y1);
+    std::fill(sums.begin(), sums.end(), 0U);
+    for (int y = y0; y < y1; ++y) {
+      add_luma_row(frame.pixels.data() + static_cast<size_t>(y) * row_bytes, width,
+                   frame.format, sums.data());
+    }
+    for (int cell_x = 0; cell_x < grid_width; ++cell_x) {
+      int x0 = 0;
+      int x1 = 0;
+      cell_span(cell_x, grid_width, width, &x0, &x1);
+      uint64_t total = 0;
+      for (int x = x0; x < x1; ++x) {
+        total += sums[static_cast<size_t>(x)];
+      }
+      grid[static_cast<size_t>(cell_y) * grid_width + cell_x] =
+          static_cast<uint32_t>(total / (static_cast<uint64_t>(x1 - x0) * (y1 - y0)));
+    }
+  }
+}
+
+// dHash of the 9x8 block of `grid` at (x, y).
+uint64_t difference_hash(const uint32_t* grid, int stride, int x, int y) {
+  uint64_t hash = 0;
+  for (int row = 0; row < 8; ++row) {
+    const uint32_t* cells = grid + static_cast<size_t>(y + row) * stride + x;
+    for (int column = 0; column < 8; ++column) {
+      if (cells[column] > cells[column + 1]) {
+        hash |= uint64_t{1} << (row * 8 + column);
+      }
+    }
+  }
+  return hash;
+}
+
+}
+
+void hash_frame(const FrameData& frame, const HashOptions& options, FrameHash* hash) {
+  const int columns = clamp_tiles(options.tile_columns);
+  const int rows = clamp_tiles(options.tile_rows);
+  const int grid_width = columns * 9;
+  const int grid_height = rows * 8;
+  hash->timestamp_us = frame.timestamp_us;
+  hash->tiles.assign(static_cast<size_t>(columns) * rows, 0);
+  hash->frame = 0;
+  if (frame.width <= 0 || frame.height <= 0) {
+    return;
+  }
+
+  std::vector<uint32_t> grid(static_cast<size_t>(grid_width) * grid_height);
+  downsample_luma(frame, grid_width, grid_height, grid.data());
+  for (int tile_y = 0; tile_y < rows; ++tile_y) {
+    for (int tile_x = 0; tile_x < columns; ++tile_x) {
+      hash->tiles[static_cast<size_t>(tile_y) * columns + tile_x] =
+          difference_hash(grid.data(), grid_width, tile_x * 9, tile_y * 8);
+    }
+  }
+
+  // Each coarse cell averages a columns x rows block of the grid.
+  uint32_t coarse[9 * 8];
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 9; ++x) {
+      uint64_t total = 0;
+      for (int row = y * rows; row < (y + 1) * rows; ++row) {
+        for (int column = x * columns; column < (x + 1) * columns; ++column) {
+          total += grid[static_cast<size_t>(row) * grid_width + column];
+        }
+      }
+      coarse[y * 9 + x] = static_cast<uint32_t>(total / (static_cast<uint64_t>(columns) * rows));
+    }
+  }
+  hash->frame = difference_hash(coarse, 9, 0, 0);
+}
+
+int hash_distance(uint64_t a, uint64_t b) {
+  return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+HashRecorder::HashRecorder(const HashOptions& options) : options_(options) {
+  options_.tile_columns = clamp_tiles(options.tile_columns);
+  options_.tile_rows = clamp_tiles(options.tile_rows);
+}
+
+HashRecorder::~HashRecorder() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void HashRecorder::append(const FramePtr& frame, WorkerPool* workers) {
+  if (hashes_.empty()) {
+    width_ = frame->width;
+    height_ = frame->height;
+  }
+  hashes_.emplace_back();
+  Entry* entry = &hashes_.back();
+
+  bool inline_hash = workers == nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!inline_hash && pending_ >= static_cast<size_t>(workers->thread_count() + 1) * 2U) {
+      inline_hash = true;
+    }
+    ++pending_;
+  }
+  auto task = [this, entry, frame]() {
+    FrameHash hash;
+    hash_frame(*frame, options_, &hash);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entry->hash = std::move(hash);
+      entry->ready = true;
+      --pending_;
+    }
+    cv_.notify_all();
+  };
+  if (inline_hash) {
+    task();
+  } else {
+    workers->post(task);
+  }
+}
+
+bool HashRecorder::repeat_last() {
+  if (hashes_.empty()) {
+    return false;
+  }
+  // The previous hash may still be computing; write() copies it.
+  hashes_.emplace_back();
+  return true;
+}
+
+bool HashRecorder::write(const char* output_path,
+                         int fps,
+                         std::string* error_message,
+                         const WriteProgress& progress) {
+  if (output_path == nullptr || strlen(output_path) == 0) {
+    set_error(error_message, "outputPath is required.");
+    return false;
+  }
+  if (hashes_.empty()) {
+    set_error(error_message, "No frames were captured.");
+    return false;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+  std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    set_error(error_message, "Failed to open output file.");
+    return false;
+  }
+  const size_t record_bytes = record_size(options_.tile_columns, options_.tile_rows);
+  uint8_t header[kHashHeaderSize] = {};
+  std::memcpy(header, kHashMagic, 4);
+  put<uint16_t>(header, 4, static_cast<uint16_t>(kHashVersion));
+  put<uint16_t>(header, 6, static_cast<uint16_t>(kHashHeaderSize));
+  put<uint32_t>(header, 8, static_cast<uint32_t>(width_));
+  put<uint32_t>(header, 12, static_cast<uint32_t>(height_));
+  put<uint32_t>(header, 16, static_cast<uint32_t>(std::max(1, fps)));
+  put<uint16_t>(header, 20, static_cast<uint16_t>(options_.tile_columns));
+  put<uint16_t>(header, 22, static_cast<uint16_t>(options_.tile_rows));
+  put<uint32_t>(header, 24, static_cast<uint32_t>(hashes_.size()));
+  put<uint32_t>(header, 28, static_cast<uint32_t>(record_bytes));
+  file.write(reinterpret_cast<const char*>(header), kHashHeaderSize);
+
+  std::vector<uint8_t> record(record_bytes);
+  const FrameHash* previous = nullptr;
+  uint64_t bytes_written = kHashHeaderSize;
+  for (size_t i = 0; i < hashes_.size(); ++i) {
+    const Entry& entry = hashes_[i];
+    const FrameHash& hash = entry.ready ? entry.hash : *previous;
+    previous = &hash;
+    put<int64_t>(record.data(), 0, hash.timestamp_us);
+    put<uint64_t>(record.data(), 8, hash.frame);
+    for (size_t tile = 0; tile < hash.tiles.size(); ++tile) {
+      put<uint64_t>(record.data(), 16 + tile * 8, hash.tiles[tile]);
+    }
+    file.write(reinterpret_cast<const char*>(record.data()),
+               static_cast<std::streamsize>(record.size()));
+    bytes_written += record.size();
+    if (progress && (i + 1) % 256 == 0 && !progress(i + 1, bytes_written)) {
+      set_error(error_message, "Write was cancelled.");
+      return false;
+    }
+  }
+  file.flush();
+  if (!file.good()) {
+    set_error(error_message, "Failed to write output file.");
+    return false;
+  }
+  if (progress) {
+    progress(hashes_.size(), bytes_written);
+  }
+  return true;
+}
+
+bool read_hash_file(const char* path,
+                    HashFileHeader* header,
+                    std::vector<FrameHash>* hashes,
+                    std::string* error_message) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    set_error(error_message, "Failed to open hash file.");
+    return false;
+  }
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+  if (data.size() < kHashHeaderSize || std::memcmp(data.data(), kHashMagic, 4) != 0 ||
+      get<uint16_t>(data.data(), 4) != kHashVersion) {
+    set_error(error_message, "Not a .rhash file.");
+    return false;
+  }
+  const size_t header_size = get<uint16_t>(data.data(), 6);
+  header->width = get<uint32_t>(data.data(), 8);
+  header->height = get<uint32_t>(data.data(), 12);
+  header->fps = get<uint32_t>(data.data(), 16);
+  header->tile_columns = get<uint16_t>(data.data(), 20);
+  header->tile_rows = get<uint16_t>(data.data(), 22);
+  const size_t count = get<uint32_t>(data.data(), 24);
+  const size_t record_bytes = get<uint32_t>(data.data(), 28);
+  if (header_size < kHashHeaderSize || header->tile_columns < 1 || header->tile_rows < 1 ||
+      record_bytes != record_size(header->tile_columns, header->tile_rows) ||
+      (data.size() - std::min(data.size(), header_size)) / record_bytes < count) {
+    set_error(error_message, "The hash file is truncated or corrupt.");
+    return false;
+  }
+
+  const size_t tiles = static_cast<size_t>(header->tile_columns) * header->tile_rows;
+  hashes->assign(count, FrameHash());
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t* record = data.data() + header_size + i * record_bytes;
+    FrameHash& hash = (*hashes)[i];
+    hash.timestamp_us = get<int64_t>(record, 0);
+    hash.frame = get<uint64_t>(record, 8);
+    hash.tiles.resize(tiles);
+    for (size_t tile = 0; tile < tiles; ++tile) {
+      hash.tiles[tile] = get<uint64_t>(record, 16 + tile * 8);
+    }
+  }
+  return true;
+}
+
+bool compare_hash_files(const char* first_path,
+                        const char* second_path,
+                        const HashCompareOptions& options,
+                        HashComparison* comparison,
+                        std::string* error_message) {
+  HashFileHeader first_header;
+  HashFileHeader second_header;
+  std::vector<FrameHash> first;
+  std::vector<FrameHash> second;
+  if (!read_hash_file(first_path, &first_header, &first, error_message) ||
+      !read_hash_file(second_path, &second_header, &second, error_message)) {
+    return false;
+  }
+  if (first_header.tile_columns != second_header.tile_columns ||
+      first_header.tile_rows != second_header.tile_rows) {
+    set_error(error_message, "The recordings were hashed with different tile grids.");
+    return false;
+  }
+
+  *comparison = HashComparison();
+  const int columns = first_header.tile_columns;
+  const int rows = first_header.tile_rows;
+  const int width = static_cast<int>(first_header.width);
+  const int height = static_cast<int>(first_header.height);
+  const size_t common = std::min(first.size(), second.size());
+  for (size_t i = 0; i < common; ++i) {
+    const FrameHash& a = first[i];
+    const FrameHash& b = second[i];
+    const int frame_distance = hash_distance(a.frame, b.frame);
+    int max_tile_distance = 0;
+    int left = columns;
+    int top = rows;
+    int right = -1;
+    int bottom = -1;
+    for (int tile_y = 0; tile_y < rows; ++tile_y) {
+      for (int tile_x = 0; tile_x < columns; ++tile_x) {
+        const size_t tile = static_cast<size_t>(tile_y) * columns + tile_x;
+        const int distance = hash_distance(a.tiles[tile], b.tiles[tile]);
+        max_tile_distance = std::max(max_tile_distance, distance);
+        if (distance > options.tile_threshold) {
+          left = std::min(left, tile_x);
+          top = std::min(top, tile_y);
+          right = std::max(right, tile_x);
+          bottom = std::max(bottom, tile_y);
+        }
+      }
+    }
+    comparison->frames_compared = i + 1;
+    if (frame_distance <= options.frame_threshold && right < 0) {
+      continue;
+    }
+    if (right < 0) {
+      left = 0;
+      top = 0;
+      right = columns - 1;
+      bottom = rows - 1;
+    }
+    comparison->first_divergent_frame = static_cast<int64_t>(i);
+    comparison->timestamp_us = a.timestamp_us;
+    comparison->frame_distance = frame_distance;
+    comparison->max_tile_distance = max_tile_distance;
+    comparison->x = static_cast<int>(static_cast<int64_t>(left) * width / columns);
+    comparison->y = static_cast<int>(static_cast<int64_t>(top) * height / rows);
+    comparison->width =
+        static_cast<int>(static_cast<int64_t>(right + 1) * width / columns) - comparison->x;
+    comparison->height =
+        static_cast<int>(static_cast<int64_t>(bottom + 1) * height / rows) - comparison->y;
+    return true;
+  }
+
+  if (first.size() != second.size()) {
+    const std::vector<FrameHash>& longer = first.size() > second.size() ? first : second;
+    comparison->first_divergent_frame = static_cast<int64_t>(common);
+    comparison->timestamp_us = longer[common].timestamp_us;
+    comparison->width = width;
+    comparison->height = height;
+  }
+  return true;
+}
+
+}
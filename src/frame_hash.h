@@ -0,0 +1,134 @@
+#ifndef RECASTER_FRAME_HASH_H_
+#define RECASTER_FRAME_HASH_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+// .rhash layout, little endian:
+//   32-byte header | one record per frame
+// A record is the frame's timestamp, its whole-frame hash and one hash per
+// tile in row-major order, so record `i` sits at a fixed offset.
+constexpr uint32_t kHashVersion = 1;
+constexpr size_t kHashHeaderSize = 32;
+
+struct HashOptions {
+  int tile_columns = 8;
+  int tile_rows = 8;
+};
+
+// Difference hashes (dHash) of one frame: each hash has a bit per pixel of an
+// 8x8 grayscale grid, set when the pixel is brighter than its right
+// neighbour. Small rendering noise flips few bits; a changed widget flips
+// many in its tile.
+struct FrameHash {
+  int64_t timestamp_us = 0;
+  uint64_t frame = 0;
+  std::vector<uint64_t> tiles;
+};
+
+struct HashFileHeader {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t fps = 0;
+  int tile_columns = 0;
+  int tile_rows = 0;
+};
+
+// Hashes a BGRA or BGR frame. The frame is box-filtered to a grayscale grid
+// of 9x8 cells per tile (SSE2 where available); the whole-frame hash uses the
+// same grid averaged down to 9x8.
+void hash_frame(const FrameData& frame, const HashOptions& options, FrameHash* hash);
+
+// Number of differing bits.
+int hash_distance(uint64_t a, uint64_t b);
+
+// Hashes frames on the worker pool as they arrive and keeps only the hashes,
+// a few hundred bytes per frame. Appends come from one thread.
+class HashRecorder {
+ public:
+  explicit HashRecorder(const HashOptions& options);
+  ~HashRecorder();
+
+  HashRecorder(const HashRecorder&) = delete;
+  HashRecorder& operator=(const HashRecorder&) = delete;
+
+  // Hashes inline when there is no pool or the pool is falling behind.
+  void append(const FramePtr& frame, WorkerPool* workers);
+  // Records the previous hash again; false when there is none.
+  bool repeat_last();
+
+  size_t size() const { return hashes_.size(); }
+  const HashOptions& options() const { return options_; }
+
+  // Waits for pending hashes and writes the .rhash file.
+  bool write(const char* output_path,
+             int fps,
+             std::string* error_message,
+             const WriteProgress& progress = nullptr);
+
+ private:
+  struct Entry {
+    FrameHash hash;
+    bool ready = false;
+  };
+
+  HashOptions options_;
+  int width_ = 0;
+  int height_ = 0;
+  std::deque<Entry> hashes_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t pending_ = 0;
+};
+
+bool read_hash_file(const char* path,
+                    HashFileHeader* header,
+                    std::vector<FrameHash>* hashes,
+                    std::string* error_message);
+
+struct HashCompareOptions {
+  // A frame diverges when its whole-frame hash or any tile hash differs in
+  // more than this many of its 64 bits.
+  int frame_threshold = 6;
+  int tile_threshold = 6;
+};
+
+struct HashComparison {
+  size_t frames_compared = 0;
+  // -1 when the recordings match. A recording that ends early diverges at
+  // the first frame the other one has alone.
+  int64_t first_divergent_frame = -1;
+  int64_t timestamp_us = 0;
+  int frame_distance = 0;
+  int max_tile_distance = 0;
+  // Bounding box of the divergent tiles in pixels of the first recording;
+  // the whole frame when the frame hash alone or the length differs.
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+};
+
+// Compares two .rhash files frame by frame. They must use the same tile
+// grid; the recorded sizes may differ.
+bool compare_hash_files(const char* first_path,
+                        const char* second_path,
+                        const HashCompareOptions& options,
+                        HashComparison* comparison,
+                        std::string* error_message);
+
+}
+
+#endif
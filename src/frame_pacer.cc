@@ -0,0 +1,22 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+
+namespace recaster {
+
+FramePacer::FramePacer(int fps, Clock::time_point start)
+    : interval_(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) /
+                std::max(1, fps)),
+      next_(start) {}
+
+FramePacer::Clock::time_point FramePacer::next_deadline(Clock::time_point now) {
+  next_ += interval_;
+  if (next_ <= now) {
+    const auto behind = (now - next_) / interval_ + 1;
+    missed_ += static_cast<uint64_t>(behind);
+    next_ += interval_ * behind;
+  }
+  return next_;
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef RECASTER_FRAME_PACER_H_
+#define RECASTER_FRAME_PACER_H_
+
+#include <chrono>
+#include <cstdint>
+
+namespace recaster {
+
+// Fixed-rate tick schedule anchored at the start time. Sleeping until the
+// next deadline instead of for one interval after each capture keeps capture
+// cost from accumulating as drift; slots already in the past are skipped and
+// counted as missed.
+class FramePacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  FramePacer(int fps, Clock::time_point start);
+
+  // Advances to the first slot after `now` and returns it.
+  Clock::time_point next_deadline(Clock::time_point now);
+
+  Clock::duration interval() const { return interval_; }
+  uint64_t missed() const { return missed_; }
+
+ private:
+  Clock::duration interval_;
+  Clock::time_point next_;
+  uint64_t missed_ = 0;
+};
+
+}
+
+#endif
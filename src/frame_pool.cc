@@ -0,0 +1,57 @@
+#include "frame_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace recaster {
+
+FramePool::FramePool(size_t max_free) : state_(std::make_shared<State>()) {
+  state_->max_free = max_free;
+}
+
+std::shared_ptr<FrameData> FramePool::acquire(size_t size) {
+  std::vector<uint8_t> pixels;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    for (size_t i = 0; i < state_->free.size(); ++i) {
+      if (state_->free[i].capacity() >= size) {
+        pixels = std::move(state_->free[i]);
+        state_->free.erase(state_->free.begin() + static_cast<std::ptrdiff_t>(i));
+        break;
+      }
+    }
+  }
+  pixels.resize(size);
+
+  std::weak_ptr<State> weak_state = state_;
+  FrameData* frame = new FrameData();
+  frame->pixels = std::move(pixels);
+  return std::shared_ptr<FrameData>(frame, [weak_state](FrameData* released) {
+    if (std::shared_ptr<State> state = weak_state.lock()) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->free.size() < state->max_free) {
+        state->free.push_back(std::move(released->pixels));
+      }
+    }
+    delete released;
+  });
+}
+
+void FramePool::reserve(size_t size, size_t count) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  for (std::vector<uint8_t>& pixels : state_->free) {
+    if (pixels.size() < size) {
+      pixels.resize(size);
+    }
+  }
+  while (state_->free.size() < std::min(count, state_->max_free)) {
+    state_->free.emplace_back(size);
+  }
+}
+
+size_t FramePool::free_count() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->free.size();
+}
+
+}
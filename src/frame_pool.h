@@ -0,0 +1,44 @@
+#ifndef RECASTER_FRAME_POOL_H_
+#define RECASTER_FRAME_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+// Recycles pixel buffers of frames that are released soon after capture, such
+// as a readback that every sink scales down. Large buffers otherwise go back
+// to the kernel on every free and fault in again on the next tick. Frames
+// only hold a weak reference, so they may outlive the pool.
+class FramePool {
+ public:
+  explicit FramePool(size_t max_free = 4);
+
+  // Returns a frame whose pixel buffer holds `size` bytes of unspecified
+  // content. Thread safe.
+  std::shared_ptr<FrameData> acquire(size_t size);
+
+  // Fills the free list with up to `count` zeroed buffers of `size` bytes, so
+  // the first frames of a capture do not fault in fresh memory.
+  void reserve(size_t size, size_t count);
+
+  size_t free_count() const;
+
+ private:
+  struct State {
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> free;
+    size_t max_free = 0;
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+}
+
+#endif
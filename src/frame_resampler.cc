@@ -0,0 +1,370 @@
+#include "frame_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// MSVC does not define __SSE2__; SSE2 is baseline on x64.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RECASTER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "worker_pool.h"
+
+namespace recaster {
+
+namespace {
+
+constexpr int kWeightBits = 14;
+constexpr int32_t kWeightOne = 1 << kWeightBits;
+constexpr int32_t kWeightRound = 1 << (kWeightBits - 1);
+constexpr double kPi = 3.14159265358979323846;
+
+double filter_support(ResampleFilter filter) {
+  switch (filter) {
+    case ResampleFilter::kBicubic:
+      return 2.0;
+    case ResampleFilter::kLanczos3:
+      return 3.0;
+    case ResampleFilter::kBilinear:
+    default:
+      return 1.0;
+  }
+}
+
+double sinc(double x) {
+  if (x == 0.0) {
+    return 1.0;
+  }
+  x *= kPi;
+  return std::sin(x) / x;
+}
+
+double filter_weight(ResampleFilter filter, double x) {
+  x = std::fabs(x);
+  switch (filter) {
+    case ResampleFilter::kBicubic: {
+      constexpr double a = -0.5;
+      if (x < 1.0) {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+      }
+      if (x < 2.0) {
+        return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+      }
+      return 0.0;
+    }
+    case ResampleFilter::kLanczos3:
+      return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    case ResampleFilter::kBilinear:
+    default:
+      return x < 1.0 ? 1.0 - x : 0.0;
+  }
+}
+
+uint8_t clamp_to_u8(int32_t value) {
+  value >>= kWeightBits;
+  return static_cast<uint8_t>(std::min(255, std::max(0, value)));
+}
+
+int row_grain(int rows, WorkerPool* pool) {
+  const int workers = pool != nullptr ? pool->thread_count() + 1 : 1;
+  return std::max(8, rows / (workers * 4));
+}
+
+void horizontal_row(const uint8_t* src,
+                    uint8_t* dst,
+                    int dst_width,
+                    int taps,
+                    const int32_t* starts,
+                    const int16_t* weights) {
+#if defined(RECASTER_HAVE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (int x = 0; x < dst_width; ++x) {
+    const uint8_t* pixels = src + static_cast<size_t>(starts[x]) * 4U;
+    const int16_t* w = weights + static_cast<size_t>(x) * static_cast<size_t>(taps);
+    __m128i acc = _mm_set1_epi32(kWeightRound);
+    int k = 0;
+    for (; k + 1 < taps; k += 2) {
+      __m128i pair = _mm_loadl_epi64(
+          reinterpret_cast<const __m128i*>(pixels + static_cast<size_t>(k) * 4U));
+      pair = _mm_unpacklo_epi8(pair, zero);
+      pair = _mm_unpacklo_epi16(pair, _mm_srli_si128(pair, 8));
+      const __m128i coeff = _mm_set1_epi32(
+          static_cast<int32_t>(static_cast<uint16_t>(w[k])) |
+          (static_cast<int32_t>(w[k + 1]) << 16));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(pair, coeff));
+    }
+    if (k < taps) {
+      int32_t single = 0;
+      std::memcpy(&single, pixels + static_cast<size_t>(k) * 4U, sizeof(single));
+      __m128i pixel = _mm_unpacklo_epi8(_mm_cvtsi32_si128(single), zero);
+      pixel = _mm_unpacklo_epi16(pixel, zero);
+      const __m128i coeff =
+          _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(w[k])));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(pixel, coeff));
+    }
+    acc = _mm_srai_epi32(acc, kWeightBits);
+    acc = _mm_packs_epi32(acc, acc);
+    acc = _mm_packus_epi16(acc, acc);
+    const int32_t packed = _mm_cvtsi128_si32(acc);
+    std::memcpy(dst + static_cast<size_t>(x) * 4U, &packed, sizeof(packed));
+  }
+#else
+  for (int x = 0; x < dst_width; ++x) {
+    const uint8_t* pixels = src + static_cast<size_t>(starts[x]) * 4U;
+    const int16_t* w = weights + static_cast<size_t>(x) * static_cast<size_t>(taps);
+    int32_t acc[4] = {kWeightRound, kWeightRound, kWeightRound, kWeightRound};
+    for (int k = 0; k < taps; ++k) {
+      const uint8_t* pixel = pixels + static_cast<size_t>(k) * 4U;
+      for (int c = 0; c < 4; ++c) {
+        acc[c] += static_cast<int32_t>(pixel[c]) * w[k];
+      }
+    }
+    uint8_t* out = dst + static_cast<size_t>(x) * 4U;
+    for (int c = 0; c < 4; ++c) {
+      out[c] = clamp_to_u8(acc[c]);
+    }
+  }
+#endif
+}
+
+void vertical_row(const uint8_t* src,
+                  size_t src_stride,
+                  uint8_t* dst,
+                  int row_bytes,
+                  int taps,
+                  const int16_t* w) {
+  int i = 0;
+#if defined(RECASTER_HAVE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(kWeightRound);
+  for (; i + 16 <= row_bytes; i += 16) {
+    __m128i acc0 = round;
+    __m128i acc1 = round;
+    __m128i acc2 = round;
+    __m128i acc3 = round;
+    int k = 0;
+    for (; k < taps; k += 2) {
+      const __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+          src + static_cast<size_t>(k) * src_stride + static_cast<size_t>(i)));
+      __m128i row1 = zero;
+      int32_t coeff_bits = static_cast<int32_t>(static_cast<uint16_t>(w[k]));
+      if (k + 1 < taps) {
+        row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+            src + static_cast<size_t>(k + 1) * src_stride + static_cast<size_t>(i)));
+        coeff_bits |= static_cast<int32_t>(w[k + 1]) << 16;
+      }
+      const __m128i coeff = _mm_set1_epi32(coeff_bits);
+      const __m128i lo0 = _mm_unpacklo_epi8(row0, zero);
+      const __m128i lo1 = _mm_unpacklo_epi8(row1, zero);
+      const __m128i hi0 = _mm_unpackhi_epi8(row0, zero);
+      const __m128i hi1 = _mm_unpackhi_epi8(row1, zero);
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(lo0, lo1), coeff));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(lo0, lo1), coeff));
+      acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(hi0, hi1), coeff));
+      acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(hi0, hi1), coeff));
+    }
+    acc0 = _mm_srai_epi32(acc0, kWeightBits);
+    acc1 = _mm_srai_epi32(acc1, kWeightBits);
+    acc2 = _mm_srai_epi32(acc2, kWeightBits);
+    acc3 = _mm_srai_epi32(acc3, kWeightBits);
+    const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1),
+                                            _mm_packs_epi32(acc2, acc3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+  }
+#endif
+  for (; i < row_bytes; ++i) {
+    int32_t acc = kWeightRound;
+    for (int k = 0; k < taps; ++k) {
+      acc += static_cast<int32_t>(
+                 src[static_cast<size_t>(k) * src_stride + static_cast<size_t>(i)]) *
+             w[k];
+    }
+    dst[i] = clamp_to_u8(acc);
+  }
+}
+
+}
+
+bool parse_resample_filter(const char* name, ResampleFilter* filter) {
+  if (name == nullptr || filter == nullptr) {
+    return false;
+  }
+  if (strcmp(name, "bilinear") == 0) {
+    *filter = ResampleFilter::kBilinear;
+  } else if (strcmp(name, "bicubic") == 0) {
+    *filter = ResampleFilter::kBicubic;
+  } else if (strcmp(name, "lanczos3") == 0) {
+    *filter = ResampleFilter::kLanczos3;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void compute_scaled_size(int source_width,
+                         int source_height,
+                         const ScaleOptions& options,
+                         int* width,
+                         int* height) {
+  const int divisor = std::max(1, options.resolution_divisor);
+  double w = std::max(1, source_width / divisor);
+  double h = std::max(1, source_height / divisor);
+  if (options.scale > 0.0 && options.scale != 1.0) {
+    w *= options.scale;
+    h *= options.scale;
+  }
+  double fit = 1.0;
+  if (options.max_width > 0 && w > options.max_width) {
+    fit = std::min(fit, options.max_width / w);
+  }
+  if (options.max_height > 0 && h > options.max_height) {
+    fit = std::min(fit, options.max_height / h);
+  }
+  *width = std::max(1, static_cast<int>(std::lround(w * fit)));
+  *height = std::max(1, static_cast<int>(std::lround(h * fit)));
+  if (options.max_width > 0) {
+    *width = std::min(*width, options.max_width);
+  }
+  if (options.max_height > 0) {
+    *height = std::min(*height, options.max_height);
+  }
+}
+
+void FrameResampler::build_table(int src_size,
+                                 int dst_size,
+                                 ResampleFilter filter,
+                                 AxisTable* table) {
+  if (table->src_size == src_size && table->dst_size == dst_size &&
+      table->filter == filter && table->taps > 0) {
+    return;
+  }
+
+  const double scale = static_cast<double>(src_size) / dst_size;
+  const double filter_scale = std::max(1.0, scale);
+  const double support = filter_support(filter) * filter_scale;
+  const int taps = std::min(src_size, static_cast<int>(std::ceil(support)) * 2 + 1);
+
+  table->src_size = src_size;
+  table->dst_size = dst_size;
+  table->filter = filter;
+  table->taps = taps;
+  table->starts.assign(static_cast<size_t>(dst_size), 0);
+  table->weights.assign(static_cast<size_t>(dst_size) * static_cast<size_t>(taps), 0);
+
+  std::vector<double> raw(static_cast<size_t>(taps));
+  for (int i = 0; i < dst_size; ++i) {
+    const double center = (i + 0.5) * scale;
+    const int min_index = std::max(0, static_cast<int>(center - support + 0.5));
+    const int max_index =
+        std::min(src_size, std::max(min_index + 1, static_cast<int>(center + support + 0.5)));
+    const int count = std::min(taps, max_index - min_index);
+    const int start = std::max(0, std::min(min_index, src_size - taps));
+    const int offset = min_index - start;
+
+    double total = 0.0;
+    for (int k = 0; k < count; ++k) {
+      raw[static_cast<size_t>(k)] =
+          filter_weight(filter, (min_index + k - center + 0.5) / filter_scale);
+      total += raw[static_cast<size_t>(k)];
+    }
+    if (total == 0.0) {
+      raw[0] = 1.0;
+      total = 1.0;
+    }
+
+    int16_t* w = table->weights.data() +
+                 static_cast<size_t>(i) * static_cast<size_t>(taps);
+    int32_t sum = 0;
+    int peak = offset;
+    for (int k = 0; k < count; ++k) {
+      const int32_t value = static_cast<int32_t>(
+          std::lround(raw[static_cast<size_t>(k)] / total * kWeightOne));
+      w[offset + k] = static_cast<int16_t>(value);
+      sum += value;
+      if (w[offset + k] > w[peak]) {
+        peak = offset + k;
+      }
+    }
+    w[peak] = static_cast<int16_t>(w[peak] + (kWeightOne - sum));
+    table->starts[static_cast<size_t>(i)] = start;
+  }
+}
+
+void FrameResampler::resample(const uint8_t* src,
+                              int src_width,
+                              int src_height,
+                              size_t src_stride,
+                              uint8_t* dst,
+                              int dst_width,
+                              int dst_height,
+                              ResampleFilter filter,
+                              WorkerPool* pool) {
+  if (src == nullptr || dst == nullptr || src_width <= 0 || src_height <= 0 ||
+      dst_width <= 0 || dst_height <= 0) {
+    return;
+  }
+
+  const size_t dst_stride = static_cast<size_t>(dst_width) * 4U;
+  const bool scale_x = src_width != dst_width;
+  const bool scale_y = src_height != dst_height;
+
+  if (!scale_x && !scale_y) {
+    for (int y = 0; y < src_height; ++y) {
+      std::memcpy(dst + static_cast<size_t>(y) * dst_stride,
+                  src + static_cast<size_t>(y) * src_stride, dst_stride);
+    }
+    return;
+  }
+
+  const uint8_t* vertical_src = src;
+  size_t vertical_stride = src_stride;
+
+  if (scale_x) {
+    build_table(src_width, dst_width, filter, &horizontal_);
+    uint8_t* target = dst;
+    if (scale_y) {
+      intermediate_.resize(static_cast<size_t>(src_height) * dst_stride);
+      target = intermediate_.data();
+      vertical_src = target;
+      vertical_stride = dst_stride;
+    }
+    const AxisTable& table = horizontal_;
+    WorkerPool* workers = pool;
+    auto body = [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        horizontal_row(src + static_cast<size_t>(y) * src_stride,
+                       target + static_cast<size_t>(y) * dst_stride, dst_width,
+                       table.taps, table.starts.data(), table.weights.data());
+      }
+    };
+    if (workers != nullptr) {
+      workers->parallel_for(src_height, row_grain(src_height, workers), body);
+    } else {
+      body(0, src_height);
+    }
+  }
+
+  if (scale_y) {
+    build_table(src_height, dst_height, filter, &vertical_);
+    const AxisTable& table = vertical_;
+    const int row_bytes = dst_width * 4;
+    auto body = [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        const size_t start = static_cast<size_t>(table.starts[static_cast<size_t>(y)]);
+        vertical_row(vertical_src + start * vertical_stride, vertical_stride,
+                     dst + static_cast<size_t>(y) * dst_stride, row_bytes, table.taps,
+                     table.weights.data() +
+                         static_cast<size_t>(y) * static_cast<size_t>(table.taps));
+      }
+    };
+    if (pool != nullptr) {
+      pool->parallel_for(dst_height, row_grain(dst_height, pool), body);
+    } else {
+      body(0, dst_height);
+    }
+  }
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef RECASTER_FRAME_RESAMPLER_H_
+#define RECASTER_FRAME_RESAMPLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace recaster {
+
+class WorkerPool;
+
+enum class ResampleFilter {
+  kBilinear,
+  kBicubic,
+  kLanczos3,
+};
+
+bool parse_resample_filter(const char* name, ResampleFilter* filter);
+
+struct ScaleOptions {
+  int resolution_divisor = 1;
+  double scale = 1.0;
+  int max_width = 0;
+  int max_height = 0;
+  ResampleFilter filter = ResampleFilter::kBilinear;
+};
+
+// Applies the divisor, then the scale factor, then shrinks (never grows) the
+// result to fit max_width x max_height while keeping the aspect ratio.
+void compute_scaled_size(int source_width,
+                         int source_height,
+                         const ScaleOptions& options,
+                         int* width,
+                         int* height);
+
+// Separable polyphase resampler for 32-bit BGRA frames. Coefficient tables are
+// Q14 fixed point and are rebuilt only when the geometry or filter changes.
+// Rows are split into tiles across the worker pool; an instance must not be
+// used from two threads at once.
+class FrameResampler {
+ public:
+  void resample(const uint8_t* src,
+                int src_width,
+                int src_height,
+                size_t src_stride,
+                uint8_t* dst,
+                int dst_width,
+                int dst_height,
+                ResampleFilter filter,
+                WorkerPool* pool);
+
+ private:
+  struct AxisTable {
+    int src_size = 0;
+    int dst_size = 0;
+    ResampleFilter filter = ResampleFilter::kBilinear;
+    int taps = 0;
+    std::vector<int32_t> starts;
+    std::vector<int16_t> weights;
+  };
+
+  static void build_table(int src_size,
+                          int dst_size,
+                          ResampleFilter filter,
+                          AxisTable* table);
+
+  AxisTable horizontal_;
+  AxisTable vertical_;
+  std::vector<uint8_t> intermediate_;
+};
+
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include "frame_sink.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "worker_pool.h"
+
+namespace recaster {
+
+bool parse_resize_policy(const char* name, ResizePolicy* policy) {
+  if (strcmp(name, "letterbox") == 0) {
+    *policy = ResizePolicy::kLetterbox;
+  } else if (strcmp(name, "scale") == 0) {
+    *policy = ResizePolicy::kScale;
+  } else if (strcmp(name, "crop") == 0) {
+    *policy = ResizePolicy::kCrop;
+  } else if (strcmp(name, "segment") == 0) {
+    *policy = ResizePolicy::kSegment;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string segment_output_path(const std::string& output_path, size_t index) {
+  if (index == 0) {
+    return output_path;
+  }
+  const size_t separator = output_path.find_last_of("/\\");
+  size_t dot = output_path.rfind('.');
+  if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+    dot = output_path.size();
+  }
+  return output_path.substr(0, dot) + "-" + std::to_string(index + 1) +
+         output_path.substr(dot);
+}
+
+FrameSink::FrameSink() : segments_(1) {}
+
+void FrameSink::configure(const ScaleOptions& scale_options,
+                          PixelFormat format,
+                          ResizePolicy resize_policy,
+                          BufferCompression compression) {
+  scale_options_ = scale_options;
+  pixel_format_ = format;
+  resize_policy_ = resize_policy;
+  compression_ = compression;
+}
+
+size_t FrameSink::frame_count() const {
+  size_t count = 0;
+  for (const FrameSegment& segment : segments_) {
+    count += segment.frame_count();
+  }
+  return count;
+}
+
+FramePtr FrameSink::last_frame() const {
+  const FrameSegment& segment = segments_.back();
+  if (segment.store != nullptr) {
+    return segment.store->last();
+  }
+  return segment.frames.empty() ? nullptr : segment.frames.back();
+}
+
+size_t FrameSink::append(const FramePtr& source, WorkerPool* workers, int divisor_boost) {
+  if (source_width_ != 0 &&
+      (source->width != source_width_ || source->height != source_height_)) {
+    ++resizes_;
+  }
+  source_width_ = source->width;
+  source_height_ = source->height;
+
+  int width = source->width;
+  int height = source->height;
+  compute_scaled_size(source->width, source->height, scale_options_, &width, &height);
+  if (resize_policy_ == ResizePolicy::kSegment && segments_.back().width != 0 &&
+      (segments_.back().width != width || segments_.back().height != height)) {
+    if (segments_.back().frame_count() == 0) {
+      segments_.back() = FrameSegment();
+    } else {
+      segments_.emplace_back();
+    }
+  }
+  FrameSegment& segment = segments_.back();
+  if (segment.width == 0) {
+    segment.width = width;
+    segment.height = height;
+  }
+  if (compression_ != BufferCompression::kNone && segment.store == nullptr) {
+    segment.store = std::make_unique<FrameStore>(compression_ == BufferCompression::kDelta);
+  }
+
+  // Degraded frames stay BGRA below the canvas size until restore_reduced().
+  const bool reduced = divisor_boost > 1;
+  const int target_width = reduced ? std::max(1, segment.width / divisor_boost) : segment.width;
+  const int target_height =
+      reduced ? std::max(1, segment.height / divisor_boost) : segment.height;
+  const PixelFormat format = reduced ? PixelFormat::kBgra32 : pixel_format_;
+
+  Rect source_rect{0, 0, source->width, source->height};
+  Rect target_rect{0, 0, target_width, target_height};
+  if (width != segment.width || height != segment.height) {
+    const double sx = static_cast<double>(target_width) / source->width;
+    const double sy = static_cast<double>(target_height) / source->height;
+    if (resize_policy_ == ResizePolicy::kLetterbox) {
+      const double fit = std::min(sx, sy);
+      target_rect.width = std::min(
+          target_width, std::max(1, static_cast<int>(std::lround(source->width * fit))));
+      target_rect.height = std::min(
+          target_height, std::max(1, static_cast<int>(std::lround(source->height * fit))));
+      target_rect.x = (target_width - target_rect.width) / 2;
+      target_rect.y = (target_height - target_rect.height) / 2;
+    } else if (resize_policy_ == ResizePolicy::kCrop) {
+      const double fill = std::max(sx, sy);
+      source_rect.width = std::min(
+          source->width, std::max(1, static_cast<int>(std::lround(target_width / fill))));
+      source_rect.height = std::min(
+          source->height, std::max(1, static_cast<int>(std::lround(target_height / fill))));
+      source_rect.x = (source->width - source_rect.width) / 2;
+      source_rect.y = (source->height - source_rect.height) / 2;
+    }
+  }
+
+  const bool needs_scale = target_width != source->width || target_height != source->height ||
+                           source_rect.width != source->width ||
+                           source_rect.height != source->height ||
+                           target_rect.width != target_width ||
+                           target_rect.height != target_height;
+  if (!needs_scale && format == PixelFormat::kBgra32) {
+    if (segment.store != nullptr) {
+      segment.store->append(source, workers, compression_level_);
+      return static_cast<size_t>(segment.store->take_new_bytes());
+    }
+    segment.frames.push_back(source);
+    return 0;
+  }
+
+  auto frame = std::make_shared<FrameData>();
+  frame->width = target_width;
+  frame->height = target_height;
+  frame->format = format;
+  frame->timestamp_us = source->timestamp_us;
+  frame->pixels.resize(frame_byte_size(target_width, target_height, format));
+
+  const uint8_t* bgra = source->pixels.data();
+  if (needs_scale) {
+    uint8_t* target = frame->pixels.data();
+    if (format != PixelFormat::kBgra32) {
+      scaled_.resize(static_cast<size_t>(target_width) * static_cast<size_t>(target_height) *
+                     4U);
+      target = scaled_.data();
+    }
+    render(*source, source_rect, target, target_width, target_height, target_rect, workers);
+    bgra = target;
+  }
+  if (format != PixelFormat::kBgra32) {
+    convert_bgra_frame(bgra, target_width, target_height, format, frame->pixels.data());
+  }
+  if (segment.store != nullptr) {
+    segment.store->append(frame, workers, compression_level_);
+    return static_cast<size_t>(segment.store->take_new_bytes());
+  }
+  const size_t bytes = frame->pixels.size();
+  segment.frames.push_back(std::move(frame));
+  return bytes;
+}
+
+void FrameSink::render(const FrameData& source,
+                       const Rect& source_rect,
+                       uint8_t* dst,
+                       int dst_width,
+                       int dst_height,
+                       const Rect& dst_rect,
+                       WorkerPool* workers) {
+  const size_t source_stride = static_cast<size_t>(source.width) * 4U;
+  const uint8_t* origin = source.pixels.data() +
+                          static_cast<size_t>(source_rect.y) * source_stride +
+                          static_cast<size_t>(source_rect.x) * 4U;
+  if (dst_rect.width == dst_width && dst_rect.height == dst_height) {
+    resampler_.resample(origin, source_rect.width, source_rect.height, source_stride, dst,
+                        dst_width, dst_height, scale_options_.filter, workers);
+    return;
+  }
+
+  const size_t dst_stride = static_cast<size_t>(dst_width) * 4U;
+  const size_t row_bytes = static_cast<size_t>(dst_rect.width) * 4U;
+  fitted_.resize(row_bytes * static_cast<size_t>(dst_rect.height));
+  resampler_.resample(origin, source_rect.width, source_rect.height, source_stride,
+                      fitted_.data(), dst_rect.width, dst_rect.height, scale_options_.filter,
+                      workers);
+  static const uint8_t kBlack[4] = {0, 0, 0, 255};
+  for (size_t i = 0; i < dst_stride; i += 4) {
+    memcpy(dst + i, kBlack, 4);
+  }
+  for (int y = 1; y < dst_height; ++y) {
+    memcpy(dst + static_cast<size_t>(y) * dst_stride, dst, dst_stride);
+  }
+  for (int y = 0; y < dst_rect.height; ++y) {
+    memcpy(dst + static_cast<size_t>(dst_rect.y + y) * dst_stride +
+               static_cast<size_t>(dst_rect.x) * 4U,
+           fitted_.data() + static_cast<size_t>(y) * row_bytes, row_bytes);
+  }
+}
+
+bool FrameSink::repeat_last() {
+  FrameSegment& segment = segments_.back();
+  if (segment.store != nullptr) {
+    return segment.store->repeat_last();
+  }
+  std::vector<FramePtr>& frames = segment.frames;
+  if (frames.empty()) {
+    return false;
+  }
+  frames.push_back(frames.back());
+  return true;
+}
+
+void FrameSink::restore_reduced(WorkerPool* workers) {
+  for (FrameSegment& segment : segments_) {
+    const FrameData* last_reduced = nullptr;
+    FramePtr last_restored;
+    for (FramePtr& frame : segment.frames) {
+      if (frame->width == segment.width && frame->height == segment.height) {
+        continue;
+      }
+      if (frame.get() != last_reduced) {
+        last_reduced = frame.get();
+        last_restored = restore_frame(*frame, segment.width, segment.height, workers);
+      }
+      frame = last_restored;
+    }
+  }
+}
+
+FramePtr FrameSink::frame_at(size_t segment_index, size_t index, WorkerPool* workers) {
+  FrameSegment& segment = segments_[segment_index];
+  if (segment.store == nullptr) {
+    return index < segment.frames.size() ? segment.frames[index] : nullptr;
+  }
+  FramePtr frame = segment.store->frame(index);
+  if (frame == nullptr || (frame->width == segment.width && frame->height == segment.height)) {
+    return frame;
+  }
+  if (frame != last_reduced_) {
+    last_restored_ = restore_frame(*frame, segment.width, segment.height, workers);
+    last_reduced_ = std::move(frame);
+  }
+  return last_restored_;
+}
+
+bool FrameSink::expand_segment(size_t segment_index, WorkerPool* workers) {
+  FrameSegment& segment = segments_[segment_index];
+  if (segment.store == nullptr) {
+    return true;
+  }
+  const size_t count = segment.store->size();
+  std::vector<FramePtr> frames;
+  frames.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    FramePtr frame = frame_at(segment_index, i, workers);
+    if (frame == nullptr) {
+      return false;
+    }
+    frames.push_back(std::move(frame));
+  }
+  segment.frames.swap(frames);
+  segment.store.reset();
+  return true;
+}
+
+void FrameSink::release_segment(size_t segment_index) {
+  FrameSegment& segment = segments_[segment_index];
+  segment.frames.clear();
+  segment.frames.shrink_to_fit();
+  segment.store.reset();
+  last_reduced_ = nullptr;
+  last_restored_ = nullptr;
+}
+
+FramePtr FrameSink::restore_frame(const FrameData& frame,
+                                  int width,
+                                  int height,
+                                  WorkerPool* workers) {
+  auto restored = std::make_shared<FrameData>();
+  restored->width = width;
+  restored->height = height;
+  restored->format = pixel_format_;
+  restored->timestamp_us = frame.timestamp_us;
+  restored->pixels.resize(frame_byte_size(width, height, pixel_format_));
+  uint8_t* target = restored->pixels.data();
+  if (pixel_format_ != PixelFormat::kBgra32) {
+    scaled_.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * 4U);
+    target = scaled_.data();
+  }
+  resampler_.resample(frame.pixels.data(), frame.width, frame.height,
+                      static_cast<size_t>(frame.width) * 4U, target, width, height,
+                      scale_options_.filter, workers);
+  if (pixel_format_ != PixelFormat::kBgra32) {
+    convert_bgra_frame(target, width, height, pixel_format_, restored->pixels.data());
+  }
+  return restored;
+}
+
+}
@@ -0,0 +1,141 @@
+#ifndef RECASTER_FRAME_SINK_H_
+#define RECASTER_FRAME_SINK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_data.h"
+#include "frame_resampler.h"
+#include "frame_store.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+// What a sink does with captures whose output size differs from the canvas
+// fixed by the first frame, e.g. after the window was resized.
+enum class ResizePolicy {
+  // Fit inside the canvas keeping the aspect ratio, with black bars.
+  kLetterbox,
+  // Stretch to the canvas.
+  kScale,
+  // Fill the canvas keeping the aspect ratio, cropping the overflow.
+  kCrop,
+  // Close the current segment and start a new one at the new size.
+  kSegment,
+};
+
+bool parse_resize_policy(const char* name, ResizePolicy* policy);
+
+// Path of segment `index` of a recording: the output path itself for the
+// first segment, then "<stem>-2<ext>", "<stem>-3<ext>", ...
+std::string segment_output_path(const std::string& output_path, size_t index);
+
+// Frames of one output size, either raw in `frames` or compressed in `store`.
+struct FrameSegment {
+  int width = 0;
+  int height = 0;
+  std::vector<FramePtr> frames;
+  std::unique_ptr<FrameStore> store;
+
+  size_t frame_count() const { return store != nullptr ? store->size() : frames.size(); }
+};
+
+// Per-output stage of the capture pipeline: scales and converts the shared
+// BGRA capture to this output's size and format and buffers the result. A
+// full-size BGRA output keeps the capture itself without copying. Not thread
+// safe; the platform adapter serialises calls.
+class FrameSink {
+ public:
+  FrameSink();
+
+  void configure(const ScaleOptions& scale_options,
+                 PixelFormat format,
+                 ResizePolicy resize_policy = ResizePolicy::kLetterbox,
+                 BufferCompression compression = BufferCompression::kNone);
+
+  // Returns the bytes newly buffered. A frame shared with the capture is not
+  // counted. With compression, returns the compressed bytes finished since the
+  // last call instead.
+  size_t append(const FramePtr& source, WorkerPool* workers, int divisor_boost = 1);
+
+  // Buffers the previous frame again; false when there is none.
+  bool repeat_last();
+
+  // Codec level for compressed buffers, applied to frames appended from now
+  // on; see FrameEncoder. Ignored with BufferCompression::kNone.
+  void set_compression_level(int level) { compression_level_ = level; }
+
+  // Scales frames stored under a divisor boost back to their segment's size
+  // and format. Call once capture has stopped. Compressed segments are
+  // restored as they are read instead.
+  void restore_reduced(WorkerPool* workers);
+
+  // Frame `index` of segment `segment` at the segment's size and format,
+  // decoded if the segment is compressed. Reading in order is cheapest.
+  FramePtr frame_at(size_t segment, size_t index, WorkerPool* workers);
+  // Decodes a compressed segment into its `frames`, for writers that need
+  // every frame at once. False if a frame could not be decoded.
+  bool expand_segment(size_t segment, WorkerPool* workers);
+  // Drops the frames of a segment once it has been written.
+  void release_segment(size_t segment);
+
+  const ScaleOptions& scale_options() const { return scale_options_; }
+  PixelFormat pixel_format() const { return pixel_format_; }
+  ResizePolicy resize_policy() const { return resize_policy_; }
+  BufferCompression compression() const { return compression_; }
+  // Canvas size of the current segment.
+  int width() const { return segments_.back().width; }
+  int height() const { return segments_.back().height; }
+  // Frames of the current segment.
+  std::vector<FramePtr>& frames() { return segments_.back().frames; }
+  const std::vector<FramePtr>& frames() const { return segments_.back().frames; }
+  // The frame buffered last, before any compression.
+  FramePtr last_frame() const;
+  std::vector<FrameSegment>& segments() { return segments_; }
+  const std::vector<FrameSegment>& segments() const { return segments_; }
+  size_t frame_count() const;
+  // Captures whose size differed from the canvas.
+  uint64_t resizes() const { return resizes_; }
+
+ private:
+  struct Rect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+  };
+
+  FramePtr restore_frame(const FrameData& frame, int width, int height, WorkerPool* workers);
+  void render(const FrameData& source,
+              const Rect& source_rect,
+              uint8_t* dst,
+              int dst_width,
+              int dst_height,
+              const Rect& dst_rect,
+              WorkerPool* workers);
+
+  ScaleOptions scale_options_;
+  PixelFormat pixel_format_ = PixelFormat::kBgra32;
+  ResizePolicy resize_policy_ = ResizePolicy::kLetterbox;
+  BufferCompression compression_ = BufferCompression::kNone;
+  int compression_level_ = 1;
+  // Size the source was scaled for; a change means the window was resized.
+  int source_width_ = 0;
+  int source_height_ = 0;
+  uint64_t resizes_ = 0;
+  FrameResampler resampler_;
+  std::vector<uint8_t> scaled_;
+  std::vector<uint8_t> fitted_;
+  std::vector<FrameSegment> segments_;
+  // frame_at() restores each reduced frame once, however often it repeats.
+  FramePtr last_reduced_;
+  FramePtr last_restored_;
+};
+
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include "frame_store.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "worker_pool.h"
+
+namespace recaster {
+
+namespace {
+
+uint64_t load_word(const uint8_t* data, size_t word) {
+  uint64_t value;
+  memcpy(&value, data + word * 8, 8);
+  return value;
+}
+
+uint64_t delta_word(const uint8_t* frame, const uint8_t* reference, size_t word) {
+  const uint64_t value = load_word(frame, word);
+  return reference != nullptr ? value ^ load_word(reference, word) : value;
+}
+
+void put_varint(uint64_t value, std::vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+bool get_varint(const uint8_t* data, size_t size, size_t* offset, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *offset < size; shift += 7) {
+    const uint8_t byte = data[(*offset)++];
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Alternating runs of zero and non-zero words of `frame` XOR `reference`: a
+// varint count of zero words, a varint count of literal words and the
+// literals. A literal run only ends at two zero words in a row, so isolated
+// unchanged words do not cost a run header. The bytes past the last whole
+// word follow as literals.
+void pack_words(const uint8_t* frame,
+                const uint8_t* reference,
+                size_t size,
+                std::vector<uint8_t>* out) {
+  out->clear();
+  const size_t words = size / 8;
+  size_t word = 0;
+  while (word < words) {
+    const size_t zero_start = word;
+    while (word < words && delta_word(frame, reference, word) == 0) {
+      ++word;
+    }
+    const size_t literal_start = word;
+    while (word < words &&
+           !(delta_word(frame, reference, word) == 0 &&
+             (word + 1 == words || delta_word(frame, reference, word + 1) == 0))) {
+      ++word;
+    }
+    put_varint(literal_start - zero_start, out);
+    put_varint(word - literal_start, out);
+    const size_t offset = out->size();
+    out->resize(offset + (word - literal_start) * 8);
+    for (size_t i = literal_start; i < word; ++i) {
+      const uint64_t value = delta_word(frame, reference, i);
+      memcpy(out->data() + offset + (i - literal_start) * 8, &value, 8);
+    }
+  }
+  for (size_t i = words * 8; i < size; ++i) {
+    out->push_back(reference != nullptr ? frame[i] ^ reference[i] : frame[i]);
+  }
+}
+
+bool unpack_words(const uint8_t* packed,
+                  size_t packed_size,
+                  const uint8_t* reference,
+                  uint8_t* frame,
+                  size_t size) {
+  const size_t words = size / 8;
+  size_t offset = 0;
+  size_t word = 0;
+  while (word < words) {
+    uint64_t zeros = 0;
+    uint64_t literals = 0;
+    if (!get_varint(packed, packed_size, &offset, &zeros) ||
+        !get_varint(packed, packed_size, &offset, &literals) || zeros > words - word ||
+        literals > words - word - zeros || literals * 8 > packed_size - offset) {
+      return false;
+    }
+    if (reference != nullptr) {
+      memcpy(frame + word * 8, reference + word * 8, zeros * 8);
+    } else {
+      memset(frame + word * 8, 0, zeros * 8);
+    }
+    word += zeros;
+    for (uint64_t i = 0; i < literals; ++i, ++word) {
+      uint64_t value = load_word(packed + offset, i);
+      if (reference != nullptr) {
+        value ^= load_word(reference, word);
+      }
+      memcpy(frame + word * 8, &value, 8);
+    }
+    offset += literals * 8;
+  }
+  const size_t tail = size - words * 8;
+  if (packed_size - offset != tail) {
+    return false;
+  }
+  for (size_t i = 0; i < tail; ++i) {
+    const size_t at = words * 8 + i;
+    frame[at] = reference != nullptr ? packed[offset + i] ^ reference[at] : packed[offset + i];
+  }
+  return true;
+}
+
+}
+
+bool parse_buffer_compression(const char* name, BufferCompression* compression) {
+  if (strcmp(name, "none") == 0) {
+    *compression = BufferCompression::kNone;
+  } else if (strcmp(name, "frame") == 0) {
+    *compression = BufferCompression::kFrame;
+  } else if (strcmp(name, "delta") == 0) {
+    *compression = BufferCompression::kDelta;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+FrameStore::FrameStore(bool delta)
+    : delta_(delta),
+      codec_(frame_codec_available(FrameCodec::kLz4) ? FrameCodec::kLz4 : FrameCodec::kStored) {}
+
+FrameStore::~FrameStore() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void FrameStore::append(const FramePtr& frame, WorkerPool* workers, int level) {
+  entries_.emplace_back();
+  Entry& entry = entries_.back();
+  entry.width = frame->width;
+  entry.height = frame->height;
+  entry.format = frame->format;
+  entry.timestamp_us = frame->timestamp_us;
+  entry.raw_size = frame->pixels.size();
+  FramePtr reference;
+  if (delta_ && last_ != nullptr && last_->width == frame->width &&
+      last_->height == frame->height && last_->format == frame->format &&
+      last_->pixels.size() == frame->pixels.size()) {
+    reference = last_;
+    entry.key = false;
+  }
+  last_ = frame;
+
+  bool inline_compress = workers == nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Bound the raw frames waiting for a worker.
+    if (!inline_compress &&
+        pending_ >= static_cast<size_t>(workers->thread_count() + 1) * 2U) {
+      inline_compress = true;
+    }
+    ++pending_;
+  }
+  if (inline_compress) {
+    compress(&entry, frame, reference, 1);
+    return;
+  }
+  Entry* target = &entry;
+  workers->post([this, target, frame, reference, level]() {
+    compress(target, frame, reference, level);
+  });
+}
+
+bool FrameStore::repeat_last() {
+  if (entries_.empty()) {
+    return false;
+  }
+  const Entry& previous = entries_.back();
+  Entry entry;
+  entry.width = previous.width;
+  entry.height = previous.height;
+  entry.format = previous.format;
+  entry.timestamp_us = previous.timestamp_us;
+  entry.raw_size = previous.raw_size;
+  entry.key = false;
+  entry.repeat = true;
+  entry.ready = true;
+  entries_.push_back(std::move(entry));
+  return true;
+}
+
+void FrameStore::compress(Entry* entry,
+                          const FramePtr& frame,
+                          const FramePtr& reference,
+                          int level) {
+  std::vector<uint8_t> packed;
+  pack_words(frame->pixels.data(), reference != nullptr ? reference->pixels.data() : nullptr,
+             frame->pixels.size(), &packed);
+  const size_t packed_size = packed.size();
+  std::vector<uint8_t> data;
+  if (codec_ == FrameCodec::kStored) {
+    data.swap(packed);
+  } else {
+    std::unique_ptr<FrameEncoder> encoder = take_encoder(level);
+    if (!encoder->encode(packed.data(), packed.size(), &data) || data.size() >= packed.size()) {
+      // Kept packed; decode() tells the two apart by size.
+      data.swap(packed);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_encoders_.push_back(std::move(encoder));
+  }
+  const uint64_t bytes = data.size();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->packed_size = packed_size;
+    entry->data = std::move(data);
+    entry->ready = true;
+    --pending_;
+  }
+  stored_bytes_.fetch_add(bytes);
+  new_bytes_.fetch_add(bytes);
+  cv_.notify_all();
+}
+
+std::unique_ptr<FrameEncoder> FrameStore::take_encoder(int level) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < idle_encoders_.size(); ++i) {
+      if (idle_encoders_[i]->level() == level) {
+        std::unique_ptr<FrameEncoder> encoder = std::move(idle_encoders_[i]);
+        idle_encoders_.erase(idle_encoders_.begin() + static_cast<std::ptrdiff_t>(i));
+        return encoder;
+      }
+    }
+  }
+  return std::make_unique<FrameEncoder>(codec_, level, std::vector<uint8_t>());
+}
+
+FramePtr FrameStore::frame(size_t index) {
+  if (index >= entries_.size()) {
+    return nullptr;
+  }
+  if (decoded_ != nullptr && index == decoded_index_) {
+    return decoded_;
+  }
+  size_t start = index;
+  FramePtr reference;
+  if (decoded_ != nullptr && decoded_index_ < index) {
+    start = decoded_index_ + 1;
+    reference = decoded_;
+  } else {
+    while (start > 0 && !entries_[start].key) {
+      --start;
+    }
+  }
+  for (size_t i = start; i <= index; ++i) {
+    const Entry& entry = entries_[i];
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [&entry]() { return entry.ready; });
+    }
+    reference = entry.repeat ? reference : decode(entry, reference);
+    if (reference == nullptr) {
+      decoded_ = nullptr;
+      return nullptr;
+    }
+  }
+  decoded_index_ = index;
+  decoded_ = reference;
+  return decoded_;
+}
+
+FramePtr FrameStore::decode(const Entry& entry, const FramePtr& reference) {
+  if (!entry.key && (reference == nullptr || reference->pixels.size() != entry.raw_size)) {
+    return nullptr;
+  }
+  const uint8_t* packed = entry.data.data();
+  if (entry.data.size() != entry.packed_size) {
+    packed_.resize(entry.packed_size);
+    FrameDecoder decoder(codec_, nullptr, 0);
+    if (!decoder.decode(entry.data.data(), entry.data.size(), packed_.data(), packed_.size())) {
+      return nullptr;
+    }
+    packed = packed_.data();
+  }
+  auto frame = std::make_shared<FrameData>();
+  frame->width = entry.width;
+  frame->height = entry.height;
+  frame->format = entry.format;
+  frame->timestamp_us = entry.timestamp_us;
+  frame->pixels.resize(entry.raw_size);
+  if (!unpack_words(packed, entry.packed_size, entry.key ? nullptr : reference->pixels.data(),
+                    frame->pixels.data(), entry.raw_size)) {
+    return nullptr;
+  }
+  return frame;
+}
+
+}
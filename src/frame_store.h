@@ -0,0 +1,104 @@
+#ifndef RECASTER_FRAME_STORE_H_
+#define RECASTER_FRAME_STORE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "frame_codec.h"
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+// How a sink keeps frames in memory until the recording is written.
+enum class BufferCompression {
+  // Raw frames; the capture itself is shared when sizes match.
+  kNone,
+  // Each frame compressed on its own.
+  kFrame,
+  // Each frame XORed with the previous one before compression, so unchanged
+  // pixels cost almost nothing.
+  kDelta,
+};
+
+bool parse_buffer_compression(const char* name, BufferCompression* compression);
+
+// Buffered frames of one segment, compressed on the worker pool as they
+// arrive. Frames are packed into runs of unchanged and changed 8-byte words
+// and then LZ4-compressed when the build has LZ4. Appends come from one
+// thread; frame() may be called from another once appends have stopped.
+class FrameStore {
+ public:
+  explicit FrameStore(bool delta);
+  ~FrameStore();
+
+  FrameStore(const FrameStore&) = delete;
+  FrameStore& operator=(const FrameStore&) = delete;
+
+  // Holds `frame` until a worker compresses it at `level` (see FrameEncoder).
+  // Compresses inline when there is no pool or the pool is falling behind,
+  // always at level 1 so a raised level never slows the calling thread.
+  void append(const FramePtr& frame, WorkerPool* workers, int level = 1);
+  // Buffers the previous frame again; false when there is none.
+  bool repeat_last();
+
+  size_t size() const { return entries_.size(); }
+  // The frame most recently appended, before compression.
+  const FramePtr& last() const { return last_; }
+  uint64_t stored_bytes() const { return stored_bytes_.load(); }
+  // Compressed bytes finished since the previous call.
+  uint64_t take_new_bytes() { return new_bytes_.exchange(0); }
+
+  // Decodes frame `index`, waiting for its compression if needed. Reading in
+  // order decodes each frame once; seeking back restarts at a key frame.
+  // Returns nullptr if the frame cannot be decoded.
+  FramePtr frame(size_t index);
+
+ private:
+  struct Entry {
+    int32_t width = 0;
+    int32_t height = 0;
+    PixelFormat format = PixelFormat::kBgra32;
+    int64_t timestamp_us = 0;
+    size_t raw_size = 0;
+    bool key = true;
+    bool repeat = false;
+    bool ready = false;
+    size_t packed_size = 0;
+    std::vector<uint8_t> data;
+  };
+
+  void compress(Entry* entry, const FramePtr& frame, const FramePtr& reference, int level);
+  std::unique_ptr<FrameEncoder> take_encoder(int level);
+  FramePtr decode(const Entry& entry, const FramePtr& reference);
+
+  bool delta_;
+  FrameCodec codec_;
+  std::deque<Entry> entries_;
+  FramePtr last_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t pending_ = 0;
+  // Encoders are reused across frames: one per concurrent compress() for each
+  // level used so far, which degradation keeps to a handful.
+  std::vector<std::unique_ptr<FrameEncoder>> idle_encoders_;
+  std::atomic<uint64_t> stored_bytes_{0};
+  std::atomic<uint64_t> new_bytes_{0};
+
+  // Reader state.
+  size_t decoded_index_ = 0;
+  FramePtr decoded_;
+  std::vector<uint8_t> packed_;
+};
+
+}
+
+#endif
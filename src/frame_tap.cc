@@ -0,0 +1,78 @@
+#include "frame_tap.h"
+
+#include <algorithm>
+
+namespace recaster {
+
+FrameTap::FrameTap(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+void FrameTap::offer(const FramePtr& frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (queue_.size() == capacity_) {
+    queue_.pop_front();
+    ++dropped_;
+  }
+  queue_.emplace_back(offered_++, frame);
+}
+
+bool FrameTap::take(FramePtr* frame, uint64_t* sequence) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (queue_.empty() || lent_ >= capacity_) {
+    return false;
+  }
+  *sequence = queue_.front().first;
+  *frame = std::move(queue_.front().second);
+  queue_.pop_front();
+  ++lent_;
+  return true;
+}
+
+void FrameTap::release() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (lent_ > 0) {
+    --lent_;
+  }
+}
+
+uint64_t FrameTap::dropped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+size_t FrameTap::lent() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lent_;
+}
+
+int64_t FrameTapRegistry::open(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int64_t id = next_id_++;
+  taps_.emplace(id, std::make_shared<FrameTap>(capacity));
+  open_count_ = taps_.size();
+  return id;
+}
+
+bool FrameTapRegistry::close(int64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const bool closed = taps_.erase(id) > 0;
+  open_count_ = taps_.size();
+  return closed;
+}
+
+std::shared_ptr<FrameTap> FrameTapRegistry::find(int64_t id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = taps_.find(id);
+  return it != taps_.end() ? it->second : nullptr;
+}
+
+void FrameTapRegistry::offer(const FramePtr& frame) {
+  if (open_count_.load() == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : taps_) {
+    entry.second->offer(frame);
+  }
+}
+
+}
@@ -0,0 +1,76 @@
+#ifndef RECASTER_FRAME_TAP_H_
+#define RECASTER_FRAME_TAP_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+// Lends captured frames to a consumer outside the pipeline, such as a Dart
+// FFI binding, without copying: the consumer holds a reference to the pooled
+// frame until it gives it back. At most `capacity` frames wait in the queue
+// and at most `capacity` are lent out; a consumer that falls behind loses the
+// oldest queued frames, so capture never waits for it.
+class FrameTap {
+ public:
+  explicit FrameTap(size_t capacity);
+
+  FrameTap(const FrameTap&) = delete;
+  FrameTap& operator=(const FrameTap&) = delete;
+
+  // Capture side. Frames are numbered in the order offered, so gaps in
+  // `sequence` show drops.
+  void offer(const FramePtr& frame);
+
+  // Consumer side. False when the queue is empty or `capacity` frames are
+  // already lent out; each successful take needs a matching release().
+  bool take(FramePtr* frame, uint64_t* sequence);
+  void release();
+
+  size_t capacity() const { return capacity_; }
+  uint64_t dropped() const;
+  size_t lent() const;
+
+ private:
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  std::deque<std::pair<uint64_t, FramePtr>> queue_;
+  uint64_t offered_ = 0;
+  uint64_t dropped_ = 0;
+  size_t lent_ = 0;
+};
+
+// Taps addressed by id, for entry points that cannot hold C++ objects.
+class FrameTapRegistry {
+ public:
+  FrameTapRegistry() = default;
+
+  FrameTapRegistry(const FrameTapRegistry&) = delete;
+  FrameTapRegistry& operator=(const FrameTapRegistry&) = delete;
+
+  // Ids start at 1 and are never reused.
+  int64_t open(size_t capacity);
+  bool close(int64_t id);
+  std::shared_ptr<FrameTap> find(int64_t id) const;
+
+  // Offers `frame` to every open tap. Returns at once when there is none.
+  void offer(const FramePtr& frame);
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<int64_t, std::shared_ptr<FrameTap>> taps_;
+  int64_t next_id_ = 1;
+  std::atomic<size_t> open_count_{0};
+};
+
+}
+
+#endif
@@ -0,0 +1,702 @@
+#include "gif_writer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+// MSVC does not define __SSE2__; SSE2 is baseline on x64.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RECASTER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "worker_pool.h"
+
+namespace recaster {
+
+namespace {
+
+// Colours are bucketed at 5 bits per channel for the histogram and for the
+// nearest-colour cache.
+constexpr int kBuckets = 1 << 15;
+constexpr int kMaxCodes = 4096;
+constexpr int kMinDelayCs = 2;
+
+int bucket_of(int r, int g, int b) {
+  return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+}
+
+int bucket_channel(int bucket, int channel) {
+  return (bucket >> (10 - channel * 5)) & 31;
+}
+
+struct Palette {
+  int size = 0;
+  // Table entries as written; always a power of two above `size`, so the
+  // last entry is free for transparency.
+  int table_bits = 1;
+  uint8_t rgb[256][3] = {};
+  // Planar copy for the vectorised nearest-colour search, padded to a
+  // multiple of four with entries that never win.
+  alignas(16) float r[256];
+  alignas(16) float g[256];
+  alignas(16) float b[256];
+  int padded = 0;
+
+  int transparent_index() const { return (1 << table_bits) - 1; }
+
+  void finish() {
+    table_bits = 1;
+    while ((1 << table_bits) < size + 1) {
+      ++table_bits;
+    }
+    padded = (size + 3) & ~3;
+    for (int i = 0; i < padded; ++i) {
+      const bool used = i < size;
+      r[i] = used ? rgb[i][0] : 1e6f;
+      g[i] = used ? rgb[i][1] : 1e6f;
+      b[i] = used ? rgb[i][2] : 1e6f;
+    }
+  }
+
+  int nearest(int red, int green, int blue) const {
+#if defined(RECASTER_HAVE_SSE2)
+    const __m128 qr = _mm_set1_ps(static_cast<float>(red));
+    const __m128 qg = _mm_set1_ps(static_cast<float>(green));
+    const __m128 qb = _mm_set1_ps(static_cast<float>(blue));
+    __m128 best = _mm_set1_ps(FLT_MAX);
+    __m128i best_index = _mm_setzero_si128();
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+    for (int i = 0; i < padded; i += 4) {
+      const __m128 dr = _mm_sub_ps(_mm_load_ps(r + i), qr);
+      const __m128 dg = _mm_sub_ps(_mm_load_ps(g + i), qg);
+      const __m128 db = _mm_sub_ps(_mm_load_ps(b + i), qb);
+      const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+                                         _mm_mul_ps(db, db));
+      const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+      best = _mm_min_ps(distance, best);
+      best_index = _mm_or_si128(_mm_and_si128(closer, index),
+                                _mm_andnot_si128(closer, best_index));
+      index = _mm_add_epi32(index, step);
+    }
+    alignas(16) float lane_best[4];
+    alignas(16) int32_t lane_index[4];
+    _mm_store_ps(lane_best, best);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+    int result = lane_index[0];
+    float result_distance = lane_best[0];
+    for (int lane = 1; lane < 4; ++lane) {
+      if (lane_best[lane] < result_distance ||
+          (lane_best[lane] == result_distance && lane_index[lane] < result)) {
+        result = lane_index[lane];
+        result_distance = lane_best[lane];
+      }
+    }
+    return result;
+#else
+    int result = 0;
+    int result_distance = INT32_MAX;
+    for (int i = 0; i < size; ++i) {
+      const int dr = rgb[i][0] - red;
+      const int dg = rgb[i][1] - green;
+      const int db = rgb[i][2] - blue;
+      const int distance = dr * dr + dg * dg + db * db;
+      if (distance < result_distance) {
+        result = i;
+        result_distance = distance;
+      }
+    }
+    return result;
+#endif
+  }
+};
+
+struct Histogram {
+  std::vector<uint32_t> count = std::vector<uint32_t>(kBuckets);
+  std::vector<uint64_t> sum = std::vector<uint64_t>(kBuckets * 3);
+
+  void add(const FrameData& frame, int step) {
+    const int bytes_per_pixel = frame.format == PixelFormat::kBgr24 ? 3 : 4;
+    const size_t row_bytes = frame_row_bytes(frame.width, frame.format);
+    for (int y = 0; y < frame.height; y += step) {
+      const uint8_t* px = frame.pixels.data() + static_cast<size_t>(y) * row_bytes;
+      for (int x = 0; x < frame.width; x += step) {
+        const uint8_t* p = px + static_cast<size_t>(x) * bytes_per_pixel;
+        const int bucket = bucket_of(p[2], p[1], p[0]);
+        ++count[bucket];
+        sum[bucket * 3] += p[2];
+        sum[bucket * 3 + 1] += p[1];
+        sum[bucket * 3 + 2] += p[0];
+      }
+    }
+  }
+
+  void merge(const Histogram& other) {
+    for (int i = 0; i < kBuckets; ++i) {
+      count[i] += other.count[i];
+    }
+    for (size_t i = 0; i < sum.size(); ++i) {
+      sum[i] += other.sum[i];
+    }
+  }
+};
+
+// Median cut over the occupied buckets: repeatedly splits the box with the
+// most pixels times extent at its pixel median along its longest axis.
+void median_cut(const Histogram& histogram, int max_colors, Palette* palette) {
+  std::vector<int> buckets;
+  for (int i = 0; i < kBuckets; ++i) {
+    if (histogram.count[i] != 0) {
+      buckets.push_back(i);
+    }
+  }
+
+  struct Box {
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t pixels = 0;
+    int axis = 0;
+    int extent = 0;
+  };
+  auto measure = [&](Box* box) {
+    int lo[3] = {31, 31, 31};
+    int hi[3] = {0, 0, 0};
+    box->pixels = 0;
+    for (size_t i = box->begin; i < box->end; ++i) {
+      for (int c = 0; c < 3; ++c) {
+        const int v = bucket_channel(buckets[i], c);
+        lo[c] = std::min(lo[c], v);
+        hi[c] = std::max(hi[c], v);
+      }
+      box->pixels += histogram.count[buckets[i]];
+    }
+    box->axis = 0;
+    box->extent = hi[0] - lo[0];
+    for (int c = 1; c < 3; ++c) {
+      if (hi[c] - lo[c] > box->extent) {
+        box->axis = c;
+        box->extent = hi[c] - lo[c];
+      }
+    }
+  };
+
+  std::vector<Box> boxes;
+  if (!buckets.empty()) {
+    Box all;
+    all.end = buckets.size();
+    measure(&all);
+    boxes.push_back(all);
+  }
+  while (static_cast<int>(boxes.size()) < max_colors) {
+    int pick = -1;
+    uint64_t pick_score = 0;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+      const uint64_t score = boxes[i].pixels * static_cast<uint64_t>(boxes[i].extent);
+      if (boxes[i].extent > 0 && score > pick_score) {
+        pick = static_cast<int>(i);
+        pick_score = score;
+      }
+    }
+    if (pick < 0) {
+      break;
+    }
+    Box box = boxes[static_cast<size_t>(pick)];
+    const int axis = box.axis;
+    std::sort(buckets.begin() + static_cast<std::ptrdiff_t>(box.begin),
+              buckets.begin() + static_cast<std::ptrdiff_t>(box.end),
+              [axis](int a, int b) { return bucket_channel(a, axis) < bucket_channel(b, axis); });
+    uint64_t running = 0;
+    size_t split = box.begin + 1;
+    for (size_t i = box.begin; i < box.end - 1; ++i) {
+      running += histogram.count[buckets[i]];
+      split = i + 1;
+      if (running * 2 >= box.pixels) {
+        break;
+      }
+    }
+    Box lower = box;
+    lower.end = split;
+    Box upper = box;
+    upper.begin = split;
+    measure(&lower);
+    measure(&upper);
+    boxes[static_cast<size_t>(pick)] = lower;
+    boxes.push_back(upper);
+  }
+
+  palette->size = std::max<int>(1, static_cast<int>(boxes.size()));
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    uint64_t total[3] = {0, 0, 0};
+    uint64_t pixels = 0;
+    for (size_t j = boxes[i].begin; j < boxes[i].end; ++j) {
+      const int bucket = buckets[j];
+      pixels += histogram.count[bucket];
+      for (int c = 0; c < 3; ++c) {
+        total[c] += histogram.sum[static_cast<size_t>(bucket) * 3 + c];
+      }
+    }
+    for (int c = 0; c < 3; ++c) {
+      palette->rgb[i][c] = static_cast<uint8_t>(pixels > 0 ? (total[c] + pixels / 2) / pixels : 0);
+    }
+  }
+  palette->finish();
+}
+
+// Nearest palette index per 15-bit bucket, filled on demand or up front.
+class ColorMap {
+ public:
+  explicit ColorMap(const Palette* palette) : palette_(palette), cache_(kBuckets, -1) {}
+
+  void fill(int begin, int end) {
+    for (int bucket = begin; bucket < end; ++bucket) {
+      lookup(bucket);
+    }
+  }
+
+  uint8_t lookup(int bucket) {
+    int16_t& entry = cache_[static_cast<size_t>(bucket)];
+    if (entry < 0) {
+      // Centre of the bucket, so the result does not depend on which pixel
+      // filled it first.
+      entry = static_cast<int16_t>(palette_->nearest((bucket_channel(bucket, 0) << 3) | 4,
+                                                     (bucket_channel(bucket, 1) << 3) | 4,
+                                                     (bucket_channel(bucket, 2) << 3) | 4));
+    }
+    return static_cast<uint8_t>(entry);
+  }
+
+ private:
+  const Palette* palette_;
+  std::vector<int16_t> cache_;
+};
+
+void map_frame(const FrameData& frame, ColorMap* map, std::vector<uint8_t>* indices) {
+  const int bytes_per_pixel = frame.format == PixelFormat::kBgr24 ? 3 : 4;
+  const size_t row_bytes = frame_row_bytes(frame.width, frame.format);
+  indices->resize(static_cast<size_t>(frame.width) * static_cast<size_t>(frame.height));
+  uint8_t* out = indices->data();
+  for (int y = 0; y < frame.height; ++y) {
+    const uint8_t* px = frame.pixels.data() + static_cast<size_t>(y) * row_bytes;
+    for (int x = 0; x < frame.width; ++x) {
+      *out++ = map->lookup(bucket_of(px[2], px[1], px[0]));
+      px += bytes_per_pixel;
+    }
+  }
+}
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t>* out) : out_(out) {}
+
+  void put(int code, int bits) {
+    buffer_ |= static_cast<uint32_t>(code) << count_;
+    count_ += bits;
+    while (count_ >= 8) {
+      out_->push_back(static_cast<uint8_t>(buffer_ & 0xff));
+      buffer_ >>= 8;
+      count_ -= 8;
+    }
+  }
+
+  void flush() {
+    if (count_ > 0) {
+      out_->push_back(static_cast<uint8_t>(buffer_ & 0xff));
+    }
+    buffer_ = 0;
+    count_ = 0;
+  }
+
+ private:
+  std::vector<uint8_t>* out_;
+  uint32_t buffer_ = 0;
+  int count_ = 0;
+};
+
+// Variable-width GIF LZW. The string table is an open-addressed hash of
+// (prefix code, next index) pairs.
+void lzw_encode(const uint8_t* indices, size_t count, int min_code_size,
+                std::vector<uint8_t>* out) {
+  constexpr int kHashSize = 5003;
+  std::vector<int32_t> keys(kHashSize, -1);
+  std::vector<int16_t> codes(kHashSize);
+  const int clear_code = 1 << min_code_size;
+  const int end_code = clear_code + 1;
+  int next_code = end_code + 1;
+  int code_size = min_code_size + 1;
+
+  out->clear();
+  BitWriter writer(out);
+  writer.put(clear_code, code_size);
+  if (count == 0) {
+    writer.put(end_code, code_size);
+    writer.flush();
+    return;
+  }
+
+  int prefix = indices[0];
+  for (size_t i = 1; i < count; ++i) {
+    const int pixel = indices[i];
+    const int32_t key = (prefix << 8) | pixel;
+    int slot = static_cast<int>((static_cast<uint32_t>(pixel) << 4 ^ static_cast<uint32_t>(prefix)) %
+                                kHashSize);
+    bool found = false;
+    while (keys[static_cast<size_t>(slot)] >= 0) {
+      if (keys[static_cast<size_t>(slot)] == key) {
+        found = true;
+        break;
+      }
+      slot = slot + 1 == kHashSize ? 0 : slot + 1;
+    }
+    if (found) {
+      prefix = codes[static_cast<size_t>(slot)];
+      continue;
+    }
+
+    writer.put(prefix, code_size);
+    if (next_code < kMaxCodes) {
+      keys[static_cast<size_t>(slot)] = key;
+      codes[static_cast<size_t>(slot)] = static_cast<int16_t>(next_code);
+      ++next_code;
+      if (next_code > (1 << code_size) && code_size < 12) {
+        ++code_size;
+      }
+    } else {
+      writer.put(clear_code, code_size);
+      std::fill(keys.begin(), keys.end(), -1);
+      next_code = end_code + 1;
+      code_size = min_code_size + 1;
+    }
+    prefix = pixel;
+  }
+  writer.put(prefix, code_size);
+  writer.put(end_code, code_size);
+  writer.flush();
+}
+
+struct EncodedFrame {
+  const Palette* palette = nullptr;
+  std::vector<uint8_t> indices;
+  int left = 0;
+  int top = 0;
+  int width = 0;
+  int height = 0;
+  bool transparent = false;
+  int delay_cs = 0;
+  std::vector<uint8_t> lzw;
+};
+
+void put_u16(std::ofstream* file, int value) {
+  const char bytes[2] = {static_cast<char>(value & 0xff), static_cast<char>((value >> 8) & 0xff)};
+  file->write(bytes, 2);
+}
+
+void write_color_table(std::ofstream* file, const Palette& palette) {
+  std::vector<uint8_t> table(static_cast<size_t>(3) << palette.table_bits, 0);
+  std::memcpy(table.data(), palette.rgb, static_cast<size_t>(palette.size) * 3U);
+  file->write(reinterpret_cast<const char*>(table.data()),
+              static_cast<std::streamsize>(table.size()));
+}
+
+void write_frame(std::ofstream* file, const EncodedFrame& frame, bool local_palette) {
+  const Palette& palette = *frame.palette;
+  // Graphic control: keep the previous frame under this one (disposal 1).
+  const char control[4] = {0x21, static_cast<char>(0xf9), 4,
+                           static_cast<char>((1 << 2) | (frame.transparent ? 1 : 0))};
+  file->write(control, 4);
+  put_u16(file, frame.delay_cs);
+  const char control_end[2] = {static_cast<char>(palette.transparent_index()), 0};
+  file->write(control_end, 2);
+
+  file->put(0x2c);
+  put_u16(file, frame.left);
+  put_u16(file, frame.top);
+  put_u16(file, frame.width);
+  put_u16(file, frame.height);
+  file->put(local_palette ? static_cast<char>(0x80 | (palette.table_bits - 1)) : 0);
+  if (local_palette) {
+    write_color_table(file, palette);
+  }
+  file->put(static_cast<char>(std::max(2, palette.table_bits)));
+  for (size_t offset = 0; offset < frame.lzw.size(); offset += 255) {
+    const size_t length = std::min<size_t>(255, frame.lzw.size() - offset);
+    file->put(static_cast<char>(length));
+    file->write(reinterpret_cast<const char*>(frame.lzw.data() + offset),
+                static_cast<std::streamsize>(length));
+  }
+  file->put(0);
+}
+
+void run(WorkerPool* pool, int count, const std::function<void(int, int)>& body) {
+  if (pool != nullptr) {
+    pool->parallel_for(count, 1, body);
+  } else {
+    body(0, count);
+  }
+}
+
+}
+
+bool parse_gif_palette(const char* name, GifPalette* palette) {
+  if (strcmp(name, "global") == 0) {
+    *palette = GifPalette::kGlobal;
+  } else if (strcmp(name, "perFrame") == 0) {
+    *palette = GifPalette::kPerFrame;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+bool write_gif_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    const GifOptions& options,
+                    WorkerPool* pool,
+                    std::string* error_message,
+                    const WriteProgress& progress) {
+  if (frames.empty()) {
+    if (error_message != nullptr) {
+      *error_message = "No frames were captured.";
+    }
+    return false;
+  }
+  const FrameData& first = *frames.front();
+  if (first.width <= 0 || first.height <= 0 || first.width > 65535 || first.height > 65535) {
+    if (error_message != nullptr) {
+      *error_message = "Invalid frame size.";
+    }
+    return false;
+  }
+  fps = std::max(1, fps);
+  const int max_colors = std::min(255, std::max(2, options.max_colors));
+
+  // Frames that start at least kMinDelayCs after the previously kept one,
+  // with how long each stays on screen.
+  std::vector<const FrameData*> selected;
+  std::vector<int> delays;
+  int64_t last_cs = 0;
+  int64_t index = 0;
+  for (const FramePtr& frame : frames) {
+    if (frame->width != first.width || frame->height != first.height ||
+        frame->format != first.format) {
+      continue;
+    }
+    const int64_t start_cs = (index * 100 + fps / 2) / fps;
+    ++index;
+    if (!selected.empty() && start_cs - last_cs < kMinDelayCs) {
+      continue;
+    }
+    if (!selected.empty()) {
+      delays.back() = static_cast<int>(start_cs - last_cs);
+    }
+    selected.push_back(frame.get());
+    delays.push_back(0);
+    last_cs = start_cs;
+  }
+  delays.back() = static_cast<int>(
+      std::max<int64_t>(kMinDelayCs, (index * 100 + fps / 2) / fps - last_cs));
+
+  std::unique_ptr<Palette> global_palette;
+  std::unique_ptr<ColorMap> global_map;
+  if (options.palette == GifPalette::kGlobal) {
+    // Up to 32 evenly spaced frames feed one histogram.
+    const int samples = static_cast<int>(std::min<size_t>(32, selected.size()));
+    Histogram histogram;
+    std::mutex histogram_mutex;
+    run(pool, samples, [&](int begin, int end) {
+      Histogram local;
+      for (int i = begin; i < end; ++i) {
+        local.add(*selected[static_cast<size_t>(i) * selected.size() / static_cast<size_t>(samples)],
+                  2);
+      }
+      std::lock_guard<std::mutex> lock(histogram_mutex);
+      histogram.merge(local);
+    });
+    global_palette = std::make_unique<Palette>();
+    median_cut(histogram, max_colors, global_palette.get());
+    global_map = std::make_unique<ColorMap>(global_palette.get());
+    run(pool, kBuckets / 1024, [&](int begin, int end) {
+      global_map->fill(begin * 1024, end * 1024);
+    });
+  }
+
+  std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    if (error_message != nullptr) {
+      *error_message = "Failed to open output file.";
+    }
+    return false;
+  }
+  file.write("GIF89a", 6);
+  put_u16(&file, first.width);
+  put_u16(&file, first.height);
+  if (global_palette != nullptr) {
+    file.put(static_cast<char>(0xf0 | (global_palette->table_bits - 1)));
+  } else {
+    file.put(0x70);
+  }
+  file.put(0);
+  file.put(0);
+  if (global_palette != nullptr) {
+    write_color_table(&file, *global_palette);
+  }
+  // Loop forever.
+  file.write("\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+
+  const size_t pixel_count = static_cast<size_t>(first.width) * static_cast<size_t>(first.height);
+  const int workers = pool != nullptr ? pool->thread_count() + 1 : 1;
+  const size_t batch_size = static_cast<size_t>(workers) * 2U;
+  std::vector<EncodedFrame> batch(batch_size);
+  std::vector<std::unique_ptr<Palette>> palettes(batch_size);
+  // Colours currently on screen, as 0xRRGGBB.
+  std::vector<uint32_t> canvas(pixel_count);
+  // The last frame is held back until later unchanged frames have added
+  // their time to its delay.
+  EncodedFrame pending;
+  std::unique_ptr<Palette> pending_palette;
+  bool has_pending = false;
+  size_t frames_written = 0;
+
+  auto write_pending = [&]() {
+    write_frame(&file, pending, global_palette == nullptr);
+    ++frames_written;
+    if (!file.good()) {
+      if (error_message != nullptr) {
+        *error_message = "Failed to write frame.";
+      }
+      return false;
+    }
+    if (progress && !progress(frames_written, static_cast<uint64_t>(file.tellp()))) {
+      if (error_message != nullptr) {
+        *error_message = "Write was cancelled.";
+      }
+      return false;
+    }
+    return true;
+  };
+
+  for (size_t start = 0; start < selected.size(); start += batch_size) {
+    const int count = static_cast<int>(std::min(batch_size, selected.size() - start));
+
+    run(pool, count, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        const FrameData& frame = *selected[start + static_cast<size_t>(i)];
+        EncodedFrame& encoded = batch[static_cast<size_t>(i)];
+        if (global_palette != nullptr) {
+          encoded.palette = global_palette.get();
+          map_frame(frame, global_map.get(), &encoded.indices);
+        } else {
+          Histogram histogram;
+          histogram.add(frame, pixel_count > (1U << 18) ? 2 : 1);
+          palettes[static_cast<size_t>(i)] = std::make_unique<Palette>();
+          median_cut(histogram, max_colors, palettes[static_cast<size_t>(i)].get());
+          encoded.palette = palettes[static_cast<size_t>(i)].get();
+          ColorMap map(encoded.palette);
+          map_frame(frame, &map, &encoded.indices);
+        }
+      }
+    });
+
+    // Diffing depends on the previous frame, so it runs in order. Unchanged
+    // pixels become transparent and the frame shrinks to the changed box.
+    std::vector<int> kept;
+    EncodedFrame* last_kept = has_pending ? &pending : nullptr;
+    for (int i = 0; i < count; ++i) {
+      EncodedFrame& encoded = batch[static_cast<size_t>(i)];
+      const Palette& palette = *encoded.palette;
+      const int delay_cs = delays[start + static_cast<size_t>(i)];
+      const bool first_frame = start == 0 && i == 0;
+      const uint8_t* indices = encoded.indices.data();
+      int min_x = first.width;
+      int min_y = first.height;
+      int max_x = -1;
+      int max_y = -1;
+      for (int y = 0; y < first.height; ++y) {
+        const size_t row = static_cast<size_t>(y) * static_cast<size_t>(first.width);
+        for (int x = 0; x < first.width; ++x) {
+          const uint8_t* rgb = palette.rgb[indices[row + static_cast<size_t>(x)]];
+          const uint32_t color = (static_cast<uint32_t>(rgb[0]) << 16) |
+                                 (static_cast<uint32_t>(rgb[1]) << 8) | rgb[2];
+          if (first_frame || canvas[row + static_cast<size_t>(x)] != color) {
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+          }
+        }
+      }
+      if (max_x < 0) {
+        last_kept->delay_cs += delay_cs;
+        continue;
+      }
+
+      encoded.delay_cs = delay_cs;
+      encoded.left = min_x;
+      encoded.top = min_y;
+      encoded.width = max_x - min_x + 1;
+      encoded.height = max_y - min_y + 1;
+      encoded.transparent = !first_frame;
+      const uint8_t transparent = static_cast<uint8_t>(palette.transparent_index());
+      std::vector<uint8_t> cropped(static_cast<size_t>(encoded.width) *
+                                   static_cast<size_t>(encoded.height));
+      uint8_t* out = cropped.data();
+      for (int y = min_y; y <= max_y; ++y) {
+        const size_t row = static_cast<size_t>(y) * static_cast<size_t>(first.width);
+        for (int x = min_x; x <= max_x; ++x) {
+          const uint8_t value = indices[row + static_cast<size_t>(x)];
+          const uint8_t* rgb = palette.rgb[value];
+          const uint32_t color = (static_cast<uint32_t>(rgb[0]) << 16) |
+                                 (static_cast<uint32_t>(rgb[1]) << 8) | rgb[2];
+          uint32_t& shown = canvas[row + static_cast<size_t>(x)];
+          if (!first_frame && shown == color) {
+            *out++ = transparent;
+          } else {
+            *out++ = value;
+            shown = color;
+          }
+        }
+      }
+      encoded.indices.swap(cropped);
+      kept.push_back(i);
+      last_kept = &encoded;
+    }
+
+    run(pool, static_cast<int>(kept.size()), [&](int begin, int end) {
+      for (int k = begin; k < end; ++k) {
+        EncodedFrame& encoded = batch[static_cast<size_t>(kept[static_cast<size_t>(k)])];
+        lzw_encode(encoded.indices.data(), encoded.indices.size(),
+                   std::max(2, encoded.palette->table_bits), &encoded.lzw);
+      }
+    });
+
+    for (int i : kept) {
+      if (has_pending && !write_pending()) {
+        return false;
+      }
+      std::swap(pending, batch[static_cast<size_t>(i)]);
+      std::swap(pending_palette, palettes[static_cast<size_t>(i)]);
+      has_pending = true;
+    }
+  }
+  if (has_pending && !write_pending()) {
+    return false;
+  }
+
+  file.put(0x3b);
+  file.close();
+  if (file.fail()) {
+    if (error_message != nullptr) {
+      *error_message = "Failed to finalize GIF output.";
+    }
+    return false;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef RECASTER_GIF_WRITER_H_
+#define RECASTER_GIF_WRITER_H_
+
+#include <string>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+enum class GifPalette {
+  // One median-cut palette sampled across the clip; smallest files.
+  kGlobal,
+  // A palette per frame; better colour when scenes change.
+  kPerFrame,
+};
+
+bool parse_gif_palette(const char* name, GifPalette* palette);
+
+struct GifOptions {
+  GifPalette palette = GifPalette::kGlobal;
+  // Colours per palette, 2..255; one more index is kept for transparency.
+  int max_colors = 255;
+};
+
+// Writes a looping animated GIF. Frames are quantised and LZW-compressed in
+// parallel batches; pixels that match the previous displayed frame become
+// transparent and each frame is cropped to its changed area, so static UI
+// costs almost nothing. GIF delays are whole centiseconds and viewers clamp
+// very short ones, so frames closer than 20 ms to the previous one are
+// dropped. Frames whose size or format differ from the first are skipped.
+bool write_gif_file(const char* output_path,
+                    const std::vector<FramePtr>& frames,
+                    int fps,
+                    const GifOptions& options,
+                    WorkerPool* pool,
+                    std::string* error_message,
+                    const WriteProgress& progress = nullptr);
+
+}
+
+#endif
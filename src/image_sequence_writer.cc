@@ -0,0 +1,514 @@
+#include "image_sequence_writer.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(RECASTER_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+#include "json_util.h"
+#include "worker_pool.h"
+
+namespace recaster {
+
+namespace {
+
+// Frames fetched per worker thread in each batch.
+constexpr size_t kFramesPerThread = 2;
+
+void set_error(std::string* error_message, const char* message) {
+  if (error_message != nullptr) {
+    *error_message = message;
+  }
+}
+
+void put_u32_be(std::vector<uint8_t>* out, uint32_t value) {
+  out->push_back(static_cast<uint8_t>(value >> 24));
+  out->push_back(static_cast<uint8_t>(value >> 16));
+  out->push_back(static_cast<uint8_t>(value >> 8));
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t png_crc(const uint8_t* data, size_t size, uint32_t crc) {
+#if defined(RECASTER_HAVE_ZLIB)
+  return static_cast<uint32_t>(crc32(crc, data, static_cast<uInt>(size)));
+#else
+  static const struct Table {
+    uint32_t values[256];
+    Table() {
+      for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+          c = (c & 1U) != 0 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        }
+        values[n] = c;
+      }
+    }
+  } table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table.values[(crc ^ data[i]) & 0xFFU] ^ (crc >> 8);
+  }
+  return ~crc;
+#endif
+}
+
+void put_png_chunk(std::vector<uint8_t>* out, const char* type, const uint8_t* data,
+                   size_t size) {
+  put_u32_be(out, static_cast<uint32_t>(size));
+  const size_t start = out->size();
+  out->insert(out->end(), type, type + 4);
+  if (size > 0) {
+    out->insert(out->end(), data, data + size);
+  }
+  put_u32_be(out, png_crc(out->data() + start, size + 4, 0));
+}
+
+// A zlib stream of the filtered rows.
+bool deflate_rows(const std::vector<uint8_t>& rows, int level, std::vector<uint8_t>* out) {
+#if defined(RECASTER_HAVE_ZLIB)
+  uLongf size = compressBound(static_cast<uLong>(rows.size()));
+  out->resize(size);
+  if (compress2(out->data(), &size, rows.data(), static_cast<uLong>(rows.size()),
+                std::min(9, std::max(1, level))) != Z_OK) {
+    return false;
+  }
+  out->resize(size);
+  return true;
+#else
+  (void)level;
+  // Stored blocks keep the file valid without a compressor.
+  constexpr size_t kMaxStoredBlock = 65535;
+  out->clear();
+  out->reserve(rows.size() + rows.size() / kMaxStoredBlock * 5 + 11);
+  out->push_back(0x78);
+  out->push_back(0x01);
+  size_t offset = 0;
+  do {
+    const size_t size = std::min(kMaxStoredBlock, rows.size() - offset);
+    const bool last = offset + size == rows.size();
+    out->push_back(last ? 1 : 0);
+    out->push_back(static_cast<uint8_t>(size));
+    out->push_back(static_cast<uint8_t>(size >> 8));
+    out->push_back(static_cast<uint8_t>(~size));
+    out->push_back(static_cast<uint8_t>(~size >> 8));
+    out->insert(out->end(), rows.begin() + static_cast<std::ptrdiff_t>(offset),
+                rows.begin() + static_cast<std::ptrdiff_t>(offset + size));
+    offset += size;
+  } while (offset < rows.size());
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (uint8_t value : rows) {
+    a = (a + value) % 65521U;
+    b = (b + a) % 65521U;
+  }
+  put_u32_be(out, (b << 16) | a);
+  return true;
+#endif
+}
+
+bool valid_frame(const FrameData& frame) {
+  return frame.width > 0 && frame.height > 0 &&
+         frame.pixels.size() >= frame_byte_size(frame.width, frame.height, frame.format);
+}
+
+std::string output_stem(const std::string& output_path, std::string* extension) {
+  const size_t separator = output_path.find_last_of("/\\");
+  size_t dot = output_path.rfind('.');
+  if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+    dot = output_path.size();
+  }
+  if (extension != nullptr) {
+    *extension = output_path.substr(dot);
+  }
+  return output_path.substr(0, dot);
+}
+
+std::string file_name(const std::string& path) {
+  const size_t separator = path.find_last_of("/\\");
+  return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+std::string directory_of(const std::string& path) {
+  const size_t separator = path.find_last_of("/\\");
+  return separator == std::string::npos ? std::string(".") : path.substr(0, separator + 1);
+}
+
+// Writes `data` to a new file and leaves it open in `*fd` for sync_and_close().
+// On Linux the kernel starts writing it back straight away, so the later sync
+// mostly finds the work done.
+bool write_file(const std::string& path, const std::vector<uint8_t>& data, int* fd) {
+#if defined(_WIN32)
+  *fd = -1;
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(data.data()),
+             static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(file);
+#else
+  *fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (*fd < 0) {
+    return false;
+  }
+  size_t offset = 0;
+  while (offset < data.size()) {
+    const ssize_t written = ::write(*fd, data.data() + offset, data.size() - offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      ::close(*fd);
+      *fd = -1;
+      return false;
+    }
+    offset += static_cast<size_t>(written);
+  }
+#if defined(__linux__)
+  sync_file_range(*fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+  return true;
+#endif
+}
+
+// Waits for a file from write_file() to reach the disk and closes it. The
+// directory entry is synced separately.
+bool sync_and_close(int fd) {
+#if defined(_WIN32)
+  (void)fd;
+  return true;
+#else
+  if (fd < 0) {
+    return true;
+  }
+#if defined(__linux__)
+  const bool synced = fdatasync(fd) == 0;
+#else
+  const bool synced = fsync(fd) == 0;
+#endif
+  return ::close(fd) == 0 && synced;
+#endif
+}
+
+void sync_directory(const std::string& directory) {
+#if !defined(_WIN32)
+  const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) {
+    fsync(fd);
+    ::close(fd);
+  }
+#endif
+}
+
+void run(WorkerPool* pool, int count, const std::function<void(int, int)>& body) {
+  if (pool != nullptr) {
+    pool->parallel_for(count, 1, body);
+  } else if (count > 0) {
+    body(0, count);
+  }
+}
+
+}
+
+bool image_format_for_path(const std::string& output_path, ImageFormat* format) {
+  std::string extension;
+  output_stem(output_path, &extension);
+  if (extension == ".png") {
+    *format = ImageFormat::kPng;
+  } else if (extension == ".qoi") {
+    *format = ImageFormat::kQoi;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool encode_png(const FrameData& frame, int level, std::vector<uint8_t>* out) {
+  if (!valid_frame(frame)) {
+    return false;
+  }
+  const size_t width = static_cast<size_t>(frame.width);
+  const size_t height = static_cast<size_t>(frame.height);
+  const size_t channels = frame.format == PixelFormat::kBgr24 ? 3 : 4;
+  const size_t src_stride = frame_row_bytes(frame.width, frame.format);
+  const size_t row_size = width * 3;
+
+  // Each row takes whichever of the Sub and Up filters leaves the smaller
+  // residuals, as libpng's heuristic does; flat UI mostly becomes zeros.
+  std::vector<uint8_t> rows(height * (row_size + 1));
+  std::vector<uint8_t> previous(row_size, 0);
+  std::vector<uint8_t> current(row_size);
+  std::vector<uint8_t> sub(row_size);
+  std::vector<uint8_t> up(row_size);
+  for (size_t y = 0; y < height; ++y) {
+    const uint8_t* src = frame.pixels.data() + y * src_stride;
+    for (size_t x = 0; x < width; ++x) {
+      current[x * 3] = src[x * channels + 2];
+      current[x * 3 + 1] = src[x * channels + 1];
+      current[x * 3 + 2] = src[x * channels];
+    }
+    uint32_t sub_cost = 0;
+    uint32_t up_cost = 0;
+    for (size_t i = 0; i < row_size; ++i) {
+      sub[i] = static_cast<uint8_t>(current[i] - (i >= 3 ? current[i - 3] : 0));
+      up[i] = static_cast<uint8_t>(current[i] - previous[i]);
+      sub_cost += static_cast<uint32_t>(std::abs(static_cast<int8_t>(sub[i])));
+      up_cost += static_cast<uint32_t>(std::abs(static_cast<int8_t>(up[i])));
+    }
+    uint8_t* row = rows.data() + y * (row_size + 1);
+    const bool use_up = y > 0 && up_cost < sub_cost;
+    row[0] = use_up ? 2 : 1;
+    memcpy(row + 1, use_up ? up.data() : sub.data(), row_size);
+    previous.swap(current);
+  }
+
+  std::vector<uint8_t> compressed;
+  if (!deflate_rows(rows, level, &compressed)) {
+    return false;
+  }
+  static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  out->clear();
+  out->reserve(compressed.size() + 64);
+  out->insert(out->end(), kSignature, kSignature + 8);
+  std::vector<uint8_t> header;
+  put_u32_be(&header, static_cast<uint32_t>(width));
+  put_u32_be(&header, static_cast<uint32_t>(height));
+  // 8-bit truecolour, deflate, adaptive filtering, no interlace.
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+  put_png_chunk(out, "IHDR", header.data(), header.size());
+  put_png_chunk(out, "IDAT", compressed.data(), compressed.size());
+  put_png_chunk(out, "IEND", nullptr, 0);
+  return true;
+}
+
+bool encode_qoi(const FrameData& frame, std::vector<uint8_t>* out) {
+  if (!valid_frame(frame)) {
+    return false;
+  }
+  const size_t width = static_cast<size_t>(frame.width);
+  const size_t height = static_cast<size_t>(frame.height);
+  const size_t channels = frame.format == PixelFormat::kBgr24 ? 3 : 4;
+  const size_t src_stride = frame_row_bytes(frame.width, frame.format);
+
+  // Sized for the worst case of four bytes per pixel, then trimmed. A reused
+  // buffer is not cleared first, so it is not zero-filled again.
+  std::vector<uint8_t> header;
+  put_u32_be(&header, 0x716F6966U);  // "qoif"
+  put_u32_be(&header, static_cast<uint32_t>(width));
+  put_u32_be(&header, static_cast<uint32_t>(height));
+  header.push_back(3);  // RGB
+  header.push_back(0);  // sRGB
+  out->resize(header.size() + width * height * 4 + 8);
+  memcpy(out->data(), header.data(), header.size());
+  uint8_t* dst = out->data() + header.size();
+
+  // Alpha is always 255, so QOI_OP_RGBA is never needed and the hash's alpha
+  // term is a constant.
+  uint32_t index[64] = {};
+  uint8_t pr = 0;
+  uint8_t pg = 0;
+  uint8_t pb = 0;
+  int run = 0;
+  const size_t last = width * height - 1;
+  for (size_t y = 0; y < height; ++y) {
+    const uint8_t* src = frame.pixels.data() + y * src_stride;
+    for (size_t x = 0; x < width; ++x, src += channels) {
+      const uint8_t r = src[2];
+      const uint8_t g = src[1];
+      const uint8_t b = src[0];
+      if (r == pr && g == pg && b == pb) {
+        ++run;
+        if (run == 62 || y * width + x == last) {
+          *dst++ = static_cast<uint8_t>(0xC0 | (run - 1));
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0) {
+        *dst++ = static_cast<uint8_t>(0xC0 | (run - 1));
+        run = 0;
+      }
+      const uint32_t pixel = (static_cast<uint32_t>(r) << 24) |
+                             (static_cast<uint32_t>(g) << 16) |
+                             (static_cast<uint32_t>(b) << 8) | 0xFFU;
+      const int slot = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+      if (index[slot] == pixel) {
+        *dst++ = static_cast<uint8_t>(slot);
+      } else {
+        index[slot] = pixel;
+        const int dr = static_cast<int8_t>(r - pr);
+        const int dg = static_cast<int8_t>(g - pg);
+        const int db = static_cast<int8_t>(b - pb);
+        const int dr_dg = dr - dg;
+        const int db_dg = db - dg;
+        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+          *dst++ = static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+        } else if (dr_dg >= -8 && dr_dg <= 7 && dg >= -32 && dg <= 31 && db_dg >= -8 &&
+                   db_dg <= 7) {
+          *dst++ = static_cast<uint8_t>(0x80 | (dg + 32));
+          *dst++ = static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8));
+        } else {
+          dst[0] = 0xFE;
+          dst[1] = r;
+          dst[2] = g;
+          dst[3] = b;
+          dst += 4;
+        }
+      }
+      pr = r;
+      pg = g;
+      pb = b;
+    }
+  }
+  static const uint8_t kEnd[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  memcpy(dst, kEnd, sizeof(kEnd));
+  out->resize(static_cast<size_t>(dst + sizeof(kEnd) - out->data()));
+  return true;
+}
+
+std::string image_sequence_frame_path(const std::string& output_path, size_t index) {
+  std::string extension;
+  const std::string stem = output_stem(output_path, &extension);
+  char number[24];
+  snprintf(number, sizeof(number), "_%06zu", index);
+  return stem + number + extension;
+}
+
+std::string image_sequence_manifest_path(const std::string& output_path) {
+  return output_stem(output_path, nullptr) + ".json";
+}
+
+bool write_image_sequence(const char* output_path,
+                          size_t frame_count,
+                          const FrameSource& frames,
+                          int fps,
+                          const ImageSequenceOptions& options,
+                          WorkerPool* pool,
+                          std::string* error_message,
+                          const WriteProgress& progress) {
+  if (frame_count == 0) {
+    set_error(error_message, "No frames were captured.");
+    return false;
+  }
+  fps = std::max(1, fps);
+  const std::string path = output_path;
+  const std::string directory = directory_of(path);
+  const bool png = options.format == ImageFormat::kPng;
+
+  struct Job {
+    FramePtr frame;
+    size_t file_index;
+    int fd = -1;
+  };
+  FramePtr first;
+  FramePtr previous;
+  size_t file_count = 0;
+  std::string entries;
+  const size_t threads = pool != nullptr ? static_cast<size_t>(pool->thread_count()) + 1 : 1;
+  const size_t batch_size = threads * kFramesPerThread;
+  std::atomic<uint64_t> bytes_written{0};
+  std::atomic<bool> failed{false};
+  bool ok = true;
+  for (size_t batch = 0; ok && batch < frame_count; batch += batch_size) {
+    // Frame sources decode on this thread; only encoding fans out.
+    std::vector<Job> jobs;
+    const size_t batch_end = std::min(frame_count, batch + batch_size);
+    for (size_t i = batch; i < batch_end; ++i) {
+      FramePtr frame = frames(i);
+      if (frame == nullptr || !valid_frame(*frame)) {
+        continue;
+      }
+      if (first == nullptr) {
+        first = frame;
+      } else if (frame->width != first->width || frame->height != first->height ||
+                 frame->format != first->format) {
+        continue;
+      }
+      if (frame != previous) {
+        jobs.push_back({frame, file_count++, -1});
+        previous = frame;
+      }
+      char entry[160];
+      snprintf(entry, sizeof(entry), "%s\n    {\"file\": \"", entries.empty() ? "" : ",");
+      entries += entry;
+      entries += json_escape(file_name(image_sequence_frame_path(path, file_count - 1)));
+      snprintf(entry, sizeof(entry), "\", \"timeUs\": %lld, \"capturedUs\": %lld}",
+               static_cast<long long>(static_cast<int64_t>(i) * 1000000 / fps),
+               static_cast<long long>(frame->timestamp_us));
+      entries += entry;
+    }
+
+    run(pool, static_cast<int>(jobs.size()), [&](int begin, int end) {
+      std::vector<uint8_t> encoded;
+      for (int i = begin; i < end && !failed.load(); ++i) {
+        Job& job = jobs[static_cast<size_t>(i)];
+        const bool encoded_ok = png ? encode_png(*job.frame, options.png_level, &encoded)
+                                    : encode_qoi(*job.frame, &encoded);
+        if (!encoded_ok ||
+            !write_file(image_sequence_frame_path(path, job.file_index), encoded, &job.fd)) {
+          failed = true;
+          continue;
+        }
+        bytes_written += encoded.size();
+      }
+    });
+    // One sync per file once the whole batch is written, then one for the
+    // directory, instead of stalling every encode on its own sync.
+    run(pool, static_cast<int>(jobs.size()), [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        if (!sync_and_close(jobs[static_cast<size_t>(i)].fd)) {
+          failed = true;
+        }
+      }
+    });
+    sync_directory(directory);
+    if (failed.load()) {
+      set_error(error_message, "Failed to write frame.");
+      ok = false;
+    } else if (progress && !progress(batch_end, bytes_written.load())) {
+      set_error(error_message, "Write was cancelled.");
+      ok = false;
+    }
+  }
+  if (ok && first == nullptr) {
+    set_error(error_message, "No frames were captured.");
+    ok = false;
+  }
+
+  const std::string manifest_path = image_sequence_manifest_path(path);
+  if (ok) {
+    char header[192];
+    snprintf(header, sizeof(header),
+             "{\n  \"format\": \"%s\",\n  \"fps\": %d,\n  \"width\": %d,\n"
+             "  \"height\": %d,\n  \"frames\": [",
+             png ? "png" : "qoi", fps, first->width, first->height);
+    const std::string manifest = header + entries + "\n  ]\n}\n";
+    int fd = -1;
+    if (!write_file(manifest_path, std::vector<uint8_t>(manifest.begin(), manifest.end()),
+                    &fd) ||
+        !sync_and_close(fd)) {
+      set_error(error_message, "Failed to write the frame manifest.");
+      ok = false;
+    }
+    sync_directory(directory);
+  }
+  if (!ok) {
+    for (size_t i = 0; i < file_count; ++i) {
+      std::remove(image_sequence_frame_path(path, i).c_str());
+    }
+    std::remove(manifest_path.c_str());
+  }
+  return ok;
+}
+
+}
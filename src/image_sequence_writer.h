@@ -0,0 +1,56 @@
+#ifndef RECASTER_IMAGE_SEQUENCE_WRITER_H_
+#define RECASTER_IMAGE_SEQUENCE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+enum class ImageFormat {
+  kPng,
+  kQoi,
+};
+
+// Picks the format from a `.png` or `.qoi` output path.
+bool image_format_for_path(const std::string& output_path, ImageFormat* format);
+
+struct ImageSequenceOptions {
+  ImageFormat format = ImageFormat::kPng;
+  // zlib level for PNG, 1..9. Without zlib, PNGs are stored uncompressed.
+  int png_level = 1;
+};
+
+// Opaque RGB images; alpha is dropped. Return false for invalid frames.
+bool encode_png(const FrameData& frame, int level, std::vector<uint8_t>* out);
+bool encode_qoi(const FrameData& frame, std::vector<uint8_t>* out);
+
+// `/out/run.png` numbers its frames `/out/run_000000.png`, ... and lists them
+// in `/out/run.json`.
+std::string image_sequence_frame_path(const std::string& output_path, size_t index);
+std::string image_sequence_manifest_path(const std::string& output_path);
+
+// Writes one image file per frame and a JSON manifest with each frame's file,
+// output time and capture timestamp. Frames are fetched in batches of a few
+// per worker, so at most one batch is held in memory, and encoded and written
+// in parallel; a repeated frame points at the file already written for it.
+// A batch's files are synced once all of them are written, followed by one
+// directory sync. Frames whose size or format differ from the first are skipped. On
+// failure or cancellation the files written so far are removed.
+bool write_image_sequence(const char* output_path,
+                          size_t frame_count,
+                          const FrameSource& frames,
+                          int fps,
+                          const ImageSequenceOptions& options,
+                          WorkerPool* pool,
+                          std::string* error_message,
+                          const WriteProgress& progress = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef RECASTER_JSON_UTIL_H_
+#define RECASTER_JSON_UTIL_H_
+
+#include <string>
+
+namespace recaster {
+
+// Escapes `value` for use between the quotes of a JSON string, e.g. a file
+// name in one of the manifests written next to a recording.
+std::string json_escape(const std::string& value);
+
+}
+
+#endif
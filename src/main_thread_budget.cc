@@ -0,0 +1,57 @@
+#include "main_thread_budget.h"
+
+#include <algorithm>
+
+namespace recaster {
+
+namespace {
+
+constexpr double kCostSmoothing = 0.25;
+
+}
+
+MainThreadBudget::MainThreadBudget(double fraction, int64_t window_us)
+    : fraction_(std::min(1.0, std::max(0.0, fraction))),
+      window_us_(std::max<int64_t>(1, window_us)),
+      budget_us_(static_cast<int64_t>(fraction_ * static_cast<double>(window_us_))) {}
+
+void MainThreadBudget::expire(int64_t now_us) {
+  while (!ticks_.empty() && ticks_.front().start_us + window_us_ <= now_us) {
+    spent_us_ -= ticks_.front().cost_us;
+    ticks_.pop_front();
+  }
+}
+
+bool MainThreadBudget::admit(int64_t now_us) {
+  if (!enabled()) {
+    return true;
+  }
+  expire(now_us);
+  if (last_admitted_us_ < 0 || last_admitted_us_ + window_us_ <= now_us ||
+      static_cast<double>(spent_us_) + estimate_us_ <= static_cast<double>(budget_us_)) {
+    return true;
+  }
+  ++ticks_shed_;
+  return false;
+}
+
+void MainThreadBudget::record(int64_t start_us, int64_t cost_us, bool shed) {
+  cost_us = std::max<int64_t>(0, cost_us);
+  max_tick_us_ = std::max(max_tick_us_, cost_us);
+  if (!shed) {
+    estimate_us_ = estimate_us_ == 0.0 ? static_cast<double>(cost_us)
+                                       : estimate_us_ + kCostSmoothing *
+                                             (static_cast<double>(cost_us) - estimate_us_);
+    last_admitted_us_ = start_us;
+  }
+  expire(start_us);
+  ticks_.push_back({start_us, cost_us});
+  spent_us_ += cost_us;
+  high_water_ = std::max(high_water_, spent_fraction());
+}
+
+double MainThreadBudget::spent_fraction() const {
+  return static_cast<double>(spent_us_) / static_cast<double>(window_us_);
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef RECASTER_MAIN_THREAD_BUDGET_H_
+#define RECASTER_MAIN_THREAD_BUDGET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace recaster {
+
+// Caps the share of the UI thread that capture ticks may take over a sliding
+// window. Ticks report what they cost; admit() says whether the next one may
+// do its work or should be shed (repeat the previous frame, which costs next
+// to nothing). Costs are predicted from recent admitted ticks, so a window
+// stays within `fraction`, give or take what the shed ticks cost, unless a
+// single tick alone exceeds it: one tick per window is always admitted, so
+// the recording never freezes.
+class MainThreadBudget {
+ public:
+  // `fraction` of each `window_us` may be spent in ticks; 0 disables the cap.
+  explicit MainThreadBudget(double fraction, int64_t window_us = 1000000);
+
+  bool enabled() const { return budget_us_ > 0; }
+  bool admit(int64_t now_us);
+  // Pass `shed` for every tick that did not do the admitted work, whether it
+  // was shed, skipped or had nothing to capture: only real captures feed the
+  // cost prediction and count as the window's admitted tick.
+  void record(int64_t start_us, int64_t cost_us, bool shed);
+
+  double fraction() const { return fraction_; }
+  // Share of the window ending at the last recorded tick spent in ticks.
+  double spent_fraction() const;
+  // Highest spent_fraction() seen.
+  double high_water() const { return high_water_; }
+  int64_t max_tick_us() const { return max_tick_us_; }
+  uint64_t ticks_shed() const { return ticks_shed_; }
+
+ private:
+  struct Tick {
+    int64_t start_us;
+    int64_t cost_us;
+  };
+
+  void expire(int64_t now_us);
+
+  const double fraction_;
+  const int64_t window_us_;
+  const int64_t budget_us_;
+  std::deque<Tick> ticks_;
+  int64_t spent_us_ = 0;
+  double estimate_us_ = 0.0;
+  int64_t last_admitted_us_ = -1;
+  double high_water_ = 0.0;
+  int64_t max_tick_us_ = 0;
+  uint64_t ticks_shed_ = 0;
+};
+
+}
+
+#endif
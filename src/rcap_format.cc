@@ -0,0 +1,369 @@
+#include "rcap_format.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+#include "worker_pool.h"
+
+namespace recaster {
+
+namespace {
+
+constexpr char kRcapMagic[4] = {'R', 'C', 'A', 'P'};
+constexpr char kRcapTrailerMagic[4] = {'R', 'C', 'P', 'X'};
+
+template <typename T>
+void put(uint8_t* dst, size_t offset, T value) {
+  std::memcpy(dst + offset, &value, sizeof(value));
+}
+
+template <typename T>
+T get(const uint8_t* src, size_t offset) {
+  T value;
+  std::memcpy(&value, src + offset, sizeof(value));
+  return value;
+}
+
+void encode_header(const RcapHeader& header, uint8_t* dst) {
+  std::memset(dst, 0, kRcapHeaderSize);
+  std::memcpy(dst, kRcapMagic, 4);
+  put<uint16_t>(dst, 4, static_cast<uint16_t>(kRcapVersion));
+  put<uint16_t>(dst, 6, static_cast<uint16_t>(kRcapHeaderSize));
+  put<uint32_t>(dst, 8, header.width);
+  put<uint32_t>(dst, 12, header.height);
+  put<uint32_t>(dst, 16, header.fps);
+  put<uint32_t>(dst, 20, static_cast<uint32_t>(header.format));
+  put<uint32_t>(dst, 24, static_cast<uint32_t>(header.codec));
+  put<int32_t>(dst, 28, header.level);
+  put<uint64_t>(dst, 32, header.dictionary_offset);
+  put<uint32_t>(dst, 40, header.dictionary_size);
+}
+
+void set_error(std::string* error_message, const char* message) {
+  if (error_message != nullptr) {
+    *error_message = message;
+  }
+}
+
+}
+
+bool write_rcap_file(const char* output_path,
+                     const std::vector<FramePtr>& frames,
+                     int fps,
+                     const RcapOptions& options,
+                     WorkerPool* pool,
+                     std::string* error_message,
+                     const WriteProgress& progress) {
+  if (output_path == nullptr || strlen(output_path) == 0) {
+    set_error(error_message, "outputPath is required.");
+    return false;
+  }
+  if (frames.empty()) {
+    set_error(error_message, "No frames were captured.");
+    return false;
+  }
+  if (!frame_codec_available(options.codec)) {
+    set_error(error_message, "Requested codec is not available in this build.");
+    return false;
+  }
+
+  const FrameData& first = *frames.front();
+  std::vector<const FrameData*> accepted;
+  accepted.reserve(frames.size());
+  for (const FramePtr& frame : frames) {
+    if (frame->width == first.width && frame->height == first.height &&
+        frame->format == first.format) {
+      accepted.push_back(frame.get());
+    }
+  }
+
+  const std::vector<uint8_t> dictionary =
+      train_frame_dictionary(options.codec, frames, options.dictionary_capacity);
+
+  RcapHeader header;
+  header.width = static_cast<uint32_t>(first.width);
+  header.height = static_cast<uint32_t>(first.height);
+  header.fps = static_cast<uint32_t>(std::max(1, fps));
+  header.format = first.format;
+  header.codec = options.codec;
+  header.level = options.level;
+  header.dictionary_offset = dictionary.empty() ? 0 : kRcapHeaderSize;
+  header.dictionary_size = static_cast<uint32_t>(dictionary.size());
+
+  std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    set_error(error_message, "Failed to open output file.");
+    return false;
+  }
+
+  uint8_t header_bytes[kRcapHeaderSize];
+  encode_header(header, header_bytes);
+  file.write(reinterpret_cast<const char*>(header_bytes), kRcapHeaderSize);
+  file.write(reinterpret_cast<const char*>(dictionary.data()),
+             static_cast<std::streamsize>(dictionary.size()));
+  uint64_t offset = kRcapHeaderSize + dictionary.size();
+
+  const int workers = pool != nullptr ? pool->thread_count() + 1 : 1;
+  std::vector<std::unique_ptr<FrameEncoder>> idle_encoders;
+  for (int i = 0; i < workers; ++i) {
+    idle_encoders.push_back(
+        std::make_unique<FrameEncoder>(options.codec, options.level, dictionary));
+  }
+  std::mutex encoders_mutex;
+
+  const size_t batch_size = static_cast<size_t>(workers) * 4U;
+  std::vector<std::vector<uint8_t>> encoded(batch_size);
+  std::vector<uint8_t> encoded_ok(batch_size);
+  std::vector<RcapIndexEntry> index;
+  index.reserve(accepted.size());
+
+  for (size_t batch = 0; batch < accepted.size(); batch += batch_size) {
+    const size_t count = std::min(batch_size, accepted.size() - batch);
+    auto body = [&](int begin, int end) {
+      std::unique_ptr<FrameEncoder> encoder;
+      {
+        std::lock_guard<std::mutex> lock(encoders_mutex);
+        encoder = std::move(idle_encoders.back());
+        idle_encoders.pop_back();
+      }
+      for (int i = begin; i < end; ++i) {
+        const FrameData& frame = *accepted[batch + static_cast<size_t>(i)];
+        encoded_ok[static_cast<size_t>(i)] = encoder->encode(
+            frame.pixels.data(), frame.pixels.size(), &encoded[static_cast<size_t>(i)]);
+      }
+      std::lock_guard<std::mutex> lock(encoders_mutex);
+      idle_encoders.push_back(std::move(encoder));
+    };
+    if (pool != nullptr) {
+      pool->parallel_for(static_cast<int>(count), 1, body);
+    } else {
+      body(0, static_cast<int>(count));
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      if (!encoded_ok[i]) {
+        set_error(error_message, "Failed to compress frame.");
+        return false;
+      }
+      const FrameData& frame = *accepted[batch + i];
+      RcapIndexEntry entry;
+      entry.offset = offset;
+      entry.compressed_size = static_cast<uint32_t>(encoded[i].size());
+      entry.raw_size = static_cast<uint32_t>(frame.pixels.size());
+      entry.timestamp_us = frame.timestamp_us;
+      index.push_back(entry);
+      file.write(reinterpret_cast<const char*>(encoded[i].data()),
+                 static_cast<std::streamsize>(encoded[i].size()));
+      offset += encoded[i].size();
+    }
+    if (progress && !progress(index.size(), offset)) {
+      set_error(error_message, "Write was cancelled.");
+      return false;
+    }
+  }
+
+  std::vector<uint8_t> index_bytes(index.size() * kRcapIndexEntrySize);
+  for (size_t i = 0; i < index.size(); ++i) {
+    uint8_t* dst = index_bytes.data() + i * kRcapIndexEntrySize;
+    put<uint64_t>(dst, 0, index[i].offset);
+    put<uint32_t>(dst, 8, index[i].compressed_size);
+    put<uint32_t>(dst, 12, index[i].raw_size);
+    put<int64_t>(dst, 16, index[i].timestamp_us);
+  }
+  file.write(reinterpret_cast<const char*>(index_bytes.data()),
+             static_cast<std::streamsize>(index_bytes.size()));
+
+  uint8_t trailer[kRcapTrailerSize] = {};
+  put<uint64_t>(trailer, 0, offset);
+  put<uint32_t>(trailer, 8, static_cast<uint32_t>(index.size()));
+  put<uint32_t>(trailer, 12, static_cast<uint32_t>(kRcapIndexEntrySize));
+  std::memcpy(trailer + 16, kRcapTrailerMagic, 4);
+  put<uint32_t>(trailer, 20, kRcapVersion);
+  file.write(reinterpret_cast<const char*>(trailer), kRcapTrailerSize);
+  file.flush();
+
+  if (!file.good()) {
+    set_error(error_message, "Failed to finalize RCAP output.");
+    return false;
+  }
+  return true;
+}
+
+RcapReader::~RcapReader() {
+  close();
+}
+
+#if defined(_WIN32)
+
+void RcapReader::close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  if (file_ != nullptr) {
+    CloseHandle(file_);
+    file_ = nullptr;
+  }
+  size_ = 0;
+  index_.clear();
+}
+
+bool RcapReader::map_file(const char* path, std::string* error_message) {
+  const int count = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+  std::wstring wide_path(static_cast<size_t>(std::max(count, 1)), L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide_path[0], count);
+  HANDLE file = CreateFileW(wide_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    set_error(error_message, "Failed to open input file.");
+    return false;
+  }
+  file_ = file;
+  LARGE_INTEGER size = {};
+  if (!GetFileSizeEx(file, &size) ||
+      static_cast<uint64_t>(size.QuadPart) < kRcapHeaderSize + kRcapTrailerSize) {
+    set_error(error_message, "Input is too small to be an RCAP file.");
+    return false;
+  }
+  mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    set_error(error_message, "Failed to map input file.");
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    set_error(error_message, "Failed to map input file.");
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+#else
+
+void RcapReader::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  size_ = 0;
+  index_.clear();
+}
+
+bool RcapReader::map_file(const char* path, std::string* error_message) {
+  fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    set_error(error_message, "Failed to open input file.");
+    return false;
+  }
+  struct stat info = {};
+  if (fstat(fd_, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < kRcapHeaderSize + kRcapTrailerSize) {
+    set_error(error_message, "Input is too small to be an RCAP file.");
+    return false;
+  }
+  void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED,
+                      fd_, 0);
+  if (mapped == MAP_FAILED) {
+    set_error(error_message, "Failed to map input file.");
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(mapped);
+  size_ = static_cast<size_t>(info.st_size);
+  madvise(data_, size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+#endif
+
+bool RcapReader::open(const char* path, std::string* error_message) {
+  close();
+  if (!map_file(path, error_message)) {
+    close();
+    return false;
+  }
+
+  const uint8_t* trailer = data_ + size_ - kRcapTrailerSize;
+  if (std::memcmp(data_, kRcapMagic, 4) != 0 ||
+      std::memcmp(trailer + 16, kRcapTrailerMagic, 4) != 0 ||
+      get<uint16_t>(data_, 4) != kRcapVersion) {
+    set_error(error_message, "Input is not a supported RCAP file.");
+    close();
+    return false;
+  }
+
+  header_.width = get<uint32_t>(data_, 8);
+  header_.height = get<uint32_t>(data_, 12);
+  header_.fps = get<uint32_t>(data_, 16);
+  header_.format = static_cast<PixelFormat>(get<uint32_t>(data_, 20));
+  header_.codec = static_cast<FrameCodec>(get<uint32_t>(data_, 24));
+  header_.level = get<int32_t>(data_, 28);
+  header_.dictionary_offset = get<uint64_t>(data_, 32);
+  header_.dictionary_size = get<uint32_t>(data_, 40);
+
+  const uint64_t index_offset = get<uint64_t>(trailer, 0);
+  const uint32_t frame_count = get<uint32_t>(trailer, 8);
+  const uint32_t entry_size = get<uint32_t>(trailer, 12);
+  const uint64_t payload_end = size_ - kRcapTrailerSize;
+  if (entry_size < kRcapIndexEntrySize || index_offset > payload_end ||
+      static_cast<uint64_t>(frame_count) * entry_size != payload_end - index_offset ||
+      header_.dictionary_offset + header_.dictionary_size > index_offset) {
+    set_error(error_message, "RCAP index is corrupt.");
+    close();
+    return false;
+  }
+
+  index_.resize(frame_count);
+  for (uint32_t i = 0; i < frame_count; ++i) {
+    const uint8_t* src = data_ + index_offset + static_cast<uint64_t>(i) * entry_size;
+    RcapIndexEntry& entry = index_[i];
+    entry.offset = get<uint64_t>(src, 0);
+    entry.compressed_size = get<uint32_t>(src, 8);
+    entry.raw_size = get<uint32_t>(src, 12);
+    entry.timestamp_us = get<int64_t>(src, 16);
+    if (entry.offset + entry.compressed_size > index_offset ||
+        entry.raw_size != raw_frame_size()) {
+      set_error(error_message, "RCAP index entry is out of range.");
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t RcapReader::raw_frame_size() const {
+  return frame_byte_size(static_cast<int>(header_.width), static_cast<int>(header_.height),
+                         header_.format);
+}
+
+const uint8_t* RcapReader::dictionary() const {
+  if (header_.dictionary_size == 0) {
+    return nullptr;
+  }
+  return data_ + header_.dictionary_offset;
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef RECASTER_RCAP_FORMAT_H_
+#define RECASTER_RCAP_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_codec.h"
+#include "frame_data.h"
+
+namespace recaster {
+
+class WorkerPool;
+
+// .rcap layout, little endian:
+//   64-byte header | codec dictionary | frame payloads | index | 24-byte trailer
+// The trailer points at the index, which holds one entry per frame, so the
+// file can be memory-mapped and any frame decoded without scanning.
+constexpr uint32_t kRcapVersion = 1;
+constexpr size_t kRcapHeaderSize = 64;
+constexpr size_t kRcapIndexEntrySize = 24;
+constexpr size_t kRcapTrailerSize = 24;
+
+struct RcapHeader {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t fps = 0;
+  PixelFormat format = PixelFormat::kBgra32;
+  FrameCodec codec = FrameCodec::kStored;
+  int32_t level = 0;
+  uint64_t dictionary_offset = 0;
+  uint32_t dictionary_size = 0;
+};
+
+struct RcapIndexEntry {
+  uint64_t offset = 0;
+  uint32_t compressed_size = 0;
+  uint32_t raw_size = 0;
+  int64_t timestamp_us = 0;
+};
+
+struct RcapOptions {
+  FrameCodec codec = FrameCodec::kStored;
+  int level = 1;
+  size_t dictionary_capacity = 64 * 1024;
+};
+
+// Compresses frames in parallel batches on `pool` and writes them in order.
+bool write_rcap_file(const char* output_path,
+                     const std::vector<FramePtr>& frames,
+                     int fps,
+                     const RcapOptions& options,
+                     WorkerPool* pool,
+                     std::string* error_message,
+                     const WriteProgress& progress = nullptr);
+
+class RcapReader {
+ public:
+  RcapReader() = default;
+  ~RcapReader();
+
+  RcapReader(const RcapReader&) = delete;
+  RcapReader& operator=(const RcapReader&) = delete;
+
+  bool open(const char* path, std::string* error_message);
+  void close();
+
+  const RcapHeader& header() const { return header_; }
+  size_t frame_count() const { return index_.size(); }
+  const RcapIndexEntry& entry(size_t index) const { return index_[index]; }
+  size_t raw_frame_size() const;
+  uint64_t file_size() const { return size_; }
+  const uint8_t* dictionary() const;
+  const uint8_t* payload(size_t index) const { return data_ + index_[index].offset; }
+
+ private:
+  bool map_file(const char* path, std::string* error_message);
+
+#if defined(_WIN32)
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  RcapHeader header_;
+  std::vector<RcapIndexEntry> index_;
+};
+
+}
+
+#endif
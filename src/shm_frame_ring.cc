@@ -0,0 +1,306 @@
+#include "shm_frame_ring.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+#endif
+
+namespace recaster {
+
+// Lives at the start of the memfd. The indices only ever grow; a slot is
+// free once the consumer's head has passed it.
+struct ShmFrameRing::Control {
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint64_t slot_count = 0;
+  uint64_t slot_capacity = 0;
+  uint64_t slot_stride = 0;
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+  alignas(64) std::atomic<uint32_t> closed{0};
+  uint64_t sequence_end = 0;
+};
+
+#if defined(__linux__)
+
+namespace {
+
+constexpr uint32_t kMagic = 0x52435246;  // "RCRF"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kPageSize = 4096;
+// The Control block gets a page of its own, ahead of the slots.
+constexpr size_t kControlSize = kPageSize;
+// Each slot starts with its SlotHeader; pixels follow at this offset.
+constexpr size_t kSlotHeaderSize = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "The ring's indices are shared between processes.");
+
+struct SlotHeader {
+  uint64_t sequence;
+  int64_t timestamp_us;
+  int32_t width;
+  int32_t height;
+  int32_t format;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+static_assert(sizeof(SlotHeader) <= kSlotHeaderSize, "SlotHeader must fit its space.");
+
+size_t round_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void set_error(std::string* error_message, const char* message) {
+  if (error_message != nullptr) {
+    *error_message = message;
+  }
+}
+
+void signal_event(int event_fd) {
+  const uint64_t one = 1;
+  ssize_t written;
+  do {
+    written = write(event_fd, &one, sizeof(one));
+  } while (written < 0 && errno == EINTR);
+}
+
+}
+
+ShmFrameRing::~ShmFrameRing() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+  if (memory_fd_ >= 0) {
+    ::close(memory_fd_);
+  }
+  if (event_fd_ >= 0) {
+    ::close(event_fd_);
+  }
+}
+
+bool ShmFrameRing::create(size_t slot_count, size_t slot_capacity, std::string* error_message) {
+  if (mapping_ != nullptr || slot_count == 0 || slot_capacity == 0) {
+    set_error(error_message, "Invalid frame ring size.");
+    return false;
+  }
+  static_assert(sizeof(Control) <= kControlSize, "Control must fit its page.");
+  const size_t slot_stride = round_up(kSlotHeaderSize + slot_capacity, kPageSize);
+  const size_t size = kControlSize + slot_count * slot_stride;
+  memory_fd_ = memfd_create("recaster-frames", MFD_CLOEXEC);
+  if (memory_fd_ < 0 || ftruncate(memory_fd_, static_cast<off_t>(size)) != 0) {
+    set_error(error_message, "Failed to create the shared frame memory.");
+    return false;
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd_, 0);
+  if (mapping == MAP_FAILED) {
+    set_error(error_message, "Failed to map the shared frame memory.");
+    return false;
+  }
+  mapping_ = mapping;
+  mapping_size_ = size;
+  event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (event_fd_ < 0) {
+    set_error(error_message, "Failed to create the frame ring's eventfd.");
+    return false;
+  }
+
+  control_ = new (mapping_) Control();
+  control_->slot_count = slot_count;
+  control_->slot_capacity = slot_capacity;
+  control_->slot_stride = slot_stride;
+  control_->version = kVersion;
+  control_->magic = kMagic;
+  slot_count_ = slot_count;
+  slot_capacity_ = slot_capacity;
+  slot_stride_ = slot_stride;
+  return true;
+}
+
+bool ShmFrameRing::attach(int memory_fd, int event_fd, std::string* error_message) {
+  memory_fd_ = memory_fd;
+  event_fd_ = event_fd;
+  struct stat info;
+  if (mapping_ != nullptr || memory_fd < 0 || event_fd < 0 || fstat(memory_fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < kControlSize) {
+    set_error(error_message, "Invalid shared frame memory.");
+    return false;
+  }
+  const size_t size = static_cast<size_t>(info.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+  if (mapping == MAP_FAILED) {
+    set_error(error_message, "Failed to map the shared frame memory.");
+    return false;
+  }
+  mapping_ = mapping;
+  mapping_size_ = size;
+
+  Control* control = static_cast<Control*>(mapping_);
+  if (control->magic != kMagic || control->version != kVersion ||
+      control->slot_count == 0 ||
+      control->slot_stride < kSlotHeaderSize + control->slot_capacity ||
+      kControlSize + control->slot_count * control->slot_stride > size) {
+    set_error(error_message, "The shared frame memory has an unknown layout.");
+    return false;
+  }
+  control_ = control;
+  slot_count_ = control->slot_count;
+  slot_capacity_ = control->slot_capacity;
+  slot_stride_ = control->slot_stride;
+  return true;
+}
+
+uint8_t* ShmFrameRing::slot(uint64_t index) const {
+  return static_cast<uint8_t*>(mapping_) + kControlSize + (index % slot_count_) * slot_stride_;
+}
+
+uint8_t* ShmFrameRing::begin_write() {
+  if (control_ == nullptr || control_->closed.load(std::memory_order_acquire) != 0) {
+    return nullptr;
+  }
+  const uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+  if (tail - control_->head.load(std::memory_order_acquire) >= slot_count_) {
+    return nullptr;
+  }
+  return slot(tail) + kSlotHeaderSize;
+}
+
+void ShmFrameRing::commit_write(const ShmFrameInfo& info) {
+  const uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+  SlotHeader header = {};
+  header.sequence = info.sequence;
+  header.timestamp_us = info.timestamp_us;
+  header.width = info.width;
+  header.height = info.height;
+  header.format = static_cast<int32_t>(info.format);
+  header.size = std::min<uint64_t>(info.size, slot_capacity_);
+  memcpy(slot(tail), &header, sizeof(header));
+  control_->tail.store(tail + 1, std::memory_order_release);
+  signal_event(event_fd_);
+}
+
+void ShmFrameRing::close(uint64_t sequence_end) {
+  if (control_ == nullptr) {
+    return;
+  }
+  control_->sequence_end = sequence_end;
+  control_->closed.store(1, std::memory_order_release);
+  signal_event(event_fd_);
+}
+
+bool ShmFrameRing::wait(int timeout_ms) {
+  if (control_ == nullptr) {
+    return false;
+  }
+  if (closed() || control_->head.load(std::memory_order_relaxed) !=
+                      control_->tail.load(std::memory_order_acquire)) {
+    return true;
+  }
+  struct pollfd event = {event_fd_, POLLIN, 0};
+  if (poll(&event, 1, timeout_ms) <= 0) {
+    return false;
+  }
+  uint64_t count = 0;
+  // Resets the counter; every commit after this read signals again.
+  if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    return false;
+  }
+  return true;
+}
+
+const uint8_t* ShmFrameRing::begin_read(ShmFrameInfo* info) {
+  if (control_ == nullptr) {
+    return nullptr;
+  }
+  const uint64_t head = control_->head.load(std::memory_order_relaxed);
+  if (head == control_->tail.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  SlotHeader header;
+  memcpy(&header, slot(head), sizeof(header));
+  info->sequence = header.sequence;
+  info->timestamp_us = header.timestamp_us;
+  info->width = header.width;
+  info->height = header.height;
+  info->format = header.format == static_cast<int32_t>(PixelFormat::kBgr24)
+                     ? PixelFormat::kBgr24
+                     : PixelFormat::kBgra32;
+  info->size = std::min<uint64_t>(header.size, slot_capacity_);
+  return slot(head) + kSlotHeaderSize;
+}
+
+void ShmFrameRing::end_read() {
+  const uint64_t head = control_->head.load(std::memory_order_relaxed);
+  control_->head.store(head + 1, std::memory_order_release);
+}
+
+bool ShmFrameRing::closed() const {
+  return control_ != nullptr && control_->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t ShmFrameRing::sequence_end() const {
+  return closed() ? control_->sequence_end : 0;
+}
+
+#else
+
+ShmFrameRing::~ShmFrameRing() = default;
+
+bool ShmFrameRing::create(size_t slot_count, size_t slot_capacity, std::string* error_message) {
+  if (error_message != nullptr) {
+    *error_message = "Shared-memory frame rings need Linux.";
+  }
+  return false;
+}
+
+bool ShmFrameRing::attach(int memory_fd, int event_fd, std::string* error_message) {
+  if (error_message != nullptr) {
+    *error_message = "Shared-memory frame rings need Linux.";
+  }
+  return false;
+}
+
+uint8_t* ShmFrameRing::slot(uint64_t index) const {
+  return nullptr;
+}
+
+uint8_t* ShmFrameRing::begin_write() {
+  return nullptr;
+}
+
+void ShmFrameRing::commit_write(const ShmFrameInfo& info) {}
+
+void ShmFrameRing::close(uint64_t sequence_end) {}
+
+bool ShmFrameRing::wait(int timeout_ms) {
+  return false;
+}
+
+const uint8_t* ShmFrameRing::begin_read(ShmFrameInfo* info) {
+  return nullptr;
+}
+
+void ShmFrameRing::end_read() {}
+
+bool ShmFrameRing::closed() const {
+  return false;
+}
+
+uint64_t ShmFrameRing::sequence_end() const {
+  return 0;
+}
+
+#endif
+
+}
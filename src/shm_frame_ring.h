@@ -0,0 +1,84 @@
+#ifndef RECASTER_SHM_FRAME_RING_H_
+#define RECASTER_SHM_FRAME_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "frame_data.h"
+
+namespace recaster {
+
+struct ShmFrameInfo {
+  // Capture slot the frame belongs to; gaps are slots the producer dropped.
+  uint64_t sequence = 0;
+  int64_t timestamp_us = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  PixelFormat format = PixelFormat::kBgra32;
+  uint64_t size = 0;
+};
+
+// Hands frames from one process to another through a fixed ring of slots in
+// a memfd, with an eventfd to wake the reader. The producer writes pixels
+// straight into a slot and never waits: when every slot is taken the frame
+// is dropped. Each side uses the ring from one thread. Linux only; elsewhere
+// create and attach fail.
+class ShmFrameRing {
+ public:
+  ShmFrameRing() = default;
+  ~ShmFrameRing();
+
+  ShmFrameRing(const ShmFrameRing&) = delete;
+  ShmFrameRing& operator=(const ShmFrameRing&) = delete;
+
+  // Producer side. Slots hold up to `slot_capacity` bytes of pixels; the
+  // memfd is only backed where slots are written.
+  bool create(size_t slot_count, size_t slot_capacity, std::string* error_message);
+  // Consumer side, on descriptors inherited from the producer. Takes
+  // ownership of both.
+  bool attach(int memory_fd, int event_fd, std::string* error_message);
+
+  int memory_fd() const { return memory_fd_; }
+  int event_fd() const { return event_fd_; }
+  size_t slot_count() const { return slot_count_; }
+  size_t slot_capacity() const { return slot_capacity_; }
+
+  // Producer: the next free slot's pixels, or nullptr when the ring is full
+  // or closed. commit_write() publishes it and wakes the consumer.
+  uint8_t* begin_write();
+  void commit_write(const ShmFrameInfo& info);
+  // No frames follow; the consumer drains the ring and sees closed().
+  // `sequence_end` is one past the last capture slot, so the consumer also
+  // knows about slots dropped at the very end.
+  void close(uint64_t sequence_end);
+
+  // Consumer: waits up to `timeout_ms` for a frame or close. False on
+  // timeout.
+  bool wait(int timeout_ms);
+  // The oldest committed frame, or nullptr when none is waiting. The slot
+  // stays valid until end_read().
+  const uint8_t* begin_read(ShmFrameInfo* info);
+  void end_read();
+  bool closed() const;
+  // The producer's `sequence_end`, once closed().
+  uint64_t sequence_end() const;
+
+ private:
+  struct Control;
+
+  uint8_t* slot(uint64_t index) const;
+
+  int memory_fd_ = -1;
+  int event_fd_ = -1;
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  Control* control_ = nullptr;
+  size_t slot_count_ = 0;
+  size_t slot_capacity_ = 0;
+  size_t slot_stride_ = 0;
+};
+
+}
+
+#endif
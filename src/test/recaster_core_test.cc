@@ -0,0 +1,1155 @@
+#include <gtest/gtest.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "avi_edit.h"
+#include "avi_writer.h"
+#include "degradation_controller.h"
+#include "frame_blender.h"
+#include "frame_codec.h"
+#include "frame_data.h"
+#include "frame_hash.h"
+#include "frame_pacer.h"
+#include "frame_pool.h"
+#include "frame_resampler.h"
+#include "frame_sink.h"
+#include "frame_store.h"
+#include "frame_tap.h"
+#include "gif_writer.h"
+#include "image_sequence_writer.h"
+#include "json_util.h"
+#include "main_thread_budget.h"
+#include "rcap_format.h"
+#include "shm_frame_ring.h"
+#include "spsc_ring.h"
+#include "worker_pool.h"
+
+namespace recaster {
+namespace test {
+
+namespace {
+
+std::string temp_path(const char* name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+FramePtr make_bgra_frame(int width, int height, uint8_t value, int64_t timestamp_us = 0) {
+  auto frame = std::make_shared<FrameData>();
+  frame->width = width;
+  frame->height = height;
+  frame->timestamp_us = timestamp_us;
+  frame->pixels.assign(frame_byte_size(width, height, PixelFormat::kBgra32), value);
+  return frame;
+}
+
+// Minimal GIF reader: composites every image onto a 0xRRGGBB canvas and
+// returns the canvas after each frame.
+std::vector<std::vector<uint32_t>> decode_gif(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  std::vector<std::vector<uint32_t>> frames;
+  if (data.size() < 13 || std::string(data.begin(), data.begin() + 6) != "GIF89a") {
+    return frames;
+  }
+  auto u16 = [&](size_t at) { return data[at] | (data[at + 1] << 8); };
+  const int width = u16(6);
+  const int height = u16(8);
+  size_t pos = 13;
+  std::vector<uint32_t> global_table;
+  auto read_table = [&](int flags, std::vector<uint32_t>* table) {
+    table->clear();
+    for (int i = 0; i < (2 << (flags & 7)); ++i, pos += 3) {
+      table->push_back((data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2]);
+    }
+  };
+  if ((data[10] & 0x80) != 0) {
+    read_table(data[10], &global_table);
+  }
+  std::vector<uint32_t> canvas(static_cast<size_t>(width) * static_cast<size_t>(height));
+  int transparent = -1;
+  while (pos < data.size() && data[pos] != 0x3b) {
+    if (data[pos] == 0x21) {
+      if (data[pos + 1] == 0xf9) {
+        transparent = (data[pos + 3] & 1) != 0 ? data[pos + 6] : -1;
+      }
+      pos += 2;
+      while (data[pos] != 0) {
+        pos += data[pos] + 1U;
+      }
+      ++pos;
+      continue;
+    }
+    const int left = u16(pos + 1);
+    const int top = u16(pos + 3);
+    const int w = u16(pos + 5);
+    const int h = u16(pos + 7);
+    const int flags = data[pos + 9];
+    pos += 10;
+    std::vector<uint32_t> table = global_table;
+    if ((flags & 0x80) != 0) {
+      read_table(flags, &table);
+    }
+    const int min_code_size = data[pos++];
+    std::vector<uint8_t> lzw;
+    while (data[pos] != 0) {
+      lzw.insert(lzw.end(), data.begin() + static_cast<std::ptrdiff_t>(pos) + 1,
+                 data.begin() + static_cast<std::ptrdiff_t>(pos) + 1 + data[pos]);
+      pos += data[pos] + 1U;
+    }
+    ++pos;
+
+    const int clear = 1 << min_code_size;
+    std::vector<std::vector<uint8_t>> dict;
+    std::vector<uint8_t> indices;
+    std::vector<uint8_t> previous;
+    int size = min_code_size + 1;
+    size_t bit = 0;
+    while (bit + static_cast<size_t>(size) <= lzw.size() * 8) {
+      int code = 0;
+      for (int b = 0; b < size; ++b, ++bit) {
+        code |= ((lzw[bit / 8] >> (bit % 8)) & 1) << b;
+      }
+      if (code == clear) {
+        dict.clear();
+        for (int i = 0; i < clear + 2; ++i) {
+          dict.push_back({static_cast<uint8_t>(i)});
+        }
+        size = min_code_size + 1;
+        previous.clear();
+        continue;
+      }
+      if (code == clear + 1) {
+        break;
+      }
+      std::vector<uint8_t> entry;
+      if (code < static_cast<int>(dict.size())) {
+        entry = dict[static_cast<size_t>(code)];
+      } else {
+        entry = previous;
+        entry.push_back(previous.front());
+      }
+      if (!previous.empty() && dict.size() < 4096) {
+        previous.push_back(entry.front());
+        dict.push_back(previous);
+        if (dict.size() == (1U << size) && size < 12) {
+          ++size;
+        }
+      }
+      indices.insert(indices.end(), entry.begin(), entry.end());
+      previous = entry;
+    }
+    if (indices.size() != static_cast<size_t>(w) * static_cast<size_t>(h)) {
+      return {};
+    }
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        const int index = indices[static_cast<size_t>(y * w + x)];
+        if (index != transparent) {
+          canvas[static_cast<size_t>((top + y) * width + left + x)] =
+              table[static_cast<size_t>(index)];
+        }
+      }
+    }
+    frames.push_back(canvas);
+  }
+  return frames;
+}
+
+}
+
+TEST(FrameResampler, ComputeScaledSizeFitsBounds) {
+  ScaleOptions options;
+  options.max_width = 1280;
+  options.max_height = 720;
+  int width = 0;
+  int height = 0;
+  compute_scaled_size(1920, 1200, options, &width, &height);
+  EXPECT_EQ(width, 1152);
+  EXPECT_EQ(height, 720);
+
+  options = ScaleOptions();
+  options.scale = 0.75;
+  compute_scaled_size(1920, 1080, options, &width, &height);
+  EXPECT_EQ(width, 1440);
+  EXPECT_EQ(height, 810);
+}
+
+TEST(FrameResampler, PreservesFlatColor) {
+  WorkerPool pool(2);
+  FrameResampler resampler;
+  std::vector<uint8_t> src(64U * 48U * 4U, 200);
+  std::vector<uint8_t> dst(17U * 9U * 4U, 0);
+  for (ResampleFilter filter :
+       {ResampleFilter::kBilinear, ResampleFilter::kBicubic, ResampleFilter::kLanczos3}) {
+    resampler.resample(src.data(), 64, 48, 64U * 4U, dst.data(), 17, 9, filter, &pool);
+    for (uint8_t value : dst) {
+      ASSERT_EQ(value, 200);
+    }
+  }
+}
+
+TEST(AviWriter, WritesPaddedBgr24Frames) {
+  auto frame = std::make_shared<FrameData>();
+  frame->width = 3;
+  frame->height = 2;
+  frame->format = PixelFormat::kBgr24;
+  frame->pixels.assign(frame_byte_size(3, 2, frame->format), 7);
+  ASSERT_EQ(frame->pixels.size(), 24U);
+
+  const std::string path = temp_path("recaster_writer_test.avi");
+  std::string error;
+  const std::vector<FramePtr> frames = {frame, frame};
+  ASSERT_TRUE(write_avi_file(path.c_str(), frames, 30, &error)) << error;
+
+  {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    const std::streamoff size = file.tellg();
+    file.seekg(0);
+    char riff[4] = {};
+    file.read(riff, 4);
+    EXPECT_EQ(std::string(riff, 4), "RIFF");
+    EXPECT_GT(size, 2 * (24 + 8));
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(AviWriter, ParallelWriteMatchesSerialOutput) {
+  std::vector<FramePtr> frames;
+  for (int i = 0; i < 37; ++i) {
+    auto frame = std::make_shared<FrameData>();
+    frame->width = i == 5 ? 4 : 5;
+    frame->height = 3;
+    frame->format = PixelFormat::kBgr24;
+    frame->pixels.assign(frame_byte_size(frame->width, 3, frame->format),
+                         static_cast<uint8_t>(i));
+    frames.push_back(frame);
+  }
+  const std::string serial = temp_path("recaster_writer_serial.avi");
+  const std::string parallel = temp_path("recaster_writer_parallel.avi");
+  std::string error;
+  ASSERT_TRUE(write_avi_file(serial.c_str(), frames, 30, &error)) << error;
+  WorkerPool pool(3);
+  size_t reported_frames = 0;
+  ASSERT_TRUE(write_avi_file(parallel.c_str(), frames, 30, &pool, &error,
+                             [&reported_frames](size_t frames_written, uint64_t) {
+                               reported_frames = frames_written;
+                               return true;
+                             }))
+      << error;
+  EXPECT_EQ(reported_frames, 36U);
+
+  auto read_all = [](const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>());
+  };
+  const std::vector<char> expected = read_all(serial);
+  ASSERT_FALSE(expected.empty());
+  EXPECT_EQ(read_all(parallel), expected);
+  std::filesystem::remove(serial);
+  std::filesystem::remove(parallel);
+}
+
+TEST(AviEdit, TrimsAndConcatenatesWithoutDecoding) {
+  std::vector<FramePtr> frames;
+  for (int i = 0; i < 5; ++i) {
+    auto frame = std::make_shared<FrameData>();
+    frame->width = 3;
+    frame->height = 2;
+    frame->format = PixelFormat::kBgr24;
+    frame->pixels.assign(frame_byte_size(3, 2, frame->format), static_cast<uint8_t>(i * 10));
+    frames.push_back(frame);
+  }
+  const std::string source = temp_path("recaster_edit_source.avi");
+  const std::string trimmed = temp_path("recaster_edit_trimmed.avi");
+  const std::string joined = temp_path("recaster_edit_joined.avi");
+  std::string error;
+  ASSERT_TRUE(write_avi_file(source.c_str(), frames, 10, &error)) << error;
+
+  // Frames 1..3 are on screen between 0.1 s and 0.35 s.
+  ASSERT_TRUE(trim_avi_file(source.c_str(), trimmed.c_str(), 100000, 350000, &error)) << error;
+  ASSERT_TRUE(concat_avi_files({trimmed, source}, joined.c_str(), &error)) << error;
+  EXPECT_FALSE(trim_avi_file(source.c_str(), source.c_str(), 0, -1, &error));
+  EXPECT_FALSE(trim_avi_file(source.c_str(), trimmed.c_str(), 600000, -1, &error));
+
+  AviReader reader;
+  ASSERT_TRUE(reader.open(joined.c_str(), &error)) << error;
+  EXPECT_EQ(reader.width(), 3);
+  EXPECT_EQ(reader.height(), 2);
+  EXPECT_EQ(reader.format(), PixelFormat::kBgr24);
+  EXPECT_EQ(reader.fps(), 10);
+  const std::vector<uint8_t> expected = {10, 20, 30, 0, 10, 20, 30, 40};
+  ASSERT_EQ(reader.frame_count(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(reader.pixels(i)[0], expected[i]) << i;
+  }
+  reader.close();
+
+  for (const std::string& path : {source, trimmed, joined}) {
+    std::filesystem::remove(path);
+  }
+}
+
+TEST(AviEdit, RecoversUnfinishedRecording) {
+  const std::string path = temp_path("recaster_recover_test.avi");
+  std::vector<uint8_t> pixels(frame_byte_size(4, 2, PixelFormat::kBgra32));
+  {
+    // Killed before finish(): zero sizes and no index.
+    AviWriter writer;
+    std::string error;
+    ASSERT_TRUE(writer.open(path.c_str(), 4, 2, PixelFormat::kBgra32, 25, &error)) << error;
+    for (uint8_t value : {1, 2, 3}) {
+      std::fill(pixels.begin(), pixels.end(), value);
+      ASSERT_TRUE(writer.append(pixels.data(), pixels.size()));
+    }
+  }
+  {
+    // A damaged stretch, one more good chunk and a torn one.
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file.write("garbage-00db-bytes", 18);
+    const uint32_t size = static_cast<uint32_t>(pixels.size());
+    std::fill(pixels.begin(), pixels.end(), 4);
+    for (int i = 0; i < 2; ++i) {
+      file.write("00db", 4);
+      file.write(reinterpret_cast<const char*>(&size), 4);
+      file.write(reinterpret_cast<const char*>(pixels.data()),
+                 static_cast<std::streamsize>(i == 0 ? pixels.size() : pixels.size() / 2));
+    }
+  }
+
+  std::string error;
+  AviReader reader;
+  EXPECT_FALSE(reader.open(path.c_str(), &error));
+  AviRecovery recovery;
+  ASSERT_TRUE(recover_avi_file(path.c_str(), &recovery, &error)) << error;
+  EXPECT_EQ(recovery.frames, 4U);
+  EXPECT_EQ(recovery.skipped_bytes, 18U);
+  EXPECT_EQ(recovery.truncated_bytes, 8 + pixels.size() / 2);
+
+  ASSERT_TRUE(reader.open(path.c_str(), &error)) << error;
+  EXPECT_EQ(reader.fps(), 25);
+  ASSERT_EQ(reader.frame_count(), 4U);
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(reader.pixels(i)[0], i + 1) << i;
+  }
+  EXPECT_EQ(reader.data_end() + 8 + 16 * 4, reader.file_size());
+  reader.close();
+  std::filesystem::remove(path);
+}
+
+TEST(FrameHash, FindsFirstDivergentFrameAndRegion) {
+  // A blocky pattern; the width exercises the scalar tail of the SSE2 path.
+  auto make_scene = [](int64_t timestamp_us, bool changed) {
+    auto frame = std::make_shared<FrameData>();
+    frame->width = 157;
+    frame->height = 96;
+    frame->timestamp_us = timestamp_us;
+    frame->pixels.resize(frame_byte_size(157, 96, PixelFormat::kBgra32));
+    for (int y = 0; y < 96; ++y) {
+      for (int x = 0; x < 157; ++x) {
+        uint8_t* pixel = frame->pixels.data() + (static_cast<size_t>(y) * 157 + x) * 4;
+        const bool patch = changed && x >= 120 && y >= 60;
+        const uint8_t value = static_cast<uint8_t>(
+            patch ? 255 - ((x / 3) * 53 + (y / 5) * 71) : (x / 6) * 37 + (y / 4) * 91);
+        pixel[0] = value;
+        pixel[1] = static_cast<uint8_t>(value ^ 0x55);
+        pixel[2] = static_cast<uint8_t>(255 - value);
+        pixel[3] = 255;
+      }
+    }
+    return FramePtr(frame);
+  };
+
+  HashOptions options;
+  options.tile_columns = 4;
+  options.tile_rows = 4;
+  FrameHash bgra_hash;
+  hash_frame(*make_scene(0, false), options, &bgra_hash);
+  auto bgr = std::make_shared<FrameData>();
+  bgr->width = 157;
+  bgr->height = 96;
+  bgr->format = PixelFormat::kBgr24;
+  bgr->pixels.resize(frame_byte_size(157, 96, PixelFormat::kBgr24));
+  convert_bgra_frame(make_scene(0, false)->pixels.data(), 157, 96, PixelFormat::kBgr24,
+                     bgr->pixels.data());
+  FrameHash bgr_hash;
+  hash_frame(*bgr, options, &bgr_hash);
+  EXPECT_EQ(bgra_hash.frame, bgr_hash.frame);
+  EXPECT_EQ(bgra_hash.tiles, bgr_hash.tiles);
+  ASSERT_EQ(bgra_hash.tiles.size(), 16U);
+
+  const std::string golden_path = temp_path("recaster_hash_golden.rhash");
+  const std::string run_path = temp_path("recaster_hash_run.rhash");
+  WorkerPool pool(2);
+  std::string error;
+  {
+    HashRecorder golden(options);
+    HashRecorder run(options);
+    for (int i = 0; i < 5; ++i) {
+      golden.append(make_scene(i * 40000, false), &pool);
+      run.append(make_scene(i * 40000, i >= 3), &pool);
+    }
+    EXPECT_TRUE(golden.repeat_last());
+    ASSERT_TRUE(golden.write(golden_path.c_str(), 25, &error)) << error;
+    ASSERT_TRUE(run.write(run_path.c_str(), 25, &error)) << error;
+  }
+  EXPECT_EQ(std::filesystem::file_size(golden_path), kHashHeaderSize + 6 * (16 + 16 * 8));
+
+  HashComparison comparison;
+  ASSERT_TRUE(compare_hash_files(golden_path.c_str(), golden_path.c_str(),
+                                 HashCompareOptions(), &comparison, &error))
+      << error;
+  EXPECT_EQ(comparison.first_divergent_frame, -1);
+  EXPECT_EQ(comparison.frames_compared, 6U);
+
+  ASSERT_TRUE(compare_hash_files(golden_path.c_str(), run_path.c_str(), HashCompareOptions(),
+                                 &comparison, &error))
+      << error;
+  EXPECT_EQ(comparison.first_divergent_frame, 3);
+  EXPECT_EQ(comparison.timestamp_us, 120000);
+  // Only the bottom-right tiles hold the patch.
+  EXPECT_GE(comparison.x, 78);
+  EXPECT_GE(comparison.y, 48);
+  EXPECT_EQ(comparison.x + comparison.width, 157);
+  EXPECT_EQ(comparison.y + comparison.height, 96);
+  std::filesystem::remove(golden_path);
+  std::filesystem::remove(run_path);
+}
+
+TEST(DegradationController, EscalatesUnderLoadAndRecovers) {
+  DegradationPolicy policy;
+  policy.steps = {DegradationStep::kReduceFps, DegradationStep::kIncreaseDivisor};
+  policy.escalate_after_us = 100000;
+  policy.recover_after_us = 300000;
+  DegradationController controller(policy);
+
+  const int64_t interval = 33000;
+  int64_t now = 0;
+  for (int i = 0; i < 30; ++i) {
+    now += interval;
+    controller.observe(now, 30000, interval, interval, 0);
+  }
+  EXPECT_EQ(controller.level(), 2);
+  EXPECT_EQ(controller.state().fps_step, 2);
+  EXPECT_EQ(controller.state().divisor_boost, 2);
+
+  for (int i = 0; i < 60; ++i) {
+    now += interval;
+    controller.observe(now, 1000, interval, interval, 0);
+  }
+  EXPECT_EQ(controller.level(), 0);
+  EXPECT_EQ(controller.state().fps_step, 1);
+  ASSERT_EQ(controller.events().size(), 4U);
+  EXPECT_TRUE(controller.events().front().escalated);
+  EXPECT_FALSE(controller.events().back().escalated);
+}
+
+TEST(DegradationController, DropsAtMemoryBudget) {
+  DegradationPolicy policy;
+  policy.max_buffered_bytes = 1000;
+  DegradationController controller(policy);
+  EXPECT_FALSE(controller.should_drop(999));
+  EXPECT_TRUE(controller.should_drop(1000));
+}
+
+TEST(DegradationController, RaisesCompressionOnlyForMemoryPressure) {
+  DegradationPolicy policy;
+  policy.steps = {DegradationStep::kRaiseCompression};
+  policy.escalate_after_us = 100000;
+  const int64_t interval = 33000;
+
+  // Over the memory budget at low load: worth spending CPU on.
+  policy.max_buffered_bytes = 1000;
+  DegradationController memory(policy);
+  int64_t now = 0;
+  for (int i = 0; i < 10; ++i) {
+    now += interval;
+    memory.observe(now, 1000, interval, interval, 2000);
+  }
+  EXPECT_EQ(memory.level(), 1);
+  EXPECT_EQ(memory.buffer_compression_level(), 4);
+
+  // Over the load target: the step is taken but compression stays cheap.
+  DegradationController load(policy);
+  now = 0;
+  for (int i = 0; i < 10; ++i) {
+    now += interval;
+    load.observe(now, 30000, interval, interval, 0);
+  }
+  EXPECT_EQ(load.level(), 1);
+  EXPECT_EQ(load.buffer_compression_level(), 1);
+}
+
+TEST(MainThreadBudget, ShedsTicksBeyondTheBudget) {
+  // 5% of each second; 10 ms captures, 0.1 ms repeats, at 30 fps.
+  MainThreadBudget budget(0.05);
+  int admitted = 0;
+  int64_t now = 0;
+  for (int i = 0; i < 90; ++i, now += 33333) {
+    const bool admit = budget.admit(now);
+    admitted += admit ? 1 : 0;
+    budget.record(now, admit ? 10000 : 100, !admit);
+  }
+  EXPECT_GE(admitted, 9);
+  EXPECT_LE(admitted, 15);
+  EXPECT_EQ(budget.ticks_shed(), static_cast<uint64_t>(90 - admitted));
+  // The shed ticks' own 0.1 ms is all that goes over.
+  EXPECT_LE(budget.high_water(), 0.055);
+  EXPECT_EQ(budget.max_tick_us(), 10000);
+
+  // A tick that alone exceeds the budget still runs once per window.
+  MainThreadBudget tight(0.05);
+  admitted = 0;
+  for (now = 0; now < 3000000; now += 100000) {
+    const bool admit = tight.admit(now);
+    admitted += admit ? 1 : 0;
+    tight.record(now, admit ? 80000 : 0, !admit);
+  }
+  EXPECT_EQ(admitted, 3);
+
+  MainThreadBudget unlimited(0.0);
+  EXPECT_TRUE(unlimited.admit(0));
+  unlimited.record(0, 500000, false);
+  EXPECT_TRUE(unlimited.admit(1000));
+  EXPECT_DOUBLE_EQ(unlimited.high_water(), 0.5);
+}
+
+TEST(MainThreadBudget, IgnoresTicksThatCaptureNothing) {
+  // A 10 fps sink on a 30 fps session: two of every three ticks are not due
+  // and cost next to nothing. Like the plugin, only due ticks ask admit(),
+  // and every tick that did not read back is recorded as shed. Were the cheap
+  // ticks predicted too, a 10 ms capture would look like 6 ms and a fifth one
+  // would be let into the 48 ms.
+  MainThreadBudget budget(0.048);
+  int admitted = 0;
+  int64_t now = 0;
+  for (int i = 0; i < 300; ++i, now += 33333) {
+    if (i % 3 != 0) {
+      budget.record(now, 20, true);
+      continue;
+    }
+    const bool admit = budget.admit(now);
+    admitted += admit ? 1 : 0;
+    budget.record(now, admit ? 10000 : 100, !admit);
+  }
+  EXPECT_GE(admitted, 30);
+  EXPECT_LE(admitted, 40);
+  EXPECT_LE(budget.high_water(), 0.0495);
+}
+
+TEST(RcapFormat, RoundTripsFramesThroughIndex) {
+  std::vector<FramePtr> frames;
+  for (int i = 0; i < 3; ++i) {
+    frames.push_back(make_bgra_frame(4, 2, static_cast<uint8_t>(i * 40), i * 33333));
+  }
+
+  const std::string path = temp_path("recaster_format_test.rcap");
+  WorkerPool pool(2);
+  RcapOptions options;
+  options.codec = default_frame_codec();
+  std::string error;
+  ASSERT_TRUE(write_rcap_file(path.c_str(), frames, 30, options, &pool, &error)) << error;
+
+  RcapReader reader;
+  ASSERT_TRUE(reader.open(path.c_str(), &error)) << error;
+  ASSERT_EQ(reader.frame_count(), 3U);
+  EXPECT_EQ(reader.header().width, 4U);
+  EXPECT_EQ(reader.entry(2).timestamp_us, 66666);
+  FrameDecoder decoder(reader.header().codec, reader.dictionary(),
+                       reader.header().dictionary_size);
+  std::vector<uint8_t> pixels(reader.raw_frame_size());
+  for (size_t i = 0; i < reader.frame_count(); ++i) {
+    ASSERT_TRUE(decoder.decode(reader.payload(i), reader.entry(i).compressed_size,
+                               pixels.data(), pixels.size()));
+    EXPECT_EQ(pixels, frames[i]->pixels);
+  }
+  reader.close();
+  std::filesystem::remove(path);
+}
+
+TEST(FrameCodec, HigherLevelsNeverCompressWorse) {
+  std::vector<uint8_t> pixels(256 * 256 * 4);
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    pixels[i] = static_cast<uint8_t>((i / 4) % 61 + (i / 1024) % 7);
+  }
+  for (FrameCodec codec : {FrameCodec::kStored, FrameCodec::kLz4, FrameCodec::kZstd}) {
+    if (!frame_codec_available(codec)) {
+      continue;
+    }
+    size_t previous_size = pixels.size() * 2;
+    for (int level : {1, 2, 3, 9, 12, 19}) {
+      FrameEncoder encoder(codec, level, std::vector<uint8_t>());
+      std::vector<uint8_t> encoded;
+      ASSERT_TRUE(encoder.encode(pixels.data(), pixels.size(), &encoded));
+      EXPECT_LE(encoded.size(), previous_size) << frame_codec_name(codec) << " " << level;
+      previous_size = encoded.size();
+
+      FrameDecoder decoder(codec, nullptr, 0);
+      std::vector<uint8_t> decoded(pixels.size());
+      ASSERT_TRUE(decoder.decode(encoded.data(), encoded.size(), decoded.data(),
+                                 decoded.size()));
+      EXPECT_EQ(decoded, pixels);
+    }
+  }
+}
+
+TEST(FramePool, RecyclesReleasedBuffers) {
+  FramePool pool(1);
+  const uint8_t* first_data = nullptr;
+  {
+    std::shared_ptr<FrameData> frame = pool.acquire(4096);
+    ASSERT_EQ(frame->pixels.size(), 4096U);
+    first_data = frame->pixels.data();
+    EXPECT_EQ(pool.free_count(), 0U);
+  }
+  EXPECT_EQ(pool.free_count(), 1U);
+
+  std::shared_ptr<FrameData> reused = pool.acquire(1024);
+  EXPECT_EQ(reused->pixels.data(), first_data);
+  EXPECT_EQ(reused->pixels.size(), 1024U);
+  EXPECT_EQ(pool.free_count(), 0U);
+
+  // Frames may outlive the pool.
+  std::shared_ptr<FrameData> orphan;
+  {
+    FramePool scoped;
+    orphan = scoped.acquire(16);
+  }
+  orphan.reset();
+}
+
+TEST(FramePool, ReservesBuffersUpFront) {
+  FramePool pool(3);
+  pool.reserve(4096, 8);
+  EXPECT_EQ(pool.free_count(), 3U);
+  std::shared_ptr<FrameData> frame = pool.acquire(4096);
+  EXPECT_GE(frame->pixels.capacity(), 4096U);
+  EXPECT_EQ(pool.free_count(), 2U);
+}
+
+TEST(FrameBlender, AveragesEachGroupOfCaptures) {
+  FrameBlender blender(3);
+  EXPECT_EQ(blender.add(make_bgra_frame(2, 2, 10, 100), nullptr), nullptr);
+  EXPECT_EQ(blender.add(make_bgra_frame(2, 2, 20, 200), nullptr), nullptr);
+  FramePtr blended = blender.add(make_bgra_frame(2, 2, 31, 300), nullptr);
+  ASSERT_NE(blended, nullptr);
+  EXPECT_EQ(blended->timestamp_us, 100);
+  EXPECT_EQ(blended->pixels[0], 20);  // 61 / 3, rounded
+  EXPECT_EQ(blender.pending(), 0);
+  EXPECT_EQ(blender.last()->timestamp_us, 300);
+
+  // A new size ends the group early with what it has.
+  EXPECT_EQ(blender.add(make_bgra_frame(2, 2, 255, 400), nullptr), nullptr);
+  blended = blender.add(make_bgra_frame(4, 2, 0, 500), nullptr);
+  ASSERT_NE(blended, nullptr);
+  EXPECT_EQ(blended->width, 2);
+  EXPECT_EQ(blended->pixels[0], 255);
+  blended = blender.flush();
+  ASSERT_NE(blended, nullptr);
+  EXPECT_EQ(blended->width, 4);
+  EXPECT_EQ(blender.flush(), nullptr);
+
+  // The widest group stays exact, also when split across workers.
+  WorkerPool pool(3);
+  FrameBlender wide(1000);
+  EXPECT_EQ(wide.count(), 256);
+  for (int i = 0; i < 255; ++i) {
+    EXPECT_EQ(wide.add(make_bgra_frame(256, 256, static_cast<uint8_t>(i % 2 == 0 ? 255 : 254)),
+                       &pool),
+              nullptr);
+  }
+  blended = wide.add(make_bgra_frame(256, 256, 0), &pool);
+  ASSERT_NE(blended, nullptr);
+  // (128 * 255 + 127 * 254 + 0) / 256 = 253.5, rounded up.
+  EXPECT_EQ(blended->pixels.front(), 254);
+  EXPECT_EQ(blended->pixels.back(), 254);
+}
+
+TEST(FrameTap, DropsOldestFramesAndBoundsLending) {
+  FrameTapRegistry registry;
+  const int64_t id = registry.open(2);
+  std::shared_ptr<FrameTap> tap = registry.find(id);
+  ASSERT_NE(tap, nullptr);
+  for (int i = 0; i < 5; ++i) {
+    registry.offer(make_bgra_frame(2, 2, static_cast<uint8_t>(i), i));
+  }
+  EXPECT_EQ(tap->dropped(), 3U);
+
+  FramePtr first;
+  FramePtr second;
+  FramePtr third;
+  uint64_t sequence = 0;
+  ASSERT_TRUE(tap->take(&first, &sequence));
+  EXPECT_EQ(sequence, 3U);
+  EXPECT_EQ(first->timestamp_us, 3);
+  ASSERT_TRUE(tap->take(&second, &sequence));
+  EXPECT_EQ(sequence, 4U);
+  // Both frames are lent out, so a new one waits until one comes back.
+  registry.offer(make_bgra_frame(2, 2, 5, 5));
+  EXPECT_FALSE(tap->take(&third, &sequence));
+  tap->release();
+  ASSERT_TRUE(tap->take(&third, &sequence));
+  EXPECT_EQ(sequence, 5U);
+  EXPECT_EQ(tap->lent(), 2U);
+
+  EXPECT_TRUE(registry.close(id));
+  EXPECT_FALSE(registry.close(id));
+  EXPECT_EQ(registry.find(id), nullptr);
+  // Lent frames outlive the tap's registration.
+  EXPECT_EQ(third->pixels[0], 5);
+}
+
+TEST(SpscRing, HandsOverItemsInOrderAcrossThreads) {
+  SpscRing<std::unique_ptr<int>> ring(3);
+  EXPECT_EQ(ring.capacity(), 4U);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.push(std::make_unique<int>(i)));
+  }
+  auto extra = std::make_unique<int>(4);
+  EXPECT_FALSE(ring.push(std::move(extra)));
+  ASSERT_NE(extra, nullptr);
+  std::unique_ptr<int> item;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(ring.pop(&item));
+    EXPECT_EQ(*item, i);
+  }
+  EXPECT_FALSE(ring.pop(&item));
+
+  const int count = 100000;
+  std::thread producer([&ring]() {
+    for (int i = 0; i < count; ++i) {
+      auto value = std::make_unique<int>(i);
+      while (!ring.push(std::move(value))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  int expected = 0;
+  while (expected < count) {
+    if (ring.pop(&item)) {
+      ASSERT_EQ(*item, expected);
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+}
+
+#if defined(__linux__)
+TEST(ShmFrameRing, HandsFramesToAnAttachedReader) {
+  ShmFrameRing writer;
+  std::string error;
+  ASSERT_TRUE(writer.create(2, 16, &error)) << error;
+  ShmFrameRing reader;
+  ASSERT_TRUE(reader.attach(dup(writer.memory_fd()), dup(writer.event_fd()), &error)) << error;
+  EXPECT_EQ(reader.slot_count(), 2U);
+  EXPECT_EQ(reader.slot_capacity(), 16U);
+  EXPECT_FALSE(reader.wait(0));
+
+  // The writer drops rather than waits once both slots are taken.
+  for (uint64_t i = 0; i < 2; ++i) {
+    uint8_t* pixels = writer.begin_write();
+    ASSERT_NE(pixels, nullptr);
+    memset(pixels, static_cast<int>(i + 1), 16);
+    ShmFrameInfo info;
+    info.sequence = i;
+    info.width = 2;
+    info.height = 2;
+    info.size = 16;
+    writer.commit_write(info);
+  }
+  EXPECT_EQ(writer.begin_write(), nullptr);
+
+  ASSERT_TRUE(reader.wait(1000));
+  ShmFrameInfo info;
+  const uint8_t* pixels = reader.begin_read(&info);
+  ASSERT_NE(pixels, nullptr);
+  EXPECT_EQ(info.sequence, 0U);
+  EXPECT_EQ(info.size, 16U);
+  EXPECT_EQ(pixels[15], 1);
+  reader.end_read();
+  EXPECT_NE(writer.begin_write(), nullptr);
+
+  const int count = 1000;
+  std::thread producer([&writer]() {
+    for (int i = 2; i < count; ++i) {
+      uint8_t* slot = writer.begin_write();
+      while (slot == nullptr) {
+        std::this_thread::yield();
+        slot = writer.begin_write();
+      }
+      slot[0] = static_cast<uint8_t>(i);
+      ShmFrameInfo frame;
+      frame.sequence = static_cast<uint64_t>(i);
+      frame.size = 1;
+      writer.commit_write(frame);
+    }
+    writer.close(count);
+  });
+  uint64_t expected = 1;
+  while (true) {
+    pixels = reader.begin_read(&info);
+    if (pixels == nullptr) {
+      if (reader.closed() && reader.begin_read(&info) == nullptr) {
+        break;
+      }
+      reader.wait(100);
+      continue;
+    }
+    ASSERT_EQ(info.sequence, expected);
+    EXPECT_EQ(pixels[0], static_cast<uint8_t>(expected == 1 ? 2 : expected));
+    reader.end_read();
+    ++expected;
+  }
+  producer.join();
+  EXPECT_EQ(expected, static_cast<uint64_t>(count));
+  EXPECT_EQ(reader.sequence_end(), static_cast<uint64_t>(count));
+}
+#endif
+
+TEST(FramePacer, SkipsMissedSlots) {
+  const auto start = FramePacer::Clock::time_point();
+  FramePacer pacer(10, start);
+  EXPECT_EQ(pacer.interval(), std::chrono::milliseconds(100));
+  EXPECT_EQ(pacer.next_deadline(start), start + std::chrono::milliseconds(100));
+
+  // Capture overran by two and a half intervals.
+  EXPECT_EQ(pacer.next_deadline(start + std::chrono::milliseconds(350)),
+            start + std::chrono::milliseconds(400));
+  EXPECT_EQ(pacer.missed(), 2U);
+}
+
+TEST(FrameSink, SharesFullSizeBgraFrames) {
+  FrameSink sink;
+  sink.configure(ScaleOptions(), PixelFormat::kBgra32);
+  FramePtr frame = make_bgra_frame(8, 4, 10);
+  EXPECT_EQ(sink.append(frame, nullptr), 0U);
+  ASSERT_EQ(sink.frames().size(), 1U);
+  EXPECT_EQ(sink.frames().front(), frame);
+  EXPECT_TRUE(sink.repeat_last());
+  EXPECT_EQ(sink.frames().size(), 2U);
+}
+
+TEST(FrameSink, ScalesAndRestoresReducedFrames) {
+  WorkerPool pool(2);
+  FrameSink sink;
+  ScaleOptions options;
+  options.scale = 0.5;
+  sink.configure(options, PixelFormat::kBgr24);
+
+  EXPECT_EQ(sink.append(make_bgra_frame(16, 8, 50), &pool),
+            frame_byte_size(8, 4, PixelFormat::kBgr24));
+  EXPECT_EQ(sink.width(), 8);
+  EXPECT_EQ(sink.height(), 4);
+  sink.append(make_bgra_frame(16, 8, 50), &pool, 2);
+  EXPECT_EQ(sink.frames().back()->width, 4);
+  ASSERT_EQ(sink.frames().size(), 2U);
+
+  sink.restore_reduced(&pool);
+  for (const FramePtr& frame : sink.frames()) {
+    EXPECT_EQ(frame->width, 8);
+    EXPECT_EQ(frame->height, 4);
+    EXPECT_EQ(frame->format, PixelFormat::kBgr24);
+    EXPECT_EQ(frame->pixels.size(), frame_byte_size(8, 4, PixelFormat::kBgr24));
+  }
+}
+
+TEST(FrameSink, LetterboxesResizedCaptures) {
+  FrameSink sink;
+  sink.configure(ScaleOptions(), PixelFormat::kBgra32, ResizePolicy::kLetterbox);
+  sink.append(make_bgra_frame(8, 4, 10), nullptr);
+  // Taller window: fitted to 4x4 in the middle of the 8x4 canvas.
+  sink.append(make_bgra_frame(6, 6, 200), nullptr);
+  ASSERT_EQ(sink.frames().size(), 2U);
+  EXPECT_EQ(sink.resizes(), 1U);
+  const FrameData& frame = *sink.frames().back();
+  ASSERT_EQ(frame.width, 8);
+  ASSERT_EQ(frame.height, 4);
+  for (int x = 0; x < 8; ++x) {
+    const uint8_t* px = &frame.pixels[static_cast<size_t>(x) * 4U];
+    const bool bar = x < 2 || x >= 6;
+    EXPECT_EQ(px[0], bar ? 0 : 200) << x;
+    EXPECT_EQ(px[3], bar ? 255 : 200) << x;
+  }
+}
+
+TEST(FrameSink, CropsResizedCapturesToCanvas) {
+  FrameSink sink;
+  sink.configure(ScaleOptions(), PixelFormat::kBgr24, ResizePolicy::kCrop);
+  sink.append(make_bgra_frame(8, 4, 10), nullptr);
+  sink.append(make_bgra_frame(8, 8, 90), nullptr);
+  ASSERT_EQ(sink.frames().size(), 2U);
+  EXPECT_EQ(sink.frames().back()->width, 8);
+  EXPECT_EQ(sink.frames().back()->height, 4);
+  for (uint8_t value : sink.frames().back()->pixels) {
+    ASSERT_EQ(value, 90);
+  }
+}
+
+TEST(FrameSink, StartsSegmentOnResize) {
+  FrameSink sink;
+  sink.configure(ScaleOptions(), PixelFormat::kBgra32, ResizePolicy::kSegment);
+  sink.append(make_bgra_frame(8, 4, 10), nullptr);
+  sink.append(make_bgra_frame(8, 4, 10), nullptr);
+  sink.append(make_bgra_frame(12, 6, 10), nullptr);
+  ASSERT_EQ(sink.segments().size(), 2U);
+  EXPECT_EQ(sink.segments()[0].frames.size(), 2U);
+  EXPECT_EQ(sink.width(), 12);
+  EXPECT_EQ(sink.frames().size(), 1U);
+  EXPECT_EQ(sink.frame_count(), 3U);
+
+  EXPECT_EQ(segment_output_path("/tmp/a.b/out.avi", 0), "/tmp/a.b/out.avi");
+  EXPECT_EQ(segment_output_path("/tmp/a.b/out.avi", 1), "/tmp/a.b/out-2.avi");
+  EXPECT_EQ(segment_output_path("/tmp/a.b/out", 2), "/tmp/a.b/out-3");
+}
+
+TEST(FrameStore, CompressesInlineAtTheFastestLevel) {
+  // Frames compressed on the calling thread cost the same whatever level a
+  // raiseCompression step asked for: they come out byte for byte the same.
+  FrameStore fast(false);
+  FrameStore raised(false);
+  for (int i = 0; i < 3; ++i) {
+    const FramePtr frame = make_bgra_frame(64, 32, static_cast<uint8_t>(i * 50), i * 1000);
+    fast.append(frame, nullptr, 1);
+    raised.append(frame, nullptr, 19);
+  }
+  EXPECT_EQ(raised.stored_bytes(), fast.stored_bytes());
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(raised.frame(i)->pixels, fast.frame(i)->pixels);
+  }
+}
+
+TEST(FrameStore, RoundTripsDeltaFramesAndRepeats) {
+  WorkerPool pool(2);
+  FrameStore store(true);
+  std::vector<FramePtr> originals;
+  for (int i = 0; i < 6; ++i) {
+    auto frame = std::make_shared<FrameData>();
+    // The size change at frame 4 forces a key frame; 13x3 leaves a tail
+    // past the last whole word.
+    frame->width = i < 4 ? 16 : 13;
+    frame->height = i < 4 ? 8 : 3;
+    frame->timestamp_us = i * 1000;
+    frame->pixels.assign(frame_byte_size(frame->width, frame->height, PixelFormat::kBgra32),
+                         40);
+    frame->pixels[static_cast<size_t>(i) * 9U] = static_cast<uint8_t>(200 + i);
+    frame->pixels.back() = static_cast<uint8_t>(i);
+    originals.push_back(frame);
+    // Later frames at a raised level, as under DegradationStep::kRaiseCompression.
+    store.append(frame, &pool, i >= 3 ? 7 : 1);
+    if (i == 1) {
+      ASSERT_TRUE(store.repeat_last());
+      originals.push_back(frame);
+    }
+  }
+  ASSERT_EQ(store.size(), originals.size());
+  EXPECT_EQ(store.last(), originals.back());
+
+  for (size_t i : {0, 1, 2, 3, 4, 5, 6, 2, 5}) {
+    const FramePtr frame = store.frame(i);
+    ASSERT_NE(frame, nullptr) << i;
+    EXPECT_EQ(frame->width, originals[i]->width) << i;
+    EXPECT_EQ(frame->timestamp_us, originals[i]->timestamp_us) << i;
+    EXPECT_EQ(frame->pixels, originals[i]->pixels) << i;
+  }
+  uint64_t raw_bytes = 0;
+  for (const FramePtr& frame : originals) {
+    raw_bytes += frame->pixels.size();
+  }
+  EXPECT_LT(store.stored_bytes() * 2, raw_bytes);
+  EXPECT_EQ(store.take_new_bytes(), store.stored_bytes());
+  EXPECT_EQ(store.take_new_bytes(), 0U);
+}
+
+TEST(FrameSink, StreamsCompressedBufferIntoAvi) {
+  WorkerPool pool(2);
+  FrameSink sink;
+  sink.configure(ScaleOptions(), PixelFormat::kBgr24, ResizePolicy::kLetterbox,
+                 BufferCompression::kDelta);
+  sink.append(make_bgra_frame(8, 4, 10), &pool);
+  sink.set_compression_level(4);
+  sink.append(make_bgra_frame(8, 4, 90), &pool, 2);
+  EXPECT_TRUE(sink.repeat_last());
+  EXPECT_EQ(sink.frame_count(), 3U);
+  EXPECT_TRUE(sink.frames().empty());
+  EXPECT_EQ(sink.last_frame()->width, 4);
+
+  sink.restore_reduced(&pool);
+  for (size_t i = 0; i < 3; ++i) {
+    const FramePtr frame = sink.frame_at(0, i, &pool);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->width, 8);
+    EXPECT_EQ(frame->format, PixelFormat::kBgr24);
+    EXPECT_EQ(frame->pixels.front(), i == 0 ? 10 : 90);
+  }
+
+  const std::string path = temp_path("recaster_store_test.avi");
+  std::string error;
+  size_t written = 0;
+  ASSERT_TRUE(write_avi_file(
+      path.c_str(), sink.segments()[0].frame_count(),
+      [&sink, &pool](size_t index) { return sink.frame_at(0, index, &pool); }, 30, &error,
+      [&written](size_t frames, uint64_t) {
+        written = frames;
+        return true;
+      }))
+      << error;
+  EXPECT_EQ(written, 3U);
+  std::filesystem::remove(path);
+
+  ASSERT_TRUE(sink.expand_segment(0, &pool));
+  ASSERT_EQ(sink.frames().size(), 3U);
+  EXPECT_EQ(sink.frames()[1], sink.frames()[2]);
+  sink.release_segment(0);
+  EXPECT_EQ(sink.frame_count(), 0U);
+}
+
+TEST(GifWriter, WritesTransparentDeltaFrames) {
+  // Left half red, right half blue; the second frame paints a green square.
+  auto first = std::make_shared<FrameData>();
+  first->width = 8;
+  first->height = 4;
+  first->pixels.assign(frame_byte_size(8, 4, PixelFormat::kBgra32), 0);
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      uint8_t* px = first->pixels.data() + (y * 8 + x) * 4;
+      px[x < 4 ? 2 : 0] = 255;
+      px[3] = 255;
+    }
+  }
+  auto second = std::make_shared<FrameData>(*first);
+  for (int y = 1; y < 3; ++y) {
+    for (int x = 5; x < 7; ++x) {
+      uint8_t* px = second->pixels.data() + (y * 8 + x) * 4;
+      px[0] = 0;
+      px[1] = 255;
+      px[2] = 0;
+    }
+  }
+  const std::vector<FramePtr> frames = {first, first, second};
+
+  WorkerPool pool(2);
+  for (GifPalette palette : {GifPalette::kGlobal, GifPalette::kPerFrame}) {
+    const std::string path = temp_path("recaster_writer_test.gif");
+    GifOptions options;
+    options.palette = palette;
+    std::string error;
+    ASSERT_TRUE(write_gif_file(path.c_str(), frames, 10, options, &pool, &error)) << error;
+
+    // The repeated first frame folds into the first image's delay.
+    const auto decoded = decode_gif(path);
+    ASSERT_EQ(decoded.size(), 2U);
+    EXPECT_EQ(decoded[0][0], 0xff0000U);
+    EXPECT_EQ(decoded[0][7], 0x0000ffU);
+    EXPECT_EQ(decoded[1][8 + 5], 0x00ff00U);
+    EXPECT_EQ(decoded[1][8 + 4], 0x0000ffU);
+    EXPECT_EQ(decoded[1][3 * 8], 0xff0000U);
+    std::filesystem::remove(path);
+  }
+
+  GifPalette parsed = GifPalette::kGlobal;
+  EXPECT_TRUE(parse_gif_palette("perFrame", &parsed));
+  EXPECT_EQ(parsed, GifPalette::kPerFrame);
+  EXPECT_FALSE(parse_gif_palette("octree", &parsed));
+}
+
+TEST(ImageSequence, WritesNumberedFramesAndManifest) {
+  // Three pixels of one colour: a QOI_OP_RGB, then a run of two.
+  FrameData flat;
+  flat.width = 3;
+  flat.height = 1;
+  flat.pixels = {30, 20, 10, 255, 30, 20, 10, 255, 30, 20, 10, 255};
+  std::vector<uint8_t> qoi;
+  ASSERT_TRUE(encode_qoi(flat, &qoi));
+  const std::vector<uint8_t> expected = {'q', 'o', 'i', 'f', 0, 0, 0, 3, 0, 0, 0, 1, 3, 0,
+                                         0xFE, 10, 20, 30, 0xC1, 0, 0, 0, 0, 0, 0, 0, 1};
+  EXPECT_EQ(qoi, expected);
+
+  const FramePtr first = make_bgra_frame(16, 8, 40, 0);
+  const FramePtr second = make_bgra_frame(16, 8, 200, 66000);
+  const std::vector<FramePtr> frames = {first, first, make_bgra_frame(4, 4, 0), second};
+  const std::string path = temp_path("recaster_sequence_test.png");
+  ImageSequenceOptions options;
+  WorkerPool pool(2);
+  std::string error;
+  ASSERT_TRUE(write_image_sequence(
+      path.c_str(), frames.size(), [&frames](size_t index) { return frames[index]; }, 10,
+      options, &pool, &error))
+      << error;
+
+  // The repeat reuses the first file; the odd-sized frame is skipped.
+  const std::string frame0 = image_sequence_frame_path(path, 0);
+  const std::string frame1 = image_sequence_frame_path(path, 1);
+  EXPECT_EQ(frame0, temp_path("recaster_sequence_test_000000.png"));
+  EXPECT_TRUE(std::filesystem::exists(frame1));
+  EXPECT_FALSE(std::filesystem::exists(image_sequence_frame_path(path, 2)));
+  std::ifstream png(frame0, std::ios::binary);
+  const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(png)),
+                                   std::istreambuf_iterator<char>());
+  ASSERT_GT(bytes.size(), 33U);
+  EXPECT_EQ(memcmp(bytes.data(), "\x89PNG\r\n\x1a\n", 8), 0);
+  EXPECT_EQ(memcmp(bytes.data() + 12, "IHDR", 4), 0);
+  EXPECT_EQ(bytes[19], 16);
+  EXPECT_EQ(bytes[23], 8);
+  EXPECT_EQ(memcmp(bytes.data() + bytes.size() - 8, "IEND", 4), 0);
+
+  std::ifstream manifest_file(image_sequence_manifest_path(path));
+  const std::string manifest((std::istreambuf_iterator<char>(manifest_file)),
+                             std::istreambuf_iterator<char>());
+  EXPECT_NE(manifest.find("\"frames\": ["), std::string::npos);
+  EXPECT_NE(manifest.find("{\"file\": \"recaster_sequence_test_000000.png\", \"timeUs\": 100000"),
+            std::string::npos);
+  EXPECT_NE(manifest.find("{\"file\": \"recaster_sequence_test_000001.png\", \"timeUs\": 300000, "
+                          "\"capturedUs\": 66000}"),
+            std::string::npos);
+  std::filesystem::remove(frame0);
+  std::filesystem::remove(frame1);
+  std::filesystem::remove(image_sequence_manifest_path(path));
+
+  ImageFormat format = ImageFormat::kPng;
+  EXPECT_TRUE(image_format_for_path("/tmp/run.qoi", &format));
+  EXPECT_EQ(format, ImageFormat::kQoi);
+  EXPECT_FALSE(image_format_for_path("/tmp/run.avi", &format));
+}
+
+TEST(ImageSequence, EscapesFileNamesInManifest) {
+  EXPECT_EQ(json_escape("a\tb"), "a\\u0009b");
+
+  const std::vector<FramePtr> frames = {make_bgra_frame(4, 2, 40, 0)};
+  const std::string path = temp_path("recaster \"quoted\" seq.qoi");
+  ImageSequenceOptions options;
+  options.format = ImageFormat::kQoi;
+  std::string error;
+  ASSERT_TRUE(write_image_sequence(
+      path.c_str(), frames.size(), [&frames](size_t index) { return frames[index]; }, 10,
+      options, nullptr, &error))
+      << error;
+
+  std::ifstream manifest_file(image_sequence_manifest_path(path));
+  const std::string manifest((std::istreambuf_iterator<char>(manifest_file)),
+                             std::istreambuf_iterator<char>());
+  EXPECT_NE(manifest.find("{\"file\": \"recaster \\\"quoted\\\" seq_000000.qoi\""),
+            std::string::npos)
+      << manifest;
+  std::filesystem::remove(image_sequence_frame_path(path, 0));
+  std::filesystem::remove(image_sequence_manifest_path(path));
+}
+
+}
+}
@@ -0,0 +1,245 @@
+// Offline helper for recordings.
+//
+//   recaster_tool info <file.rcap>
+//   recaster_tool transcode <in.rcap> <out.avi> [--threads N]
+//   recaster_tool trim <in.avi> <out.avi> <start-seconds> [end-seconds]
+//   recaster_tool concat <out.avi> <in.avi>...
+//   recaster_tool recover <file.avi>
+//   recaster_tool compare <a.rhash> <b.rhash>
+//
+// compare exits with status 3 when the recordings diverge.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "avi_edit.h"
+#include "avi_writer.h"
+#include "frame_codec.h"
+#include "frame_hash.h"
+#include "rcap_format.h"
+#include "worker_pool.h"
+
+namespace {
+
+int usage() {
+  fprintf(stderr,
+          "usage: recaster_tool info <file.rcap>\n"
+          "       recaster_tool transcode <in.rcap> <out.avi> [--threads N]\n"
+          "       recaster_tool trim <in.avi> <out.avi> <start-seconds> [end-seconds]\n"
+          "       recaster_tool concat <out.avi> <in.avi>...\n"
+          "       recaster_tool recover <file.avi>\n"
+          "       recaster_tool compare <a.rhash> <b.rhash>\n");
+  return 2;
+}
+
+int print_info(const char* path) {
+  recaster::RcapReader reader;
+  std::string error;
+  if (!reader.open(path, &error)) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return 1;
+  }
+  const recaster::RcapHeader& header = reader.header();
+  uint64_t compressed = 0;
+  for (size_t i = 0; i < reader.frame_count(); ++i) {
+    compressed += reader.entry(i).compressed_size;
+  }
+  const uint64_t raw = static_cast<uint64_t>(reader.raw_frame_size()) * reader.frame_count();
+  const double duration =
+      reader.frame_count() > 1
+          ? (reader.entry(reader.frame_count() - 1).timestamp_us - reader.entry(0).timestamp_us) /
+                1e6
+          : 0.0;
+  printf("size: %ux%u\n", header.width, header.height);
+  printf("fps: %u\n", header.fps);
+  printf("format: %s\n", header.format == recaster::PixelFormat::kBgr24 ? "bgr24" : "bgra32");
+  printf("codec: %s (level %d, dictionary %u bytes)\n",
+         recaster::frame_codec_name(header.codec), header.level, header.dictionary_size);
+  printf("frames: %zu\n", reader.frame_count());
+  printf("duration: %.3f s\n", duration);
+  printf("bytes: %llu compressed, %llu raw (%.2fx)\n",
+         static_cast<unsigned long long>(compressed), static_cast<unsigned long long>(raw),
+         compressed > 0 ? static_cast<double>(raw) / compressed : 0.0);
+  return 0;
+}
+
+int transcode(const char* input_path, const char* output_path, int threads) {
+  recaster::RcapReader reader;
+  std::string error;
+  if (!reader.open(input_path, &error)) {
+    fprintf(stderr, "%s: %s\n", input_path, error.c_str());
+    return 1;
+  }
+  const recaster::RcapHeader& header = reader.header();
+  if (!recaster::frame_codec_available(header.codec)) {
+    fprintf(stderr, "%s: codec %s is not available in this build\n", input_path,
+            recaster::frame_codec_name(header.codec));
+    return 1;
+  }
+
+  recaster::AviWriter writer;
+  if (!writer.open(output_path, static_cast<int>(header.width), static_cast<int>(header.height),
+                   header.format, static_cast<int>(header.fps), &error)) {
+    fprintf(stderr, "%s: %s\n", output_path, error.c_str());
+    return 1;
+  }
+
+  recaster::WorkerPool pool(threads - 1);
+  const int workers = pool.thread_count() + 1;
+  std::vector<std::unique_ptr<recaster::FrameDecoder>> idle_decoders;
+  for (int i = 0; i < workers; ++i) {
+    idle_decoders.push_back(std::make_unique<recaster::FrameDecoder>(
+        header.codec, reader.dictionary(), header.dictionary_size));
+  }
+  std::mutex decoders_mutex;
+
+  const size_t frame_size = reader.raw_frame_size();
+  const size_t batch_size = static_cast<size_t>(workers) * 4U;
+  std::vector<uint8_t> batch_pixels(batch_size * frame_size);
+  std::vector<uint8_t> decoded_ok(batch_size);
+
+  for (size_t batch = 0; batch < reader.frame_count(); batch += batch_size) {
+    const size_t count = std::min(batch_size, reader.frame_count() - batch);
+    pool.parallel_for(static_cast<int>(count), 1, [&](int begin, int end) {
+      std::unique_ptr<recaster::FrameDecoder> decoder;
+      {
+        std::lock_guard<std::mutex> lock(decoders_mutex);
+        decoder = std::move(idle_decoders.back());
+        idle_decoders.pop_back();
+      }
+      for (int i = begin; i < end; ++i) {
+        const size_t frame = batch + static_cast<size_t>(i);
+        decoded_ok[static_cast<size_t>(i)] = decoder->decode(
+            reader.payload(frame), reader.entry(frame).compressed_size,
+            batch_pixels.data() + static_cast<size_t>(i) * frame_size, frame_size);
+      }
+      std::lock_guard<std::mutex> lock(decoders_mutex);
+      idle_decoders.push_back(std::move(decoder));
+    });
+
+    for (size_t i = 0; i < count; ++i) {
+      if (!decoded_ok[i]) {
+        fprintf(stderr, "%s: frame %zu is corrupt\n", input_path, batch + i);
+        return 1;
+      }
+      if (!writer.append(batch_pixels.data() + i * frame_size, frame_size)) {
+        fprintf(stderr, "%s: write failed\n", output_path);
+        return 1;
+      }
+    }
+  }
+
+  if (!writer.finish(&error)) {
+    fprintf(stderr, "%s: %s\n", output_path, error.c_str());
+    return 1;
+  }
+  printf("wrote %u frames to %s\n", writer.frame_count(), output_path);
+  return 0;
+}
+
+int trim(const char* input_path, const char* output_path, double start, double end) {
+  std::string error;
+  size_t frames = 0;
+  const bool ok = recaster::trim_avi_file(
+      input_path, output_path, static_cast<int64_t>(start * 1e6),
+      end < 0 ? -1 : static_cast<int64_t>(end * 1e6), &error,
+      [&frames](size_t frames_written, uint64_t) {
+        frames = frames_written;
+        return true;
+      });
+  if (!ok) {
+    fprintf(stderr, "%s: %s\n", input_path, error.c_str());
+    return 1;
+  }
+  printf("wrote %zu frames to %s\n", frames, output_path);
+  return 0;
+}
+
+int concat(const char* output_path, const std::vector<std::string>& input_paths) {
+  std::string error;
+  size_t frames = 0;
+  const bool ok = recaster::concat_avi_files(input_paths, output_path, &error,
+                                             [&frames](size_t frames_written, uint64_t) {
+                                               frames = frames_written;
+                                               return true;
+                                             });
+  if (!ok) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  printf("wrote %zu frames to %s\n", frames, output_path);
+  return 0;
+}
+
+int recover(const char* path) {
+  recaster::AviRecovery recovery;
+  std::string error;
+  if (!recaster::recover_avi_file(path, &recovery, &error)) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return 1;
+  }
+  printf("recovered %zu frames in %s (%llu damaged bytes skipped, %llu bytes cut)\n",
+         recovery.frames, path, static_cast<unsigned long long>(recovery.skipped_bytes),
+         static_cast<unsigned long long>(recovery.truncated_bytes));
+  return 0;
+}
+
+int compare(const char* first_path, const char* second_path) {
+  recaster::HashComparison comparison;
+  std::string error;
+  if (!recaster::compare_hash_files(first_path, second_path, recaster::HashCompareOptions(),
+                                    &comparison, &error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  if (comparison.first_divergent_frame < 0) {
+    printf("%zu frames match\n", comparison.frames_compared);
+    return 0;
+  }
+  printf("frame %lld (%.3f s) diverges in %dx%d at %d,%d (frame distance %d, tile distance %d)\n",
+         static_cast<long long>(comparison.first_divergent_frame),
+         static_cast<double>(comparison.timestamp_us) / 1e6, comparison.width, comparison.height,
+         comparison.x, comparison.y, comparison.frame_distance, comparison.max_tile_distance);
+  return 3;
+}
+
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    return usage();
+  }
+  if (strcmp(argv[1], "info") == 0 && argc == 3) {
+    return print_info(argv[2]);
+  }
+  if (strcmp(argv[1], "transcode") == 0 && argc >= 4) {
+    int threads = recaster::WorkerPool::default_thread_count();
+    for (int i = 4; i < argc; ++i) {
+      if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+        threads = std::max(1, atoi(argv[++i]));
+      } else {
+        return usage();
+      }
+    }
+    return transcode(argv[2], argv[3], threads);
+  }
+  if (strcmp(argv[1], "trim") == 0 && (argc == 5 || argc == 6)) {
+    return trim(argv[2], argv[3], atof(argv[4]), argc == 6 ? atof(argv[5]) : -1.0);
+  }
+  if (strcmp(argv[1], "recover") == 0 && argc == 3) {
+    return recover(argv[2]);
+  }
+  if (strcmp(argv[1], "compare") == 0 && argc == 4) {
+    return compare(argv[2], argv[3]);
+  }
+  if (strcmp(argv[1], "concat") == 0 && argc >= 4) {
+    return concat(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+  }
+  return usage();
+}
@@ -0,0 +1,107 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace recaster {
+
+WorkerPool::WorkerPool(int thread_count) {
+  const int count = std::max(0, thread_count);
+  threads_.reserve(static_cast<size_t>(count));
+  for (int i = 0; i < count; ++i) {
+    threads_.emplace_back([this]() { run(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread& thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+int WorkerPool::default_thread_count() {
+  const unsigned int cores = std::thread::hardware_concurrency();
+  return std::max(1, std::min(8, static_cast<int>(cores) - 1));
+}
+
+void WorkerPool::post(std::function<void()> task) {
+  if (threads_.empty()) {
+    task();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void WorkerPool::parallel_for(
+    int count, int grain, const std::function<void(int begin, int end)>& body) {
+  if (count <= 0) {
+    return;
+  }
+  grain = std::max(1, grain);
+  const int chunks = (count + grain - 1) / grain;
+  if (threads_.empty() || chunks == 1) {
+    body(0, count);
+    return;
+  }
+
+  struct State {
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<State>();
+  const std::function<void(int, int)>* body_ptr = &body;
+  auto work = [state, chunks, grain, count, body_ptr]() {
+    int chunk = 0;
+    while ((chunk = state->next.fetch_add(1)) < chunks) {
+      const int begin = chunk * grain;
+      const int end = std::min(count, begin + grain);
+      (*body_ptr)(begin, end);
+      if (state->done.fetch_add(1) + 1 == chunks) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->cv.notify_all();
+      }
+    }
+  };
+
+  const int helpers = std::min(thread_count(), chunks - 1);
+  for (int i = 0; i < helpers; ++i) {
+    post(work);
+  }
+  work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&state, chunks]() { return state->done.load() == chunks; });
+}
+
+void WorkerPool::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+      if (stopping_ && tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef RECASTER_WORKER_POOL_H_
+#define RECASTER_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace recaster {
+
+// Fixed set of worker threads shared by the pixel stages. parallel_for splits
+// [0, count) into chunks of `grain` items; the calling thread takes part, so it
+// is safe to call from inside a posted task.
+class WorkerPool {
+ public:
+  explicit WorkerPool(int thread_count);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  static int default_thread_count();
+
+  int thread_count() const { return static_cast<int>(threads_.size()); }
+
+  void post(std::function<void()> task);
+  void parallel_for(int count, int grain,
+                    const std::function<void(int begin, int end)>& body);
+
+ private:
+  void run();
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+};
+
+}
+
+#endif
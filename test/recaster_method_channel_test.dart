@@ -1,6 +1,7 @@
 import 'package:flutter/services.dart';
 import 'package:flutter_test/flutter_test.dart';
 import 'package:recaster/recaster_method_channel.dart';
+import 'package:recaster/recaster_types.dart';
 
 void main() {
   TestWidgetsFlutterBinding.ensureInitialized();
@@ -25,6 +26,55 @@ void main() {
             return '/tmp/out.mp4';
           case 'startRecording':
             return null;
+          case 'captureScreenshot':
+            return <String, Object>{
+              'path': '/tmp/shot.png',
+              'width': 640,
+              'height': 360,
+            };
+          case 'stopSession':
+            return <String>['/tmp/full.avi', '/tmp/proxy.avi'];
+          case 'cancelFinalize':
+            return true;
+          case 'getPreviewUrl':
+            return 'http://127.0.0.1:8090/';
+          case 'trimRecording':
+          case 'concatRecordings':
+            return (methodCall.arguments as Map<Object?, Object?>)['outputPath'];
+          case 'compareFrameHashes':
+            return <String, Object>{
+              'framesCompared': 42,
+              'divergentFrame': 41,
+              'timestampUs': 1366666,
+              'frameDistance': 3,
+              'maxTileDistance': 19,
+              'x': 480,
+              'y': 270,
+              'width': 240,
+              'height': 135,
+            };
+          case 'getRecordingStats':
+            return <String, Object>{
+              'recording': true,
+              'framesCaptured': 120,
+              'framesDropped': 3,
+              'resizes': 2,
+              'level': 1,
+              'load': 0.72,
+              'mainThreadBudget': 0.05,
+              'mainThreadHighWater': 0.048,
+              'maxTickUs': 9000,
+              'framesShed': 40,
+              'events': <Object>[
+                <String, Object>{
+                  'timeMs': 1500,
+                  'level': 1,
+                  'step': 'reduceFps',
+                  'escalated': true,
+                  'load': 0.8,
+                },
+              ],
+            };
           default:
             return null;
         }
@@ -58,10 +108,317 @@ void main() {
     );
   });
 
+  test('startRecording with target size', () async {
+    await platform.startRecording(
+      outputPath: '/tmp/out.avi',
+      maxWidth: 1280,
+      maxHeight: 720,
+      scale: 0.75,
+      filter: ResampleFilter.lanczos3,
+      resizePolicy: ResizePolicy.segment,
+    );
+    expect(
+      calls.single.arguments,
+      <String, Object>{
+        'outputPath': '/tmp/out.avi',
+        'fps': 30,
+        'resolutionDivisor': 1,
+        'maxWidth': 1280,
+        'maxHeight': 720,
+        'scale': 0.75,
+        'filter': 'lanczos3',
+        'resizePolicy': 'segment',
+      },
+    );
+  });
+
+  test('startRecording at a high frame rate', () async {
+    await platform.startRecording(
+      outputPath: '/tmp/out.avi',
+      fps: 240,
+      highFrameRate: true,
+    );
+    expect(
+      calls.single.arguments,
+      <String, Object>{
+        'outputPath': '/tmp/out.avi',
+        'fps': 240,
+        'highFrameRate': true,
+        'resolutionDivisor': 1,
+      },
+    );
+  });
+
+  test('startRecording out of process', () async {
+    await platform.startRecording(
+      outputPath: '/tmp/out.rcap',
+      outOfProcess: true,
+    );
+    expect(
+      calls.single.arguments,
+      <String, Object>{
+        'outputPath': '/tmp/out.rcap',
+        'fps': 30,
+        'outOfProcess': true,
+        'resolutionDivisor': 1,
+      },
+    );
+  });
+
   test('stopRecording', () async {
     expect(await platform.stopRecording(), '/tmp/out.mp4');
   });
 
+  test('startSession', () async {
+    await platform.startSession(
+      fps: 30,
+      sinks: const <RecordingSink>[
+        RecordingSink(outputPath: '/tmp/full.avi'),
+        RecordingSink(
+          outputPath: '/tmp/proxy.avi',
+          fps: 5,
+          maxWidth: 640,
+          pixelFormat: PixelFormat.bgr24,
+          thumbnails: ThumbnailOptions(every: 10, format: ThumbnailFormat.png),
+        ),
+      ],
+    );
+    expect(calls.single.method, 'startSession');
+    expect(
+      calls.single.arguments,
+      <String, Object>{
+        'fps': 30,
+        'sinks': <Object>[
+          <String, Object>{
+            'outputPath': '/tmp/full.avi',
+            'resolutionDivisor': 1,
+          },
+          <String, Object>{
+            'outputPath': '/tmp/proxy.avi',
+            'fps': 5,
+            'resolutionDivisor': 1,
+            'maxWidth': 640,
+            'pixelFormat': 'bgr24',
+            'thumbnails': <String, Object>{
+              'every': 10,
+              'tileWidth': 160,
+              'columns': 10,
+              'format': 'png',
+            },
+          },
+        ],
+      },
+    );
+  });
+
+  test('RecordingSink encodes rcap codec options', () {
+    expect(
+      const RecordingSink(
+        outputPath: '/tmp/archive.rcap',
+        codec: FrameCodec.zstd,
+        compressionLevel: 5,
+      ).toMap(),
+      <String, Object>{
+        'outputPath': '/tmp/archive.rcap',
+        'resolutionDivisor': 1,
+        'codec': 'zstd',
+        'compressionLevel': 5,
+      },
+    );
+  });
+
+  test('RecordingSink encodes gif palette', () {
+    expect(
+      const RecordingSink(
+        outputPath: '/tmp/clip.gif',
+        gifPalette: GifPalette.perFrame,
+      ).toMap(),
+      <String, Object>{
+        'outputPath': '/tmp/clip.gif',
+        'resolutionDivisor': 1,
+        'gifPalette': 'perFrame',
+      },
+    );
+  });
+
+  test('RecordingSink encodes buffer compression', () {
+    expect(
+      const RecordingSink(
+        outputPath: '/tmp/out.avi',
+        bufferCompression: BufferCompression.delta,
+      ).toMap(),
+      <String, Object>{
+        'outputPath': '/tmp/out.avi',
+        'resolutionDivisor': 1,
+        'bufferCompression': 'delta',
+      },
+    );
+  });
+
+  test('startRecording with time-lapse', () async {
+    await platform.startRecording(
+      outputPath: '/tmp/lapse.avi',
+      fps: 10,
+      timeLapse: const TimeLapse(
+        interval: Duration(seconds: 5),
+        playbackFps: 24,
+      ),
+    );
+    final arguments = calls.single.arguments as Map<Object?, Object?>;
+    expect(arguments['timeLapse'], <String, Object>{
+      'intervalMs': 5000,
+      'playbackFps': 24,
+    });
+  });
+
+  test('startRecording with degradation policy', () async {
+    await platform.startRecording(
+      outputPath: '/tmp/out.avi',
+      degradation: const DegradationPolicy(
+        steps: <DegradationStep>[DegradationStep.increaseDivisor],
+        maxBufferedBytes: 1 << 30,
+      ),
+    );
+    final arguments = calls.single.arguments as Map<Object?, Object?>;
+    expect(arguments['degradation'], <String, Object>{
+      'steps': <String>['increaseDivisor'],
+      'targetLoad': 0.6,
+      'maxBufferedBytes': 1 << 30,
+      'recoverAfterMs': 3000,
+    });
+  });
+
+  test('getRecordingStats', () async {
+    final stats = await platform.getRecordingStats();
+    expect(stats.recording, true);
+    expect(stats.framesCaptured, 120);
+    expect(stats.framesDropped, 3);
+    expect(stats.resizes, 2);
+    expect(stats.level, 1);
+    expect(stats.events.single.step, DegradationStep.reduceFps);
+    expect(stats.events.single.time, const Duration(milliseconds: 1500));
+    expect(stats.mainThreadBudget, 0.05);
+    expect(stats.mainThreadHighWater, 0.048);
+    expect(stats.maxTickTime, const Duration(microseconds: 9000));
+    expect(stats.framesShed, 40);
+  });
+
+  test('startRecording with main-thread budget', () async {
+    await platform.startRecording(
+      outputPath: '/tmp/out.avi',
+      mainThreadBudget: 0.05,
+    );
+    final arguments = calls.single.arguments as Map<Object?, Object?>;
+    expect(arguments['mainThreadBudget'], 0.05);
+  });
+
+  test('startSession with preview', () async {
+    await platform.startSession(
+      sinks: const <RecordingSink>[RecordingSink(outputPath: '/tmp/out.avi')],
+      preview: const PreviewOptions(port: 8090, fps: 2),
+    );
+    final arguments = calls.single.arguments as Map<Object?, Object?>;
+    expect(arguments['preview'], <String, Object>{
+      'port': 8090,
+      'fps': 2,
+      'maxWidth': 640,
+      'quality': 70,
+    });
+    expect(await platform.getPreviewUrl(), 'http://127.0.0.1:8090/');
+  });
+
+  test('trimRecording and concatRecordings', () async {
+    expect(
+      await platform.trimRecording(
+        inputPath: '/tmp/long.avi',
+        outputPath: '/tmp/cut.avi',
+        start: const Duration(seconds: 90),
+        end: const Duration(seconds: 120),
+      ),
+      '/tmp/cut.avi',
+    );
+    expect(calls.last.arguments, <String, Object>{
+      'inputPath': '/tmp/long.avi',
+      'outputPath': '/tmp/cut.avi',
+      'startMs': 90000,
+      'endMs': 120000,
+    });
+    expect(
+      await platform.concatRecordings(
+        inputPaths: <String>['/tmp/a.avi', '/tmp/a-2.avi'],
+        outputPath: '/tmp/joined.avi',
+      ),
+      '/tmp/joined.avi',
+    );
+    expect(calls.last.method, 'concatRecordings');
+  });
+
+  test('compareFrameHashes', () async {
+    final comparison = await platform.compareFrameHashes(
+      goldenPath: '/tmp/golden.rhash',
+      runPath: '/tmp/run.rhash',
+      tileThreshold: 8,
+    );
+    expect(calls.last.arguments, <String, Object>{
+      'goldenPath': '/tmp/golden.rhash',
+      'runPath': '/tmp/run.rhash',
+      'frameThreshold': 6,
+      'tileThreshold': 8,
+    });
+    expect(comparison.matches, isFalse);
+    expect(comparison.divergentFrame, 41);
+    expect(comparison.timestamp, const Duration(microseconds: 1366666));
+    expect(comparison.width, 240);
+    final match =
+        FrameHashComparison.fromMap(<Object?, Object?>{'framesCompared': 9});
+    expect(match.matches, isTrue);
+  });
+
+  test('cancelFinalize', () async {
+    expect(await platform.cancelFinalize(), true);
+    expect(calls.single.method, 'cancelFinalize');
+  });
+
+  test('FinalizeProgress.fromMap', () {
+    final progress = FinalizeProgress.fromMap(<Object?, Object?>{
+      'bytesWritten': 4096,
+      'framesWritten': 10,
+      'framesRemaining': 30,
+      'etaMs': 1500,
+      'done': false,
+    });
+    expect(progress.bytesWritten, 4096);
+    expect(progress.framesRemaining, 30);
+    expect(progress.eta, const Duration(milliseconds: 1500));
+    expect(FinalizeProgress.fromMap(<Object?, Object?>{'etaMs': -1}).eta,
+        isNull);
+  });
+
+  test('stopSession', () async {
+    expect(
+      await platform.stopSession(),
+      <String>['/tmp/full.avi', '/tmp/proxy.avi'],
+    );
+  });
+
+  test('captureScreenshot', () async {
+    final shot = await platform.captureScreenshot(
+      outputPath: '/tmp/shot.png',
+      resolutionDivisor: 2,
+    );
+    expect(
+      calls.single.arguments,
+      <String, Object>{
+        'outputPath': '/tmp/shot.png',
+        'format': 'png',
+        'resolutionDivisor': 2,
+      },
+    );
+    expect(shot.path, '/tmp/shot.png');
+    expect(shot.width, 640);
+    expect(shot.height, 360);
+  });
+
   test('isRecording', () async {
     expect(await platform.isRecording(), true);
   });
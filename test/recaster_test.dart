@@ -13,14 +13,92 @@ class MockRecasterPlatform
   @override
   Future<bool> isRecording() => Future.value(true);
 
+  @override
+  Future<String?> getPreviewUrl() => Future.value('http://127.0.0.1:8090/');
+
+  @override
+  Future<String> trimRecording(
+          {required String inputPath,
+          required String outputPath,
+          Duration start = Duration.zero,
+          Duration? end}) =>
+      Future.value(outputPath);
+
+  @override
+  Future<String> concatRecordings(
+          {required List<String> inputPaths, required String outputPath}) =>
+      Future.value(outputPath);
+
+  @override
+  Future<FrameHashComparison> compareFrameHashes(
+          {required String goldenPath,
+          required String runPath,
+          int frameThreshold = 6,
+          int tileThreshold = 6}) =>
+      Future.value(const FrameHashComparison(framesCompared: 300));
+
   @override
   Future<void> startRecording(
       {required String outputPath,
       int fps = 30,
-      int resolutionDivisor = 1}) async {}
+      bool highFrameRate = false,
+      bool outOfProcess = false,
+      double? mainThreadBudget,
+      int resolutionDivisor = 1,
+      int? maxWidth,
+      int? maxHeight,
+      double? scale,
+      ResampleFilter filter = ResampleFilter.bilinear,
+      ResizePolicy resizePolicy = ResizePolicy.letterbox,
+      GifPalette gifPalette = GifPalette.global,
+      BufferCompression bufferCompression = BufferCompression.none,
+      ThumbnailOptions? thumbnails,
+      TimeLapse? timeLapse,
+      DegradationPolicy? degradation,
+      PreviewOptions? preview}) async {}
 
   @override
   Future<String?> stopRecording() => Future.value('/tmp/recording.mp4');
+
+  @override
+  Stream<FinalizeProgress> get finalizeProgress => const Stream.empty();
+
+  @override
+  Future<bool> cancelFinalize() => Future.value(true);
+
+  @override
+  Future<ScreenshotResult> captureScreenshot(
+          {required String outputPath,
+          ScreenshotFormat format = ScreenshotFormat.png,
+          int resolutionDivisor = 1}) =>
+      Future.value(
+          ScreenshotResult(path: outputPath, width: 640, height: 360));
+
+  @override
+  Future<void> startSession(
+      {required List<RecordingSink> sinks,
+      int fps = 30,
+      bool highFrameRate = false,
+      double? mainThreadBudget,
+      DegradationPolicy? degradation,
+      PreviewOptions? preview}) async {}
+
+  @override
+  Future<RecordingStats> getRecordingStats() =>
+      Future.value(RecordingStats.fromMap(<Object?, Object?>{
+        'framesCaptured': 90,
+        'framesRepeated': 30,
+        'framesSharedMemory': 90,
+        'totalReadbackUs': 45000,
+        'highFrameRate': true,
+        'requestedFps': 240,
+        'achievedFps': 231.5,
+        'framesMissed': 12,
+      }));
+
+  @override
+  Future<List<String>> stopSession() =>
+      Future.value(<String>['/tmp/full.avi', '/tmp/proxy.avi']);
 }
 
 void main() {
@@ -53,4 +131,36 @@ void main() {
 
     expect(await recasterPlugin.stopRecording(), '/tmp/recording.mp4');
   });
+
+  test('getRecordingStats', () async {
+    Recaster recasterPlugin = Recaster();
+    MockRecasterPlatform fakePlatform = MockRecasterPlatform();
+    RecasterPlatform.instance = fakePlatform;
+
+    final stats = await recasterPlugin.getRecordingStats();
+    expect(stats.framesCaptured, 90);
+    expect(stats.framesRepeated, 30);
+    expect(stats.framesSharedMemory, 90);
+    expect(stats.readbackTime, const Duration(milliseconds: 45));
+    expect(stats.highFrameRate, true);
+    expect(stats.requestedFps, 240);
+    expect(stats.achievedFps, 231.5);
+    expect(stats.framesMissed, 12);
+  });
+
+  test('cancelFinalize', () async {
+    Recaster recasterPlugin = Recaster();
+    MockRecasterPlatform fakePlatform = MockRecasterPlatform();
+    RecasterPlatform.instance = fakePlatform;
+
+    expect(await recasterPlugin.cancelFinalize(), true);
+  });
+
+  test('stopSession', () async {
+    Recaster recasterPlugin = Recaster();
+    MockRecasterPlatform fakePlatform = MockRecasterPlatform();
+    RecasterPlatform.instance = fakePlatform;
+
+    expect(await recasterPlugin.stopSession(), hasLength(2));
+  });
 }
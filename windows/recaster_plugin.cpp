@@ -26,10 +26,17 @@
 #include <utility>
 #include <vector>
 
+#include "frame_pacer.h"
+
 namespace recaster {
 
 namespace {
 
+bool HasSuffix(const std::string& value, const char* suffix) {
+  const size_t length = strlen(suffix);
+  return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+}
+
 std::wstring Utf8ToWide(const std::string& input) {
   if (input.empty()) {
     return L"";
@@ -46,6 +53,24 @@ std::wstring Utf8ToWide(const std::string& input) {
   return output;
 }
 
+bool ReadIntArgument(const flutter::EncodableMap& arguments,
+                     const char* key,
+                     int* value) {
+  const auto it = arguments.find(flutter::EncodableValue(key));
+  if (it == arguments.end()) {
+    return false;
+  }
+  if (const auto* int_value = std::get_if<int32_t>(&it->second)) {
+    *value = *int_value;
+    return true;
+  }
+  if (const auto* long_value = std::get_if<int64_t>(&it->second)) {
+    *value = static_cast<int>(*long_value);
+    return true;
+  }
+  return false;
+}
+
 }
 
 void RecasterPlugin::RegisterWithRegistrar(
@@ -78,40 +103,38 @@ RecasterPlugin::~RecasterPlugin() {
   StopRecording(&path, &error);
 }
 
-bool RecasterPlugin::CaptureWindowFrame(FrameData* frame) {
-  if (frame == nullptr || native_window_handle_ == nullptr) {
-    return false;
+std::shared_ptr<FrameData> RecasterPlugin::CaptureWindowFrame() {
+  if (native_window_handle_ == nullptr) {
+    return nullptr;
   }
 
   const HWND hwnd = static_cast<HWND>(native_window_handle_);
   RECT rect = {};
   if (!GetClientRect(hwnd, &rect)) {
-    return false;
+    return nullptr;
   }
 
   const int width = rect.right - rect.left;
   const int height = rect.bottom - rect.top;
   if (width <= 0 || height <= 0) {
-    return false;
+    return nullptr;
   }
-  const int target_width = std::max(1, capture_width_);
-  const int target_height = std::max(1, capture_height_);
 
   HDC window_dc = GetDC(hwnd);
   if (window_dc == nullptr) {
-    return false;
+    return nullptr;
   }
 
   HDC memory_dc = CreateCompatibleDC(window_dc);
   if (memory_dc == nullptr) {
     ReleaseDC(hwnd, window_dc);
-    return false;
+    return nullptr;
   }
 
   BITMAPINFO bitmap_info = {};
   bitmap_info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-  bitmap_info.bmiHeader.biWidth = target_width;
-  bitmap_info.bmiHeader.biHeight = -target_height;
+  bitmap_info.bmiHeader.biWidth = width;
+  bitmap_info.bmiHeader.biHeight = -height;
   bitmap_info.bmiHeader.biPlanes = 1;
   bitmap_info.bmiHeader.biBitCount = 32;
   bitmap_info.bmiHeader.biCompression = BI_RGB;
@@ -125,55 +148,46 @@ bool RecasterPlugin::CaptureWindowFrame(FrameData* frame) {
     }
     DeleteDC(memory_dc);
     ReleaseDC(hwnd, window_dc);
-    return false;
+    return nullptr;
   }
 
+  // Copy at native size; the shared resampler produces the output size with
+  // the requested filter instead of GDI's StretchBlt.
   HGDIOBJ old_bitmap = SelectObject(memory_dc, bitmap);
-  const BOOL blt_ok = StretchBlt(memory_dc, 0, 0, target_width, target_height,
-                                 window_dc, 0, 0, width, height,
-                                 SRCCOPY | CAPTUREBLT);
+  const BOOL blt_ok = BitBlt(memory_dc, 0, 0, width, height, window_dc, 0, 0,
+                             SRCCOPY | CAPTUREBLT);
 
-  if (!blt_ok) {
-    SelectObject(memory_dc, old_bitmap);
-    DeleteObject(bitmap);
-    DeleteDC(memory_dc);
-    ReleaseDC(hwnd, window_dc);
-    return false;
+  std::shared_ptr<FrameData> frame;
+  if (blt_ok) {
+    const size_t bytes = frame_byte_size(width, height, PixelFormat::kBgra32);
+    frame = frame_pool_.acquire(bytes);
+    frame->width = width;
+    frame->height = height;
+    std::memcpy(frame->pixels.data(), bits, bytes);
   }
 
-  const size_t bytes =
-      static_cast<size_t>(target_width) * static_cast<size_t>(target_height) * 4U;
-  frame->width = target_width;
-  frame->height = target_height;
-  frame->pixels.resize(bytes);
-  std::memcpy(frame->pixels.data(), bits, bytes);
-
   SelectObject(memory_dc, old_bitmap);
   DeleteObject(bitmap);
   DeleteDC(memory_dc);
   ReleaseDC(hwnd, window_dc);
-  return true;
+  return frame;
 }
 
 void RecasterPlugin::CaptureLoop() {
-  const auto frame_interval = std::chrono::milliseconds(
-      std::max(1, 1000 / std::max(1, fps_)));
+  using Clock = FramePacer::Clock;
+  const Clock::time_point start = Clock::now();
+  FramePacer pacer(fps_, start);
 
   while (is_recording_.load()) {
-    FrameData frame;
-    if (CaptureWindowFrame(&frame)) {
+    const Clock::time_point now = Clock::now();
+    std::shared_ptr<FrameData> frame = CaptureWindowFrame();
+    if (frame != nullptr) {
+      frame->timestamp_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
       std::lock_guard<std::mutex> lock(frames_mutex_);
-      if (!frames_.empty()) {
-        const FrameData& first = frames_.front();
-        if (frame.width != first.width || frame.height != first.height) {
-          frame.pixels.clear();
-        }
-      }
-      if (!frame.pixels.empty()) {
-        frames_.push_back(std::move(frame));
-      }
+      sink_.append(frame, workers_.get());
     }
-    std::this_thread::sleep_for(frame_interval);
+    std::this_thread::sleep_until(pacer.next_deadline(Clock::now()));
   }
 }
 
@@ -223,7 +237,7 @@ bool RecasterPlugin::EnsureOutputPathWritable(const std::string& output_path,
 }
 
 bool RecasterPlugin::WriteMp4File(const std::string& output_path,
-                                  const std::vector<FrameData>& frames,
+                                  const std::vector<FramePtr>& frames,
                                   int fps,
                                   std::string* error_message) {
   if (frames.empty()) {
@@ -233,8 +247,8 @@ bool RecasterPlugin::WriteMp4File(const std::string& output_path,
     return false;
   }
 
-  const int width = frames.front().width;
-  const int height = frames.front().height;
+  const int width = frames.front()->width;
+  const int height = frames.front()->height;
   if (width <= 0 || height <= 0) {
     if (error_message != nullptr) {
       *error_message = "Invalid frame size.";
@@ -343,9 +357,9 @@ bool RecasterPlugin::WriteMp4File(const std::string& output_path,
     const LONGLONG frame_duration = 10 * 1000 * 1000LL / std::max(1, fps);
     LONGLONG sample_time = 0;
 
-    for (const FrameData& frame : frames) {
-      if (frame.width != width || frame.height != height ||
-          frame.pixels.size() != frame_size) {
+    for (const FramePtr& frame : frames) {
+      if (frame->width != width || frame->height != height ||
+          frame->pixels.size() != frame_size) {
         continue;
       }
 
@@ -371,7 +385,7 @@ bool RecasterPlugin::WriteMp4File(const std::string& output_path,
         media_buffer->Release();
         break;
       }
-      std::memcpy(dst, frame.pixels.data(), frame_size);
+      std::memcpy(dst, frame->pixels.data(), frame_size);
       media_buffer->Unlock();
       media_buffer->SetCurrentLength(frame_size);
 
@@ -431,7 +445,9 @@ bool RecasterPlugin::WriteMp4File(const std::string& output_path,
 
 bool RecasterPlugin::StartRecording(const std::string& output_path,
                                     int fps,
-                                    int resolution_divisor,
+                                    const ScaleOptions& scale_options,
+                                    ResizePolicy resize_policy,
+                                    const GifOptions& gif_options,
                                     std::string* error_code,
                                     std::string* error_message) {
   if (is_recording_.load()) {
@@ -479,12 +495,16 @@ bool RecasterPlugin::StartRecording(const std::string& output_path,
   }
 
   std::lock_guard<std::mutex> lock(frames_mutex_);
-  frames_.clear();
   current_output_path_ = output_path;
   fps_ = std::max(1, std::min(60, fps));
-  resolution_divisor_ = std::max(1, std::min(8, resolution_divisor));
-  capture_width_ = std::max(1, source_width / resolution_divisor_);
-  capture_height_ = std::max(1, source_height / resolution_divisor_);
+  gif_options_ = gif_options;
+  ScaleOptions options = scale_options;
+  options.resolution_divisor = std::max(1, std::min(8, scale_options.resolution_divisor));
+  sink_ = FrameSink();
+  sink_.configure(options, PixelFormat::kBgra32, resize_policy);
+  if (workers_ == nullptr) {
+    workers_ = std::make_unique<WorkerPool>(WorkerPool::default_thread_count());
+  }
   is_recording_.store(true);
 
   capture_thread_ = std::thread([this]() { CaptureLoop(); });
@@ -502,28 +522,38 @@ bool RecasterPlugin::StopRecording(std::string* saved_path,
     capture_thread_.join();
   }
 
-  std::vector<FrameData> captured_frames;
+  std::vector<FrameSegment> segments;
   {
     std::lock_guard<std::mutex> lock(frames_mutex_);
-    captured_frames.swap(frames_);
+    segments.swap(sink_.segments());
+    sink_ = FrameSink();
   }
 
   std::string output_path = current_output_path_;
   current_output_path_.clear();
-  if (captured_frames.empty()) {
+  if (segments.empty() || segments.front().frames.empty()) {
     if (error_message != nullptr) {
       *error_message = "No frames captured.";
     }
     return false;
   }
 
-  std::string write_error;
-  const bool ok = WriteMp4File(output_path, captured_frames, fps_, &write_error);
-  if (!ok) {
-    if (error_message != nullptr) {
-      *error_message = write_error;
+  // A resize under the segment policy leaves one file per canvas size.
+  for (size_t i = 0; i < segments.size(); ++i) {
+    std::string write_error;
+    const std::string path = segment_output_path(output_path, i);
+    const bool ok =
+        HasSuffix(output_path, ".gif")
+            ? write_gif_file(path.c_str(), segments[i].frames, fps_, gif_options_,
+                             workers_.get(), &write_error)
+            : WriteMp4File(path, segments[i].frames, fps_, &write_error);
+    segments[i].frames.clear();
+    if (!ok) {
+      if (error_message != nullptr) {
+        *error_message = write_error;
+      }
+      return false;
     }
-    return false;
   }
 
   if (saved_path != nullptr) {
@@ -569,30 +599,63 @@ void RecasterPlugin::HandleMethodCall(
     }
 
     int fps = 30;
-    int resolution_divisor = 1;
-    const auto fps_it = arguments->find(flutter::EncodableValue("fps"));
-    if (fps_it != arguments->end()) {
-      if (const auto* fps_int = std::get_if<int32_t>(&fps_it->second)) {
-        fps = *fps_int;
-      } else if (const auto* fps_long = std::get_if<int64_t>(&fps_it->second)) {
-        fps = static_cast<int>(*fps_long);
+    ScaleOptions scale_options;
+    ReadIntArgument(*arguments, "fps", &fps);
+    ReadIntArgument(*arguments, "resolutionDivisor",
+                    &scale_options.resolution_divisor);
+    int max_width = 0;
+    if (ReadIntArgument(*arguments, "maxWidth", &max_width) && max_width > 0 &&
+        max_width <= 16384) {
+      scale_options.max_width = max_width;
+    }
+    int max_height = 0;
+    if (ReadIntArgument(*arguments, "maxHeight", &max_height) && max_height > 0 &&
+        max_height <= 16384) {
+      scale_options.max_height = max_height;
+    }
+    const auto scale_it = arguments->find(flutter::EncodableValue("scale"));
+    if (scale_it != arguments->end()) {
+      if (const auto* scale = std::get_if<double>(&scale_it->second)) {
+        if (*scale > 0.0 && *scale <= 1.0) {
+          scale_options.scale = *scale;
+        }
+      }
+    }
+    const auto filter_it = arguments->find(flutter::EncodableValue("filter"));
+    if (filter_it != arguments->end()) {
+      const auto* filter = std::get_if<std::string>(&filter_it->second);
+      if (filter != nullptr &&
+          !parse_resample_filter(filter->c_str(), &scale_options.filter)) {
+        result->Error("invalid_args", "filter must be bilinear, bicubic or lanczos3.");
+        return;
       }
     }
-    const auto divisor_it =
-        arguments->find(flutter::EncodableValue("resolutionDivisor"));
-    if (divisor_it != arguments->end()) {
-      if (const auto* divisor_int = std::get_if<int32_t>(&divisor_it->second)) {
-        resolution_divisor = *divisor_int;
-      } else if (const auto* divisor_long =
-                     std::get_if<int64_t>(&divisor_it->second)) {
-        resolution_divisor = static_cast<int>(*divisor_long);
+
+    ResizePolicy resize_policy = ResizePolicy::kLetterbox;
+    const auto resize_it = arguments->find(flutter::EncodableValue("resizePolicy"));
+    if (resize_it != arguments->end()) {
+      const auto* policy = std::get_if<std::string>(&resize_it->second);
+      if (policy != nullptr && !parse_resize_policy(policy->c_str(), &resize_policy)) {
+        result->Error("invalid_args",
+                      "resizePolicy must be letterbox, scale, crop or segment.");
+        return;
+      }
+    }
+
+    GifOptions gif_options;
+    const auto palette_it = arguments->find(flutter::EncodableValue("gifPalette"));
+    if (palette_it != arguments->end()) {
+      const auto* palette = std::get_if<std::string>(&palette_it->second);
+      if (palette != nullptr && !parse_gif_palette(palette->c_str(), &gif_options.palette)) {
+        result->Error("invalid_args", "gifPalette must be global or perFrame.");
+        return;
       }
     }
 
     std::string error_code;
     std::string error_message;
-    if (!StartRecording(*output_path, fps, resolution_divisor, &error_code,
-                        &error_message)) {
+    if (!StartRecording(*output_path, fps, scale_options, resize_policy, gif_options,
+                        &error_code, &error_message)) {
       result->Error(error_code.empty() ? "start_failed" : error_code,
                     error_message);
       return;
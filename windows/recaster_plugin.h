@@ -12,13 +12,14 @@
 #include <thread>
 #include <vector>
 
-namespace recaster {
+#include "frame_data.h"
+#include "frame_pool.h"
+#include "frame_resampler.h"
+#include "frame_sink.h"
+#include "gif_writer.h"
+#include "worker_pool.h"
 
-struct FrameData {
-  int32_t width = 0;
-  int32_t height = 0;
-  std::vector<uint8_t> pixels;
-};
+namespace recaster {
 
 class RecasterPlugin : public flutter::Plugin {
  public:
@@ -38,17 +39,19 @@ class RecasterPlugin : public flutter::Plugin {
  private:
   bool StartRecording(const std::string& output_path,
                       int fps,
-                      int resolution_divisor,
+                      const ScaleOptions& scale_options,
+                      ResizePolicy resize_policy,
+                      const GifOptions& gif_options,
                       std::string* error_code,
                       std::string* error_message);
   bool StopRecording(std::string* saved_path, std::string* error_message);
-  bool CaptureWindowFrame(FrameData* frame);
+  std::shared_ptr<FrameData> CaptureWindowFrame();
   void CaptureLoop();
   bool EnsureOutputPathWritable(const std::string& output_path,
                                 std::string* error_code,
                                 std::string* error_message);
   bool WriteMp4File(const std::string& output_path,
-                    const std::vector<FrameData>& frames,
+                    const std::vector<FramePtr>& frames,
                     int fps,
                     std::string* error_message);
 
@@ -56,11 +59,11 @@ class RecasterPlugin : public flutter::Plugin {
   std::atomic<bool> is_recording_{false};
   std::thread capture_thread_;
   std::mutex frames_mutex_;
-  std::vector<FrameData> frames_;
+  FrameSink sink_;
+  FramePool frame_pool_;
+  std::unique_ptr<WorkerPool> workers_;
   int fps_ = 30;
-  int resolution_divisor_ = 1;
-  int capture_width_ = 0;
-  int capture_height_ = 0;
+  GifOptions gif_options_;
   std::string current_output_path_;
 };
 